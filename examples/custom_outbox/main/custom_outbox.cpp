@@ -80,13 +80,15 @@ struct outbox_item {
         pending_state_t pending_state,
         allocator_type alloc = {}
     ) : message(std::move(message), alloc), id(msg_id), type(msg_type), qos(msg_qos), tick(tick),
-        pending_state(pending_state) {}
+        transmit_tick(tick), due(tick), pending_state(pending_state) {}
 
     /*Copy and move constructors have an extra allocator parameter, for copy default and allocator aware are the same.*/
     outbox_item(const outbox_item &other, allocator_type alloc = {}) : message(other.message, alloc), id(other.id),
-        type(other.type), qos(other.qos), tick(other.tick), pending_state(other.pending_state) {}
+        type(other.type), qos(other.qos), tick(other.tick), transmit_tick(other.transmit_tick), due(other.due),
+        retransmits(other.retransmits), pending_state(other.pending_state) {}
     outbox_item(outbox_item &&other, allocator_type alloc) noexcept : message(std::move(other.message), alloc),
-        id(other.id), type(other.type), qos(other.qos),  tick(other.tick), pending_state(other.pending_state)
+        id(other.id), type(other.type), qos(other.qos),  tick(other.tick), transmit_tick(other.transmit_tick),
+        due(other.due), retransmits(other.retransmits), pending_state(other.pending_state)
     {}
 
     outbox_item(const outbox_item &) = default;
@@ -116,6 +118,28 @@ struct outbox_item {
         tick = n_tick;
     }
 
+    /* Last write of the item, how many times it was retransmitted and when it is to be retransmitted */
+    void set_transmitted(outbox_tick_t n_transmit_tick, int n_retransmits, outbox_tick_t n_due) noexcept
+    {
+        transmit_tick = n_transmit_tick;
+        retransmits = n_retransmits;
+        due = n_due;
+    }
+
+    [[nodiscard]] auto get_retransmits(outbox_tick_t *n_transmit_tick) const noexcept
+    {
+        if (n_transmit_tick != nullptr) {
+            *n_transmit_tick = transmit_tick;
+        }
+
+        return retransmits;
+    }
+
+    [[nodiscard]] auto get_due() const noexcept
+    {
+        return due;
+    }
+
     [[nodiscard]] auto get_id() const noexcept
     {
         return id;
@@ -151,6 +175,9 @@ private:
     type_t type;
     qos_t qos;
     outbox_tick_t tick;
+    outbox_tick_t transmit_tick;
+    outbox_tick_t due;
+    int retransmits{};
     pending_state_t pending_state;
 };
 
@@ -225,8 +252,14 @@ struct outbox_t {
     outbox_item_handle_t enqueue(outbox_message_handle_t message, outbox_tick_t tick) noexcept
     {
         try {
+            std::pmr::vector<uint8_t> data{message->data, message->data + message->len, get_allocator()};
+
+            if (message->remaining_data != nullptr) {
+                data.insert(std::end(data), message->remaining_data, message->remaining_data + message->remaining_len);
+            }
+
             auto &item =
-                queue.emplace_back(std::pmr::vector<uint8_t> {message->data, message->data + message->len},
+                queue.emplace_back(std::move(data),
                                    outbox_item::id_t{message->msg_id},
                                    outbox_item::type_t{message->msg_type},
                                    outbox_item::qos_t{message->msg_qos},
@@ -234,6 +267,12 @@ struct outbox_t {
                                    QUEUED
                                   );
             total_size += item.get_size();
+
+            /* This outbox always keeps its own copy, so caller owned data can be released right away */
+            if (message->remaining_free != nullptr) {
+                message->remaining_free(message->remaining_data, message->remaining_free_ctx);
+            }
+
             ESP_LOGD(TAG, "ENQUEUE msgid=%d, msg_type=%d, len=%d, size=%" PRIu64, message->msg_id, message->msg_type,
                      message->len + message->remaining_len, outbox_get_size(this));
             return &item;
@@ -256,6 +295,25 @@ struct outbox_t {
         }
         return nullptr;
     }
+
+    /* A linear scan is enough for the example, the default outbox keeps these items in a heap ordered by due */
+    outbox_item_handle_t next_retransmit(outbox_tick_t *due)
+    {
+        outbox_item_handle_t next = nullptr;
+
+        for (auto &item : queue) {
+            if ((item.state() == TRANSMITTED || item.state() == ACKNOWLEDGED) &&
+                    (next == nullptr || item.get_due() < next->get_due())) {
+                next = &item;
+            }
+        }
+
+        if (next != nullptr) {
+            *due = next->get_due();
+        }
+
+        return next;
+    }
     [[nodiscard]] allocator_type get_allocator() const
     {
         return queue.get_allocator();
@@ -330,6 +388,12 @@ uint8_t *outbox_item_get_data(outbox_item_handle_t item,  size_t *len, uint16_t
     return item->get_data(len, msg_id, msg_type, qos);
 }
 
+uint8_t *outbox_item_get_remaining_data(outbox_item_handle_t item, size_t *len)
+{
+    *len = 0;
+    return nullptr;
+}
+
 esp_err_t outbox_delete_item(outbox_handle_t outbox, outbox_item_handle_t item_to_delete)
 {
     return outbox->erase(item_to_delete);
@@ -377,6 +441,26 @@ esp_err_t outbox_set_tick(outbox_handle_t outbox, int msg_id, outbox_tick_t tick
     return ESP_FAIL;
 }
 
+esp_err_t outbox_set_transmitted(outbox_handle_t outbox, int msg_id, outbox_tick_t tick, int retransmits,
+                                 outbox_tick_t due)
+{
+    if (auto *item = outbox->get(outbox_item::id_t{msg_id}); item != nullptr) {
+        item->set_transmitted(tick, retransmits, due);
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+outbox_item_handle_t outbox_get_next_retransmit(outbox_handle_t outbox, outbox_tick_t *due)
+{
+    return outbox->next_retransmit(due);
+}
+
+int outbox_item_get_retransmits(outbox_item_handle_t item, outbox_tick_t *transmit_tick)
+{
+    return item->get_retransmits(transmit_tick);
+}
+
 uint64_t outbox_get_size(outbox_handle_t outbox)
 {
     return outbox->size();
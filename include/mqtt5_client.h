@@ -190,7 +190,9 @@ typedef struct {
     int content_type_len;               /*!< Content type length of the message */
     uint16_t subscribe_id;              /*!< Subscription identifier of the message */
     mqtt5_user_property_handle_t
-    user_property;  /*!< The handle for user property, call function esp_mqtt5_client_delete_user_property to free the memory */
+    user_property;  /*!< The handle for user property, freed after the event handler returns. NULL if CONFIG_MQTT5_USER_PROPERTY_VIEWS is enabled */
+    const uint8_t *properties;          /*!< Encoded properties of the message in the receive buffer, read the user properties with esp_mqtt5_client_user_property_next() */
+    size_t properties_len;              /*!< Length of the encoded properties */
     esp_mqtt5_server_resp_property_t server; /*!< Server response properties from CONNACK (valid only in MQTT_EVENT_CONNECTED) */
 } esp_mqtt5_event_property_t;
 
@@ -202,6 +204,26 @@ typedef struct {
     const char *value;                     /*!< Item value string */
 } esp_mqtt5_user_property_item_t;
 
+/**
+ *  MQTT5 user property of a received message, pointing into the receive buffer
+ *
+ *  Key and value are not NUL terminated and are only valid within the event handler.
+ */
+typedef struct {
+    const char *key;                       /*!< Item key name */
+    uint16_t key_len;                      /*!< Item key name length */
+    const char *value;                     /*!< Item value string */
+    uint16_t value_len;                    /*!< Item value string length */
+} esp_mqtt5_user_property_view_t;
+
+/**
+ *  Iterator over the user properties of a received message
+ */
+typedef struct {
+    const uint8_t *next;                   /*!< Next property to read */
+    const uint8_t *end;                    /*!< End of the message properties */
+} esp_mqtt5_user_property_iter_t;
+
 /**
  * @brief Set MQTT5 client connect property configuration
  *
@@ -333,6 +355,62 @@ uint8_t esp_mqtt5_client_get_user_property_count(mqtt5_user_property_handle_t us
  * This API will free the memory in user property list and free user_property itself
  */
 void esp_mqtt5_client_delete_user_property(mqtt5_user_property_handle_t user_property);
+
+/**
+ * @brief Parse the properties of a received publish message
+ *
+ * With CONFIG_MQTT5_LAZY_PUBLISH_PROPERTIES enabled, the properties of received publish messages are not parsed
+ * on receive. Call this function from the MQTT_EVENT_DATA handler to fill event->property before reading it.
+ * Otherwise the properties are parsed on receive and this function does nothing.
+ *
+ * @param client                   mqtt client handle, event->client
+ * @param property                 properties of the event, event->property
+ *
+ * @return ESP_ERR_INVALID_ARG on wrong arguments
+ *         ESP_FAIL if the properties are malformed
+ *         ESP_OK on success
+ */
+esp_err_t esp_mqtt5_client_parse_publish_property(esp_mqtt5_client_handle_t client,
+                                                  esp_mqtt5_event_property_t *property);
+
+/**
+ * @brief Start reading the user properties of a received message
+ *
+ * The user properties are read in place from the receive buffer without any allocation, so they can only
+ * be read within the event handler.
+ *
+ * @param iter                     iterator to initialize
+ * @param property                 properties of the event, event->property
+ */
+void esp_mqtt5_client_user_property_iter_init(esp_mqtt5_user_property_iter_t *iter,
+                                              const esp_mqtt5_event_property_t *property);
+
+/**
+ * @brief Read the next user property of a received message
+ *
+ * @param iter                     iterator initialized by esp_mqtt5_client_user_property_iter_init()
+ * @param item                     filled with the key and value of the user property
+ *
+ * @return true if item was filled
+ *         false once all user properties were read
+ */
+bool esp_mqtt5_client_user_property_next(esp_mqtt5_user_property_iter_t *iter, esp_mqtt5_user_property_view_t *item);
+
+/**
+ * @brief Copy the user properties of a received message to a new user property list
+ *
+ * Use this to keep the user properties after the event handler returns.
+ *
+ * @param property                 properties of the event, event->property
+ * @param user_property            set to the new list, or NULL if the message has no user properties.
+ *                                 Free it with esp_mqtt5_client_delete_user_property()
+ *
+ * @return ESP_ERR_NO_MEM if failed to allocate
+ *         ESP_ERR_INVALID_ARG on wrong arguments
+ *         ESP_OK on success
+ */
+esp_err_t esp_mqtt5_client_copy_user_property(const esp_mqtt5_event_property_t *property,
+                                              mqtt5_user_property_handle_t *user_property);
 #ifdef __cplusplus
 }
 #endif //__cplusplus
@@ -33,6 +33,7 @@ typedef void *esp_event_handler_t;
 #endif
 
 typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+typedef struct esp_mqtt_publish_template *esp_mqtt_publish_template_handle_t;
 
 #define MQTT_OVER_TCP_SCHEME "mqtt"
 #define MQTT_OVER_SSL_SCHEME "mqtts"
@@ -240,6 +241,27 @@ typedef struct esp_mqtt_event_t {
 
 typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
 
+/**
+ * @brief Receive buffer held by an event handler, see esp_mqtt_event_hold_data()
+ */
+typedef struct esp_mqtt_in_buffer *esp_mqtt_event_data_handle_t;
+
+/**
+ * @brief Topic handler, see esp_mqtt_client_register_topic_handler()
+ *
+ * @param handler_args  arguments given when registering the handler
+ * @param event         the MQTT_EVENT_DATA event of a message whose topic matches the filter of the handler
+ */
+typedef void (*esp_mqtt_topic_handler_t)(void *handler_args, esp_mqtt_event_handle_t event);
+
+/**
+ * @brief Event callback, see esp_mqtt_client_config_t::event_callback
+ *
+ * @param handler_args  arguments set in the configuration
+ * @param event         the event, only valid during the call
+ */
+typedef void (*esp_mqtt_event_callback_t)(void *handler_args, const esp_mqtt_event_t *event);
+
 /**
  * *MQTT* client configuration structure
  *
@@ -349,12 +371,24 @@ typedef struct esp_mqtt_client_config_t {
         int keepalive;              /*!< *MQTT* keepalive, default is 120 seconds
                                         When configuring this value, keep in mind that the client attempts
                                         to communicate with the broker at half the interval that is actually set.
-                                        This conservative approach allows for more attempts before the broker's timeout occurs */
+                                        This conservative approach allows for more attempts before the broker's timeout occurs.
+                                        A ping is only sent if no packet was sent to the broker for half the
+                                        interval, or none was received from it for the whole interval */
+        int keepalive_jitter_ms;    /*!< Send pings up to this many ms earlier than half the keepalive interval, by a
+                                        random amount drawn for each ping, so that devices which connected together don't
+                                        ping in lockstep. Limited to a quarter of the keepalive interval, default: 0 */
         bool disable_keepalive; /*!< Set `disable_keepalive=true` to turn off keep-alive mechanism, keepalive is active
                         by default. Note: setting the config value `keepalive` to `0` doesn't disable
                         keepalive feature, but uses a default keepalive period */
         esp_mqtt_protocol_ver_t protocol_ver; /*!< *MQTT* protocol version used for connection.*/
-        int message_retransmit_timeout; /*!< timeout for retransmitting of failed packet, default: 1000 ms */
+        int message_retransmit_timeout; /*!< timeout for retransmitting of failed packet, default: 1000 ms.
+                                            With `adaptive_retransmit_timeout`, the timeout until the first round
+                                            trip time is measured */
+        bool adaptive_retransmit_timeout; /*!< Derive the retransmit timeout from the round trip times measured from
+                                            PUBLISH to PUBACK/PUBREC, PUBREL to PUBCOMP and PINGREQ to PINGRESP, as TCP
+                                            does. The timeout of a message doubles each time it is retransmitted */
+        int message_retransmit_timeout_max; /*!< upper bound of the adaptive retransmit timeout, backoff included,
+                                            default: 60000 ms */
     } session; /*!< *MQTT* session configuration. */
     /**
      * Network related configuration
@@ -388,6 +422,8 @@ typedef struct esp_mqtt_client_config_t {
         int size;     /*!< size of *MQTT* send/receive buffer, default: 1024*/
         int out_size; /*!< size of *MQTT* output buffer. If not defined, defaults to the size defined by
               ``buffer_size`` */
+        int in_pool_size; /*!< number of spare receive buffers, allocated with the receive buffer, which let event
+              handlers hold the received data with esp_mqtt_event_hold_data(), default: 0 */
     } buffer; /*!< Buffer size configuration.*/
 
     /**
@@ -396,6 +432,18 @@ typedef struct esp_mqtt_client_config_t {
     struct outbox_config_t {
         uint64_t limit; /*!< Size limit for the outbox in bytes.*/
     } outbox; /*!< Outbox configuration. */
+
+    /**
+     * Event callback configuration
+     *
+     * When the handler is set, it's called with each event of the client directly from the *MQTT* task, and the
+     * events are no longer posted to the event loop, so the handlers registered with esp_mqtt_client_register_event()
+     * only get the events dispatched with esp_mqtt_dispatch_custom_event().
+     */
+    struct event_callback_t {
+        esp_mqtt_event_callback_t handler; /*!< Called with each event, from the *MQTT* task */
+        void *handler_args;                /*!< Arguments passed to the handler */
+    } event_callback; /*!< Event delivery bypassing the event loop */
 } esp_mqtt_client_config_t;
 
 /**
@@ -406,6 +454,45 @@ typedef struct topic_t {
     int qos; /*!< Max QoS level of the subscription */
 } esp_mqtt_topic_t;
 
+/**
+ * Publish message definition for esp_mqtt_client_publish_batch()
+ */
+typedef struct esp_mqtt_publish {
+    const char *topic;  /*!< Topic string */
+    const char *data;   /*!< Payload (NULL for empty payload) */
+    int len;            /*!< Payload length, if set to 0, length is calculated from payload string */
+    int qos;            /*!< QoS of publish message */
+    int retain;         /*!< Retain flag */
+} esp_mqtt_publish_t;
+
+/**
+ * @brief Releases a payload passed to esp_mqtt_client_publish_owned()
+ *
+ * @param payload   payload pointer as passed to the publish call
+ * @param ctx       context pointer as passed to the publish call
+ */
+typedef void (*esp_mqtt_payload_free_cb_t)(void *payload, void *ctx);
+
+/**
+ * @brief How a message published with esp_mqtt_client_publish_async() completed
+ */
+typedef enum {
+    MQTT_PUBLISH_COMPLETED = 0, /*!< acknowledged with PUBACK or PUBCOMP, sent for QoS 0 */
+    MQTT_PUBLISH_EXPIRED,       /*!< not acknowledged within the outbox expiration timeout */
+    MQTT_PUBLISH_DROPPED,       /*!< deleted from the outbox as the client stopped or was destroyed */
+} esp_mqtt_publish_status_t;
+
+/**
+ * @brief Completion callback of esp_mqtt_client_publish_async()
+ *
+ * @param ctx           context pointer as passed to the publish call
+ * @param msg_id        message id returned by the publish call
+ * @param status        how the message completed
+ * @param reason_code   reason code of the PUBACK or PUBCOMP with MQTT v5, 0 otherwise
+ */
+typedef void (*esp_mqtt_publish_complete_cb_t)(void *ctx, int msg_id, esp_mqtt_publish_status_t status,
+                                               int reason_code);
+
 /**
  * @brief Creates *MQTT* client handle based on the configuration
  *
@@ -573,6 +660,8 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client,
  * - In case of MQTT v5, if the server quota for inflight messages is exceeded,
  *   message will be enqueued and sent later when quota is available.
  * - QoS 0 messages are sent immediately in the calling task, not via the outbox.
+ * - With CONFIG_MQTT_PUBLISH_FROM_TASK, all messages are added to the outbox and
+ *   written by the *MQTT* task, so this API doesn't wait for the network.
  * - If MQTT_SKIP_PUBLISH_IF_DISCONNECTED is enabled, this API will
  * not attempt to publish when the client is not connected and will always
  * return -1.
@@ -620,6 +709,161 @@ int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic,
                             const char *data, int len, int qos, int retain,
                             bool store);
 
+/**
+ * @brief Client to send a publish message without copying the payload
+ *
+ * Behaves like esp_mqtt_client_publish(), but the client takes ownership of the
+ * payload buffer instead of copying it. Only the header is encoded in the
+ * client buffer, the payload is written to the transport directly from the
+ * caller's memory and, for qos>0, the outbox keeps a reference to it until the
+ * message is acknowledged, expired or deleted.
+ *
+ * Notes:
+ * - free_cb is called exactly once if this API returns a message_id (>= 0),
+ *   possibly before it returns. On failure (-1 or -2) the caller keeps the
+ *   ownership of the payload.
+ * - The payload must not be modified until free_cb is called.
+ * - free_cb could be called from the mqtt-task context while the client is
+ *   locked, so it must not call any client API.
+ * - A custom outbox could copy the payload and release it immediately.
+ * - Unlike esp_mqtt_client_publish(), the message is written in the calling
+ *   task with the client locked also with CONFIG_MQTT_PUBLISH_FROM_TASK, so this
+ *   API could wait for the network.
+ * - It is thread safe, please refer to `esp_mqtt_client_subscribe` for details
+ *
+ * @param client    *MQTT* client handle
+ * @param topic     topic string
+ * @param data      payload buffer, owned by the client on success
+ * @param len       data length, if set to 0, length is calculated from payload
+ * string
+ * @param qos       QoS of publish message
+ * @param retain    retain flag
+ * @param free_cb   callback releasing the payload, must not be NULL
+ * @param free_ctx  context passed to free_cb
+ *
+ * @return message_id of the publish message (for QoS 0 message_id will always
+ * be zero) on success. -1 on failure, -2 in case of full outbox.
+ */
+int esp_mqtt_client_publish_owned(esp_mqtt_client_handle_t client, const char *topic,
+                                  const char *data, int len, int qos, int retain,
+                                  esp_mqtt_payload_free_cb_t free_cb, void *free_ctx);
+
+/**
+ * @brief Client to send a publish message, calling back when it completes
+ *
+ * Behaves like esp_mqtt_client_publish(), and calls complete_cb once the
+ * message is acknowledged, expired or dropped from the outbox, so that the
+ * caller doesn't need to match the message id in MQTT_EVENT_PUBLISHED events.
+ *
+ * Notes:
+ * - complete_cb is called exactly once if this API returns a message_id (>= 0),
+ *   for QoS 0 before it returns, or with CONFIG_MQTT_PUBLISH_FROM_TASK once the
+ *   mqtt-task wrote the message. On failure (-1 or -2) it is not called.
+ * - complete_cb is called from the mqtt-task context while the client is
+ *   locked, from the task stopping or destroying the client, or for QoS 0 from
+ *   the calling task, so it must not block. It could publish further messages.
+ * - The pending completions are kept by message id, added and removed in
+ *   constant time.
+ * - It is thread safe, please refer to `esp_mqtt_client_subscribe` for details
+ *
+ * @param client        *MQTT* client handle
+ * @param topic         topic string
+ * @param data          payload string (set to NULL, sending empty payload message)
+ * @param len           data length, if set to 0, length is calculated from payload
+ * string
+ * @param qos           QoS of publish message
+ * @param retain        retain flag
+ * @param complete_cb   callback called when the message completes, must not be NULL
+ * @param complete_ctx  context passed to complete_cb
+ *
+ * @return message_id of the publish message (for QoS 0 message_id will always
+ * be zero) on success. -1 on failure, -2 in case of full outbox.
+ */
+int esp_mqtt_client_publish_async(esp_mqtt_client_handle_t client, const char *topic,
+                                  const char *data, int len, int qos, int retain,
+                                  esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx);
+
+/**
+ * @brief Client to send several publish messages at once
+ *
+ * Each message is handled as by esp_mqtt_client_publish(), but the client is
+ * locked only once and the encoded messages are packed back to back in the
+ * output buffer, so that they are flushed to the transport in as few writes
+ * as the buffer size allows. Messages with a payload which doesn't fit the
+ * buffer are written on their own.
+ *
+ * Notes:
+ * - Every message gets its own result, a message which cannot be stored
+ *   (e.g. full outbox) doesn't prevent the following ones from being sent.
+ * - Unlike esp_mqtt_client_publish(), the packed messages are written in the
+ *   calling task with the client locked also with
+ *   CONFIG_MQTT_PUBLISH_FROM_TASK, so this API could wait for the network.
+ * - It is thread safe, please refer to `esp_mqtt_client_subscribe` for details
+ *
+ * @param client    *MQTT* client handle
+ * @param msgs      array of messages to publish
+ * @param n         number of messages
+ * @param msg_ids   array of n results, filled with the message_id of each
+ * message (for QoS 0 message_id will always be zero) on success, -1 on
+ * failure, -2 in case of full outbox
+ *
+ * @return number of messages sent or enqueued, -1 on invalid arguments
+ */
+int esp_mqtt_client_publish_batch(esp_mqtt_client_handle_t client, const esp_mqtt_publish_t *msgs,
+                                  size_t n, int *msg_ids);
+
+/**
+ * @brief Creates a publish template for messages sent repeatedly to the same topic
+ *
+ * The topic, QoS, retain flag and, for MQTT5, the publish properties set by
+ * esp_mqtt5_client_set_publish_property() are encoded once into the template.
+ * Publishing through the template with esp_mqtt_client_publish_with_template()
+ * only generates the message id and the message length and appends the payload.
+ *
+ * Notes:
+ * - MQTT5 publish properties are used by the template the same way as by a
+ *   publish message, they don't apply to the next publish message.
+ * - MQTT5 response topic is extended by the response information known when
+ *   the template is created.
+ * - The template can be used only with the client which created it, it must be
+ *   destroyed with esp_mqtt_client_destroy_publish_template() before the client.
+ * - It is thread safe, please refer to `esp_mqtt_client_subscribe` for details
+ *
+ * @param client    *MQTT* client handle
+ * @param topic     topic string
+ * @param qos       QoS of the publish messages
+ * @param retain    retain flag of the publish messages
+ *
+ * @return publish template handle on success, NULL on failure
+ */
+esp_mqtt_publish_template_handle_t esp_mqtt_client_create_publish_template(esp_mqtt_client_handle_t client,
+                                                                           const char *topic, int qos, int retain);
+
+/**
+ * @brief Client to send a publish message through a publish template
+ *
+ * Behaves like esp_mqtt_client_publish() with the topic, QoS, retain flag and
+ * properties of the template.
+ *
+ * @param client    *MQTT* client handle
+ * @param tmpl      publish template created by esp_mqtt_client_create_publish_template()
+ * @param data      payload string (set to NULL, sending empty payload message)
+ * @param len       data length, if set to 0, length is calculated from payload
+ * string
+ *
+ * @return message_id of the publish message (for QoS 0 message_id will always
+ * be zero) on success. -1 on failure, -2 in case of full outbox.
+ */
+int esp_mqtt_client_publish_with_template(esp_mqtt_client_handle_t client, esp_mqtt_publish_template_handle_t tmpl,
+                                          const char *data, int len);
+
+/**
+ * @brief Destroys a publish template
+ *
+ * @param tmpl      publish template handle, could be NULL
+ */
+void esp_mqtt_client_destroy_publish_template(esp_mqtt_publish_template_handle_t tmpl);
+
 /**
  * @brief Destroys the client handle
  *
@@ -682,6 +926,48 @@ esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
 esp_err_t esp_mqtt_client_unregister_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
                                            esp_event_handler_t event_handler);
 
+/**
+ * @brief Registers a handler for the messages received on the topics matching a topic filter
+ *
+ * The handler is called from the *MQTT* task for each MQTT_EVENT_DATA event of a matching message,
+ * before the event is posted to the event handlers. If a message is received in several events, the
+ * handler is called for each of them. A handler registered for several matching filters is called once
+ * per filter. The filters are matched in a trie, so the cost of a message does not grow with the
+ * number of registered filters.
+ *
+ * - The filter may use the + and # wildcards, and a shared subscription filter "$share/{ShareName}/{filter}"
+ *   matches the topics of its {filter}. Topics starting with $ are not matched by filters starting with a wildcard.
+ * - Registering a handler doesn't subscribe to the filter, use esp_mqtt_client_subscribe() for that.
+ *
+ * @param client        *MQTT* client handle
+ * @param topic_filter  topic filter
+ * @param handler       handler callback
+ * @param handler_args  arguments passed to the handler
+ *
+ * @return ESP_ERR_NO_MEM if failed to allocate
+ *         ESP_ERR_INVALID_ARG on wrong initialization or malformed topic filter
+ *         ESP_OK on success
+ */
+esp_err_t esp_mqtt_client_register_topic_handler(esp_mqtt_client_handle_t client, const char *topic_filter,
+                                                 esp_mqtt_topic_handler_t handler, void *handler_args);
+
+/**
+ * @brief Unregisters a handler registered with the same topic filter, handler and arguments
+ *
+ * It may be called from a topic handler.
+ *
+ * @param client        *MQTT* client handle
+ * @param topic_filter  topic filter
+ * @param handler       handler to unregister
+ * @param handler_args  arguments the handler was registered with
+ *
+ * @return ESP_ERR_INVALID_ARG on wrong initialization or malformed topic filter
+ *         ESP_ERR_NOT_FOUND if the handler is not registered
+ *         ESP_OK on success
+ */
+esp_err_t esp_mqtt_client_unregister_topic_handler(esp_mqtt_client_handle_t client, const char *topic_filter,
+                                                   esp_mqtt_topic_handler_t handler, void *handler_args);
+
 /**
  * @brief Get outbox size
  *
@@ -701,6 +987,37 @@ int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
  */
 esp_err_t esp_mqtt_dispatch_custom_event(esp_mqtt_client_handle_t client, esp_mqtt_event_t *event);
 
+/**
+ * @brief Holds the receive buffer of an event, so that its data outlives the event handler
+ *
+ * Only the bytes in the receive buffer are held: the ``data`` of the event, and its ``topic`` unless it was set
+ * from an MQTT5 topic alias, stay valid until the buffer is released, which lets a copy of the event be handled
+ * later by another task. Meanwhile the client receives into one of the spare buffers set with
+ * ``buffer.in_pool_size`` in the client configuration. The topic of the following parts of a message larger than
+ * the receive buffer is not held (ref CONFIG_MQTT_TOPIC_PRESENT_ALL_DATA_EVENTS).
+ *
+ * Notes:
+ * - This function must be called from the handler of the event.
+ * - Each hold must be released with esp_mqtt_event_release_data(), from any task.
+ * - ``event->property`` is shared by all the events of the client and cleared after each handler, so a handler
+ *   deferring an MQTT5 event copies the properties it needs. In such a copy, ``properties``, ``response_topic``,
+ *   ``correlation_data`` and ``content_type`` point into the held buffer, but ``user_property`` is freed.
+ *
+ * @param event             *MQTT* event being handled
+ * @return the held buffer
+ *         NULL if no spare buffer is left or the data isn't in a receive buffer, it must then be copied
+ */
+esp_mqtt_event_data_handle_t esp_mqtt_event_hold_data(const esp_mqtt_event_t *event);
+
+/**
+ * @brief Releases a receive buffer held with esp_mqtt_event_hold_data()
+ *
+ * It may be called from any task, also after the client is destroyed.
+ *
+ * @param data              held buffer
+ */
+void esp_mqtt_event_release_data(esp_mqtt_event_data_handle_t data);
+
 /**
  * @brief Get a transport from the scheme
  *
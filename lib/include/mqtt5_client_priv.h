@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2022-2025 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2022-2026 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -9,20 +9,69 @@
 
 #include "mqtt5_client.h"
 #include "mqtt5_msg.h"
+#include "mqtt_config.h"
+#include "mqtt_topic_router.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if MQTT5_USER_PROPERTY_VIEWS
+// user properties of received messages are only read in place, see esp_mqtt5_client_user_property_next()
+#define MQTT5_EVENT_USER_PROPERTY(client) NULL
+#else
+#define MQTT5_EVENT_USER_PROPERTY(client) (&(client)->event.property->user_property)
+#endif
+
 typedef struct mqtt5_topic_alias {
-    char *topic;
-    uint16_t topic_len;
-    uint16_t topic_alias;
-    STAILQ_ENTRY(mqtt5_topic_alias) next;
+    size_t offset;          // of the topic in the arena
+    uint16_t topic_len;     // 0 if the alias is not set
 } mqtt5_topic_alias_t;
-STAILQ_HEAD(mqtt5_topic_alias_list_t, mqtt5_topic_alias);
-typedef struct mqtt5_topic_alias_list_t *mqtt5_topic_alias_handle_t;
-typedef struct mqtt5_topic_alias *mqtt5_topic_alias_item_t;
+
+/* Topics of the inbound topic aliases, indexed by alias and stored back to back in one arena */
+typedef struct mqtt5_topic_alias_table {
+    char *arena;
+    size_t arena_size;
+    size_t arena_used;
+    uint16_t topic_alias_maximum;
+    mqtt5_topic_alias_t alias[];    // alias N is at index N - 1
+} mqtt5_topic_alias_table_t;
+typedef struct mqtt5_topic_alias_table *mqtt5_topic_alias_handle_t;
+
+typedef struct mqtt5_outbound_topic_alias {
+    char *topic;
+    uint16_t topic_len;     // 0 if the alias is not assigned
+    uint16_t topic_size;    // allocated for the topic
+    bool established;       // the broker knows the topic of the alias on this connection
+    uint32_t last_used;
+} mqtt5_outbound_topic_alias_t;
+
+/* Topic aliases assigned by the client to the topics it publishes to, see MQTT5_AUTO_TOPIC_ALIAS */
+typedef struct mqtt5_outbound_topic_alias_table {
+    uint32_t clock;
+    uint16_t topic_alias_maximum;
+    mqtt5_outbound_topic_alias_t alias[];   // alias N is at index N - 1
+} mqtt5_outbound_topic_alias_table_t;
+typedef struct mqtt5_outbound_topic_alias_table *mqtt5_outbound_topic_alias_handle_t;
+
+typedef struct mqtt5_subscription_filter {
+    char *filter;                       // as subscribed
+    mqtt_topic_filter_handle_t held;    // held in the topic router
+} mqtt5_subscription_filter_t;
+
+typedef struct mqtt5_subscription {
+    mqtt5_subscription_filter_t *filter;
+    uint16_t filter_count;              // 0 if the identifier is free
+} mqtt5_subscription_t;
+
+/* Subscriptions made with an identifier assigned by the client, see MQTT5_SUBSCRIBE_ID_ROUTING */
+typedef struct mqtt5_subscription_table {
+    mqtt_topic_router_handle_t router;
+    uint16_t size;
+    uint16_t next;                      // the search for a free identifier starts there
+    mqtt5_subscription_t *subscription; // identifier N is at index N - 1
+} mqtt5_subscription_table_t;
+typedef struct mqtt5_subscription_table *mqtt5_subscription_handle_t;
 
 typedef struct {
     esp_mqtt5_connection_property_storage_t connect_property_info;
@@ -33,6 +82,11 @@ typedef struct {
     const esp_mqtt5_subscribe_property_config_t *subscribe_property_info;
     const esp_mqtt5_unsubscribe_property_config_t *unsubscribe_property_info;
     mqtt5_topic_alias_handle_t peer_topic_alias;
+    mqtt5_outbound_topic_alias_handle_t topic_alias;
+    mqtt5_subscription_handle_t subscriptions;
+    uint16_t publish_subscribe_id;  // of the only subscription the received publish was sent for, 0 if none or several
+    bool user_subscribe_id;         // the user sets subscription identifiers, they are no longer assigned
+    bool publish_property_pending;  // properties of the received publish are parsed on request, see MQTT5_LAZY_PUBLISH_PROPERTIES
 } mqtt5_config_storage_t;
 
 void esp_mqtt5_increment_packet_counter(esp_mqtt5_client_handle_t client);
@@ -48,6 +102,35 @@ esp_err_t esp_mqtt5_client_check_inflight_maximum(esp_mqtt5_client_handle_t clie
 esp_err_t esp_mqtt5_client_publish_check(esp_mqtt5_client_handle_t client, int qos, int retain);
 esp_err_t esp_mqtt5_client_subscribe_check(esp_mqtt5_client_handle_t client, int qos);
 esp_err_t esp_mqtt5_create_default_config(esp_mqtt5_client_handle_t client);
+mqtt5_topic_alias_handle_t esp_mqtt5_client_create_topic_alias(uint16_t topic_alias_maximum);
+esp_err_t esp_mqtt5_client_update_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
+                                              const char *topic, size_t topic_len);
+char *esp_mqtt5_client_get_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
+                                       size_t *topic_length);
+void esp_mqtt5_client_reset_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle);
+void esp_mqtt5_client_delete_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle);
+mqtt5_outbound_topic_alias_handle_t esp_mqtt5_client_create_outbound_topic_alias(uint16_t topic_alias_maximum);
+uint16_t esp_mqtt5_client_assign_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                      const char *topic, size_t topic_len, bool *established);
+void esp_mqtt5_client_establish_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                     uint16_t topic_alias);
+void esp_mqtt5_client_forget_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                  uint16_t topic_alias);
+void esp_mqtt5_client_reset_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle);
+void esp_mqtt5_client_delete_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle);
+const esp_mqtt5_publish_property_config_t *esp_mqtt5_client_apply_topic_alias(esp_mqtt5_client_handle_t client,
+                                                                              const char **topic, esp_mqtt5_publish_property_config_t *alias_property);
+mqtt5_subscription_handle_t esp_mqtt5_client_create_subscriptions(mqtt_topic_router_handle_t router);
+uint16_t esp_mqtt5_client_add_subscription(mqtt5_subscription_handle_t subscription_handle,
+                                           const esp_mqtt_topic_t *topic_list, int size);
+void esp_mqtt5_client_remove_subscription(mqtt5_subscription_handle_t subscription_handle, uint16_t subscribe_id);
+void esp_mqtt5_client_remove_subscribed_filter(mqtt5_subscription_handle_t subscription_handle, const char *filter);
+void esp_mqtt5_client_reset_subscriptions(mqtt5_subscription_handle_t subscription_handle);
+void esp_mqtt5_client_delete_subscriptions(mqtt5_subscription_handle_t subscription_handle);
+bool esp_mqtt5_client_route_subscription(mqtt5_subscription_handle_t subscription_handle, uint16_t subscribe_id,
+                                         const char *topic, size_t topic_len, esp_mqtt_event_handle_t event);
+const esp_mqtt5_subscribe_property_config_t *esp_mqtt5_client_apply_subscribe_id(esp_mqtt5_client_handle_t client,
+                                                                                 const esp_mqtt_topic_t *topic_list, int size, esp_mqtt5_subscribe_property_config_t *id_property);
 esp_err_t esp_mqtt5_get_publish_data(esp_mqtt5_client_handle_t client, uint8_t *msg_buf, size_t msg_read_len,
                                      char **msg_topic, size_t *msg_topic_len, char **msg_data, size_t *msg_data_len);
 #ifdef __cplusplus
@@ -48,6 +48,8 @@ enum mqtt_properties_type {
 typedef struct mqtt5_user_property {
     char *key;
     char *value;
+    size_t key_len;         /*!< kept so that encoding a packet doesn't measure the strings again */
+    size_t value_len;
     STAILQ_ENTRY(mqtt5_user_property) next;
 } mqtt5_user_property_t;
 STAILQ_HEAD(mqtt5_user_property_list_t, mqtt5_user_property);
@@ -76,6 +78,7 @@ typedef struct {
     char *content_type;
     int content_type_len;
     uint16_t subscribe_id;
+    uint8_t subscribe_id_count;     // a message matching several subscriptions carries the identifier of each
 } esp_mqtt5_publish_resp_property_t;
 
 typedef struct {
@@ -127,8 +130,17 @@ uint16_t mqtt5_get_id(uint8_t *buffer, size_t length);
 char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length, char **msg_topic, size_t *msg_topic_len,
                                          esp_mqtt5_publish_resp_property_t *resp_property, uint16_t *property_len, size_t *payload_len,
                                          mqtt5_user_property_handle_t *user_property);
+char *mqtt5_get_publish_payload(uint8_t *buffer, size_t buffer_length, char **msg_topic, size_t *msg_topic_len,
+                                esp_mqtt5_publish_resp_property_t *resp_property, uint16_t *property_len, size_t *payload_len);
+esp_err_t mqtt5_msg_parse_publish_property(uint8_t *property, size_t property_len,
+                                           esp_mqtt5_publish_resp_property_t *resp_property,
+                                           mqtt5_user_property_handle_t *user_property);
 char *mqtt5_get_suback_data(uint8_t *buffer, size_t *length, mqtt5_user_property_handle_t *user_property);
 char *mqtt5_get_puback_data(uint8_t *buffer, size_t *length, mqtt5_user_property_handle_t *user_property);
+uint8_t *mqtt5_get_properties(uint8_t *buffer, size_t length, size_t *properties_len);
+bool mqtt5_msg_next_user_property(const uint8_t **property, const uint8_t *end, esp_mqtt5_user_property_view_t *item);
+esp_err_t mqtt5_msg_set_user_property(mqtt5_user_property_handle_t *user_property, const char *key, size_t key_len,
+                                      const char *value, size_t value_len);
 mqtt_message_t *mqtt5_msg_connect(mqtt_connection_t *connection, mqtt_connect_info_t *info,
                                   esp_mqtt5_connection_property_storage_t *property, esp_mqtt5_connection_will_property_storage_t *will_property);
 mqtt_message_t *mqtt5_msg_publish(mqtt_connection_t *connection, const char *topic, const char *data, int data_length,
@@ -7,6 +7,7 @@
 #ifndef _MQTT_CLIENT_PRIV_H_
 #define _MQTT_CLIENT_PRIV_H_
 
+#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,6 +27,9 @@
 #include "esp_transport_ws.h"
 #include "esp_log.h"
 #include "mqtt_outbox.h"
+#include "mqtt_topic_router.h"
+#include "mqtt_publish_completions.h"
+#include "mqtt_rtt.h"
 #include "freertos/event_groups.h"
 #include <errno.h>
 #include <string.h>
@@ -55,11 +59,36 @@ extern "C" {
 # define MQTT_API_UNLOCK(c)        xSemaphoreGiveRecursive(c->api_lock)
 #endif /* MQTT_USE_API_LOCKS */
 
+#if MQTT_PUBLISH_FROM_TASK && !defined(MQTT_DISABLE_API_LOCKS)
+# define MQTT_WRITE_LOCK(c)        xSemaphoreTake(c->write_lock, portMAX_DELAY)
+# define MQTT_WRITE_UNLOCK(c)      xSemaphoreGive(c->write_lock)
+#else
+# define MQTT_WRITE_LOCK(c)
+# define MQTT_WRITE_UNLOCK(c)
+#endif
+
+#if MQTT_PUBLISH_FROM_TASK
+/* The MQTT task writes queued outbox items without the API lock, so it must be the only one deleting items */
+# define MQTT_ASSERT_OUTBOX_OWNER(c) assert((c)->task_handle == NULL || xTaskGetCurrentTaskHandle() == (c)->task_handle)
+#else
+# define MQTT_ASSERT_OUTBOX_OWNER(c)
+#endif
+
+struct esp_mqtt_in_buffer {
+    atomic_int refs;                /*!< one for the client, unless it dropped the buffer, and one per hold */
+    uint8_t *data;
+};
+
 typedef struct mqtt_state {
-    uint8_t *in_buffer;
+    uint8_t *in_buffer;             /*!< data of in_buffers[0] */
+    struct esp_mqtt_in_buffer **in_buffers;  /*!< receive buffer followed by the spares for the held buffers */
+    int in_buffer_count;
     int in_buffer_length;
     size_t message_length;
     size_t in_buffer_read_len;
+    size_t in_buffer_head;          /*!< start of the received bytes which were not parsed yet */
+    size_t in_buffer_tail;          /*!< end of the received bytes in in_buffer */
+    uint64_t in_buffer_read_tick;   /*!< last time bytes of a partially received message were read */
     mqtt_connection_t connection;
     uint16_t pending_msg_id;
     int pending_msg_type;
@@ -100,7 +129,12 @@ typedef struct {
     bool use_ecdsa_peripheral;
     uint8_t ecdsa_key_efuse_blk;
     int message_retransmit_timeout;
+    int keepalive_jitter_ms;
+    bool adaptive_retransmit_timeout;
+    int message_retransmit_timeout_max;
     uint64_t outbox_limit;
+    esp_mqtt_event_callback_t event_callback;
+    void *event_callback_args;
     esp_transport_handle_t transport;
     struct ifreq *if_name;
     esp_transport_keep_alive_t tcp_keep_alive_cfg;
@@ -113,6 +147,22 @@ typedef enum {
     MQTT_STATE_WAIT_RECONNECT,
 } mqtt_client_state_t;
 
+typedef enum {
+    MQTT_DRAIN_IDLE = 0,            /*!< nothing is queued which could be sent now */
+    MQTT_DRAIN_BUDGET_EXHAUSTED,    /*!< byte or time budget of the iteration is used up, more items are queued */
+    MQTT_DRAIN_WOULD_BLOCK,         /*!< transport doesn't accept more data without blocking */
+    MQTT_DRAIN_FAILED,              /*!< writing failed and the connection was aborted */
+} mqtt_drain_result_t;
+
+struct esp_mqtt_publish_template {
+    esp_mqtt_protocol_ver_t protocol_ver;
+    int qos;
+    int retain;
+    size_t id_offset;               /*!< offset of the message id in the header, if qos > 0 */
+    size_t header_len;
+    uint8_t header[];               /*!< encoded topic, message id and properties */
+};
+
 struct esp_mqtt_client {
     esp_transport_list_handle_t transport_list;
     esp_transport_handle_t transport;
@@ -120,7 +170,10 @@ struct esp_mqtt_client {
     mqtt_state_t  mqtt_state;
     _Atomic mqtt_client_state_t state;
     uint64_t refresh_connection_tick;
-    int64_t keepalive_tick;
+    uint64_t last_outbound_tick;    /*!< last packet written to the broker */
+    uint64_t last_inbound_tick;     /*!< last packet received from the broker */
+    uint64_t ping_tick;
+    int keepalive_jitter_ms;        /*!< drawn for the next ping */
     uint64_t reconnect_tick;
 #ifdef MQTT_PROTOCOL_5
     mqtt5_config_storage_t *mqtt5_config;
@@ -131,17 +184,36 @@ struct esp_mqtt_client {
     esp_mqtt_event_t event;
     bool run;
     bool wait_for_ping_resp;
+    mqtt_rtt_t rtt;                 /*!< retransmit timeout, adapted to the measured round trip times if enabled */
     outbox_handle_t outbox;
+    mqtt_topic_router_handle_t topic_router;    /*!< created when the first topic handler is registered */
+    mqtt_publish_completions_handle_t publish_completions;  /*!< created by the first asynchronous publish */
     EventGroupHandle_t status_bits;
     SemaphoreHandle_t  api_lock;
+#if MQTT_PUBLISH_FROM_TASK
+    SemaphoreHandle_t  write_lock;      /*!< serializes the transport writes, which the MQTT task does unlocked */
+    uint32_t           queued_qos0;     /*!< QoS 0 publish messages added to the outbox so far */
+    uint32_t           removed_qos0;    /*!< QoS 0 publish messages written or deleted from the outbox so far */
+#endif
     TaskHandle_t       task_handle;
 #if MQTT_EVENT_QUEUE_SIZE > 1
     atomic_int         queued_events;
+    struct esp_mqtt_in_buffer *posted_data[MQTT_EVENT_QUEUE_SIZE];  /*!< buffers of the queued DATA events */
+    int                posted_data_head;
+    int                posted_data_count;
+    struct esp_mqtt_in_buffer *handled_data;    /*!< buffer of the DATA event being handled */
+#endif
+#if MQTT_TASK_WAKEUP
+    int                wakeup_fd;       /*!< eventfd signalled to wake up the task waiting on the transport */
 #endif
 };
 
 bool esp_mqtt_set_if_config(char const *const new_config, char **old_config);
 void esp_mqtt_destroy_config(esp_mqtt_client_handle_t client);
+mqtt_drain_result_t esp_mqtt_drain_queued(esp_mqtt_client_handle_t client);
+mqtt_drain_result_t esp_mqtt_retransmit_overdue(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_process_receive(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_process_keepalive(esp_mqtt_client_handle_t client);
 
 #ifdef __cplusplus
 }
@@ -21,8 +21,52 @@
 #define MQTT_PROTOCOL_5
 #endif
 
+#ifdef CONFIG_MQTT5_USER_PROPERTY_VIEWS
+#define MQTT5_USER_PROPERTY_VIEWS 1
+#else
+#define MQTT5_USER_PROPERTY_VIEWS 0
+#endif
+
+#ifdef CONFIG_MQTT5_LAZY_PUBLISH_PROPERTIES
+#define MQTT5_LAZY_PUBLISH_PROPERTIES 1
+#else
+#define MQTT5_LAZY_PUBLISH_PROPERTIES 0
+#endif
+
+#ifdef CONFIG_MQTT5_AUTO_TOPIC_ALIAS
+#define MQTT5_AUTO_TOPIC_ALIAS 1
+#define MQTT5_AUTO_TOPIC_ALIAS_MAXIMUM CONFIG_MQTT5_AUTO_TOPIC_ALIAS_MAXIMUM
+#else
+#define MQTT5_AUTO_TOPIC_ALIAS 0
+#define MQTT5_AUTO_TOPIC_ALIAS_MAXIMUM 0
+#endif
+
+#ifdef CONFIG_MQTT5_SUBSCRIBE_ID_ROUTING
+#define MQTT5_SUBSCRIBE_ID_ROUTING 1
+#else
+#define MQTT5_SUBSCRIBE_ID_ROUTING 0
+#endif
+
 #define MQTT_RECON_DEFAULT_MS       (10*1000)
 
+#ifdef CONFIG_MQTT_SEND_BUDGET_BYTES
+#define MQTT_SEND_BUDGET_BYTES      CONFIG_MQTT_SEND_BUDGET_BYTES
+#else
+#define MQTT_SEND_BUDGET_BYTES      (16*1024)
+#endif
+
+#ifdef CONFIG_MQTT_SEND_BUDGET_MS
+#define MQTT_SEND_BUDGET_MS         CONFIG_MQTT_SEND_BUDGET_MS
+#else
+#define MQTT_SEND_BUDGET_MS         (50)
+#endif
+
+#ifdef CONFIG_MQTT_RETRANSMIT_BURST_BYTES
+#define MQTT_RETRANSMIT_BURST_BYTES CONFIG_MQTT_RETRANSMIT_BURST_BYTES
+#else
+#define MQTT_RETRANSMIT_BURST_BYTES (16*1024)
+#endif
+
 #ifdef CONFIG_MQTT_POLL_READ_TIMEOUT_MS
 #define MQTT_POLL_READ_TIMEOUT_MS  CONFIG_MQTT_POLL_READ_TIMEOUT_MS
 #else
@@ -112,6 +156,21 @@
 #define MQTT_ENABLE_WS              CONFIG_MQTT_TRANSPORT_WEBSOCKET
 #define MQTT_ENABLE_WSS             CONFIG_MQTT_TRANSPORT_WEBSOCKET_SECURE
 #define MQTT_DEFAULT_RETRANSMIT_TIMEOUT_MS 1000
+#define MQTT_DEFAULT_RETRANSMIT_TIMEOUT_MAX_MS (60*1000)
+/* Lower bound of the adaptive retransmit timeout, so that scheduling delays of the broker don't cause retransmissions */
+#define MQTT_RETRANSMIT_TIMEOUT_MIN_MS     200
+
+#ifdef CONFIG_MQTT_TASK_WAKEUP
+#define MQTT_TASK_WAKEUP            1
+#else
+#define MQTT_TASK_WAKEUP            0
+#endif
+
+#ifdef CONFIG_MQTT_PUBLISH_FROM_TASK
+#define MQTT_PUBLISH_FROM_TASK      1
+#else
+#define MQTT_PUBLISH_FROM_TASK      0
+#endif
 
 #ifdef CONFIG_MQTT_EVENT_QUEUE_SIZE
 #define MQTT_EVENT_QUEUE_SIZE       CONFIG_MQTT_EVENT_QUEUE_SIZE
@@ -137,5 +196,14 @@
 #define MQTT_TASK_STACK_ON_EXTERNAL_MEMORY 0
 #endif
 
+#ifdef CONFIG_MQTT_OUTBOX_ARENA
+#define MQTT_OUTBOX_ARENA 1
+#else
+#define MQTT_OUTBOX_ARENA 0
+#endif
+
+/* Arena size for a given outbox limit, the headroom is for item bookkeeping and wrap around */
+#define MQTT_OUTBOX_ARENA_SIZE(limit) ((limit) + (limit) / 2)
+
 #define OUTBOX_MAX_SIZE             (4*1024)
 #endif
@@ -0,0 +1,78 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef _MQTT_HASH_PROBE_H_
+#define _MQTT_HASH_PROBE_H_
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hash tables with open addressing and linear probing, over a power of two number of buckets indexed
+ * with mask. An entry sits in its home bucket or after it, with no free bucket in between.
+ */
+
+/**
+ * @brief Tells whether a bucket is used, and if so the home bucket of its entry
+ */
+typedef bool (*mqtt_hash_probe_home_t)(const void *buckets, size_t bucket, size_t mask, size_t *home);
+
+/**
+ * @brief Moves the entry of bucket from to bucket to
+ */
+typedef void (*mqtt_hash_probe_move_t)(void *buckets, size_t from, size_t to);
+
+static inline size_t mqtt_hash_probe_next(size_t bucket, size_t mask)
+{
+    return (bucket + 1) & mask;
+}
+
+/**
+ * @brief Returns the first free bucket of the probe sequence starting at home
+ */
+static inline size_t mqtt_hash_probe_free(const void *buckets, size_t home, size_t mask,
+                                          mqtt_hash_probe_home_t home_of)
+{
+    size_t unused;
+
+    while (home_of(buckets, home, mask, &unused)) {
+        home = mqtt_hash_probe_next(home, mask);
+    }
+
+    return home;
+}
+
+/**
+ * @brief Removes the entry of a bucket without tombstones
+ *
+ * The following entries of the probe sequence which would no longer be found once the bucket is free are moved
+ * back, so lookups stay as short as if the entry had never been added.
+ *
+ * @return the bucket left free, to be cleared by the caller
+ */
+static inline size_t mqtt_hash_probe_remove(void *buckets, size_t bucket, size_t mask,
+                                            mqtt_hash_probe_home_t home_of, mqtt_hash_probe_move_t move)
+{
+    size_t home;
+
+    for (size_t next = mqtt_hash_probe_next(bucket, mask); home_of(buckets, next, mask, &home);
+            next = mqtt_hash_probe_next(next, mask)) {
+        if (((next - home) & mask) >= ((next - bucket) & mask)) {
+            move(buckets, next, bucket);
+            bucket = next;
+        }
+    }
+
+    return bucket;
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
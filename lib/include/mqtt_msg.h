@@ -43,6 +43,11 @@ typedef struct mqtt_message {
     size_t fragmented_msg_data_offset;        /*!< data offset of fragmented messages (zero for all other messages) */
 } mqtt_message_t;
 
+typedef struct mqtt_iovec {
+    const uint8_t *data;
+    size_t length;
+} mqtt_iovec_t;
+
 typedef struct mqtt_connect_info {
     char *client_id;
     char *username;
@@ -111,6 +116,9 @@ void mqtt_msg_buffer_destroy(mqtt_connection_t *connection);
 mqtt_message_t *mqtt_msg_connect(mqtt_connection_t *connection, mqtt_connect_info_t *info);
 mqtt_message_t *mqtt_msg_publish(mqtt_connection_t *connection, const char *topic, const char *data, int data_length,
                                  int qos, int retain, uint16_t *message_id);
+mqtt_message_t *mqtt_msg_publish_template(mqtt_connection_t *connection, const uint8_t *header, size_t header_len,
+                                          size_t id_offset, const char *data, int data_length, int qos, int retain,
+                                          uint16_t *message_id);
 mqtt_message_t *mqtt_msg_puback(mqtt_connection_t *connection, uint16_t message_id);
 mqtt_message_t *mqtt_msg_pubrec(mqtt_connection_t *connection, uint16_t message_id);
 mqtt_message_t *mqtt_msg_pubrel(mqtt_connection_t *connection, uint16_t message_id);
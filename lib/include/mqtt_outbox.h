@@ -23,6 +23,7 @@ typedef struct outbox_t *outbox_handle_t;
 typedef struct outbox_item *outbox_item_handle_t;
 typedef struct outbox_message *outbox_message_handle_t;
 typedef long long outbox_tick_t;
+typedef void (*outbox_free_cb_t)(void *data, void *ctx);
 
 typedef struct outbox_message {
     uint8_t *data;
@@ -32,8 +33,17 @@ typedef struct outbox_message {
     int msg_type;
     uint8_t *remaining_data;
     int remaining_len;
+    outbox_free_cb_t remaining_free;    /*!< if set, remaining_data is referenced instead of copied and released with this callback */
+    void *remaining_free_ctx;           /*!< context passed to remaining_free */
 } outbox_message_t;
 
+typedef struct outbox_arena_info {
+    size_t capacity;        /*!< size of the arena in bytes */
+    size_t used;            /*!< bytes held by items still in the outbox */
+    size_t pinned;          /*!< bytes not yet reclaimable, including deleted items newer than the oldest live one */
+    size_t fallback_items;  /*!< items currently allocated from the heap because they didn't fit in the arena */
+} outbox_arena_info_t;
+
 typedef enum pending_state {
     QUEUED,
     TRANSMITTED,
@@ -46,6 +56,14 @@ outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox, outbox_message_handl
 outbox_item_handle_t outbox_dequeue(outbox_handle_t outbox, pending_state_t pending, outbox_tick_t *tick);
 outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id);
 uint8_t *outbox_item_get_data(outbox_item_handle_t item,  size_t *len, uint16_t *msg_id, int *msg_type, int *qos);
+/**
+ * @brief Gets the referenced remaining data of an item enqueued with remaining_free set
+ *
+ * The data returned by outbox_item_get_data() is followed on the wire by these bytes.
+ *
+ * @return pointer to the referenced data, NULL if the item holds all its data (len is set to 0)
+ */
+uint8_t *outbox_item_get_remaining_data(outbox_item_handle_t item, size_t *len);
 esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type);
 esp_err_t outbox_delete_item(outbox_handle_t outbox, outbox_item_handle_t item);
 int outbox_delete_expired(outbox_handle_t outbox, outbox_tick_t current_tick, outbox_tick_t timeout);
@@ -59,9 +77,50 @@ int outbox_delete_single_expired(outbox_handle_t outbox, outbox_tick_t current_t
 esp_err_t outbox_set_pending(outbox_handle_t outbox, int msg_id, pending_state_t pending);
 pending_state_t outbox_item_get_pending(outbox_item_handle_t item);
 esp_err_t outbox_set_tick(outbox_handle_t outbox, int msg_id, outbox_tick_t tick);
+/**
+ * @brief Records the last write of an item, how many times it was retransmitted and when it is to be retransmitted
+ *
+ * Unlike outbox_set_tick(), this doesn't postpone the expiry of the item
+ */
+esp_err_t outbox_set_transmitted(outbox_handle_t outbox, int msg_id, outbox_tick_t tick, int retransmits,
+                                 outbox_tick_t due);
+/**
+ * @brief Gets the TRANSMITTED or ACKNOWLEDGED item which is the first to be retransmitted
+ *
+ * @param due set to the tick at which the item is to be retransmitted
+ *
+ * @return the item, NULL if no item waits for an acknowledgement
+ */
+outbox_item_handle_t outbox_get_next_retransmit(outbox_handle_t outbox, outbox_tick_t *due);
+/**
+ * @brief Gets how many times an item was retransmitted, and optionally when it was last written
+ *
+ * Items which were not written yet report their enqueue tick
+ */
+int outbox_item_get_retransmits(outbox_item_handle_t item, outbox_tick_t *transmit_tick);
 uint64_t outbox_get_size(outbox_handle_t outbox);
 void outbox_destroy(outbox_handle_t outbox);
 void outbox_delete_all_items(outbox_handle_t outbox);
+/**
+ * @brief Places items and their data in a single preallocated ring arena
+ *
+ * Only supported by the default outbox with CONFIG_MQTT_OUTBOX_ARENA, the arena is allocated
+ * with MQTT_OUTBOX_MEMORY capabilities. Items which don't fit fall back to the heap.
+ *
+ * @param size arena size in bytes, 0 releases the arena
+ *
+ * @return ESP_OK on success
+ *         ESP_ERR_INVALID_STATE if the outbox is not empty
+ *         ESP_ERR_NO_MEM if the arena cannot be allocated
+ *         ESP_ERR_NOT_SUPPORTED if the arena is not enabled
+ */
+esp_err_t outbox_set_arena(outbox_handle_t outbox, size_t size);
+/**
+ * @brief Reports occupancy of the outbox arena
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the arena is not enabled
+ */
+esp_err_t outbox_get_arena_info(outbox_handle_t outbox, outbox_arena_info_t *info);
 
 #ifdef  __cplusplus
 }
@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef _MQTT_PUBLISH_COMPLETIONS_H_
+#define _MQTT_PUBLISH_COMPLETIONS_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Completion callbacks of the messages published with esp_mqtt_client_publish_async(), by message id.
+ * They are kept in a hash table with open addressing, so adding and taking one doesn't depend on the
+ * number of messages in flight. With CONFIG_MQTT_PUBLISH_FROM_TASK, the QoS 0 messages complete once the
+ * MQTT task writes them, their completions are queued in order as these messages have no message id.
+ */
+typedef struct mqtt_publish_completions *mqtt_publish_completions_handle_t;
+
+mqtt_publish_completions_handle_t mqtt_publish_completions_create(void);
+void mqtt_publish_completions_destroy(mqtt_publish_completions_handle_t completions);
+
+/**
+ * @brief Makes room for one more completion, so that the following mqtt_publish_completions_add() can't fail
+ *
+ * @return ESP_ERR_NO_MEM if failed to allocate
+ *         ESP_OK on success
+ */
+esp_err_t mqtt_publish_completions_reserve(mqtt_publish_completions_handle_t completions);
+
+/**
+ * @brief Adds the completion of a message, after mqtt_publish_completions_reserve()
+ */
+void mqtt_publish_completions_add(mqtt_publish_completions_handle_t completions, uint16_t msg_id,
+                                  esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx);
+
+/**
+ * @brief Takes out the completion of a message
+ *
+ * @return true if a completion was added for the message id
+ */
+bool mqtt_publish_completions_take(mqtt_publish_completions_handle_t completions, uint16_t msg_id,
+                                   esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx);
+
+/**
+ * @brief Makes room for one more queued completion, so that the following mqtt_publish_completions_add_queued()
+ * can't fail
+ *
+ * @return ESP_ERR_NO_MEM if failed to allocate
+ *         ESP_OK on success
+ */
+esp_err_t mqtt_publish_completions_reserve_queued(mqtt_publish_completions_handle_t completions);
+
+/**
+ * @brief Adds the completion of a QoS 0 message queued in the outbox, after mqtt_publish_completions_reserve_queued()
+ *
+ * These messages have no message id, but leave the outbox in the order they were queued. The completions are kept
+ * in the same order, with the position of their message, which counts the QoS 0 messages queued so far.
+ */
+void mqtt_publish_completions_add_queued(mqtt_publish_completions_handle_t completions, uint32_t position,
+                                         esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx);
+
+/**
+ * @brief Takes out the oldest queued completion if its message left the outbox
+ *
+ * @param removed   number of QoS 0 messages which left the outbox so far
+ *
+ * @return true if the message of the oldest queued completion is among the removed ones
+ */
+bool mqtt_publish_completions_take_queued(mqtt_publish_completions_handle_t completions, uint32_t removed,
+                                          esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx);
+
+/**
+ * @brief Takes out any of the completions, to complete them all
+ *
+ * msg_id is 0 for the queued completions
+ *
+ * @return true if there was a completion
+ */
+bool mqtt_publish_completions_take_any(mqtt_publish_completions_handle_t completions, uint16_t *msg_id,
+                                       esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx);
+
+/**
+ * @brief Tells the number of completions, queued ones included
+ */
+size_t mqtt_publish_completions_count(mqtt_publish_completions_handle_t completions);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
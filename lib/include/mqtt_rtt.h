@@ -0,0 +1,50 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef _MQTT_RTT_H_
+#define _MQTT_RTT_H_
+#include <stdint.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Round trip time estimator for the retransmit timeout, as TCP computes its RTO (RFC 6298).
+ * The smoothed round trip time and its variance are kept in fixed point, scaled by 8 and by 4.
+ */
+typedef struct mqtt_rtt {
+    uint32_t srtt8;         /*!< smoothed round trip time times 8, 0 until the first sample */
+    uint32_t rttvar4;       /*!< round trip time variance times 4 */
+    uint32_t timeout;       /*!< current retransmit timeout in ms */
+    uint32_t min_timeout;
+    uint32_t max_timeout;
+} mqtt_rtt_t;
+
+/**
+ * @brief Starts without samples, the timeout is initial_timeout until the first one
+ *
+ * With min_timeout equal to max_timeout, the timeout stays fixed
+ */
+void mqtt_rtt_init(mqtt_rtt_t *rtt, uint32_t initial_timeout, uint32_t min_timeout, uint32_t max_timeout);
+
+/**
+ * @brief Adds a measured round trip time in ms
+ *
+ * Only round trips of packets which were not retransmitted are to be measured (Karn's algorithm),
+ * as the acknowledgement of a retransmitted packet can't be matched to one of its transmissions
+ */
+void mqtt_rtt_add_sample(mqtt_rtt_t *rtt, uint32_t sample);
+
+/**
+ * @brief Tells the timeout of a packet which was already retransmitted the given number of times,
+ *        doubled with each retransmission up to the maximal timeout
+ */
+uint32_t mqtt_rtt_get_timeout(const mqtt_rtt_t *rtt, int retransmits);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
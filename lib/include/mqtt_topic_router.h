@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef _MQTT_TOPIC_ROUTER_H_
+#define _MQTT_TOPIC_ROUTER_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Topic handlers registered by topic filter. The filters are stored level by level in a trie, whose
+ * edges are kept in one hash table, so a topic is matched in a number of steps which depends on its
+ * levels and on the wildcards in the filters, not on the number of filters.
+ */
+typedef struct mqtt_topic_router *mqtt_topic_router_handle_t;
+typedef struct mqtt_topic_node *mqtt_topic_filter_handle_t;
+
+mqtt_topic_router_handle_t mqtt_topic_router_create(void);
+void mqtt_topic_router_destroy(mqtt_topic_router_handle_t router);
+
+/**
+ * @brief Adds a handler for the topics matching the filter
+ *
+ * The filter may use the + and # wildcards. A shared subscription filter "$share/{ShareName}/{filter}"
+ * matches the topics of its {filter}.
+ *
+ * @return ESP_ERR_INVALID_ARG if the filter is malformed
+ *         ESP_ERR_NO_MEM if failed to allocate
+ *         ESP_OK on success
+ */
+esp_err_t mqtt_topic_router_add(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                esp_mqtt_topic_handler_t handler, void *handler_args);
+
+/**
+ * @brief Removes a handler added with the same filter, handler and arguments, it may be called from a handler
+ *
+ * @return ESP_ERR_INVALID_ARG if the filter is malformed
+ *         ESP_ERR_NOT_FOUND if the handler was not added
+ *         ESP_OK on success
+ */
+esp_err_t mqtt_topic_router_remove(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                   esp_mqtt_topic_handler_t handler, void *handler_args);
+
+/**
+ * @brief Calls the handlers of all the filters matching the topic, once per added filter
+ *
+ * @return number of handlers called
+ */
+size_t mqtt_topic_router_dispatch(mqtt_topic_router_handle_t router, const char *topic, size_t topic_len,
+                                  esp_mqtt_event_handle_t event);
+
+/**
+ * @brief Holds a filter, so that its handlers can be called with mqtt_topic_router_dispatch_filter()
+ *
+ * The filter is kept until released, whether handlers are added to it or not.
+ *
+ * @return the held filter, NULL if the filter is malformed or failed to allocate
+ */
+mqtt_topic_filter_handle_t mqtt_topic_router_hold(mqtt_topic_router_handle_t router, const char *topic_filter);
+
+/**
+ * @brief Releases a filter held with mqtt_topic_router_hold(), it may be called from a handler
+ */
+void mqtt_topic_router_release(mqtt_topic_router_handle_t router, mqtt_topic_filter_handle_t filter);
+
+/**
+ * @brief Tells whether all the filters with handlers are held
+ *
+ * When they are, the handlers of a message delivered for known filters can be called with
+ * mqtt_topic_router_dispatch_filter() without matching its topic.
+ */
+bool mqtt_topic_router_all_held(mqtt_topic_router_handle_t router);
+
+/**
+ * @brief Calls the handlers of a held filter, without matching the topic
+ *
+ * @return number of handlers called
+ */
+size_t mqtt_topic_router_dispatch_filter(mqtt_topic_router_handle_t router, mqtt_topic_filter_handle_t filter,
+                                         esp_mqtt_event_handle_t event);
+
+/**
+ * @brief Tells whether a topic matches a topic filter, shared subscription filters included
+ */
+bool mqtt_topic_filter_matches(const char *topic_filter, const char *topic, size_t topic_len);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
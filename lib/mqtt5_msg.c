@@ -19,7 +19,7 @@ static const char *TAG = "mqtt5_msg";
         ESP_LOGE(TAG,"%s(%d) fail",__FUNCTION__, __LINE__);      \
         return (ret);                                           \
         }
-#define MQTT5_SHARED_SUB "$share/%s/%s"
+#define MQTT5_SHARED_SUB_PREFIX "$share/"
 #define MQTT5_CONVERT_ONE_BYTE_TO_FOUR(i, a, b, c, d) i = (a << 24); \
                                                       i |= (b << 16); \
                                                       i |= (c << 8); \
@@ -88,36 +88,100 @@ static bool mqtt5_property_has_bytes(size_t property_offset, size_t needed, size
     return property_offset <= property_len && needed <= (property_len - property_offset);
 }
 
-static int update_property_len_value(mqtt_connection_t *connection, size_t property_len, int property_offset)
+/* Size of the property value following the property identifier, 0 if the identifier is unknown or the value is cut */
+static size_t mqtt5_property_value_size(uint8_t property_id, const uint8_t *value, size_t available)
 {
-    uint8_t encoded_lens[4] = {0}, len_bytes = 0;
-    size_t len = property_len, message_offset = property_offset + property_len;
-    generate_variable_len(len, &len_bytes, encoded_lens);
-    int offset = len_bytes - 1;
-    connection->outbound_message.length += offset;
+    uint8_t len_bytes = 0;
+    size_t size = 0;
+
+    switch (property_id) {
+    case MQTT5_PROPERTY_PAYLOAD_FORMAT_INDICATOR:
+    case MQTT5_PROPERTY_REQUEST_PROBLEM_INFO:
+    case MQTT5_PROPERTY_REQUEST_RESP_INFO:
+    case MQTT5_PROPERTY_MAXIMUM_QOS:
+    case MQTT5_PROPERTY_RETAIN_AVAILABLE:
+    case MQTT5_PROPERTY_WILDCARD_SUBSCR_AVAILABLE:
+    case MQTT5_PROPERTY_SUBSCR_IDENTIFIER_AVAILABLE:
+    case MQTT5_PROPERTY_SHARED_SUBSCR_AVAILABLE:
+        size = 1;
+        break;
 
-    if (connection->outbound_message.length > connection->buffer_length) {
-        return -1;
-    }
+    case MQTT5_PROPERTY_SERVER_KEEP_ALIVE:
+    case MQTT5_PROPERTY_RECEIVE_MAXIMUM:
+    case MQTT5_PROPERTY_TOPIC_ALIAS_MAXIMIM:
+    case MQTT5_PROPERTY_TOPIC_ALIAS:
+        size = 2;
+        break;
+
+    case MQTT5_PROPERTY_MESSAGE_EXPIRY_INTERVAL:
+    case MQTT5_PROPERTY_SESSION_EXPIRY_INTERVAL:
+    case MQTT5_PROPERTY_WILL_DELAY_INTERVAL:
+    case MQTT5_PROPERTY_MAXIMUM_PACKET_SIZE:
+        size = 4;
+        break;
+
+    case MQTT5_PROPERTY_SUBSCRIBE_IDENTIFIER:
+        get_variable_len((uint8_t *)value, 0, available, &len_bytes);
+        size = len_bytes;
+        break;
+
+    case MQTT5_PROPERTY_CONTENT_TYPE:
+    case MQTT5_PROPERTY_RESPONSE_TOPIC:
+    case MQTT5_PROPERTY_CORRELATION_DATA:
+    case MQTT5_PROPERTY_ASSIGNED_CLIENT_IDENTIFIER:
+    case MQTT5_PROPERTY_AUTHENTICATION_METHOD:
+    case MQTT5_PROPERTY_AUTHENTICATION_DATA:
+    case MQTT5_PROPERTY_RESP_INFO:
+    case MQTT5_PROPERTY_SERVER_REFERENCE:
+    case MQTT5_PROPERTY_REASON_STRING:
+        size = available < 2 ? 0 : 2 + (value[0] << 8 | value[1]);
+        break;
 
-    if (offset > 0) {
-        for (int i = 0; i < property_len; i ++) {
-            connection->buffer[message_offset + offset] = connection->buffer[message_offset];
-            message_offset --;
+    case MQTT5_PROPERTY_USER_PROPERTY:
+        if (available < 2) {
+            return 0;
         }
+
+        size = 2 + (value[0] << 8 | value[1]);
+        size = available < size + 2 ? 0 : size + 2 + (value[size] << 8 | value[size + 1]);
+        break;
+
+    default:
+        return 0;
     }
 
-    for (int i = 0; i < len_bytes; i ++) {
-        connection->buffer[property_offset ++] = encoded_lens[i];
+    return size <= available ? size : 0;
+}
+
+static uint8_t variable_len_size(size_t len)
+{
+    return len < 128 ? 1 : len < 16384 ? 2 : len < 2097152 ? 3 : 4;
+}
+
+/* Number of bytes append_property() writes for the same arguments */
+static size_t property_size(uint8_t property_type, uint8_t len_occupy, const char *data, size_t data_len)
+{
+    return (property_type ? 1 : 0) + (len_occupy ? len_occupy : variable_len_size(data_len)) + (data ? data_len : 0);
+}
+
+static size_t user_property_size(mqtt5_user_property_handle_t user_property)
+{
+    size_t size = 0;
+
+    if (user_property) {
+        mqtt5_user_property_item_t item;
+        STAILQ_FOREACH(item, user_property, next) {
+            size += 5 + item->key_len + item->value_len;
+        }
     }
 
-    return offset;
+    return size;
 }
 
 static int append_property(mqtt_connection_t *connection, uint8_t property_type, uint8_t len_occupy, const char *data,
                            size_t data_len)
 {
-    if ((connection->outbound_message.length + len_occupy + (data ? data_len : 0) + (property_type ? 1 : 0)) >
+    if (connection->outbound_message.length + property_size(property_type, len_occupy, data, data_len) >
             connection->buffer_length) {
         return -1;
     }
@@ -149,6 +213,87 @@ static int append_property(mqtt_connection_t *connection, uint8_t property_type,
     return connection->outbound_message.length - origin_message_len;
 }
 
+static int append_user_property(mqtt_connection_t *connection, mqtt5_user_property_handle_t user_property)
+{
+    mqtt5_user_property_item_t item;
+    STAILQ_FOREACH(item, user_property, next) {
+        size_t key_len = item->key_len, value_len = item->value_len;
+
+        if (connection->outbound_message.length + 5 + key_len + value_len > connection->buffer_length) {
+            return -1;
+        }
+
+        uint8_t *buffer = connection->buffer + connection->outbound_message.length;
+        *buffer++ = MQTT5_PROPERTY_USER_PROPERTY;
+        *buffer++ = key_len >> 8;
+        *buffer++ = key_len & 0xff;
+        memcpy(buffer, item->key, key_len);
+        buffer += key_len;
+        *buffer++ = value_len >> 8;
+        *buffer++ = value_len & 0xff;
+        memcpy(buffer, item->value, value_len);
+        connection->outbound_message.length += 5 + key_len + value_len;
+    }
+
+    return 0;
+}
+
+/*
+ * Properties are preceded by their total length, the callers compute it before writing them
+ * so that the properties are written once and never moved. Most blocks are shorter than 128 bytes
+ * and take a single length byte.
+ */
+static int append_property_len(mqtt_connection_t *connection, size_t property_len)
+{
+    if (property_len < 128) {
+        if (connection->outbound_message.length + 1 + property_len > connection->buffer_length) {
+            return -1;
+        }
+
+        connection->buffer[connection->outbound_message.length ++] = property_len;
+        return 1;
+    }
+
+    uint8_t encoded_lens[4] = {0}, len_bytes = 0;
+    generate_variable_len(property_len, &len_bytes, encoded_lens);
+
+    if (connection->outbound_message.length + len_bytes + property_len > connection->buffer_length) {
+        return -1;
+    }
+
+    memcpy(connection->buffer + connection->outbound_message.length, encoded_lens, len_bytes);
+    connection->outbound_message.length += len_bytes;
+    return len_bytes;
+}
+
+static int append_data(mqtt_connection_t *connection, const char *data, size_t data_len)
+{
+    if (connection->outbound_message.length + data_len > connection->buffer_length) {
+        return -1;
+    }
+
+    memcpy(connection->buffer + connection->outbound_message.length, data, data_len);
+    connection->outbound_message.length += data_len;
+    return data_len;
+}
+
+/* Writes "$share/{share_name}/{filter}" as a string */
+static int append_shared_topic(mqtt_connection_t *connection, const char *share_name, const char *filter)
+{
+    size_t share_name_len = strlen(share_name), filter_len = strlen(filter);
+    size_t topic_len = strlen(MQTT5_SHARED_SUB_PREFIX) + share_name_len + 1 + filter_len;
+
+    if (append_property(connection, 0, 2, NULL, topic_len) == -1 ||
+            append_data(connection, MQTT5_SHARED_SUB_PREFIX, strlen(MQTT5_SHARED_SUB_PREFIX)) == -1 ||
+            append_data(connection, share_name, share_name_len) == -1 ||
+            append_data(connection, "/", 1) == -1 ||
+            append_data(connection, filter, filter_len) == -1) {
+        return -1;
+    }
+
+    return topic_len + 2;
+}
+
 static uint16_t append_message_id(mqtt_connection_t *connection, uint16_t message_id)
 {
     // If message_id is zero then we should assign one, otherwise
@@ -217,9 +362,14 @@ static mqtt_message_t *fini_message(mqtt_connection_t *connection, int type, int
     return &connection->outbound_message;
 }
 
-static esp_err_t mqtt5_msg_set_user_property(mqtt5_user_property_handle_t *user_property, char *key, size_t key_len,
-                                             char *value, size_t value_len)
+/* Appends a copy of the user property to the list, nothing is copied if user_property is NULL */
+esp_err_t mqtt5_msg_set_user_property(mqtt5_user_property_handle_t *user_property, const char *key, size_t key_len,
+                                      const char *value, size_t value_len)
 {
+    if (!user_property) {
+        return ESP_OK;
+    }
+
     if (!*user_property) {
         *user_property = calloc(1, sizeof(struct mqtt5_user_property_list_t));
         ESP_MEM_CHECK(TAG, *user_property, return ESP_FAIL);
@@ -235,6 +385,7 @@ static esp_err_t mqtt5_msg_set_user_property(mqtt5_user_property_handle_t *user_
     });
     memcpy(user_property_item->key, key, key_len);
     user_property_item->key[key_len] = '\0';
+    user_property_item->key_len = key_len;
     user_property_item->value = calloc(1, value_len + 1);
     ESP_MEM_CHECK(TAG, user_property_item->value, {
         free(user_property_item->key);
@@ -243,13 +394,14 @@ static esp_err_t mqtt5_msg_set_user_property(mqtt5_user_property_handle_t *user_
     });
     memcpy(user_property_item->value, value, value_len);
     user_property_item->value[value_len] = '\0';
+    user_property_item->value_len = value_len;
     STAILQ_INSERT_TAIL(*user_property, user_property_item, next);
     return ESP_OK;
 }
 
-static mqtt5_user_property_handle_t mqtt5_msg_get_user_property(uint8_t *buffer, size_t buffer_length)
+static esp_err_t mqtt5_msg_get_user_property(uint8_t *buffer, size_t buffer_length,
+                                             mqtt5_user_property_handle_t *user_property)
 {
-    mqtt5_user_property_handle_t user_porperty = NULL;
     uint8_t *property = buffer;
     uint16_t property_offset = 0, len = 0;
 
@@ -306,7 +458,7 @@ static mqtt5_user_property_handle_t mqtt5_msg_get_user_property(uint8_t *buffer,
             ESP_LOGD(TAG, "MQTT5_PROPERTY_USER_PROPERTY value: %.*s", value_len, (char *)value);
             property_offset += len;
 
-            if (mqtt5_msg_set_user_property(&user_porperty, (char *)key, key_len, (char *)value, value_len) != ESP_OK) {
+            if (mqtt5_msg_set_user_property(user_property, (char *)key, key_len, (char *)value, value_len) != ESP_OK) {
                 ESP_LOGE(TAG, "mqtt5_msg_set_user_property fail");
                 goto err;
             }
@@ -320,10 +472,15 @@ static mqtt5_user_property_handle_t mqtt5_msg_get_user_property(uint8_t *buffer,
         }
     }
 
-    return user_porperty;
+    return ESP_OK;
 err:
-    esp_mqtt5_client_delete_user_property(user_porperty);
-    return NULL;
+
+    if (user_property) {
+        esp_mqtt5_client_delete_user_property(*user_property);
+        *user_property = NULL;
+    }
+
+    return ESP_FAIL;
 }
 
 uint16_t mqtt5_get_id(uint8_t *buffer, size_t length)
@@ -370,11 +527,14 @@ uint16_t mqtt5_get_id(uint8_t *buffer, size_t length)
     }
 }
 
-char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length, char **msg_topic, size_t *msg_topic_len,
-                                         esp_mqtt5_publish_resp_property_t *resp_property, uint16_t *property_len, size_t *payload_len,
-                                         mqtt5_user_property_handle_t *user_property)
+/*
+ * Locates the topic, the properties and the payload of a publish message, the properties themselves are not read.
+ * Returns the properties, or NULL if the message is malformed
+ */
+static uint8_t *mqtt5_get_publish_properties(uint8_t *buffer, size_t buffer_length, char **msg_topic,
+                                             size_t *msg_topic_len, uint16_t *property_len, char **payload,
+                                             size_t *payload_len)
 {
-    *user_property = NULL;
     uint8_t len_bytes = 0;
     size_t offset = 1;
     size_t totlen = get_variable_len(buffer, offset, buffer_length, &len_bytes);
@@ -400,16 +560,39 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
 
     *property_len = get_variable_len(buffer, offset, buffer_length, &len_bytes);
     offset += len_bytes;
-    uint16_t len = 0, property_offset = 0;
-    uint8_t *property = (buffer + offset);
 
-    while (property_offset < *property_len) {
+    if (offset + *property_len > buffer_length) {
+        return NULL;
+    }
+
+    uint8_t *property = buffer + offset;
+    offset += *property_len;
+
+    if (totlen <= buffer_length) {
+        *payload_len = totlen - offset;
+    } else {
+        *payload_len = buffer_length - offset;
+    }
+
+    *payload = (char *)(buffer + offset);
+    return property;
+}
+
+esp_err_t mqtt5_msg_parse_publish_property(uint8_t *property, size_t property_len,
+                                           esp_mqtt5_publish_resp_property_t *resp_property,
+                                           mqtt5_user_property_handle_t *user_property)
+{
+    uint8_t len_bytes = 0;
+    uint16_t len = 0;
+    size_t property_offset = 0;
+
+    while (property_offset < property_len) {
         uint8_t property_id = property[property_offset ++];
 
         switch (property_id) {
         case MQTT5_PROPERTY_PAYLOAD_FORMAT_INDICATOR:
-            if (!mqtt5_property_has_bytes(property_offset, 1, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, 1, property_len)) {
+                return ESP_FAIL;
             }
 
             resp_property->payload_format_indicator = property[property_offset ++];
@@ -417,8 +600,8 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             continue;
 
         case MQTT5_PROPERTY_MESSAGE_EXPIRY_INTERVAL:
-            if (!mqtt5_property_has_bytes(property_offset, 4, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, 4, property_len)) {
+                return ESP_FAIL;
             }
 
             MQTT5_CONVERT_ONE_BYTE_TO_FOUR(resp_property->message_expiry_interval, property[property_offset ++],
@@ -427,8 +610,8 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             continue;
 
         case MQTT5_PROPERTY_TOPIC_ALIAS:
-            if (!mqtt5_property_has_bytes(property_offset, 2, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, 2, property_len)) {
+                return ESP_FAIL;
             }
 
             MQTT5_CONVERT_ONE_BYTE_TO_TWO(resp_property->topic_alias, property[property_offset ++], property[property_offset ++])
@@ -436,16 +619,16 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             continue;
 
         case MQTT5_PROPERTY_RESPONSE_TOPIC:
-            if (!mqtt5_property_has_bytes(property_offset, 2, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, 2, property_len)) {
+                return ESP_FAIL;
             }
 
             MQTT5_CONVERT_ONE_BYTE_TO_TWO(resp_property->response_topic_len, property[property_offset ++],
                                           property[property_offset ++])
 
             if (resp_property->response_topic_len > MQTT5_MAX_PROPERTY_STRING_LEN ||
-                    !mqtt5_property_has_bytes(property_offset, resp_property->response_topic_len, *property_len)) {
-                return NULL;
+                    !mqtt5_property_has_bytes(property_offset, resp_property->response_topic_len, property_len)) {
+                return ESP_FAIL;
             }
 
             resp_property->response_topic = (char *)(property + property_offset);
@@ -454,18 +637,28 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             continue;
 
         case MQTT5_PROPERTY_CORRELATION_DATA:
+            if (!mqtt5_property_has_bytes(property_offset, 2, property_len)) {
+                return ESP_FAIL;
+            }
+
             MQTT5_CONVERT_ONE_BYTE_TO_TWO(resp_property->correlation_data_len, property[property_offset ++],
                                           property[property_offset ++])
+
+            if (!mqtt5_property_has_bytes(property_offset, resp_property->correlation_data_len, property_len)) {
+                return ESP_FAIL;
+            }
+
             resp_property->correlation_data = (char *)(property + property_offset);
             property_offset += resp_property->correlation_data_len;
             ESP_LOGD(TAG, "MQTT5_PROPERTY_CORRELATION_DATA length %d", resp_property->correlation_data_len);
             continue;
 
         case MQTT5_PROPERTY_SUBSCRIBE_IDENTIFIER:
-            resp_property->subscribe_id = get_variable_len(property, property_offset, *property_len, &len_bytes);
+            resp_property->subscribe_id = get_variable_len(property, property_offset, property_len, &len_bytes);
+            resp_property->subscribe_id_count += resp_property->subscribe_id_count < UINT8_MAX;
 
-            if (!mqtt5_property_has_bytes(property_offset, len_bytes, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, len_bytes, property_len)) {
+                return ESP_FAIL;
             }
 
             property_offset += len_bytes;
@@ -473,8 +666,18 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             continue;
 
         case MQTT5_PROPERTY_CONTENT_TYPE:
+            if (!mqtt5_property_has_bytes(property_offset, 2, property_len)) {
+                return ESP_FAIL;
+            }
+
             MQTT5_CONVERT_ONE_BYTE_TO_TWO(resp_property->content_type_len, property[property_offset ++],
                                           property[property_offset ++])
+
+            if (resp_property->content_type_len > MQTT5_MAX_PROPERTY_STRING_LEN ||
+                    !mqtt5_property_has_bytes(property_offset, resp_property->content_type_len, property_len)) {
+                return ESP_FAIL;
+            }
+
             resp_property->content_type = (char *)(property + property_offset);
             property_offset += resp_property->content_type_len;
             ESP_LOGD(TAG, "MQTT5_PROPERTY_CONTENT_TYPE  %.*s", resp_property->content_type_len, resp_property->content_type);
@@ -484,14 +687,14 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             uint8_t *key = NULL, *value = NULL;
             size_t key_len = 0, value_len = 0;
 
-            if (!mqtt5_property_has_bytes(property_offset, 2, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, 2, property_len)) {
+                return ESP_FAIL;
             }
 
             MQTT5_CONVERT_ONE_BYTE_TO_TWO(len, property[property_offset ++], property[property_offset ++])
 
-            if (len > MQTT5_MAX_PROPERTY_STRING_LEN || !mqtt5_property_has_bytes(property_offset, len, *property_len)) {
-                return NULL;
+            if (len > MQTT5_MAX_PROPERTY_STRING_LEN || !mqtt5_property_has_bytes(property_offset, len, property_len)) {
+                return ESP_FAIL;
             }
 
             key = &property[property_offset];
@@ -499,14 +702,14 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             ESP_LOGD(TAG, "MQTT5_PROPERTY_USER_PROPERTY key: %.*s", key_len, (char *)key);
             property_offset += len;
 
-            if (!mqtt5_property_has_bytes(property_offset, 2, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, 2, property_len)) {
+                return ESP_FAIL;
             }
 
             MQTT5_CONVERT_ONE_BYTE_TO_TWO(len, property[property_offset ++], property[property_offset ++])
 
-            if (len > MQTT5_MAX_PROPERTY_STRING_LEN || !mqtt5_property_has_bytes(property_offset, len, *property_len)) {
-                return NULL;
+            if (len > MQTT5_MAX_PROPERTY_STRING_LEN || !mqtt5_property_has_bytes(property_offset, len, property_len)) {
+                return ESP_FAIL;
             }
 
             value = &property[property_offset];
@@ -515,24 +718,22 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
             property_offset += len;
 
             if (mqtt5_msg_set_user_property(user_property, (char *)key, key_len, (char *)value, value_len) != ESP_OK) {
-                esp_mqtt5_client_delete_user_property(*user_property);
-                *user_property = NULL;
                 ESP_LOGE(TAG, "mqtt5_msg_set_user_property fail");
-                return NULL;
+                return ESP_FAIL;
             }
 
             continue;
         }
 
         case MQTT5_PROPERTY_REASON_STRING: //only print now
-            if (!mqtt5_property_has_bytes(property_offset, 2, *property_len)) {
-                return NULL;
+            if (!mqtt5_property_has_bytes(property_offset, 2, property_len)) {
+                return ESP_FAIL;
             }
 
             MQTT5_CONVERT_ONE_BYTE_TO_TWO(len, property[property_offset ++], property[property_offset ++])
 
-            if (len > MQTT5_MAX_PROPERTY_STRING_LEN || !mqtt5_property_has_bytes(property_offset, len, *property_len)) {
-                return NULL;
+            if (len > MQTT5_MAX_PROPERTY_STRING_LEN || !mqtt5_property_has_bytes(property_offset, len, property_len)) {
+                return ESP_FAIL;
             }
 
             ESP_LOGD(TAG, "MQTT5_PROPERTY_REASON_STRING %.*s", len, &property[property_offset]);
@@ -541,23 +742,80 @@ char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length,
 
         default:
             ESP_LOGW(TAG, "Unknown publish property id 0x%02x", property_id);
-            return NULL;
+            return ESP_FAIL;
         }
     }
 
-    offset += property_offset;
+    return ESP_OK;
+}
 
-    if (totlen <= buffer_length) {
-        *payload_len = totlen - offset;
-    } else {
-        *payload_len = buffer_length - offset;
+char *mqtt5_get_publish_property_payload(uint8_t *buffer, size_t buffer_length, char **msg_topic, size_t *msg_topic_len,
+                                         esp_mqtt5_publish_resp_property_t *resp_property, uint16_t *property_len, size_t *payload_len,
+                                         mqtt5_user_property_handle_t *user_property)
+{
+    if (user_property) {
+        *user_property = NULL;
     }
 
-    return (char *)(buffer + offset);
+    char *payload = NULL;
+    uint8_t *property = mqtt5_get_publish_properties(buffer, buffer_length, msg_topic, msg_topic_len, property_len,
+                                                     &payload, payload_len);
+
+    if (!property || mqtt5_msg_parse_publish_property(property, *property_len, resp_property, user_property) != ESP_OK) {
+        if (user_property) {
+            esp_mqtt5_client_delete_user_property(*user_property);
+            *user_property = NULL;
+        }
+
+        return NULL;
+    }
+
+    return payload;
+}
+
+char *mqtt5_get_publish_payload(uint8_t *buffer, size_t buffer_length, char **msg_topic, size_t *msg_topic_len,
+                                esp_mqtt5_publish_resp_property_t *resp_property, uint16_t *property_len, size_t *payload_len)
+{
+    char *payload = NULL;
+    uint8_t *property = mqtt5_get_publish_properties(buffer, buffer_length, msg_topic, msg_topic_len, property_len,
+                                                     &payload, payload_len);
+    size_t property_offset = 0;
+    uint8_t len_bytes = 0;
+
+    if (!property) {
+        return NULL;
+    }
+
+    // the properties are only checked to be well formed, the topic alias and the subscription identifiers are
+    // needed to deliver the message
+    while (property_offset < *property_len) {
+        uint8_t property_id = property[property_offset ++];
+        size_t size = mqtt5_property_value_size(property_id, property + property_offset, *property_len - property_offset);
+
+        if (size == 0) {
+            ESP_LOGW(TAG, "Invalid publish property id 0x%02x", property_id);
+            return NULL;
+        }
+
+        if (property_id == MQTT5_PROPERTY_TOPIC_ALIAS) {
+            MQTT5_CONVERT_ONE_BYTE_TO_TWO(resp_property->topic_alias, property[property_offset], property[property_offset + 1])
+        } else if (property_id == MQTT5_PROPERTY_SUBSCRIBE_IDENTIFIER) {
+            resp_property->subscribe_id = get_variable_len(property, property_offset, *property_len, &len_bytes);
+            resp_property->subscribe_id_count += resp_property->subscribe_id_count < UINT8_MAX;
+        }
+
+        property_offset += size;
+    }
+
+    return payload;
 }
 
 char *mqtt5_get_suback_data(uint8_t *buffer, size_t *length, mqtt5_user_property_handle_t *user_property)
 {
+    if (user_property) {
+        *user_property = NULL;
+    }
+
     uint8_t len_bytes = 0;
     size_t offset = 1;
     size_t totlen = get_variable_len(buffer, offset, *length, &len_bytes);
@@ -578,7 +836,7 @@ char *mqtt5_get_suback_data(uint8_t *buffer, size_t *length, mqtt5_user_property
             goto err;
         }
 
-        *user_property = mqtt5_msg_get_user_property(buffer + offset, property_len);
+        mqtt5_msg_get_user_property(buffer + offset, property_len, user_property);
         offset += property_len;
 
         if (offset < totlen) {
@@ -588,13 +846,22 @@ char *mqtt5_get_suback_data(uint8_t *buffer, size_t *length, mqtt5_user_property
     }
 
 err:
-    *user_property = NULL;
+
+    if (user_property) {
+        esp_mqtt5_client_delete_user_property(*user_property);
+        *user_property = NULL;
+    }
+
     *length = 0;
     return NULL;
 }
 
 char *mqtt5_get_puback_data(uint8_t *buffer, size_t *length, mqtt5_user_property_handle_t *user_property)
 {
+    if (user_property) {
+        *user_property = NULL;
+    }
+
     uint8_t len_bytes = 0;
     size_t offset = 1;
     size_t totlen = get_variable_len(buffer, offset, *length, &len_bytes);
@@ -616,7 +883,7 @@ char *mqtt5_get_puback_data(uint8_t *buffer, size_t *length, mqtt5_user_property
                 return NULL;
             }
 
-            *user_property = mqtt5_msg_get_user_property(buffer + offset, property_len);
+            mqtt5_msg_get_user_property(buffer + offset, property_len, user_property);
         }
 
         return data;
@@ -626,6 +893,165 @@ char *mqtt5_get_puback_data(uint8_t *buffer, size_t *length, mqtt5_user_property
     }
 }
 
+uint8_t *mqtt5_get_properties(uint8_t *buffer, size_t length, size_t *properties_len)
+{
+    uint8_t len_bytes = 0;
+    size_t offset = 1;
+    size_t totlen = get_variable_len(buffer, offset, length, &len_bytes);
+    offset += len_bytes;
+    totlen += offset;
+    *properties_len = 0;
+
+    if (totlen < length) {
+        length = totlen;
+    }
+
+    switch (mqtt5_get_type(buffer)) {
+    case MQTT_MSG_TYPE_PUBLISH:
+        if (offset + 2 > length) {
+            return NULL;
+        }
+
+        offset += 2 + (buffer[offset] << 8 | buffer[offset + 1]);
+
+        if (mqtt5_get_qos(buffer) > 0) {
+            offset += 2; // skip the message id
+        }
+
+        break;
+
+    case MQTT_MSG_TYPE_CONNACK:
+        offset += 2; // acknowledge flags and reason code
+        break;
+
+    case MQTT_MSG_TYPE_PUBACK:
+    case MQTT_MSG_TYPE_PUBREC:
+    case MQTT_MSG_TYPE_PUBREL:
+    case MQTT_MSG_TYPE_PUBCOMP:
+        offset += 3; // message id and reason code
+        break;
+
+    case MQTT_MSG_TYPE_SUBACK:
+    case MQTT_MSG_TYPE_UNSUBACK:
+        offset += 2; // message id
+        break;
+
+    case MQTT_MSG_TYPE_DISCONNECT:
+        offset += 1; // reason code
+        break;
+
+    default:
+        return NULL;
+    }
+
+    if (offset >= length) {
+        return NULL;
+    }
+
+    size_t property_len = get_variable_len(buffer, offset, length, &len_bytes);
+    offset += len_bytes;
+
+    if (len_bytes == 0 || property_len == 0 || property_len > length - offset) {
+        return NULL;
+    }
+
+    *properties_len = property_len;
+    return buffer + offset;
+}
+
+bool mqtt5_msg_next_user_property(const uint8_t **property, const uint8_t *end, esp_mqtt5_user_property_view_t *item)
+{
+    const uint8_t *next = *property;
+
+    while (next < end) {
+        uint8_t property_id = *next ++;
+        size_t size = mqtt5_property_value_size(property_id, next, end - next);
+
+        if (size == 0) {
+            ESP_LOGW(TAG, "Invalid property id 0x%02x", property_id);
+            break;
+        }
+
+        if (property_id == MQTT5_PROPERTY_USER_PROPERTY) {
+            item->key_len = next[0] << 8 | next[1];
+            item->key = (const char *)next + 2;
+            item->value_len = next[2 + item->key_len] << 8 | next[2 + item->key_len + 1];
+            item->value = item->key + item->key_len + 2;
+            *property = next + size;
+            return true;
+        }
+
+        next += size;
+    }
+
+    *property = end;
+    return false;
+}
+
+static size_t connect_property_size(const esp_mqtt5_connection_property_storage_t *property)
+{
+    size_t size = user_property_size(property->user_property);
+
+    if (property->session_expiry_interval) {
+        size += property_size(MQTT5_PROPERTY_SESSION_EXPIRY_INTERVAL, 4, NULL, 0);
+    }
+
+    if (property->maximum_packet_size) {
+        size += property_size(MQTT5_PROPERTY_MAXIMUM_PACKET_SIZE, 4, NULL, 0);
+    }
+
+    if (property->receive_maximum) {
+        size += property_size(MQTT5_PROPERTY_RECEIVE_MAXIMUM, 2, NULL, 0);
+    }
+
+    if (property->topic_alias_maximum) {
+        size += property_size(MQTT5_PROPERTY_TOPIC_ALIAS_MAXIMIM, 2, NULL, 0);
+    }
+
+    if (property->request_resp_info) {
+        size += property_size(MQTT5_PROPERTY_REQUEST_RESP_INFO, 1, NULL, 0);
+    }
+
+    if (property->request_problem_info) {
+        size += property_size(MQTT5_PROPERTY_REQUEST_PROBLEM_INFO, 1, NULL, 0);
+    }
+
+    return size;
+}
+
+static size_t will_property_size(const esp_mqtt5_connection_will_property_storage_t *will_property)
+{
+    size_t size = user_property_size(will_property->user_property);
+
+    if (will_property->will_delay_interval) {
+        size += property_size(MQTT5_PROPERTY_WILL_DELAY_INTERVAL, 4, NULL, 0);
+    }
+
+    if (will_property->payload_format_indicator) {
+        size += property_size(MQTT5_PROPERTY_PAYLOAD_FORMAT_INDICATOR, 1, NULL, 0);
+    }
+
+    if (will_property->message_expiry_interval) {
+        size += property_size(MQTT5_PROPERTY_MESSAGE_EXPIRY_INTERVAL, 4, NULL, 0);
+    }
+
+    if (will_property->content_type) {
+        size += property_size(MQTT5_PROPERTY_CONTENT_TYPE, 2, will_property->content_type, strlen(will_property->content_type));
+    }
+
+    if (will_property->response_topic) {
+        size += property_size(MQTT5_PROPERTY_RESPONSE_TOPIC, 2, will_property->response_topic,
+                              strlen(will_property->response_topic));
+    }
+
+    if (will_property->correlation_data && will_property->correlation_data_len) {
+        size += property_size(MQTT5_PROPERTY_CORRELATION_DATA, 2, will_property->correlation_data,
+                              will_property->correlation_data_len);
+    }
+
+    return size;
+}
+
 mqtt_message_t *mqtt5_msg_connect(mqtt_connection_t *connection, mqtt_connect_info_t *info,
                                   esp_mqtt5_connection_property_storage_t *property, esp_mqtt5_connection_will_property_storage_t *will_property)
 {
@@ -645,8 +1071,7 @@ mqtt_message_t *mqtt5_msg_connect(mqtt_connection_t *connection, mqtt_connect_in
     }
 
     //Add properties
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
+    APPEND_CHECK(append_property_len(connection, connect_property_size(property)), fail_message(connection));
 
     if (property->session_expiry_interval) {
         APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_SESSION_EXPIRY_INTERVAL, 4, NULL,
@@ -677,17 +1102,9 @@ mqtt_message_t *mqtt5_msg_connect(mqtt_connection_t *connection, mqtt_connect_in
     }
 
     if (property->user_property) {
-        mqtt5_user_property_item_t item;
-        STAILQ_FOREACH(item, property->user_property, next) {
-            APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_USER_PROPERTY, 2, item->key, strlen(item->key)),
-                         fail_message(connection));
-            APPEND_CHECK(append_property(connection, 0, 2, item->value, strlen(item->value)), fail_message(connection));
-        }
+        APPEND_CHECK(append_user_property(connection, property->user_property), fail_message(connection));
     }
 
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
-
     if (info->client_id != NULL && info->client_id[0] != '\0') {
         APPEND_CHECK(append_property(connection, 0, 2, info->client_id, strlen(info->client_id)), fail_message(connection));
     } else {
@@ -696,8 +1113,7 @@ mqtt_message_t *mqtt5_msg_connect(mqtt_connection_t *connection, mqtt_connect_in
 
     //Add will properties
     if (info->will_topic != NULL && info->will_topic[0] != '\0') {
-        properties_offset = connection->outbound_message.length;
-        connection->outbound_message.length ++;
+        APPEND_CHECK(append_property_len(connection, will_property_size(will_property)), fail_message(connection));
 
         if (will_property->will_delay_interval) {
             APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_WILL_DELAY_INTERVAL, 4, NULL,
@@ -730,16 +1146,9 @@ mqtt_message_t *mqtt5_msg_connect(mqtt_connection_t *connection, mqtt_connect_in
         }
 
         if (will_property->user_property) {
-            mqtt5_user_property_item_t item;
-            STAILQ_FOREACH(item, will_property->user_property, next) {
-                APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_USER_PROPERTY, 2, item->key, strlen(item->key)),
-                             fail_message(connection));
-                APPEND_CHECK(append_property(connection, 0, 2, item->value, strlen(item->value)), fail_message(connection));
-            }
+            APPEND_CHECK(append_user_property(connection, will_property->user_property), fail_message(connection));
         }
 
-        APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                               properties_offset), fail_message(connection));
         APPEND_CHECK(append_property(connection, 0, 2, info->will_topic, strlen(info->will_topic)), fail_message(connection));
         APPEND_CHECK(append_property(connection, 0, 2, info->will_message, info->will_length), fail_message(connection));
         connection->buffer[flags_offset] |= MQTT5_CONNECT_FLAG_WILL;
@@ -778,7 +1187,11 @@ esp_err_t mqtt5_msg_parse_connack_property(uint8_t *buffer, size_t buffer_len, m
                                            mqtt5_user_property_handle_t *user_property)
 {
     *reason_code = 0;
-    *user_property = NULL;
+
+    if (user_property) {
+        *user_property = NULL;
+    }
+
     uint8_t len_bytes = 0;
     size_t offset = 1;
     size_t totlen = get_variable_len(buffer, offset, buffer_len, &len_bytes);
@@ -1059,6 +1472,46 @@ esp_err_t mqtt5_msg_parse_connack_property(uint8_t *buffer, size_t buffer_len, m
     return ESP_OK;
 }
 
+/*
+ * The string lengths are measured once by the caller, for both the property length and the properties.
+ * The response topic is extended by the response information received in CONNACK.
+ */
+static size_t publish_property_size(const esp_mqtt5_publish_property_config_t *property, size_t response_topic_len,
+                                    size_t content_type_len)
+{
+    if (!property) {
+        return 0;
+    }
+
+    size_t size = user_property_size(property->user_property);
+
+    if (property->payload_format_indicator) {
+        size += property_size(MQTT5_PROPERTY_PAYLOAD_FORMAT_INDICATOR, 1, NULL, 0);
+    }
+
+    if (property->message_expiry_interval) {
+        size += property_size(MQTT5_PROPERTY_MESSAGE_EXPIRY_INTERVAL, 4, NULL, 0);
+    }
+
+    if (property->topic_alias) {
+        size += property_size(MQTT5_PROPERTY_TOPIC_ALIAS, 2, NULL, 0);
+    }
+
+    if (property->response_topic) {
+        size += property_size(MQTT5_PROPERTY_RESPONSE_TOPIC, 2, property->response_topic, response_topic_len);
+    }
+
+    if (property->correlation_data && property->correlation_data_len) {
+        size += property_size(MQTT5_PROPERTY_CORRELATION_DATA, 2, property->correlation_data, property->correlation_data_len);
+    }
+
+    if (property->content_type) {
+        size += property_size(MQTT5_PROPERTY_CONTENT_TYPE, 2, property->content_type, content_type_len);
+    }
+
+    return size;
+}
+
 mqtt_message_t *mqtt5_msg_publish(mqtt_connection_t *connection, const char *topic, const char *data, int data_length,
                                   int qos, int retain, uint16_t *message_id, const esp_mqtt5_publish_property_config_t *property, const char *resp_info)
 {
@@ -1072,10 +1525,6 @@ mqtt_message_t *mqtt5_msg_publish(mqtt_connection_t *connection, const char *top
     int topic_len = (topic == NULL || topic[0] == '\0') ? 0 : strlen(topic);
     APPEND_CHECK(append_property(connection, 0, 2, topic, topic_len), fail_message(connection));
 
-    if (data == NULL && data_length > 0) {
-        return fail_message(connection);
-    }
-
     if (qos > 0) {
         if ((*message_id = append_message_id(connection, 0)) == 0) {
             return fail_message(connection);
@@ -1084,8 +1533,20 @@ mqtt_message_t *mqtt5_msg_publish(mqtt_connection_t *connection, const char *top
         *message_id = 0;
     }
 
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
+    size_t response_topic_len = 0, resp_info_len = 0, content_type_len = 0;
+
+    if (property && property->response_topic) {
+        response_topic_len = strlen(property->response_topic);
+        resp_info_len = resp_info ? strlen(resp_info) : 0;
+    }
+
+    if (property && property->content_type) {
+        content_type_len = strlen(property->content_type);
+    }
+
+    size_t property_len = publish_property_size(property, response_topic_len + (resp_info_len ? 1 + resp_info_len : 0),
+                                                content_type_len);
+    APPEND_CHECK(append_property_len(connection, property_len), fail_message(connection));
 
     if (property) {
         if (property->payload_format_indicator) {
@@ -1104,27 +1565,16 @@ mqtt_message_t *mqtt5_msg_publish(mqtt_connection_t *connection, const char *top
         }
 
         if (property->response_topic) {
-            if (resp_info && strlen(resp_info)) {
-                uint16_t response_topic_size = strlen(property->response_topic) + strlen(resp_info) + 1;
-                char *response_topic = calloc(1, response_topic_size);
-
-                if (!response_topic) {
-                    ESP_LOGE(TAG, "Failed to calloc %d memory", response_topic_size);
-                    return fail_message(connection);
-                }
-
-                snprintf(response_topic, response_topic_size, "%s/%s", property->response_topic, resp_info);
-
-                if (append_property(connection, MQTT5_PROPERTY_RESPONSE_TOPIC, 2, response_topic, response_topic_size) == -1) {
-                    ESP_LOGE(TAG, "%s(%d) fail", __FUNCTION__, __LINE__);
-                    free(response_topic);
-                    return fail_message(connection);
-                }
-
-                free(response_topic);
+            if (resp_info_len) {
+                APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_RESPONSE_TOPIC, 2, NULL,
+                                             response_topic_len + 1 + resp_info_len), fail_message(connection));
+                APPEND_CHECK(append_data(connection, property->response_topic, response_topic_len),
+                             fail_message(connection));
+                APPEND_CHECK(append_data(connection, "/", 1), fail_message(connection));
+                APPEND_CHECK(append_data(connection, resp_info, resp_info_len), fail_message(connection));
             } else {
                 APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_RESPONSE_TOPIC, 2, property->response_topic,
-                                             strlen(property->response_topic)), fail_message(connection));
+                                             response_topic_len), fail_message(connection));
             }
         }
 
@@ -1134,31 +1584,21 @@ mqtt_message_t *mqtt5_msg_publish(mqtt_connection_t *connection, const char *top
         }
 
         if (property->user_property) {
-            mqtt5_user_property_item_t item;
-            STAILQ_FOREACH(item, property->user_property, next) {
-                APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_USER_PROPERTY, 2, item->key, strlen(item->key)),
-                             fail_message(connection));
-                APPEND_CHECK(append_property(connection, 0, 2, item->value, strlen(item->value)), fail_message(connection));
-            }
+            APPEND_CHECK(append_user_property(connection, property->user_property), fail_message(connection));
         }
 
         if (property->content_type) {
             APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_CONTENT_TYPE, 2, property->content_type,
-                                         strlen(property->content_type)), fail_message(connection));
+                                         content_type_len), fail_message(connection));
         }
     }
 
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
-
-    if (connection->outbound_message.length + data_length > connection->buffer_length) {
-        // Not enough size in buffer -> fragment this message
+    if (data_length > 0 && (data == NULL ||
+                            connection->outbound_message.length + data_length > connection->buffer_length)) {
+        // Payload is written from the caller's memory after the header (it doesn't fit the buffer or the
+        // caller sends it), encode only the header reserving space for the payload
         connection->outbound_message.fragmented_msg_data_offset = connection->outbound_message.length;
-        memcpy(connection->buffer + connection->outbound_message.length, data,
-               connection->buffer_length - connection->outbound_message.length);
-        connection->outbound_message.length = connection->buffer_length;
-        connection->outbound_message.fragmented_msg_total_length = data_length +
-                                                                   connection->outbound_message.fragmented_msg_data_offset;
+        connection->outbound_message.fragmented_msg_total_length = data_length + connection->outbound_message.length;
     } else {
         if (data != NULL) {
             memcpy(connection->buffer + connection->outbound_message.length, data, data_length);
@@ -1239,8 +1679,17 @@ mqtt_message_t *mqtt5_msg_subscribe(mqtt_connection_t *connection, const esp_mqt
         return fail_message(connection);
     }
 
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
+    size_t property_len = 0;
+
+    if (property) {
+        property_len = user_property_size(property->user_property);
+
+        if (property->subscribe_id) {
+            property_len += property_size(MQTT5_PROPERTY_SUBSCRIBE_IDENTIFIER, 0, NULL, property->subscribe_id);
+        }
+    }
+
+    APPEND_CHECK(append_property_len(connection, property_len), fail_message(connection));
 
     if (property) {
         if (property->subscribe_id) {
@@ -1249,42 +1698,18 @@ mqtt_message_t *mqtt5_msg_subscribe(mqtt_connection_t *connection, const esp_mqt
         }
 
         if (property->user_property) {
-            mqtt5_user_property_item_t item;
-            STAILQ_FOREACH(item, property->user_property, next) {
-                APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_USER_PROPERTY, 2, item->key, strlen(item->key)),
-                             fail_message(connection));
-                APPEND_CHECK(append_property(connection, 0, 2, item->value, strlen(item->value)), fail_message(connection));
-            }
+            APPEND_CHECK(append_user_property(connection, property->user_property), fail_message(connection));
         }
     }
 
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
-
     for (int topic_number = 0; topic_number < size; ++topic_number) {
         if (topic_list[topic_number].filter[0] == '\0') {
             return fail_message(connection);
         }
 
         if (property && property->is_share_subscribe) {
-            uint16_t shared_topic_size = strlen(topic_list[topic_number].filter) + strlen(MQTT5_SHARED_SUB) + strlen(
-                                             property->share_name);
-            char *shared_topic = calloc(1, shared_topic_size);
-
-            if (!shared_topic) {
-                ESP_LOGE(TAG, "Failed to calloc %d memory", shared_topic_size);
-                fail_message(connection);
-            }
-
-            snprintf(shared_topic, shared_topic_size, MQTT5_SHARED_SUB, property->share_name, topic_list[topic_number].filter);
-
-            if (append_property(connection, 0, 2, shared_topic, strlen(shared_topic)) == -1) {
-                ESP_LOGE(TAG, "%s(%d) fail", __FUNCTION__, __LINE__);
-                free(shared_topic);
-                return fail_message(connection);
-            }
-
-            free(shared_topic);
+            APPEND_CHECK(append_shared_topic(connection, property->share_name, topic_list[topic_number].filter),
+                         fail_message(connection));
         } else {
             APPEND_CHECK(append_property(connection, 0, 2, topic_list[topic_number].filter,
                                          strlen(topic_list[topic_number].filter)), fail_message(connection));
@@ -1323,8 +1748,17 @@ mqtt_message_t *mqtt5_msg_disconnect(mqtt_connection_t *connection,
     init_message(connection);
     int reason_offset = connection->outbound_message.length;
     connection->buffer[connection->outbound_message.length ++] = 0;
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
+    size_t property_len = 0;
+
+    if (disconnect_property_info) {
+        property_len = user_property_size(disconnect_property_info->user_property);
+
+        if (disconnect_property_info->session_expiry_interval) {
+            property_len += property_size(MQTT5_PROPERTY_SESSION_EXPIRY_INTERVAL, 4, NULL, 0);
+        }
+    }
+
+    APPEND_CHECK(append_property_len(connection, property_len), fail_message(connection));
 
     if (disconnect_property_info) {
         if (disconnect_property_info->session_expiry_interval) {
@@ -1333,12 +1767,7 @@ mqtt_message_t *mqtt5_msg_disconnect(mqtt_connection_t *connection,
         }
 
         if (disconnect_property_info->user_property) {
-            mqtt5_user_property_item_t item;
-            STAILQ_FOREACH(item, disconnect_property_info->user_property, next) {
-                APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_USER_PROPERTY, 2, item->key, strlen(item->key)),
-                             fail_message(connection));
-                APPEND_CHECK(append_property(connection, 0, 2, item->value, strlen(item->value)), fail_message(connection));
-            }
+            APPEND_CHECK(append_user_property(connection, disconnect_property_info->user_property), fail_message(connection));
         }
 
         if (disconnect_property_info->disconnect_reason) {
@@ -1346,8 +1775,6 @@ mqtt_message_t *mqtt5_msg_disconnect(mqtt_connection_t *connection,
         }
     }
 
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
     return fini_message(connection, MQTT_MSG_TYPE_DISCONNECT, 0, 0, 0);
 }
 
@@ -1364,41 +1791,17 @@ mqtt_message_t *mqtt5_msg_unsubscribe(mqtt_connection_t *connection, const char
         return fail_message(connection);
     }
 
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
+    APPEND_CHECK(append_property_len(connection, property ? user_property_size(property->user_property) : 0),
+                 fail_message(connection));
 
     if (property) {
         if (property->user_property) {
-            mqtt5_user_property_item_t item;
-            STAILQ_FOREACH(item, property->user_property, next) {
-                APPEND_CHECK(append_property(connection, MQTT5_PROPERTY_USER_PROPERTY, 2, item->key, strlen(item->key)),
-                             fail_message(connection));
-                APPEND_CHECK(append_property(connection, 0, 2, item->value, strlen(item->value)), fail_message(connection));
-            }
+            APPEND_CHECK(append_user_property(connection, property->user_property), fail_message(connection));
         }
     }
 
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
-
     if (property && property->is_share_subscribe) {
-        uint16_t shared_topic_size = strlen(topic) + strlen(MQTT5_SHARED_SUB) + strlen(property->share_name);
-        char *shared_topic = calloc(1, shared_topic_size);
-
-        if (!shared_topic) {
-            ESP_LOGE(TAG, "Failed to calloc %d memory", shared_topic_size);
-            fail_message(connection);
-        }
-
-        snprintf(shared_topic, shared_topic_size, MQTT5_SHARED_SUB, property->share_name, topic);
-
-        if (append_property(connection, 0, 2, shared_topic, strlen(shared_topic)) == -1) {
-            ESP_LOGE(TAG, "%s(%d) fail", __FUNCTION__, __LINE__);
-            free(shared_topic);
-            return fail_message(connection);
-        }
-
-        free(shared_topic);
+        APPEND_CHECK(append_shared_topic(connection, property->share_name, topic), fail_message(connection));
     } else {
         APPEND_CHECK(append_property(connection, 0, 2, topic, strlen(topic)), fail_message(connection));
     }
@@ -1415,10 +1818,7 @@ mqtt_message_t *mqtt5_msg_puback(mqtt_connection_t *connection, uint16_t message
     }
 
     connection->buffer[connection->outbound_message.length ++] = 0; // Regard it is success
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
+    connection->buffer[connection->outbound_message.length ++] = 0; // No properties
     return fini_message(connection, MQTT_MSG_TYPE_PUBACK, 0, 0, 0);
 }
 
@@ -1431,10 +1831,7 @@ mqtt_message_t *mqtt5_msg_pubrec(mqtt_connection_t *connection, uint16_t message
     }
 
     connection->buffer[connection->outbound_message.length ++] = 0; // Regard it is success
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
+    connection->buffer[connection->outbound_message.length ++] = 0; // No properties
     return fini_message(connection, MQTT_MSG_TYPE_PUBREC, 0, 0, 0);
 }
 
@@ -1447,10 +1844,7 @@ mqtt_message_t *mqtt5_msg_pubrel(mqtt_connection_t *connection, uint16_t message
     }
 
     connection->buffer[connection->outbound_message.length ++] = 0; // Regard it is success
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
+    connection->buffer[connection->outbound_message.length ++] = 0; // No properties
     return fini_message(connection, MQTT_MSG_TYPE_PUBREL, 0, 1, 0);
 }
 
@@ -1463,9 +1857,6 @@ mqtt_message_t *mqtt5_msg_pubcomp(mqtt_connection_t *connection, uint16_t messag
     }
 
     connection->buffer[connection->outbound_message.length ++] = 0; // Regard it is success
-    int properties_offset = connection->outbound_message.length;
-    connection->outbound_message.length ++;
-    APPEND_CHECK(update_property_len_value(connection, connection->outbound_message.length - properties_offset - 1,
-                                           properties_offset), fail_message(connection));
+    connection->buffer[connection->outbound_message.length ++] = 0; // No properties
     return fini_message(connection, MQTT_MSG_TYPE_PUBCOMP, 0, 0, 0);
 }
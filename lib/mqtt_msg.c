@@ -117,6 +117,21 @@ static mqtt_message_t *fini_message(mqtt_connection_t *connection, int type, int
     return &connection->outbound_message;
 }
 
+static void append_publish_payload(mqtt_connection_t *connection, const char *data, int data_length)
+{
+    if (data_length > 0 && (data == NULL ||
+                            connection->outbound_message.length + data_length > connection->buffer_length)) {
+        // Payload is written from the caller's memory after the header (it doesn't fit the buffer or the
+        // caller sends it), encode only the header reserving space for the payload
+        connection->outbound_message.fragmented_msg_data_offset = connection->outbound_message.length;
+        connection->outbound_message.fragmented_msg_total_length = data_length + connection->outbound_message.length;
+    } else if (data != NULL) {
+        memcpy(connection->buffer + connection->outbound_message.length, data, data_length);
+        connection->outbound_message.length += data_length;
+        connection->outbound_message.fragmented_msg_total_length = 0;
+    }
+}
+
 size_t mqtt_get_total_length(const uint8_t *buffer, size_t length, int *fixed_size_len)
 {
     int i;
@@ -446,10 +461,6 @@ mqtt_message_t *mqtt_msg_publish(mqtt_connection_t *connection, const char *topi
         return fail_message(connection);
     }
 
-    if (data == NULL && data_length > 0) {
-        return fail_message(connection);
-    }
-
     if (qos > 0) {
         if ((*message_id = append_message_id(connection, 0)) == 0) {
             return fail_message(connection);
@@ -458,22 +469,41 @@ mqtt_message_t *mqtt_msg_publish(mqtt_connection_t *connection, const char *topi
         *message_id = 0;
     }
 
-    if (data != NULL) {
-        if (connection->outbound_message.length + data_length > connection->buffer_length) {
-            // Not enough size in buffer -> fragment this message
-            connection->outbound_message.fragmented_msg_data_offset = connection->outbound_message.length;
-            memcpy(connection->buffer + connection->outbound_message.length, data,
-                   connection->buffer_length - connection->outbound_message.length);
-            connection->outbound_message.length = connection->buffer_length;
-            connection->outbound_message.fragmented_msg_total_length = data_length +
-                                                                       connection->outbound_message.fragmented_msg_data_offset;
-        } else {
-            memcpy(connection->buffer + connection->outbound_message.length, data, data_length);
-            connection->outbound_message.length += data_length;
-            connection->outbound_message.fragmented_msg_total_length = 0;
+    append_publish_payload(connection, data, data_length);
+    return fini_message(connection, MQTT_MSG_TYPE_PUBLISH, 0, qos, retain);
+}
+
+/*
+ * Encodes a publish message from its variable header encoded beforehand (topic, message id placeholder at id_offset
+ * and MQTT5 properties), only the message id and the remaining length are generated
+ */
+mqtt_message_t *mqtt_msg_publish_template(mqtt_connection_t *connection, const uint8_t *header, size_t header_len,
+                                          size_t id_offset, const char *data, int data_length, int qos, int retain,
+                                          uint16_t *message_id)
+{
+    set_message_header_size(connection);
+
+    if (connection->outbound_message.length + header_len > connection->buffer_length) {
+        return fail_message(connection);
+    }
+
+    memcpy(connection->buffer + connection->outbound_message.length, header, header_len);
+
+    if (qos > 0) {
+        // the message id placeholder is overwritten in place
+        connection->outbound_message.length += id_offset;
+
+        if ((*message_id = append_message_id(connection, 0)) == 0) {
+            return fail_message(connection);
         }
+
+        connection->outbound_message.length = MQTT_MAX_FIXED_HEADER_SIZE;
+    } else {
+        *message_id = 0;
     }
 
+    connection->outbound_message.length += header_len;
+    append_publish_payload(connection, data, data_length);
     return fini_message(connection, MQTT_MSG_TYPE_PUBLISH, 0, qos, retain);
 }
 
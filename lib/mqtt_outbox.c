@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "mqtt_outbox.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +16,19 @@
 #ifndef CONFIG_MQTT_CUSTOM_OUTBOX
 static const char *TAG = "outbox";
 
+/* Initial number of msg_id index buckets, must be a power of two */
+#define OUTBOX_INDEX_INITIAL_BUCKETS 16
+#define OUTBOX_HEAP_INITIAL_CAPACITY 16
+#define OUTBOX_PENDING_STATES (CONFIRMED + 1)
+#define OUTBOX_ARENA_ALIGN 8
+#define OUTBOX_ARENA_ALIGN_UP(x) (((x) + OUTBOX_ARENA_ALIGN - 1) & ~(size_t)(OUTBOX_ARENA_ALIGN - 1))
+
+typedef enum {
+    OUTBOX_HEAP_EXPIRY,                     /*!< all items, by tick */
+    OUTBOX_HEAP_RETRANSMIT,                 /*!< transmitted and acknowledged items, by retransmission due */
+    OUTBOX_HEAPS
+} outbox_heap_kind_t;
+
 typedef struct outbox_item {
     char *buffer;
     int len;
@@ -22,51 +36,481 @@ typedef struct outbox_item {
     int msg_type;
     int msg_qos;
     outbox_tick_t tick;
+    outbox_tick_t transmit_tick;            /*!< last write of the item, retransmissions included */
+    outbox_tick_t due;                      /*!< when the item is to be retransmitted if not acknowledged */
+    int retransmits;
     pending_state_t pending;
-    STAILQ_ENTRY(outbox_item) next;
+    uint64_t seq;                           /*!< enqueue order, used to keep the state lists sorted */
+    size_t heap_pos[OUTBOX_HEAPS];          /*!< position in the expiry and retransmit heaps */
+    uint8_t *ref_data;                      /*!< caller owned data following the buffer on the wire, not copied */
+    size_t ref_len;
+    outbox_free_cb_t ref_free;              /*!< releases ref_data once the item is deleted */
+    void *ref_free_ctx;
+#if MQTT_OUTBOX_ARENA
+    size_t arena_len;                       /*!< size of the arena record, 0 for heap allocated items */
+    bool released;                          /*!< deleted, waiting for the arena head to reclaim it */
+#endif
+    TAILQ_ENTRY(outbox_item) next;
+    TAILQ_ENTRY(outbox_item) index_next;    /*!< link in the msg_id index bucket */
+    TAILQ_ENTRY(outbox_item) state_next;    /*!< link in the list of its pending state */
 } outbox_item_t;
 
-STAILQ_HEAD(outbox_list_t, outbox_item);
+TAILQ_HEAD(outbox_list_t, outbox_item);
+
+/*
+ * Items are kept in a single list in enqueue order, and additionally hashed by msg_id
+ * so that lookups done for every ACK from the broker do not need to walk the whole outbox.
+ * Buckets are appended to in enqueue order, so items sharing the same msg_id (e.g. QoS0
+ * messages, which all use id 0) are still returned oldest first.
+ * Each item is also linked in the list of its pending state, sorted in enqueue order,
+ * so dequeue only looks at the head of the requested state.
+ * The expiry heap is a binary min-heap ordered by tick, so expiry only touches the items
+ * that are actually due. Likewise, the items waiting for an acknowledgement are in a min-heap
+ * ordered by the time of their retransmission.
+ */
+#if MQTT_OUTBOX_ARENA
+/*
+ * Ring of records, each holding the item followed by its data. Records are allocated at
+ * the tail and reclaimed from the head, so in the usual case of in order ACKs the arena never
+ * fragments. Items deleted out of order are only marked released and reclaimed once all
+ * older records are gone, enqueues which don't fit meanwhile are allocated from the heap.
+ * While wrapped, the live records are [head, wrap) followed by [0, tail).
+ */
+typedef struct outbox_arena {
+    uint8_t *base;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t wrap;
+    bool wrapped;
+    size_t records;
+    size_t pinned;
+    size_t used;
+    size_t fallback_items;
+} outbox_arena_t;
+#endif
+
+typedef struct outbox_heap {
+    outbox_item_handle_t *entries;
+    size_t count;
+    size_t capacity;
+} outbox_heap_t;
 
 struct outbox_t {
     _Atomic uint64_t size;
     struct outbox_list_t *list;
+    struct outbox_list_t *index;
+    size_t index_buckets;
+    size_t items;
+    uint64_t next_seq;
+    struct outbox_list_t states[OUTBOX_PENDING_STATES];
+    outbox_item_handle_t state_hint[OUTBOX_PENDING_STATES];    /*!< last item inserted out of order */
+    outbox_heap_t heaps[OUTBOX_HEAPS];
+#if MQTT_OUTBOX_ARENA
+    outbox_arena_t arena;
+#endif
 };
 
+static inline struct outbox_list_t *outbox_index_bucket(outbox_handle_t outbox, int msg_id)
+{
+    return &outbox->index[(unsigned)msg_id & (outbox->index_buckets - 1)];
+}
+
+static struct outbox_list_t *outbox_index_alloc(size_t buckets)
+{
+    struct outbox_list_t *index = calloc(buckets, sizeof(struct outbox_list_t));
+    ESP_MEM_CHECK(TAG, index, return NULL);
+
+    for (size_t i = 0; i < buckets; i++) {
+        TAILQ_INIT(&index[i]);
+    }
+
+    return index;
+}
+
+/*
+ * Doubles the number of buckets once the load factor exceeds one. Items are re-inserted
+ * walking the outbox list, which keeps per-bucket enqueue order. If the allocation fails
+ * the current index is kept, lookups just get slower.
+ */
+static void outbox_index_grow(outbox_handle_t outbox)
+{
+    size_t buckets = outbox->index_buckets * 2;
+    struct outbox_list_t *index = outbox_index_alloc(buckets);
+
+    if (index == NULL) {
+        return;
+    }
+
+    free(outbox->index);
+    outbox->index = index;
+    outbox->index_buckets = buckets;
+    outbox_item_handle_t item;
+    TAILQ_FOREACH(item, outbox->list, next) {
+        TAILQ_INSERT_TAIL(outbox_index_bucket(outbox, item->msg_id), item, index_next);
+    }
+}
+
+/*
+ * Transitions normally happen in enqueue order, so the item goes to the tail. Items moved
+ * back out of order (e.g. TRANSMITTED messages requeued after reconnect) are inserted
+ * starting from the previous out of order insertion, so moving a run of consecutive items
+ * costs O(1) per item.
+ */
+static void outbox_state_insert(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    struct outbox_list_t *list = &outbox->states[item->pending];
+    outbox_item_handle_t pos = TAILQ_LAST(list, outbox_list_t);
+
+    if (pos == NULL || pos->seq < item->seq) {
+        TAILQ_INSERT_TAIL(list, item, state_next);
+        return;
+    }
+
+    pos = outbox->state_hint[item->pending] ? outbox->state_hint[item->pending] : TAILQ_FIRST(list);
+
+    while (pos->seq < item->seq) {
+        pos = TAILQ_NEXT(pos, state_next);
+    }
+
+    outbox_item_handle_t prev;
+
+    while ((prev = TAILQ_PREV(pos, outbox_list_t, state_next)) != NULL && prev->seq > item->seq) {
+        pos = prev;
+    }
+
+    TAILQ_INSERT_BEFORE(pos, item, state_next);
+    outbox->state_hint[item->pending] = item;
+}
+
+static void outbox_state_remove(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    if (outbox->state_hint[item->pending] == item) {
+        outbox->state_hint[item->pending] = NULL;
+    }
+
+    TAILQ_REMOVE(&outbox->states[item->pending], item, state_next);
+}
+
+static inline bool outbox_waits_for_ack(pending_state_t pending)
+{
+    return pending == TRANSMITTED || pending == ACKNOWLEDGED;
+}
+
+static inline outbox_tick_t outbox_heap_key(outbox_heap_kind_t kind, outbox_item_handle_t item)
+{
+    return kind == OUTBOX_HEAP_EXPIRY ? item->tick : item->due;
+}
+
+static inline bool outbox_heap_less(outbox_heap_kind_t kind, outbox_item_handle_t a, outbox_item_handle_t b)
+{
+    outbox_tick_t key_a = outbox_heap_key(kind, a);
+    outbox_tick_t key_b = outbox_heap_key(kind, b);
+    return key_a < key_b || (key_a == key_b && a->seq < b->seq);
+}
+
+static inline void outbox_heap_place(outbox_handle_t outbox, outbox_heap_kind_t kind, outbox_item_handle_t item,
+                                     size_t pos)
+{
+    outbox->heaps[kind].entries[pos] = item;
+    item->heap_pos[kind] = pos;
+}
+
+static void outbox_heap_sift_up(outbox_handle_t outbox, outbox_heap_kind_t kind, size_t pos)
+{
+    outbox_item_handle_t *entries = outbox->heaps[kind].entries;
+    outbox_item_handle_t item = entries[pos];
+
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+
+        if (!outbox_heap_less(kind, item, entries[parent])) {
+            break;
+        }
+
+        outbox_heap_place(outbox, kind, entries[parent], pos);
+        pos = parent;
+    }
+
+    outbox_heap_place(outbox, kind, item, pos);
+}
+
+static void outbox_heap_sift_down(outbox_handle_t outbox, outbox_heap_kind_t kind, size_t pos)
+{
+    outbox_item_handle_t *entries = outbox->heaps[kind].entries;
+    size_t count = outbox->heaps[kind].count;
+    outbox_item_handle_t item = entries[pos];
+
+    for (;;) {
+        size_t child = 2 * pos + 1;
+
+        if (child >= count) {
+            break;
+        }
+
+        if (child + 1 < count && outbox_heap_less(kind, entries[child + 1], entries[child])) {
+            child++;
+        }
+
+        if (!outbox_heap_less(kind, entries[child], item)) {
+            break;
+        }
+
+        outbox_heap_place(outbox, kind, entries[child], pos);
+        pos = child;
+    }
+
+    outbox_heap_place(outbox, kind, item, pos);
+}
+
+static void outbox_heap_update(outbox_handle_t outbox, outbox_heap_kind_t kind, outbox_item_handle_t item)
+{
+    size_t pos = item->heap_pos[kind];
+    outbox_heap_sift_up(outbox, kind, pos);
+
+    if (item->heap_pos[kind] == pos) {
+        outbox_heap_sift_down(outbox, kind, pos);
+    }
+}
+
+/* There is always room, as the heaps are reserved for all the items on enqueue */
+static void outbox_heap_push(outbox_handle_t outbox, outbox_heap_kind_t kind, outbox_item_handle_t item)
+{
+    size_t pos = outbox->heaps[kind].count++;
+    outbox_heap_place(outbox, kind, item, pos);
+    outbox_heap_sift_up(outbox, kind, pos);
+}
+
+/* The last heap slot is moved into the hole */
+static void outbox_heap_remove(outbox_handle_t outbox, outbox_heap_kind_t kind, outbox_item_handle_t item)
+{
+    outbox_heap_t *heap = &outbox->heaps[kind];
+    outbox_item_handle_t last = heap->entries[--heap->count];
+
+    if (last != item) {
+        outbox_heap_place(outbox, kind, last, item->heap_pos[kind]);
+        outbox_heap_update(outbox, kind, last);
+    }
+}
+
+static esp_err_t outbox_heap_reserve(outbox_handle_t outbox, size_t items)
+{
+    for (int kind = 0; kind < OUTBOX_HEAPS; kind++) {
+        outbox_heap_t *heap = &outbox->heaps[kind];
+
+        if (items <= heap->capacity) {
+            continue;
+        }
+
+        size_t capacity = heap->capacity ? heap->capacity * 2 : OUTBOX_HEAP_INITIAL_CAPACITY;
+        outbox_item_handle_t *entries = realloc(heap->entries, capacity * sizeof(outbox_item_handle_t));
+        ESP_MEM_CHECK(TAG, entries, return ESP_ERR_NO_MEM);
+        heap->entries = entries;
+        heap->capacity = capacity;
+    }
+
+    return ESP_OK;
+}
+
+/* Every item of the outbox is in the expiry heap, at the position it records */
+static inline bool outbox_item_is_linked(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    const outbox_heap_t *heap = &outbox->heaps[OUTBOX_HEAP_EXPIRY];
+    size_t pos = item->heap_pos[OUTBOX_HEAP_EXPIRY];
+    return pos < heap->count && heap->entries[pos] == item;
+}
+
+static void outbox_item_unlink(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    TAILQ_REMOVE(outbox->list, item, next);
+    TAILQ_REMOVE(outbox_index_bucket(outbox, item->msg_id), item, index_next);
+    outbox_state_remove(outbox, item);
+    outbox->items--;
+    outbox_heap_remove(outbox, OUTBOX_HEAP_EXPIRY, item);
+
+    if (outbox_waits_for_ack(item->pending)) {
+        outbox_heap_remove(outbox, OUTBOX_HEAP_RETRANSMIT, item);
+    }
+
+    outbox->size -= item->len + item->ref_len;
+}
+
+#if MQTT_OUTBOX_ARENA
+static outbox_item_handle_t outbox_arena_alloc(outbox_arena_t *arena, size_t data_len)
+{
+    size_t len = OUTBOX_ARENA_ALIGN_UP(sizeof(outbox_item_t)) + OUTBOX_ARENA_ALIGN_UP(data_len);
+    size_t offset;
+
+    if (arena->base == NULL) {
+        return NULL;
+    }
+
+    if (!arena->wrapped && arena->capacity - arena->tail >= len) {
+        offset = arena->tail;
+    } else if (!arena->wrapped && arena->head >= len) {
+        arena->wrapped = true;
+        arena->wrap = arena->tail;
+        offset = 0;
+    } else if (arena->wrapped && arena->head - arena->tail >= len) {
+        offset = arena->tail;
+    } else {
+        return NULL;
+    }
+
+    arena->tail = offset + len;
+    arena->records++;
+    arena->pinned += len;
+    arena->used += len;
+    outbox_item_handle_t item = (outbox_item_handle_t)(arena->base + offset);
+    memset(item, 0, sizeof(outbox_item_t));
+    item->arena_len = len;
+    item->buffer = (char *)item + OUTBOX_ARENA_ALIGN_UP(sizeof(outbox_item_t));
+    return item;
+}
+
+static void outbox_arena_release(outbox_arena_t *arena, outbox_item_handle_t item)
+{
+    item->released = true;
+    arena->used -= item->arena_len;
+
+    while (arena->records) {
+        outbox_item_handle_t head = (outbox_item_handle_t)(arena->base + arena->head);
+
+        if (!head->released) {
+            break;
+        }
+
+        arena->head += head->arena_len;
+        arena->pinned -= head->arena_len;
+        arena->records--;
+
+        if (arena->wrapped && arena->head == arena->wrap) {
+            arena->head = 0;
+            arena->wrapped = false;
+        }
+    }
+
+    if (arena->records == 0) {
+        arena->head = 0;
+        arena->tail = 0;
+        arena->wrapped = false;
+    }
+}
+#endif
+
+static outbox_item_handle_t outbox_item_alloc(outbox_handle_t outbox, size_t data_len)
+{
+#if MQTT_OUTBOX_ARENA
+    outbox_item_handle_t arena_item = outbox_arena_alloc(&outbox->arena, data_len);
+
+    if (arena_item) {
+        return arena_item;
+    }
+
+#endif
+    outbox_item_handle_t item = calloc(1, sizeof(outbox_item_t));
+    ESP_MEM_CHECK(TAG, item, return NULL);
+    item->buffer = heap_caps_malloc(data_len, MQTT_OUTBOX_MEMORY);
+    ESP_MEM_CHECK(TAG, item->buffer, {
+        free(item);
+        return NULL;
+    });
+#if MQTT_OUTBOX_ARENA
+
+    if (outbox->arena.base) {
+        outbox->arena.fallback_items++;
+    }
+
+#endif
+    return item;
+}
+
+static void outbox_item_free(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    if (item->ref_free) {
+        item->ref_free(item->ref_data, item->ref_free_ctx);
+    }
+
+#if MQTT_OUTBOX_ARENA
+
+    if (item->arena_len) {
+        outbox_arena_release(&outbox->arena, item);
+        return;
+    }
+
+    if (outbox->arena.base) {
+        outbox->arena.fallback_items--;
+    }
+
+#endif
+    free(item->buffer);
+    free(item);
+}
+
 outbox_handle_t outbox_init(void)
 {
     outbox_handle_t outbox = calloc(1, sizeof(struct outbox_t));
     ESP_MEM_CHECK(TAG, outbox, return NULL);
     outbox->list = calloc(1, sizeof(struct outbox_list_t));
     ESP_MEM_CHECK(TAG, outbox->list, {free(outbox); return NULL;});
+    outbox->index = outbox_index_alloc(OUTBOX_INDEX_INITIAL_BUCKETS);
+    ESP_MEM_CHECK(TAG, outbox->index, {free(outbox->list); free(outbox); return NULL;});
+    outbox->index_buckets = OUTBOX_INDEX_INITIAL_BUCKETS;
     outbox->size = 0;
-    STAILQ_INIT(outbox->list);
+    TAILQ_INIT(outbox->list);
+
+    for (int i = 0; i < OUTBOX_PENDING_STATES; i++) {
+        TAILQ_INIT(&outbox->states[i]);
+    }
+
     return outbox;
 }
 
 outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox, outbox_message_handle_t message, outbox_tick_t tick)
 {
-    outbox_item_handle_t item = calloc(1, sizeof(outbox_item_t));
-    ESP_MEM_CHECK(TAG, item, return NULL);
+    if (outbox_heap_reserve(outbox, outbox->items + 1) != ESP_OK) {
+        return NULL;
+    }
+
+    // Referenced remaining data stays in the caller's buffer, only the header is copied
+    bool reference = message->remaining_free && message->remaining_data;
+    int copy_len = reference ? message->len : message->len + message->remaining_len;
+    outbox_item_handle_t item = outbox_item_alloc(outbox, copy_len);
+
+    if (item == NULL) {
+        return NULL;
+    }
+
     item->msg_id = message->msg_id;
     item->msg_type = message->msg_type;
     item->msg_qos = message->msg_qos;
     item->tick = tick;
-    item->len =  message->len + message->remaining_len;
+    item->transmit_tick = tick;
+    item->due = tick;
+    item->len = copy_len;
     item->pending = QUEUED;
-    item->buffer = heap_caps_malloc(message->len + message->remaining_len, MQTT_OUTBOX_MEMORY);
-    ESP_MEM_CHECK(TAG, item->buffer, {
-        free(item);
-        return NULL;
-    });
+    item->seq = outbox->next_seq++;
     memcpy(item->buffer, message->data, message->len);
 
-    if (message->remaining_data) {
+    if (reference) {
+        item->ref_data = message->remaining_data;
+        item->ref_len = message->remaining_len;
+        item->ref_free = message->remaining_free;
+        item->ref_free_ctx = message->remaining_free_ctx;
+    } else if (message->remaining_data) {
         memcpy(item->buffer + message->len, message->remaining_data, message->remaining_len);
     }
 
-    STAILQ_INSERT_TAIL(outbox->list, item, next);
-    outbox->size += item->len;
+    if (outbox->items >= outbox->index_buckets) {
+        outbox_index_grow(outbox);
+    }
+
+    TAILQ_INSERT_TAIL(outbox->list, item, next);
+    TAILQ_INSERT_TAIL(outbox_index_bucket(outbox, item->msg_id), item, index_next);
+    TAILQ_INSERT_TAIL(&outbox->states[QUEUED], item, state_next);
+    outbox->items++;
+    outbox_heap_push(outbox, OUTBOX_HEAP_EXPIRY, item);
+    outbox->size += item->len + item->ref_len;
     ESP_LOGD(TAG, "ENQUEUE msgid=%d, msg_type=%d, len=%d, size=%"PRIu64, message->msg_id, message->msg_type,
              message->len + message->remaining_len, outbox_get_size(outbox));
     return item;
@@ -75,7 +519,7 @@ outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox, outbox_message_handl
 outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id)
 {
     outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox->list, next) {
+    TAILQ_FOREACH(item, outbox_index_bucket(outbox, msg_id), index_next) {
         if (item->msg_id == msg_id) {
             return item;
         }
@@ -85,34 +529,26 @@ outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id)
 
 outbox_item_handle_t outbox_dequeue(outbox_handle_t outbox, pending_state_t pending, outbox_tick_t *tick)
 {
-    outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox->list, next) {
-        if (item->pending == pending) {
-            if (tick) {
-                *tick = item->tick;
-            }
+    outbox_item_handle_t item = TAILQ_FIRST(&outbox->states[pending]);
 
-            return item;
-        }
+    if (item && tick) {
+        *tick = item->tick;
     }
-    return NULL;
+
+    return item;
 }
 
 esp_err_t outbox_delete_item(outbox_handle_t outbox, outbox_item_handle_t item_to_delete)
 {
-    outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox->list, next) {
-        if (item == item_to_delete) {
-            STAILQ_REMOVE(outbox->list, item, outbox_item, next);
-            outbox->size -= item->len;
-            ESP_LOGD(TAG, "DELETE_ITEM msgid=%d, msg_type=%d, remain size=%"PRIu64, item_to_delete->msg_id,
-                     item_to_delete->msg_type, outbox_get_size(outbox));
-            free(item->buffer);
-            free(item);
-            return ESP_OK;
-        }
+    if (item_to_delete == NULL || !outbox_item_is_linked(outbox, item_to_delete)) {
+        return ESP_FAIL;
     }
-    return ESP_FAIL;
+
+    outbox_item_unlink(outbox, item_to_delete);
+    ESP_LOGD(TAG, "DELETE_ITEM msgid=%d, msg_type=%d, remain size=%"PRIu64, item_to_delete->msg_id,
+             item_to_delete->msg_type, outbox_get_size(outbox));
+    outbox_item_free(outbox, item_to_delete);
+    return ESP_OK;
 }
 
 uint8_t *outbox_item_get_data(outbox_item_handle_t item,  size_t *len, uint16_t *msg_id, int *msg_type, int *qos)
@@ -128,16 +564,25 @@ uint8_t *outbox_item_get_data(outbox_item_handle_t item,  size_t *len, uint16_t
     return NULL;
 }
 
+uint8_t *outbox_item_get_remaining_data(outbox_item_handle_t item, size_t *len)
+{
+    if (item && item->ref_data) {
+        *len = item->ref_len;
+        return item->ref_data;
+    }
+
+    *len = 0;
+    return NULL;
+}
+
 esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type)
 {
-    outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox->list, next, tmp) {
+    outbox_item_handle_t item;
+    TAILQ_FOREACH(item, outbox_index_bucket(outbox, msg_id), index_next) {
         if (item->msg_id == msg_id && (0xFF & (item->msg_type)) == msg_type) {
-            STAILQ_REMOVE(outbox->list, item, outbox_item, next);
-            outbox->size -= item->len;
+            outbox_item_unlink(outbox, item);
             ESP_LOGD(TAG, "DELETE msgid=%d, msg_type=%d, remain size=%"PRIu64, msg_id, msg_type, outbox_get_size(outbox));
-            free(item->buffer);
-            free(item);
+            outbox_item_free(outbox, item);
             return ESP_OK;
         }
     }
@@ -149,7 +594,19 @@ esp_err_t outbox_set_pending(outbox_handle_t outbox, int msg_id, pending_state_t
     outbox_item_handle_t item = outbox_get(outbox, msg_id);
 
     if (item) {
-        item->pending = pending;
+        if (item->pending != pending) {
+            bool waited_for_ack = outbox_waits_for_ack(item->pending);
+            outbox_state_remove(outbox, item);
+            item->pending = pending;
+            outbox_state_insert(outbox, item);
+
+            if (waited_for_ack && !outbox_waits_for_ack(pending)) {
+                outbox_heap_remove(outbox, OUTBOX_HEAP_RETRANSMIT, item);
+            } else if (!waited_for_ack && outbox_waits_for_ack(pending)) {
+                outbox_heap_push(outbox, OUTBOX_HEAP_RETRANSMIT, item);
+            }
+        }
+
         return ESP_OK;
     }
 
@@ -171,44 +628,80 @@ esp_err_t outbox_set_tick(outbox_handle_t outbox, int msg_id, outbox_tick_t tick
 
     if (item) {
         item->tick = tick;
+        outbox_heap_update(outbox, OUTBOX_HEAP_EXPIRY, item);
+        return ESP_OK;
+    }
+
+    return ESP_FAIL;
+}
+
+esp_err_t outbox_set_transmitted(outbox_handle_t outbox, int msg_id, outbox_tick_t tick, int retransmits,
+                                 outbox_tick_t due)
+{
+    outbox_item_handle_t item = outbox_get(outbox, msg_id);
+
+    if (item) {
+        item->transmit_tick = tick;
+        item->retransmits = retransmits;
+        item->due = due;
+
+        if (outbox_waits_for_ack(item->pending)) {
+            outbox_heap_update(outbox, OUTBOX_HEAP_RETRANSMIT, item);
+        }
+
         return ESP_OK;
     }
 
     return ESP_FAIL;
 }
 
+outbox_item_handle_t outbox_get_next_retransmit(outbox_handle_t outbox, outbox_tick_t *due)
+{
+    if (outbox->heaps[OUTBOX_HEAP_RETRANSMIT].count == 0) {
+        return NULL;
+    }
+
+    outbox_item_handle_t item = outbox->heaps[OUTBOX_HEAP_RETRANSMIT].entries[0];
+    *due = item->due;
+    return item;
+}
+
+int outbox_item_get_retransmits(outbox_item_handle_t item, outbox_tick_t *transmit_tick)
+{
+    if (transmit_tick) {
+        *transmit_tick = item->transmit_tick;
+    }
+
+    return item->retransmits;
+}
+
 int outbox_delete_single_expired(outbox_handle_t outbox, outbox_tick_t current_tick, outbox_tick_t timeout)
 {
     int msg_id = -1;
-    outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox->list, next) {
-        if (current_tick - item->tick > timeout) {
-            STAILQ_REMOVE(outbox->list, item, outbox_item, next);
-            free(item->buffer);
-            outbox->size -= item->len;
-            msg_id = item->msg_id;
-            free(item);
-            ESP_LOGD(TAG, "DELETE_SINGLE_EXPIRED msgid=%d, remain size=%"PRIu64, msg_id, outbox_get_size(outbox));
-            return msg_id;
-        }
+
+    if (outbox->items && current_tick - outbox->heaps[OUTBOX_HEAP_EXPIRY].entries[0]->tick > timeout) {
+        outbox_item_handle_t item = outbox->heaps[OUTBOX_HEAP_EXPIRY].entries[0];
+        outbox_item_unlink(outbox, item);
+        msg_id = item->msg_id;
+        outbox_item_free(outbox, item);
+        ESP_LOGD(TAG, "DELETE_SINGLE_EXPIRED msgid=%d, remain size=%"PRIu64, msg_id, outbox_get_size(outbox));
     }
+
     return msg_id;
 }
 
 int outbox_delete_expired(outbox_handle_t outbox, outbox_tick_t current_tick, outbox_tick_t timeout)
 {
     int deleted_items = 0;
-    outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox->list, next, tmp) {
-        if (current_tick - item->tick > timeout) {
-            STAILQ_REMOVE(outbox->list, item, outbox_item, next);
-            free(item->buffer);
-            outbox->size -= item->len;
-            ESP_LOGD(TAG, "DELETE_EXPIRED msgid=%d, remain size=%"PRIu64, item->msg_id, outbox_get_size(outbox));
-            free(item);
-            deleted_items ++;
-        }
+
+    while (outbox->items && current_tick - outbox->heaps[OUTBOX_HEAP_EXPIRY].entries[0]->tick > timeout) {
+        outbox_item_handle_t item = outbox->heaps[OUTBOX_HEAP_EXPIRY].entries[0];
+        outbox_item_unlink(outbox, item);
+        ESP_LOGD(TAG, "DELETE_EXPIRED msgid=%d, remain size=%"PRIu64, item->msg_id, outbox_get_size(outbox));
+        outbox_item_free(outbox, item);
+        deleted_items ++;
     }
+
     return deleted_items;
 }
 
@@ -220,20 +713,69 @@ uint64_t outbox_get_size(outbox_handle_t outbox)
 void outbox_delete_all_items(outbox_handle_t outbox)
 {
     outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox->list, next, tmp) {
-        STAILQ_REMOVE(outbox->list, item, outbox_item, next);
-        outbox->size -= item->len;
+    TAILQ_FOREACH_SAFE(item, outbox->list, next, tmp) {
+        outbox_item_unlink(outbox, item);
         ESP_LOGD(TAG, "DELETE_ALL_ITEMS msgid=%d, msg_type=%d, remain size=%"PRIu64, item->msg_id, item->msg_type,
                  outbox_get_size(outbox));
-        free(item->buffer);
-        free(item);
+        outbox_item_free(outbox, item);
     }
 }
 void outbox_destroy(outbox_handle_t outbox)
 {
     outbox_delete_all_items(outbox);
+#if MQTT_OUTBOX_ARENA
+    heap_caps_free(outbox->arena.base);
+#endif
+    for (int kind = 0; kind < OUTBOX_HEAPS; kind++) {
+        free(outbox->heaps[kind].entries);
+    }
+
+    free(outbox->index);
     free(outbox->list);
     free(outbox);
 }
 
+esp_err_t outbox_set_arena(outbox_handle_t outbox, size_t size)
+{
+#if MQTT_OUTBOX_ARENA
+
+    if (size == outbox->arena.capacity) {
+        return ESP_OK;
+    }
+
+    if (outbox->items) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t *base = NULL;
+
+    if (size) {
+        base = heap_caps_malloc(size, MQTT_OUTBOX_MEMORY);
+        ESP_MEM_CHECK(TAG, base, return ESP_ERR_NO_MEM);
+    }
+
+    heap_caps_free(outbox->arena.base);
+    memset(&outbox->arena, 0, sizeof(outbox->arena));
+    outbox->arena.base = base;
+    outbox->arena.capacity = size;
+    ESP_LOGD(TAG, "ARENA size=%zu", size);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t outbox_get_arena_info(outbox_handle_t outbox, outbox_arena_info_t *info)
+{
+#if MQTT_OUTBOX_ARENA
+    info->capacity = outbox->arena.capacity;
+    info->used = outbox->arena.used;
+    info->pinned = outbox->arena.pinned;
+    info->fallback_items = outbox->arena.fallback_items;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
 #endif /* CONFIG_MQTT_CUSTOM_OUTBOX */
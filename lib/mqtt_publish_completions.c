@@ -0,0 +1,223 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "mqtt_publish_completions.h"
+#include <stdlib.h>
+#include "esp_log.h"
+#include "mqtt_hash_probe.h"
+#include "platform.h"
+
+static const char *TAG = "mqtt_completions";
+
+/* Initial number of buckets, must be a power of two */
+#define MQTT_PUBLISH_COMPLETIONS_INITIAL_SIZE 16
+/* Initial number of queued completions, must be a power of two */
+#define MQTT_PUBLISH_COMPLETIONS_INITIAL_QUEUED 4
+
+typedef struct {
+    esp_mqtt_publish_complete_cb_t complete_cb;     // NULL for a free bucket
+    void *complete_ctx;
+    uint16_t msg_id;
+} mqtt_publish_completion_t;
+
+typedef struct {
+    esp_mqtt_publish_complete_cb_t complete_cb;
+    void *complete_ctx;
+    uint32_t position;
+} mqtt_queued_completion_t;
+
+struct mqtt_publish_completions {
+    mqtt_publish_completion_t *buckets;             // see mqtt_hash_probe.h
+    size_t mask;
+    size_t used;
+    mqtt_queued_completion_t *queued;               // ring of the queued completions, oldest first
+    size_t queued_size;                             // 0 or a power of two
+    size_t queued_head;
+    size_t queued_count;
+};
+
+static size_t mqtt_publish_completion_home(uint16_t msg_id, size_t mask)
+{
+    // the low bits of an odd multiple put consecutive ids in distinct buckets, and random ids in random ones
+    return ((uint32_t)msg_id * 40503u) & mask;
+}
+
+static bool mqtt_publish_completion_used(const void *buckets, size_t bucket, size_t mask, size_t *home)
+{
+    const mqtt_publish_completion_t *completion = (const mqtt_publish_completion_t *)buckets + bucket;
+
+    if (!completion->complete_cb) {
+        return false;
+    }
+
+    *home = mqtt_publish_completion_home(completion->msg_id, mask);
+    return true;
+}
+
+static void mqtt_publish_completion_move(void *buckets, size_t from, size_t to)
+{
+    ((mqtt_publish_completion_t *)buckets)[to] = ((mqtt_publish_completion_t *)buckets)[from];
+}
+
+mqtt_publish_completions_handle_t mqtt_publish_completions_create(void)
+{
+    mqtt_publish_completions_handle_t completions = calloc(1, sizeof(struct mqtt_publish_completions));
+    ESP_MEM_CHECK(TAG, completions, return NULL);
+    completions->buckets = calloc(MQTT_PUBLISH_COMPLETIONS_INITIAL_SIZE, sizeof(mqtt_publish_completion_t));
+    ESP_MEM_CHECK(TAG, completions->buckets, {
+        free(completions);
+        return NULL;
+    });
+    completions->mask = MQTT_PUBLISH_COMPLETIONS_INITIAL_SIZE - 1;
+    return completions;
+}
+
+void mqtt_publish_completions_destroy(mqtt_publish_completions_handle_t completions)
+{
+    if (completions) {
+        free(completions->queued);
+        free(completions->buckets);
+        free(completions);
+    }
+}
+
+esp_err_t mqtt_publish_completions_reserve(mqtt_publish_completions_handle_t completions)
+{
+    // keep the table at most three quarters full
+    if ((completions->used + 1) * 4 <= (completions->mask + 1) * 3) {
+        return ESP_OK;
+    }
+
+    size_t size = (completions->mask + 1) * 2;
+    mqtt_publish_completion_t *buckets = calloc(size, sizeof(mqtt_publish_completion_t));
+    ESP_MEM_CHECK(TAG, buckets, return ESP_ERR_NO_MEM);
+    mqtt_publish_completion_t *old = completions->buckets;
+    size_t old_size = completions->mask + 1;
+    completions->buckets = buckets;
+    completions->mask = size - 1;
+
+    for (size_t i = 0; i < old_size; i ++) {
+        if (old[i].complete_cb) {
+            size_t j = mqtt_hash_probe_free(buckets, mqtt_publish_completion_home(old[i].msg_id, completions->mask),
+                                            completions->mask, mqtt_publish_completion_used);
+            buckets[j] = old[i];
+        }
+    }
+
+    free(old);
+    return ESP_OK;
+}
+
+void mqtt_publish_completions_add(mqtt_publish_completions_handle_t completions, uint16_t msg_id,
+                                  esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx)
+{
+    size_t i = mqtt_hash_probe_free(completions->buckets, mqtt_publish_completion_home(msg_id, completions->mask),
+                                    completions->mask, mqtt_publish_completion_used);
+    completions->buckets[i] = (mqtt_publish_completion_t) {
+        .complete_cb = complete_cb, .complete_ctx = complete_ctx, .msg_id = msg_id
+    };
+    completions->used ++;
+}
+
+static void mqtt_publish_completion_remove(mqtt_publish_completions_handle_t completions, size_t i)
+{
+    i = mqtt_hash_probe_remove(completions->buckets, i, completions->mask, mqtt_publish_completion_used,
+                               mqtt_publish_completion_move);
+    completions->buckets[i].complete_cb = NULL;
+    completions->used --;
+}
+
+bool mqtt_publish_completions_take(mqtt_publish_completions_handle_t completions, uint16_t msg_id,
+                                   esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx)
+{
+    for (size_t i = mqtt_publish_completion_home(msg_id, completions->mask); completions->buckets[i].complete_cb;
+            i = mqtt_hash_probe_next(i, completions->mask)) {
+        if (completions->buckets[i].msg_id == msg_id) {
+            *complete_cb = completions->buckets[i].complete_cb;
+            *complete_ctx = completions->buckets[i].complete_ctx;
+            mqtt_publish_completion_remove(completions, i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+esp_err_t mqtt_publish_completions_reserve_queued(mqtt_publish_completions_handle_t completions)
+{
+    if (completions->queued_count < completions->queued_size) {
+        return ESP_OK;
+    }
+
+    size_t size = completions->queued_size ? completions->queued_size * 2 : MQTT_PUBLISH_COMPLETIONS_INITIAL_QUEUED;
+    mqtt_queued_completion_t *queued = malloc(size * sizeof(mqtt_queued_completion_t));
+    ESP_MEM_CHECK(TAG, queued, return ESP_ERR_NO_MEM);
+
+    // the ring is full, its oldest completion follows the newest one
+    for (size_t i = 0; i < completions->queued_count; i ++) {
+        queued[i] = completions->queued[(completions->queued_head + i) & (completions->queued_size - 1)];
+    }
+
+    free(completions->queued);
+    completions->queued = queued;
+    completions->queued_size = size;
+    completions->queued_head = 0;
+    return ESP_OK;
+}
+
+void mqtt_publish_completions_add_queued(mqtt_publish_completions_handle_t completions, uint32_t position,
+                                         esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx)
+{
+    size_t i = (completions->queued_head + completions->queued_count) & (completions->queued_size - 1);
+    completions->queued[i] = (mqtt_queued_completion_t) {
+        .complete_cb = complete_cb, .complete_ctx = complete_ctx, .position = position
+    };
+    completions->queued_count ++;
+}
+
+bool mqtt_publish_completions_take_queued(mqtt_publish_completions_handle_t completions, uint32_t removed,
+                                          esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx)
+{
+    if (completions->queued_count == 0) {
+        return false;
+    }
+
+    mqtt_queued_completion_t *oldest = &completions->queued[completions->queued_head];
+
+    // the counts wrap around, the message is removed if its position is not ahead of them
+    if ((int32_t)(removed - oldest->position) < 0) {
+        return false;
+    }
+
+    *complete_cb = oldest->complete_cb;
+    *complete_ctx = oldest->complete_ctx;
+    completions->queued_head = (completions->queued_head + 1) & (completions->queued_size - 1);
+    completions->queued_count --;
+    return true;
+}
+
+bool mqtt_publish_completions_take_any(mqtt_publish_completions_handle_t completions, uint16_t *msg_id,
+                                       esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx)
+{
+    if (completions->queued_count) {
+        *msg_id = 0;
+        return mqtt_publish_completions_take_queued(completions, completions->queued[completions->queued_head].position,
+                                                    complete_cb, complete_ctx);
+    }
+
+    for (size_t i = 0; completions->used && i <= completions->mask; i ++) {
+        if (completions->buckets[i].complete_cb) {
+            *msg_id = completions->buckets[i].msg_id;
+            return mqtt_publish_completions_take(completions, *msg_id, complete_cb, complete_ctx);
+        }
+    }
+
+    return false;
+}
+
+size_t mqtt_publish_completions_count(mqtt_publish_completions_handle_t completions)
+{
+    return completions->used + completions->queued_count;
+}
@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "mqtt_rtt.h"
+
+static uint32_t mqtt_rtt_clamp(const mqtt_rtt_t *rtt, uint64_t timeout)
+{
+    if (timeout < rtt->min_timeout) {
+        return rtt->min_timeout;
+    }
+
+    return timeout > rtt->max_timeout ? rtt->max_timeout : (uint32_t)timeout;
+}
+
+void mqtt_rtt_init(mqtt_rtt_t *rtt, uint32_t initial_timeout, uint32_t min_timeout, uint32_t max_timeout)
+{
+    rtt->srtt8 = 0;
+    rtt->rttvar4 = 0;
+    rtt->min_timeout = min_timeout;
+    rtt->max_timeout = max_timeout < min_timeout ? min_timeout : max_timeout;
+    rtt->timeout = mqtt_rtt_clamp(rtt, initial_timeout);
+}
+
+void mqtt_rtt_add_sample(mqtt_rtt_t *rtt, uint32_t sample)
+{
+    // longer round trips would only yield the maximal timeout, this also keeps the scaled values in range
+    if (sample > rtt->max_timeout) {
+        sample = rtt->max_timeout;
+    }
+
+    if (sample == 0) {
+        sample = 1;
+    }
+
+    if (rtt->srtt8 == 0) {
+        // SRTT = R, RTTVAR = R/2
+        rtt->srtt8 = sample * 8;
+        rtt->rttvar4 = sample * 2;
+    } else {
+        // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, then SRTT = 7/8 SRTT + 1/8 R
+        uint32_t srtt = rtt->srtt8 / 8;
+        uint32_t deviation = sample > srtt ? sample - srtt : srtt - sample;
+        rtt->rttvar4 = rtt->rttvar4 - rtt->rttvar4 / 4 + deviation;
+        rtt->srtt8 = rtt->srtt8 - rtt->srtt8 / 8 + sample;
+    }
+
+    // RTO = SRTT + 4 RTTVAR, with a clock granularity of 1 ms
+    rtt->timeout = mqtt_rtt_clamp(rtt, (uint64_t)rtt->srtt8 / 8 + (rtt->rttvar4 > 0 ? rtt->rttvar4 : 1));
+}
+
+uint32_t mqtt_rtt_get_timeout(const mqtt_rtt_t *rtt, int retransmits)
+{
+    uint64_t timeout = rtt->timeout;
+
+    for (int i = 0; i < retransmits && timeout < rtt->max_timeout; i++) {
+        timeout *= 2;
+    }
+
+    return mqtt_rtt_clamp(rtt, timeout);
+}
@@ -0,0 +1,630 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "mqtt_topic_router.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "mqtt_hash_probe.h"
+#include "platform.h"
+
+static const char *TAG = "mqtt_router";
+
+/* Initial number of edge buckets, must be a power of two */
+#define MQTT_TOPIC_ROUTER_INITIAL_EDGES 16
+#define MQTT_SHARED_SUBSCRIPTION_PREFIX "$share/"
+
+typedef struct mqtt_topic_route {
+    esp_mqtt_topic_handler_t handler;       // NULL once removed while dispatching
+    void *handler_args;
+    struct mqtt_topic_route *next;
+} mqtt_topic_route_t;
+
+typedef struct mqtt_topic_node {
+    struct mqtt_topic_node *parent;
+    struct mqtt_topic_node *single_level;   // the + child
+    struct mqtt_topic_node *multi_level;    // the # child
+    struct mqtt_topic_node *next_purge;     // next node with removed routes, see mqtt_topic_router_remove()
+    mqtt_topic_route_t *routes;
+    uint32_t children;                      // child nodes, wildcards included
+    uint32_t holds;                         // see mqtt_topic_router_hold()
+    uint32_t hash;                          // of the edge from the parent
+    bool purge;
+    uint16_t level_len;
+    char level[];                           // empty for the wildcard nodes
+} mqtt_topic_node_t;
+
+struct mqtt_topic_router {
+    mqtt_topic_node_t root;
+    mqtt_topic_node_t **edges;              // children by parent and level, see mqtt_hash_probe.h
+    size_t edges_mask;
+    size_t edges_used;
+    int dispatching;
+    mqtt_topic_node_t *purge_list;
+    size_t unheld;                          // nodes with routes which are not held
+};
+
+static uint32_t mqtt_topic_edge_hash(const mqtt_topic_node_t *parent, const char *level, size_t level_len)
+{
+    // FNV-1a of the level, seeded with the parent node
+    uint32_t hash = 2166136261u ^ (uint32_t)((uintptr_t)parent >> 3);
+
+    for (size_t i = 0; i < level_len; i ++) {
+        hash = (hash ^ (uint8_t)level[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static bool mqtt_topic_edge_used(const void *edges, size_t bucket, size_t mask, size_t *home)
+{
+    const mqtt_topic_node_t *node = ((mqtt_topic_node_t *const *)edges)[bucket];
+
+    if (!node) {
+        return false;
+    }
+
+    *home = node->hash & mask;
+    return true;
+}
+
+static void mqtt_topic_edge_move(void *edges, size_t from, size_t to)
+{
+    ((mqtt_topic_node_t **)edges)[to] = ((mqtt_topic_node_t **)edges)[from];
+}
+
+static mqtt_topic_node_t *mqtt_topic_find_edge(mqtt_topic_router_handle_t router, const mqtt_topic_node_t *parent,
+                                               const char *level, size_t level_len, size_t *bucket)
+{
+    uint32_t hash = mqtt_topic_edge_hash(parent, level, level_len);
+    size_t i = hash & router->edges_mask;
+
+    for (mqtt_topic_node_t *node; (node = router->edges[i]) != NULL; i = mqtt_hash_probe_next(i, router->edges_mask)) {
+        if (node->hash == hash && node->parent == parent && node->level_len == level_len &&
+                memcmp(node->level, level, level_len) == 0) {
+            break;
+        }
+    }
+
+    if (bucket) {
+        *bucket = i;
+    }
+
+    return router->edges[i];
+}
+
+static esp_err_t mqtt_topic_grow_edges(mqtt_topic_router_handle_t router)
+{
+    size_t size = (router->edges_mask + 1) * 2;
+    mqtt_topic_node_t **edges = calloc(size, sizeof(mqtt_topic_node_t *));
+    ESP_MEM_CHECK(TAG, edges, return ESP_ERR_NO_MEM);
+
+    for (size_t i = 0; i <= router->edges_mask; i ++) {
+        mqtt_topic_node_t *node = router->edges[i];
+
+        if (node) {
+            edges[mqtt_hash_probe_free(edges, node->hash & (size - 1), size - 1, mqtt_topic_edge_used)] = node;
+        }
+    }
+
+    free(router->edges);
+    router->edges = edges;
+    router->edges_mask = size - 1;
+    return ESP_OK;
+}
+
+static void mqtt_topic_remove_edge(mqtt_topic_router_handle_t router, mqtt_topic_node_t *node)
+{
+    size_t i = node->hash & router->edges_mask;
+
+    while (router->edges[i] != node) {
+        i = mqtt_hash_probe_next(i, router->edges_mask);
+    }
+
+    i = mqtt_hash_probe_remove(router->edges, i, router->edges_mask, mqtt_topic_edge_used, mqtt_topic_edge_move);
+    router->edges[i] = NULL;
+    router->edges_used --;
+}
+
+static mqtt_topic_node_t *mqtt_topic_new_node(mqtt_topic_node_t *parent, const char *level, size_t level_len)
+{
+    mqtt_topic_node_t *node = calloc(1, sizeof(mqtt_topic_node_t) + level_len);
+    ESP_MEM_CHECK(TAG, node, return NULL);
+    node->parent = parent;
+    node->level_len = level_len;
+    if (level_len) {
+        memcpy(node->level, level, level_len);
+    }
+
+    parent->children ++;
+    return node;
+}
+
+static mqtt_topic_node_t *mqtt_topic_add_child(mqtt_topic_router_handle_t router, mqtt_topic_node_t *parent,
+                                               const char *level, size_t level_len)
+{
+    if (level_len == 1 && level[0] == '+') {
+        if (!parent->single_level) {
+            parent->single_level = mqtt_topic_new_node(parent, NULL, 0);
+        }
+
+        return parent->single_level;
+    }
+
+    if (level_len == 1 && level[0] == '#') {
+        if (!parent->multi_level) {
+            parent->multi_level = mqtt_topic_new_node(parent, NULL, 0);
+        }
+
+        return parent->multi_level;
+    }
+
+    size_t bucket;
+    mqtt_topic_node_t *node = mqtt_topic_find_edge(router, parent, level, level_len, &bucket);
+
+    if (node) {
+        return node;
+    }
+
+    // keep the table at most three quarters full
+    if ((router->edges_used + 1) * 4 > (router->edges_mask + 1) * 3) {
+        if (mqtt_topic_grow_edges(router) != ESP_OK) {
+            return NULL;
+        }
+
+        mqtt_topic_find_edge(router, parent, level, level_len, &bucket);
+    }
+
+    node = mqtt_topic_new_node(parent, level, level_len);
+
+    if (node) {
+        node->hash = mqtt_topic_edge_hash(parent, level, level_len);
+        router->edges[bucket] = node;
+        router->edges_used ++;
+    }
+
+    return node;
+}
+
+/* Frees the nodes without routes, holds nor children, from the node up to the root */
+static void mqtt_topic_prune(mqtt_topic_router_handle_t router, mqtt_topic_node_t *node)
+{
+    while (node != &router->root && node->routes == NULL && node->holds == 0 && node->children == 0 && !node->purge) {
+        mqtt_topic_node_t *parent = node->parent;
+
+        if (parent->single_level == node) {
+            parent->single_level = NULL;
+        } else if (parent->multi_level == node) {
+            parent->multi_level = NULL;
+        } else {
+            mqtt_topic_remove_edge(router, node);
+        }
+
+        parent->children --;
+        free(node);
+        node = parent;
+    }
+}
+
+/*
+ * Returns the filter matched by a topic filter, which is the filter itself or the part after the share name
+ * of a shared subscription, or NULL if the filter is malformed
+ */
+static const char *mqtt_topic_filter_parse(const char *topic_filter)
+{
+    if (topic_filter == NULL || topic_filter[0] == '\0') {
+        return NULL;
+    }
+
+    const char *filter = topic_filter;
+
+    if (strncmp(topic_filter, MQTT_SHARED_SUBSCRIPTION_PREFIX, strlen(MQTT_SHARED_SUBSCRIPTION_PREFIX)) == 0) {
+        const char *share_name = topic_filter + strlen(MQTT_SHARED_SUBSCRIPTION_PREFIX);
+        size_t share_name_len = strcspn(share_name, "/+#");
+
+        if (share_name_len == 0 || share_name[share_name_len] != '/' || share_name[share_name_len + 1] == '\0') {
+            return NULL;
+        }
+
+        filter = share_name + share_name_len + 1;
+    }
+
+    for (const char *level = filter; ; level ++) {
+        size_t level_len = strcspn(level, "/");
+
+        if (memchr(level, '#', level_len) && (level_len != 1 || level[1] != '\0')) {
+            // # is only valid as the last level
+            return NULL;
+        }
+
+        if (memchr(level, '+', level_len) && level_len != 1) {
+            return NULL;
+        }
+
+        level += level_len;
+
+        if (*level == '\0') {
+            return filter;
+        }
+    }
+}
+
+mqtt_topic_router_handle_t mqtt_topic_router_create(void)
+{
+    mqtt_topic_router_handle_t router = calloc(1, sizeof(struct mqtt_topic_router));
+    ESP_MEM_CHECK(TAG, router, return NULL);
+    router->edges = calloc(MQTT_TOPIC_ROUTER_INITIAL_EDGES, sizeof(mqtt_topic_node_t *));
+    ESP_MEM_CHECK(TAG, router->edges, {
+        free(router);
+        return NULL;
+    });
+    router->edges_mask = MQTT_TOPIC_ROUTER_INITIAL_EDGES - 1;
+    return router;
+}
+
+static void mqtt_topic_free_node(mqtt_topic_node_t *node)
+{
+    mqtt_topic_route_t *route = node->routes;
+
+    while (route) {
+        mqtt_topic_route_t *next = route->next;
+        free(route);
+        route = next;
+    }
+
+    free(node);
+}
+
+/* Frees the wildcard children of a node, and theirs. Their other children are in the edge table */
+static void mqtt_topic_free_wildcards(mqtt_topic_node_t *node)
+{
+    mqtt_topic_node_t *wildcards[] = { node->single_level, node->multi_level };
+
+    for (int i = 0; i < 2; i ++) {
+        if (wildcards[i]) {
+            mqtt_topic_free_wildcards(wildcards[i]);
+            mqtt_topic_free_node(wildcards[i]);
+        }
+    }
+}
+
+void mqtt_topic_router_destroy(mqtt_topic_router_handle_t router)
+{
+    if (router == NULL) {
+        return;
+    }
+
+    mqtt_topic_free_wildcards(&router->root);
+
+    for (size_t i = 0; i <= router->edges_mask; i ++) {
+        if (router->edges[i]) {
+            mqtt_topic_free_wildcards(router->edges[i]);
+        }
+    }
+
+    for (size_t i = 0; i <= router->edges_mask; i ++) {
+        if (router->edges[i]) {
+            mqtt_topic_free_node(router->edges[i]);
+        }
+    }
+
+    mqtt_topic_route_t *route = router->root.routes;
+
+    while (route) {
+        mqtt_topic_route_t *next = route->next;
+        free(route);
+        route = next;
+    }
+
+    free(router->edges);
+    free(router);
+}
+
+/* Returns the node of the filter, adding the missing levels if add is set */
+static mqtt_topic_node_t *mqtt_topic_filter_node(mqtt_topic_router_handle_t router, const char *filter, bool add)
+{
+    mqtt_topic_node_t *node = &router->root;
+
+    for (const char *level = filter; node; level ++) {
+        size_t level_len = strcspn(level, "/");
+
+        if (add) {
+            mqtt_topic_node_t *child = mqtt_topic_add_child(router, node, level, level_len);
+
+            if (child == NULL) {
+                // drop the levels added for this filter
+                mqtt_topic_prune(router, node);
+                return NULL;
+            }
+
+            node = child;
+        } else if (level_len == 1 && level[0] == '+') {
+            node = node->single_level;
+        } else if (level_len == 1 && level[0] == '#') {
+            node = node->multi_level;
+        } else {
+            node = mqtt_topic_find_edge(router, node, level, level_len, NULL);
+        }
+
+        level += level_len;
+
+        if (*level == '\0') {
+            break;
+        }
+    }
+
+    return node;
+}
+
+esp_err_t mqtt_topic_router_add(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                esp_mqtt_topic_handler_t handler, void *handler_args)
+{
+    const char *filter = mqtt_topic_filter_parse(topic_filter);
+
+    if (filter == NULL || handler == NULL) {
+        ESP_LOGE(TAG, "Invalid topic filter %s", topic_filter ? topic_filter : "(null)");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mqtt_topic_route_t *route = calloc(1, sizeof(mqtt_topic_route_t));
+    ESP_MEM_CHECK(TAG, route, return ESP_ERR_NO_MEM);
+    mqtt_topic_node_t *node = mqtt_topic_filter_node(router, filter, true);
+    ESP_MEM_CHECK(TAG, node, {
+        free(route);
+        return ESP_ERR_NO_MEM;
+    });
+    route->handler = handler;
+    route->handler_args = handler_args;
+
+    if (node->routes == NULL && node->holds == 0) {
+        router->unheld ++;
+    }
+
+    // handlers are called in the order they were added
+    mqtt_topic_route_t **last = &node->routes;
+
+    while (*last) {
+        last = &(*last)->next;
+    }
+
+    *last = route;
+    return ESP_OK;
+}
+
+/* Frees the routes removed while dispatching, and the nodes left without routes */
+static void mqtt_topic_purge(mqtt_topic_router_handle_t router)
+{
+    while (router->purge_list) {
+        mqtt_topic_node_t *node = router->purge_list;
+        router->purge_list = node->next_purge;
+        node->purge = false;
+        bool routed = node->routes != NULL;
+
+        for (mqtt_topic_route_t **route = &node->routes; *route;) {
+            if ((*route)->handler == NULL) {
+                mqtt_topic_route_t *removed = *route;
+                *route = removed->next;
+                free(removed);
+            } else {
+                route = &(*route)->next;
+            }
+        }
+
+        if (routed && node->routes == NULL && node->holds == 0) {
+            router->unheld --;
+        }
+
+        // nodes still in the purge list are not pruned until their turn
+        mqtt_topic_prune(router, node);
+    }
+}
+
+/* Purges the node once the dispatch is over, as the nodes being matched must not be freed */
+static void mqtt_topic_defer_purge(mqtt_topic_router_handle_t router, mqtt_topic_node_t *node)
+{
+    if (!node->purge) {
+        node->purge = true;
+        node->next_purge = router->purge_list;
+        router->purge_list = node;
+    }
+}
+
+esp_err_t mqtt_topic_router_remove(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                   esp_mqtt_topic_handler_t handler, void *handler_args)
+{
+    const char *filter = mqtt_topic_filter_parse(topic_filter);
+
+    if (filter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mqtt_topic_node_t *node = mqtt_topic_filter_node(router, filter, false);
+
+    for (mqtt_topic_route_t **route = node ? &node->routes : NULL; route && *route; route = &(*route)->next) {
+        if ((*route)->handler != handler || (*route)->handler_args != handler_args) {
+            continue;
+        }
+
+        if (router->dispatching) {
+            // the route may be the one being called, it is freed once the dispatch is over
+            (*route)->handler = NULL;
+            mqtt_topic_defer_purge(router, node);
+        } else {
+            mqtt_topic_route_t *removed = *route;
+            *route = removed->next;
+            free(removed);
+
+            if (node->routes == NULL && node->holds == 0) {
+                router->unheld --;
+            }
+
+            mqtt_topic_prune(router, node);
+        }
+
+        return ESP_OK;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+static size_t mqtt_topic_call_routes(mqtt_topic_node_t *node, esp_mqtt_event_handle_t event)
+{
+    size_t called = 0;
+
+    for (mqtt_topic_route_t *route = node->routes; route; route = route->next) {
+        if (route->handler) {
+            route->handler(route->handler_args, event);
+            called ++;
+        }
+    }
+
+    return called;
+}
+
+/* Matches the levels from level (NULL once all levels are matched) up to end against the children of node */
+static size_t mqtt_topic_match(mqtt_topic_router_handle_t router, mqtt_topic_node_t *node, const char *level,
+                               const char *end, bool wildcards, esp_mqtt_event_handle_t event)
+{
+    size_t called = 0;
+
+    // # also matches the parent level
+    if (node->multi_level && wildcards) {
+        called += mqtt_topic_call_routes(node->multi_level, event);
+    }
+
+    if (level == NULL) {
+        return called + mqtt_topic_call_routes(node, event);
+    }
+
+    const char *level_end = memchr(level, '/', end - level);
+    const char *next = level_end ? level_end + 1 : NULL;
+    level_end = level_end ? level_end : end;
+    mqtt_topic_node_t *child = mqtt_topic_find_edge(router, node, level, level_end - level, NULL);
+
+    if (child) {
+        called += mqtt_topic_match(router, child, next, end, true, event);
+    }
+
+    if (node->single_level && wildcards) {
+        called += mqtt_topic_match(router, node->single_level, next, end, true, event);
+    }
+
+    return called;
+}
+
+size_t mqtt_topic_router_dispatch(mqtt_topic_router_handle_t router, const char *topic, size_t topic_len,
+                                  esp_mqtt_event_handle_t event)
+{
+    if (router == NULL || topic == NULL) {
+        return 0;
+    }
+
+    router->dispatching ++;
+    // topics starting with $ are not matched by filters starting with a wildcard
+    size_t called = mqtt_topic_match(router, &router->root, topic, topic + topic_len, topic_len == 0 || topic[0] != '$',
+                                     event);
+    router->dispatching --;
+
+    if (router->dispatching == 0) {
+        mqtt_topic_purge(router);
+    }
+
+    return called;
+}
+
+mqtt_topic_filter_handle_t mqtt_topic_router_hold(mqtt_topic_router_handle_t router, const char *topic_filter)
+{
+    const char *filter = mqtt_topic_filter_parse(topic_filter);
+
+    if (filter == NULL) {
+        ESP_LOGE(TAG, "Invalid topic filter %s", topic_filter ? topic_filter : "(null)");
+        return NULL;
+    }
+
+    mqtt_topic_node_t *node = mqtt_topic_filter_node(router, filter, true);
+    ESP_MEM_CHECK(TAG, node, return NULL);
+
+    if (node->holds ++ == 0 && node->routes) {
+        router->unheld --;
+    }
+
+    return node;
+}
+
+void mqtt_topic_router_release(mqtt_topic_router_handle_t router, mqtt_topic_filter_handle_t filter)
+{
+    if (filter == NULL) {
+        return;
+    }
+
+    if (-- filter->holds == 0 && filter->routes) {
+        router->unheld ++;
+    }
+
+    if (router->dispatching) {
+        mqtt_topic_defer_purge(router, filter);
+    } else {
+        mqtt_topic_prune(router, filter);
+    }
+}
+
+bool mqtt_topic_router_all_held(mqtt_topic_router_handle_t router)
+{
+    return router->unheld == 0;
+}
+
+size_t mqtt_topic_router_dispatch_filter(mqtt_topic_router_handle_t router, mqtt_topic_filter_handle_t filter,
+                                         esp_mqtt_event_handle_t event)
+{
+    router->dispatching ++;
+    size_t called = mqtt_topic_call_routes(filter, event);
+    router->dispatching --;
+
+    if (router->dispatching == 0) {
+        mqtt_topic_purge(router);
+    }
+
+    return called;
+}
+
+bool mqtt_topic_filter_matches(const char *topic_filter, const char *topic, size_t topic_len)
+{
+    const char *filter = mqtt_topic_filter_parse(topic_filter);
+    const char *end = topic + topic_len;
+
+    // topics starting with $ are not matched by filters starting with a wildcard
+    if (filter == NULL || (topic_len && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#'))) {
+        return false;
+    }
+
+    for (const char *level = topic; ; filter ++) {
+        size_t filter_len = strcspn(filter, "/");
+
+        // # also matches the parent level
+        if (filter_len == 1 && filter[0] == '#') {
+            return true;
+        }
+
+        if (level == NULL) {
+            return false;
+        }
+
+        const char *level_end = memchr(level, '/', end - level);
+        size_t level_len = (level_end ? level_end : end) - level;
+
+        if ((filter_len != 1 || filter[0] != '+') && (filter_len != level_len || memcmp(filter, level, level_len) != 0)) {
+            return false;
+        }
+
+        level = level_end ? level_end + 1 : NULL;
+        filter += filter_len;
+
+        if (*filter == '\0') {
+            return level == NULL;
+        }
+    }
+}
@@ -13,14 +13,21 @@ static const char *TAG = "mqtt5_client";
 // Receive Maximum is optional in CONNACK; when absent the limit is 65535
 #define MQTT5_DEFAULT_RECEIVE_MAXIMUM 65535
 
+// Initial room for the inbound topic alias topics, per alias
+#define MQTT5_TOPIC_ALIAS_AVERAGE_LEN 32
+
 static void esp_mqtt5_print_error_code(esp_mqtt5_client_handle_t client, int code);
-static esp_err_t esp_mqtt5_client_update_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle,
-                                                     uint16_t topic_alias, char *topic, size_t topic_len);
-static char *esp_mqtt5_client_get_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
-                                              size_t *topic_length);
-static void esp_mqtt5_client_delete_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle);
 static esp_err_t esp_mqtt5_user_property_copy(mqtt5_user_property_handle_t user_property_new,
                                               const mqtt5_user_property_handle_t user_property_old);
+#if MQTT5_AUTO_TOPIC_ALIAS
+static void esp_mqtt5_client_update_outbound_topic_alias(esp_mqtt5_client_handle_t client);
+#endif
+
+static void esp_mqtt5_set_event_properties(esp_mqtt5_client_handle_t client, uint8_t *msg_buf, size_t msg_read_len)
+{
+    client->event.property->properties = mqtt5_get_properties(msg_buf, msg_read_len,
+                                                              &client->event.property->properties_len);
+}
 
 void esp_mqtt5_increment_packet_counter(esp_mqtt5_client_handle_t client)
 {
@@ -44,7 +51,8 @@ void esp_mqtt5_parse_pubcomp(esp_mqtt5_client_handle_t client)
         size_t msg_data_len = client->mqtt_state.in_buffer_read_len;
         client->event.reason_code = mqtt5_msg_get_reason_code(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
         client->event.data = mqtt5_get_pubcomp_data(client->mqtt_state.in_buffer, &msg_data_len,
-                                                    &client->event.property->user_property);
+                                                    MQTT5_EVENT_USER_PROPERTY(client));
+        esp_mqtt5_set_event_properties(client, client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
         client->event.data_len = msg_data_len;
         client->event.total_data_len = msg_data_len;
         client->event.current_data_offset = 0;
@@ -59,7 +67,8 @@ void esp_mqtt5_parse_puback(esp_mqtt5_client_handle_t client)
         size_t msg_data_len = client->mqtt_state.in_buffer_read_len;
         client->event.reason_code = mqtt5_msg_get_reason_code(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
         client->event.data = mqtt5_get_puback_data(client->mqtt_state.in_buffer, &msg_data_len,
-                                                   &client->event.property->user_property);
+                                                   MQTT5_EVENT_USER_PROPERTY(client));
+        esp_mqtt5_set_event_properties(client, client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
         client->event.data_len = msg_data_len;
         client->event.total_data_len = msg_data_len;
         client->event.current_data_offset = 0;
@@ -74,7 +83,8 @@ void esp_mqtt5_parse_unsuback(esp_mqtt5_client_handle_t client)
         size_t msg_data_len = client->mqtt_state.in_buffer_read_len;
         client->event.reason_code = mqtt5_msg_get_reason_code(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
         client->event.data = mqtt5_get_unsuback_data(client->mqtt_state.in_buffer, &msg_data_len,
-                                                     &client->event.property->user_property);
+                                                     MQTT5_EVENT_USER_PROPERTY(client));
+        esp_mqtt5_set_event_properties(client, client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
         client->event.data_len = msg_data_len;
         client->event.total_data_len = msg_data_len;
         client->event.current_data_offset = 0;
@@ -87,6 +97,7 @@ void esp_mqtt5_parse_suback(esp_mqtt5_client_handle_t client)
         ESP_LOGD(TAG, "MQTT_MSG_TYPE_SUBACK return code is %d", mqtt5_msg_get_reason_code(client->mqtt_state.in_buffer,
                                                                                           client->mqtt_state.in_buffer_read_len));
         client->event.reason_code = mqtt5_msg_get_reason_code(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
+        esp_mqtt5_set_event_properties(client, client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len);
     }
 }
 
@@ -104,17 +115,28 @@ esp_err_t esp_mqtt5_parse_connack(esp_mqtt5_client_handle_t client, int *connect
     client->mqtt_state.in_buffer_read_len = 0;
     uint8_t ack_flag = 0;
     client->mqtt5_config->server_resp_property_info.receive_maximum = MQTT5_DEFAULT_RECEIVE_MAXIMUM;
+    client->mqtt5_config->server_resp_property_info.topic_alias_maximum = 0;
+    client->mqtt5_config->server_resp_property_info.subscribe_identifiers_available = true;
 
     if (mqtt5_msg_parse_connack_property(client->mqtt_state.in_buffer, len, &client->mqtt_state.
                                          connection.information, &client->mqtt5_config->connect_property_info, &client->mqtt5_config->server_resp_property_info,
-                                         connect_rsp_code, &ack_flag, &client->event.property->user_property) != ESP_OK) {
+                                         connect_rsp_code, &ack_flag, MQTT5_EVENT_USER_PROPERTY(client)) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to parse CONNACK packet");
         return ESP_FAIL;
     }
 
+    esp_mqtt5_set_event_properties(client, client->mqtt_state.in_buffer, len);
+
     if (*connect_rsp_code == MQTT_CONNECTION_ACCEPTED) {
         ESP_LOGD(TAG, "Connected");
+        // topic aliases only last for a network connection
+        esp_mqtt5_client_reset_topic_alias(client->mqtt5_config->peer_topic_alias);
         client->event.session_present = ack_flag & 0x01;
+
+        if (!client->event.session_present) {
+            esp_mqtt5_client_reset_subscriptions(client->mqtt5_config->subscriptions);
+        }
+
         esp_mqtt5_connection_server_resp_property_t *src = &client->mqtt5_config->server_resp_property_info;
         esp_mqtt5_server_resp_property_t *dst = &client->event.property->server;
         dst->maximum_packet_size = src->maximum_packet_size;
@@ -127,6 +149,9 @@ esp_err_t esp_mqtt5_parse_connack(esp_mqtt5_client_handle_t client, int *connect
         dst->shared_subscribe_available = src->shared_subscribe_available;
         dst->response_info = src->response_info;
         dst->response_info_len = src->response_info ? strlen(src->response_info) : 0;
+#if MQTT5_AUTO_TOPIC_ALIAS
+        esp_mqtt5_client_update_outbound_topic_alias(client);
+#endif
         return ESP_OK;
     }
 
@@ -134,29 +159,58 @@ esp_err_t esp_mqtt5_parse_connack(esp_mqtt5_client_handle_t client, int *connect
     return ESP_FAIL;
 }
 
+static void esp_mqtt5_set_publish_event_property(esp_mqtt5_event_property_t *event_property,
+                                                 const esp_mqtt5_publish_resp_property_t *property)
+{
+    event_property->payload_format_indicator = property->payload_format_indicator;
+    event_property->response_topic = property->response_topic;
+    event_property->response_topic_len = property->response_topic_len;
+    event_property->correlation_data = property->correlation_data;
+    event_property->correlation_data_len = property->correlation_data_len;
+    event_property->content_type = property->content_type;
+    event_property->content_type_len = property->content_type_len;
+    event_property->subscribe_id = property->subscribe_id;
+}
+
 esp_err_t esp_mqtt5_get_publish_data(esp_mqtt5_client_handle_t client, uint8_t *msg_buf, size_t msg_read_len,
                                      char **msg_topic, size_t *msg_topic_len, char **msg_data, size_t *msg_data_len)
 {
     // get property
     uint16_t property_len = 0;
+    uint16_t topic_alias = 0;
     esp_mqtt5_publish_resp_property_t property = {0};
+#if MQTT5_LAZY_PUBLISH_PROPERTIES
+    // only the topic alias and the subscription identifiers are read, the rest is parsed by
+    // esp_mqtt5_client_parse_publish_property()
+    *msg_data = mqtt5_get_publish_payload(msg_buf, msg_read_len, msg_topic, msg_topic_len, &property, &property_len,
+                                          msg_data_len);
+
+    if (*msg_data == NULL) {
+        ESP_LOGE(TAG, "%s: mqtt5_get_publish_payload() failed", __func__);
+        return ESP_FAIL;
+    }
+
+#else
     *msg_data = mqtt5_get_publish_property_payload(msg_buf, msg_read_len, msg_topic, msg_topic_len, &property,
-                                                   &property_len, msg_data_len, &client->event.property->user_property);
+                                                   &property_len, msg_data_len, MQTT5_EVENT_USER_PROPERTY(client));
 
     if (*msg_data == NULL) {
         ESP_LOGE(TAG, "%s: mqtt5_get_publish_property_payload() failed", __func__);
         return ESP_FAIL;
     }
 
-    if (property.topic_alias > client->mqtt5_config->connect_property_info.topic_alias_maximum) {
-        ESP_LOGE(TAG, "%s: Broker response topic alias %d is over the max topic alias %d", __func__, property.topic_alias,
+#endif
+    topic_alias = property.topic_alias;
+
+    if (topic_alias > client->mqtt5_config->connect_property_info.topic_alias_maximum) {
+        ESP_LOGE(TAG, "%s: Broker response topic alias %d is over the max topic alias %d", __func__, topic_alias,
                  client->mqtt5_config->connect_property_info.topic_alias_maximum);
         return ESP_FAIL;
     }
 
-    if (property.topic_alias) {
+    if (topic_alias) {
         if (*msg_topic_len == 0) {
-            *msg_topic = esp_mqtt5_client_get_topic_alias(client->mqtt5_config->peer_topic_alias, property.topic_alias,
+            *msg_topic = esp_mqtt5_client_get_topic_alias(client->mqtt5_config->peer_topic_alias, topic_alias,
                                                           msg_topic_len);
 
             if (!*msg_topic) {
@@ -164,7 +218,7 @@ esp_err_t esp_mqtt5_get_publish_data(esp_mqtt5_client_handle_t client, uint8_t *
                 return ESP_FAIL;
             }
         } else {
-            if (esp_mqtt5_client_update_topic_alias(client->mqtt5_config->peer_topic_alias, property.topic_alias, *msg_topic,
+            if (esp_mqtt5_client_update_topic_alias(client->mqtt5_config->peer_topic_alias, topic_alias, *msg_topic,
                                                     *msg_topic_len) != ESP_OK) {
                 ESP_LOGE(TAG, "%s: esp_mqtt5_client_update_topic_alias() failed", __func__);
                 return ESP_FAIL;
@@ -172,14 +226,39 @@ esp_err_t esp_mqtt5_get_publish_data(esp_mqtt5_client_handle_t client, uint8_t *
         }
     }
 
-    client->event.property->payload_format_indicator = property.payload_format_indicator;
-    client->event.property->response_topic = property.response_topic;
-    client->event.property->response_topic_len = property.response_topic_len;
-    client->event.property->correlation_data = property.correlation_data;
-    client->event.property->correlation_data_len = property.correlation_data_len;
-    client->event.property->content_type = property.content_type;
-    client->event.property->content_type_len = property.content_type_len;
-    client->event.property->subscribe_id = property.subscribe_id;
+    esp_mqtt5_set_publish_event_property(client->event.property, &property);
+    client->mqtt5_config->publish_property_pending = MQTT5_LAZY_PUBLISH_PROPERTIES;
+    client->mqtt5_config->publish_subscribe_id = property.subscribe_id_count == 1 ? property.subscribe_id : 0;
+    // the properties end where the payload starts
+    client->event.property->properties = property_len ? (uint8_t *)*msg_data - property_len : NULL;
+    client->event.property->properties_len = property_len;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt5_client_parse_publish_property(esp_mqtt5_client_handle_t client,
+                                                  esp_mqtt5_event_property_t *property)
+{
+    if (!client || !property) {
+        ESP_LOGE(TAG, "Input value is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!client->mqtt5_config || !client->mqtt5_config->publish_property_pending) {
+        return ESP_OK;
+    }
+
+    client->mqtt5_config->publish_property_pending = false;
+    esp_mqtt5_publish_resp_property_t publish_property = {0};
+
+    if (mqtt5_msg_parse_publish_property((uint8_t *)property->properties, property->properties_len, &publish_property,
+                                         MQTT5_EVENT_USER_PROPERTY(client)) != ESP_OK) {
+        ESP_LOGE(TAG, "%s: mqtt5_msg_parse_publish_property() failed", __func__);
+        esp_mqtt5_client_delete_user_property(client->event.property->user_property);
+        client->event.property->user_property = NULL;
+        return ESP_FAIL;
+    }
+
+    esp_mqtt5_set_publish_event_property(property, &publish_property);
     return ESP_OK;
 }
 
@@ -398,6 +477,8 @@ void esp_mqtt5_client_destory(esp_mqtt5_client_handle_t client)
             free(client->mqtt5_config->will_property_info.correlation_data);
             free(client->mqtt5_config->server_resp_property_info.response_info);
             esp_mqtt5_client_delete_topic_alias(client->mqtt5_config->peer_topic_alias);
+            esp_mqtt5_client_delete_outbound_topic_alias(client->mqtt5_config->topic_alias);
+            esp_mqtt5_client_delete_subscriptions(client->mqtt5_config->subscriptions);
             esp_mqtt5_client_delete_user_property(client->mqtt5_config->connect_property_info.user_property);
             esp_mqtt5_client_delete_user_property(client->mqtt5_config->will_property_info.user_property);
             esp_mqtt5_client_delete_user_property(client->mqtt5_config->disconnect_property_info.user_property);
@@ -408,69 +489,510 @@ void esp_mqtt5_client_destory(esp_mqtt5_client_handle_t client)
     }
 }
 
-static void esp_mqtt5_client_delete_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle)
+mqtt5_topic_alias_handle_t esp_mqtt5_client_create_topic_alias(uint16_t topic_alias_maximum)
+{
+    mqtt5_topic_alias_handle_t topic_alias_handle = calloc(1, sizeof(mqtt5_topic_alias_table_t) +
+                                                           topic_alias_maximum * sizeof(mqtt5_topic_alias_t));
+    ESP_MEM_CHECK(TAG, topic_alias_handle, return NULL);
+    topic_alias_handle->topic_alias_maximum = topic_alias_maximum;
+    topic_alias_handle->arena_size = topic_alias_maximum * MQTT5_TOPIC_ALIAS_AVERAGE_LEN;
+    topic_alias_handle->arena = malloc(topic_alias_handle->arena_size);
+    ESP_MEM_CHECK(TAG, topic_alias_handle->arena, {
+        free(topic_alias_handle);
+        return NULL;
+    });
+    return topic_alias_handle;
+}
+
+void esp_mqtt5_client_reset_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle)
 {
     if (topic_alias_handle) {
-        mqtt5_topic_alias_item_t item, tmp;
-        STAILQ_FOREACH_SAFE(item, topic_alias_handle, next, tmp) {
-            STAILQ_REMOVE(topic_alias_handle, item, mqtt5_topic_alias, next);
-            free(item->topic);
-            free(item);
+        memset(topic_alias_handle->alias, 0, topic_alias_handle->topic_alias_maximum * sizeof(mqtt5_topic_alias_t));
+        topic_alias_handle->arena_used = 0;
+    }
+}
+
+void esp_mqtt5_client_delete_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle)
+{
+    if (topic_alias_handle) {
+        free(topic_alias_handle->arena);
+        free(topic_alias_handle);
+    }
+}
+
+/*
+ * Topics replaced by longer ones leave a gap in the arena. Once the arena is full, the topics in use are moved
+ * to a new arena, twice as large while they would take more than half of it
+ */
+static esp_err_t esp_mqtt5_client_compact_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, size_t needed)
+{
+    size_t used = needed;
+
+    for (int i = 0; i < topic_alias_handle->topic_alias_maximum; i ++) {
+        used += topic_alias_handle->alias[i].topic_len;
+    }
+
+    size_t arena_size = topic_alias_handle->arena_size;
+
+    while (used > arena_size / 2) {
+        arena_size *= 2;
+    }
+
+    char *arena = malloc(arena_size);
+    ESP_MEM_CHECK(TAG, arena, return ESP_ERR_NO_MEM);
+    size_t arena_used = 0;
+
+    for (int i = 0; i < topic_alias_handle->topic_alias_maximum; i ++) {
+        mqtt5_topic_alias_t *alias = &topic_alias_handle->alias[i];
+        memcpy(arena + arena_used, topic_alias_handle->arena + alias->offset, alias->topic_len);
+        alias->offset = arena_used;
+        arena_used += alias->topic_len;
+    }
+
+    free(topic_alias_handle->arena);
+    topic_alias_handle->arena = arena;
+    topic_alias_handle->arena_size = arena_size;
+    topic_alias_handle->arena_used = arena_used;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt5_client_update_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
+                                              const char *topic, size_t topic_len)
+{
+    if (!topic_alias_handle || topic_alias == 0 || topic_alias > topic_alias_handle->topic_alias_maximum ||
+            topic_len == 0 || topic_len > UINT16_MAX) {
+        return ESP_FAIL;
+    }
+
+    mqtt5_topic_alias_t *alias = &topic_alias_handle->alias[topic_alias - 1];
+
+    if (topic_len <= alias->topic_len) {
+        // the new topic fits in place of the old one
+        memmove(topic_alias_handle->arena + alias->offset, topic, topic_len);
+        alias->topic_len = topic_len;
+        return ESP_OK;
+    }
+
+    alias->topic_len = 0;
+
+    if (topic_alias_handle->arena_used + topic_len > topic_alias_handle->arena_size &&
+            esp_mqtt5_client_compact_topic_alias(topic_alias_handle, topic_len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    alias->offset = topic_alias_handle->arena_used;
+    alias->topic_len = topic_len;
+    memcpy(topic_alias_handle->arena + alias->offset, topic, topic_len);
+    topic_alias_handle->arena_used += topic_len;
+    return ESP_OK;
+}
+
+char *esp_mqtt5_client_get_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
+                                       size_t *topic_length)
+{
+    if (!topic_alias_handle || topic_alias == 0 || topic_alias > topic_alias_handle->topic_alias_maximum ||
+            topic_alias_handle->alias[topic_alias - 1].topic_len == 0) {
+        *topic_length = 0;
+        return NULL;
+    }
+
+    mqtt5_topic_alias_t *alias = &topic_alias_handle->alias[topic_alias - 1];
+    *topic_length = alias->topic_len;
+    return topic_alias_handle->arena + alias->offset;
+}
+
+mqtt5_outbound_topic_alias_handle_t esp_mqtt5_client_create_outbound_topic_alias(uint16_t topic_alias_maximum)
+{
+    mqtt5_outbound_topic_alias_handle_t topic_alias_handle = calloc(1, sizeof(mqtt5_outbound_topic_alias_table_t) +
+                                                                    topic_alias_maximum * sizeof(mqtt5_outbound_topic_alias_t));
+    ESP_MEM_CHECK(TAG, topic_alias_handle, return NULL);
+    topic_alias_handle->topic_alias_maximum = topic_alias_maximum;
+    return topic_alias_handle;
+}
+
+void esp_mqtt5_client_reset_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle)
+{
+    if (topic_alias_handle) {
+        // the topics are kept, they are sent again with the first message using their alias
+        for (int i = 0; i < topic_alias_handle->topic_alias_maximum; i ++) {
+            topic_alias_handle->alias[i].established = false;
+        }
+    }
+}
+
+void esp_mqtt5_client_delete_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle)
+{
+    if (topic_alias_handle) {
+        for (int i = 0; i < topic_alias_handle->topic_alias_maximum; i ++) {
+            free(topic_alias_handle->alias[i].topic);
         }
+
         free(topic_alias_handle);
     }
 }
 
-static esp_err_t esp_mqtt5_client_update_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle,
-                                                     uint16_t topic_alias, char *topic, size_t topic_len)
+static uint32_t esp_mqtt5_client_topic_alias_clock(mqtt5_outbound_topic_alias_handle_t topic_alias_handle)
 {
-    mqtt5_topic_alias_item_t item;
-    bool found = false;
-    STAILQ_FOREACH(item, topic_alias_handle, next) {
-        if (item->topic_alias == topic_alias) {
-            found = true;
-            break;
+    if (++ topic_alias_handle->clock == 0) {
+        // keep the order of use when the clock wraps around, only the aliases in use matter
+        for (int i = 0; i < topic_alias_handle->topic_alias_maximum; i ++) {
+            topic_alias_handle->alias[i].last_used = topic_alias_handle->alias[i].topic_len ? 1 : 0;
         }
+
+        topic_alias_handle->clock = 2;
+    }
+
+    return topic_alias_handle->clock;
+}
+
+/*
+ * Returns the alias of the topic, assigning the least recently used one if the topic has none,
+ * or 0 if the topic is sent without an alias. established tells whether the broker knows the topic of the alias
+ */
+uint16_t esp_mqtt5_client_assign_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                      const char *topic, size_t topic_len, bool *established)
+{
+    *established = false;
+
+    // the topic alias property takes three bytes, shorter topics are not worth an alias
+    if (!topic_alias_handle || topic_len <= 3 || topic_len > UINT16_MAX) {
+        return 0;
     }
 
-    if (found) {
-        if ((item->topic_len != topic_len) || strncmp(topic, item->topic, topic_len)) {
-            free(item->topic);
-            item->topic = calloc(1, topic_len);
-            ESP_MEM_CHECK(TAG, item->topic, return ESP_FAIL);
-            memcpy(item->topic, topic, topic_len);
-            item->topic_len = topic_len;
+    mqtt5_outbound_topic_alias_t *least_recently_used = NULL;
+
+    for (int i = 0; i < topic_alias_handle->topic_alias_maximum; i ++) {
+        mqtt5_outbound_topic_alias_t *alias = &topic_alias_handle->alias[i];
+
+        if (alias->topic_len == topic_len && memcmp(alias->topic, topic, topic_len) == 0) {
+            alias->last_used = esp_mqtt5_client_topic_alias_clock(topic_alias_handle);
+            *established = alias->established;
+            return i + 1;
+        }
+
+        if (!least_recently_used || alias->last_used < least_recently_used->last_used) {
+            least_recently_used = alias;
         }
+    }
+
+    if (least_recently_used->topic_size < topic_len) {
+        char *topic_copy = malloc(topic_len);
+        ESP_MEM_CHECK(TAG, topic_copy, return 0);
+        free(least_recently_used->topic);
+        least_recently_used->topic = topic_copy;
+        least_recently_used->topic_size = topic_len;
+    }
+
+    memcpy(least_recently_used->topic, topic, topic_len);
+    least_recently_used->topic_len = topic_len;
+    least_recently_used->established = false;
+    least_recently_used->last_used = esp_mqtt5_client_topic_alias_clock(topic_alias_handle);
+    return least_recently_used - topic_alias_handle->alias + 1;
+}
+
+void esp_mqtt5_client_establish_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                     uint16_t topic_alias)
+{
+    if (topic_alias_handle && topic_alias > 0 && topic_alias <= topic_alias_handle->topic_alias_maximum) {
+        topic_alias_handle->alias[topic_alias - 1].established = true;
+    }
+}
+
+void esp_mqtt5_client_forget_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                  uint16_t topic_alias)
+{
+    if (topic_alias_handle && topic_alias > 0 && topic_alias <= topic_alias_handle->topic_alias_maximum) {
+        mqtt5_outbound_topic_alias_t *alias = &topic_alias_handle->alias[topic_alias - 1];
+        alias->topic_len = 0;
+        alias->established = false;
+        alias->last_used = 0;
+    }
+}
+
+#if MQTT5_AUTO_TOPIC_ALIAS
+/* Sizes the topic aliases assigned by the client to the Topic Alias Maximum of the new connection */
+static void esp_mqtt5_client_update_outbound_topic_alias(esp_mqtt5_client_handle_t client)
+{
+    uint16_t topic_alias_maximum = client->mqtt5_config->server_resp_property_info.topic_alias_maximum;
+
+    if (topic_alias_maximum > MQTT5_AUTO_TOPIC_ALIAS_MAXIMUM) {
+        topic_alias_maximum = MQTT5_AUTO_TOPIC_ALIAS_MAXIMUM;
+    }
+
+    if (client->mqtt5_config->topic_alias &&
+            client->mqtt5_config->topic_alias->topic_alias_maximum != topic_alias_maximum) {
+        esp_mqtt5_client_delete_outbound_topic_alias(client->mqtt5_config->topic_alias);
+        client->mqtt5_config->topic_alias = NULL;
+    }
+
+    if (client->mqtt5_config->topic_alias) {
+        esp_mqtt5_client_reset_outbound_topic_alias(client->mqtt5_config->topic_alias);
+    } else if (topic_alias_maximum) {
+        client->mqtt5_config->topic_alias = esp_mqtt5_client_create_outbound_topic_alias(topic_alias_maximum);
+    }
+}
+#endif
+
+/*
+ * Picks the properties of a publish message. With MQTT5_AUTO_TOPIC_ALIAS the message carries the alias of its
+ * topic in a copy of the properties, and the topic is left out once the broker knows the alias
+ */
+const esp_mqtt5_publish_property_config_t *esp_mqtt5_client_apply_topic_alias(esp_mqtt5_client_handle_t client,
+                                                                              const char **topic, esp_mqtt5_publish_property_config_t *alias_property)
+{
+    const esp_mqtt5_publish_property_config_t *property = client->mqtt5_config->publish_property_info;
+    mqtt5_outbound_topic_alias_handle_t topic_alias_handle = client->mqtt5_config->topic_alias;
+
+    if (!topic_alias_handle || client->state != MQTT_STATE_CONNECTED || *topic == NULL) {
+        return property;
+    }
+
+    if (property && property->topic_alias) {
+        // the broker maps the alias set by the user to this topic from now on
+        esp_mqtt5_client_forget_outbound_topic_alias(topic_alias_handle, property->topic_alias);
+        return property;
+    }
+
+    bool established;
+    uint16_t topic_alias = esp_mqtt5_client_assign_outbound_topic_alias(topic_alias_handle, *topic, strlen(*topic),
+                                                                        &established);
+
+    if (topic_alias == 0) {
+        return property;
+    }
+
+    if (property) {
+        *alias_property = *property;
     } else {
-        item = calloc(1, sizeof(mqtt5_topic_alias_t));
-        ESP_MEM_CHECK(TAG, item, return ESP_FAIL);
-        item->topic_alias = topic_alias;
-        item->topic_len = topic_len;
-        item->topic = calloc(1, topic_len);
-        ESP_MEM_CHECK(TAG, item->topic, {
-            free(item);
-            return ESP_FAIL;
-        });
-        memcpy(item->topic, topic, topic_len);
-        STAILQ_INSERT_TAIL(topic_alias_handle, item, next);
+        memset(alias_property, 0, sizeof(esp_mqtt5_publish_property_config_t));
     }
 
-    return ESP_OK;
+    alias_property->topic_alias = topic_alias;
+
+    if (established) {
+        *topic = NULL;
+    }
+
+    return alias_property;
+}
+
+mqtt5_subscription_handle_t esp_mqtt5_client_create_subscriptions(mqtt_topic_router_handle_t router)
+{
+    mqtt5_subscription_handle_t subscription_handle = calloc(1, sizeof(mqtt5_subscription_table_t));
+    ESP_MEM_CHECK(TAG, subscription_handle, return NULL);
+    subscription_handle->router = router;
+    return subscription_handle;
+}
+
+static void esp_mqtt5_client_free_subscription(mqtt5_subscription_handle_t subscription_handle,
+                                               mqtt5_subscription_t *subscription)
+{
+    for (int i = 0; i < subscription->filter_count; i ++) {
+        mqtt_topic_router_release(subscription_handle->router, subscription->filter[i].held);
+        free(subscription->filter[i].filter);
+    }
+
+    free(subscription->filter);
+    subscription->filter = NULL;
+    subscription->filter_count = 0;
+}
+
+void esp_mqtt5_client_remove_subscribed_filter(mqtt5_subscription_handle_t subscription_handle, const char *filter)
+{
+    if (!subscription_handle || !filter) {
+        return;
+    }
+
+    for (int i = 0; i < subscription_handle->size; i ++) {
+        mqtt5_subscription_t *subscription = &subscription_handle->subscription[i];
+
+        for (int j = 0; j < subscription->filter_count; j ++) {
+            if (strcmp(subscription->filter[j].filter, filter) != 0) {
+                continue;
+            }
+
+            if (subscription->filter_count == 1) {
+                esp_mqtt5_client_free_subscription(subscription_handle, subscription);
+                break;
+            }
+
+            mqtt_topic_router_release(subscription_handle->router, subscription->filter[j].held);
+            free(subscription->filter[j].filter);
+            subscription->filter_count --;
+            memmove(&subscription->filter[j], &subscription->filter[j + 1],
+                    (subscription->filter_count - j) * sizeof(mqtt5_subscription_filter_t));
+            break;
+        }
+    }
+}
+
+/* Returns a free subscription identifier, or 0 if all are taken */
+static uint16_t esp_mqtt5_client_free_subscribe_id(mqtt5_subscription_handle_t subscription_handle)
+{
+    // the identifiers are taken in turn, so that a freed one is reused last
+    for (int n = 0; n < subscription_handle->size; n ++) {
+        int i = (subscription_handle->next + n) % subscription_handle->size;
+
+        if (subscription_handle->subscription[i].filter_count == 0) {
+            subscription_handle->next = i + 1;
+            return i + 1;
+        }
+    }
+
+    if (subscription_handle->size == UINT16_MAX) {
+        ESP_LOGW(TAG, "All the subscription identifiers are taken");
+        return 0;
+    }
+
+    int size = subscription_handle->size ? subscription_handle->size * 2 : 4;
+    size = size > UINT16_MAX ? UINT16_MAX : size;
+    mqtt5_subscription_t *subscription = realloc(subscription_handle->subscription, size * sizeof(mqtt5_subscription_t));
+    ESP_MEM_CHECK(TAG, subscription, return 0);
+    memset(subscription + subscription_handle->size, 0, (size - subscription_handle->size) * sizeof(mqtt5_subscription_t));
+    uint16_t subscribe_id = subscription_handle->size + 1;
+    subscription_handle->subscription = subscription;
+    subscription_handle->size = size;
+    subscription_handle->next = subscribe_id;
+    return subscribe_id;
+}
+
+/* Returns the identifier assigned to a subscription to the filters of the list, or 0 if none could be */
+uint16_t esp_mqtt5_client_add_subscription(mqtt5_subscription_handle_t subscription_handle,
+                                           const esp_mqtt_topic_t *topic_list, int size)
+{
+    if (!subscription_handle || size <= 0 || size > UINT16_MAX) {
+        return 0;
+    }
+
+    // a subscription to the same filter replaces the previous one
+    for (int i = 0; i < size; i ++) {
+        esp_mqtt5_client_remove_subscribed_filter(subscription_handle, topic_list[i].filter);
+    }
+
+    uint16_t subscribe_id = esp_mqtt5_client_free_subscribe_id(subscription_handle);
+
+    if (subscribe_id == 0) {
+        return 0;
+    }
+
+    mqtt5_subscription_t *subscription = &subscription_handle->subscription[subscribe_id - 1];
+    subscription->filter = calloc(size, sizeof(mqtt5_subscription_filter_t));
+    ESP_MEM_CHECK(TAG, subscription->filter, return 0);
+
+    for (int i = 0; i < size; i ++) {
+        mqtt5_subscription_filter_t *filter = &subscription->filter[subscription->filter_count];
+        filter->filter = strdup(topic_list[i].filter);
+        filter->held = filter->filter ? mqtt_topic_router_hold(subscription_handle->router, filter->filter) : NULL;
+
+        if (!filter->held) {
+            free(filter->filter);
+            esp_mqtt5_client_free_subscription(subscription_handle, subscription);
+            return 0;
+        }
+
+        subscription->filter_count ++;
+    }
+
+    return subscribe_id;
+}
+
+void esp_mqtt5_client_remove_subscription(mqtt5_subscription_handle_t subscription_handle, uint16_t subscribe_id)
+{
+    if (subscription_handle && subscribe_id > 0 && subscribe_id <= subscription_handle->size) {
+        esp_mqtt5_client_free_subscription(subscription_handle, &subscription_handle->subscription[subscribe_id - 1]);
+    }
+}
+
+void esp_mqtt5_client_reset_subscriptions(mqtt5_subscription_handle_t subscription_handle)
+{
+    if (subscription_handle) {
+        for (int i = 0; i < subscription_handle->size; i ++) {
+            esp_mqtt5_client_free_subscription(subscription_handle, &subscription_handle->subscription[i]);
+        }
+    }
+}
+
+void esp_mqtt5_client_delete_subscriptions(mqtt5_subscription_handle_t subscription_handle)
+{
+    if (subscription_handle) {
+        esp_mqtt5_client_reset_subscriptions(subscription_handle);
+        free(subscription_handle->subscription);
+        free(subscription_handle);
+    }
 }
 
-static char *esp_mqtt5_client_get_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
-                                              size_t *topic_length)
+/*
+ * Calls the topic handlers of the filters of the subscription a message was sent for. Returns false if the topic
+ * of the message has to be matched instead, as the subscription is unknown or some handlers are not subscribed
+ */
+bool esp_mqtt5_client_route_subscription(mqtt5_subscription_handle_t subscription_handle, uint16_t subscribe_id,
+                                         const char *topic, size_t topic_len, esp_mqtt_event_handle_t event)
 {
-    mqtt5_topic_alias_item_t item;
-    STAILQ_FOREACH(item, topic_alias_handle, next) {
-        if (item->topic_alias == topic_alias) {
-            *topic_length = item->topic_len;
-            return item->topic;
+    if (!subscription_handle || subscribe_id == 0 || subscribe_id > subscription_handle->size ||
+            subscription_handle->subscription[subscribe_id - 1].filter_count == 0 ||
+            !mqtt_topic_router_all_held(subscription_handle->router)) {
+        return false;
+    }
+
+    // the handlers may subscribe and unsubscribe, so the subscription is looked up again after each call
+    for (int i = 0; i < subscription_handle->subscription[subscribe_id - 1].filter_count; i ++) {
+        mqtt5_subscription_t *subscription = &subscription_handle->subscription[subscribe_id - 1];
+
+        // the broker matched the filter of a subscription with only one
+        if (subscription->filter_count == 1 ||
+                mqtt_topic_filter_matches(subscription->filter[i].filter, topic, topic_len)) {
+            mqtt_topic_router_dispatch_filter(subscription_handle->router, subscription->filter[i].held, event);
         }
     }
-    *topic_length = 0;
-    return NULL;
+
+    return true;
+}
+
+#if MQTT5_SUBSCRIBE_ID_ROUTING
+/*
+ * Picks the properties of a subscribe message. With MQTT5_SUBSCRIBE_ID_ROUTING the message carries an identifier
+ * assigned by the client in a copy of the properties, so that the messages sent for the subscription are routed
+ * to the topic handlers without matching their topic
+ */
+const esp_mqtt5_subscribe_property_config_t *esp_mqtt5_client_apply_subscribe_id(esp_mqtt5_client_handle_t client,
+                                                                                 const esp_mqtt_topic_t *topic_list, int size, esp_mqtt5_subscribe_property_config_t *id_property)
+{
+    const esp_mqtt5_subscribe_property_config_t *property = client->mqtt5_config->subscribe_property_info;
+
+    if (property && property->subscribe_id) {
+        // the identifiers of the user could be the ones assigned
+        ESP_LOGD(TAG, "Subscription identifier set by the user, identifiers are no longer assigned");
+        client->mqtt5_config->user_subscribe_id = true;
+        esp_mqtt5_client_delete_subscriptions(client->mqtt5_config->subscriptions);
+        client->mqtt5_config->subscriptions = NULL;
+        return property;
+    }
+
+    if (!client->topic_router || client->mqtt5_config->user_subscribe_id ||
+            !client->mqtt5_config->server_resp_property_info.subscribe_identifiers_available) {
+        return property;
+    }
+
+    if (!client->mqtt5_config->subscriptions) {
+        client->mqtt5_config->subscriptions = esp_mqtt5_client_create_subscriptions(client->topic_router);
+    }
+
+    uint16_t subscribe_id = esp_mqtt5_client_add_subscription(client->mqtt5_config->subscriptions, topic_list, size);
+
+    if (subscribe_id == 0) {
+        return property;
+    }
+
+    if (property) {
+        *id_property = *property;
+    } else {
+        memset(id_property, 0, sizeof(esp_mqtt5_subscribe_property_config_t));
+    }
+
+    id_property->subscribe_id = subscribe_id;
+    return id_property;
 }
+#endif
 
 static esp_err_t esp_mqtt5_user_property_copy(mqtt5_user_property_handle_t user_property_new,
                                               const mqtt5_user_property_handle_t user_property_old)
@@ -495,6 +1017,8 @@ static esp_err_t esp_mqtt5_user_property_copy(mqtt5_user_property_handle_t user_
             free(new_item);
             return ESP_FAIL;
         });
+        new_item->key_len = old_item->key_len;
+        new_item->value_len = old_item->value_len;
         STAILQ_INSERT_TAIL(user_property_new, new_item, next);
     }
     return ESP_OK;
@@ -699,10 +1223,16 @@ esp_err_t esp_mqtt5_client_set_connect_property(esp_mqtt5_client_handle_t client
         if (connect_property->topic_alias_maximum) {
             client->mqtt5_config->connect_property_info.topic_alias_maximum = connect_property->topic_alias_maximum;
 
+            if (client->mqtt5_config->peer_topic_alias &&
+                    client->mqtt5_config->peer_topic_alias->topic_alias_maximum != connect_property->topic_alias_maximum) {
+                esp_mqtt5_client_delete_topic_alias(client->mqtt5_config->peer_topic_alias);
+                client->mqtt5_config->peer_topic_alias = NULL;
+            }
+
             if (!client->mqtt5_config->peer_topic_alias) {
-                client->mqtt5_config->peer_topic_alias = calloc(1, sizeof(struct mqtt5_topic_alias_list_t));
+                client->mqtt5_config->peer_topic_alias = esp_mqtt5_client_create_topic_alias(
+                                                             connect_property->topic_alias_maximum);
                 ESP_MEM_CHECK(TAG, client->mqtt5_config->peer_topic_alias, goto _mqtt_set_config_failed);
-                STAILQ_INIT(client->mqtt5_config->peer_topic_alias);
             }
         }
 
@@ -802,6 +1332,7 @@ esp_err_t esp_mqtt5_client_set_user_property(mqtt5_user_property_handle_t *user_
             });
             memcpy(user_property_item->key, item[i].key, key_len);
             user_property_item->key[key_len] = '\0';
+            user_property_item->key_len = key_len;
             user_property_item->value = calloc(1, value_len + 1);
             ESP_MEM_CHECK(TAG, user_property_item->value, {
                 free(user_property_item->key);
@@ -810,6 +1341,7 @@ esp_err_t esp_mqtt5_client_set_user_property(mqtt5_user_property_handle_t *user_
             });
             memcpy(user_property_item->value, item[i].value, value_len);
             user_property_item->value[value_len] = '\0';
+            user_property_item->value_len = value_len;
             STAILQ_INSERT_TAIL(*user_property, user_property_item, next);
         }
     }
@@ -831,8 +1363,8 @@ esp_err_t esp_mqtt5_client_get_user_property(mqtt5_user_property_handle_t user_p
         uint8_t num = *item_num;
         STAILQ_FOREACH(user_property_item, user_property, next) {
             if (i < num) {
-                size_t item_key_len = strlen(user_property_item->key);
-                size_t item_value_len = strlen(user_property_item->value);
+                size_t item_key_len = user_property_item->key_len;
+                size_t item_value_len = user_property_item->value_len;
                 char *key = calloc(1, item_key_len + 1);
                 ESP_MEM_CHECK(TAG, key, goto err);
                 memcpy(key, user_property_item->key, item_key_len);
@@ -873,6 +1405,46 @@ err:
     return ESP_ERR_NO_MEM;
 }
 
+void esp_mqtt5_client_user_property_iter_init(esp_mqtt5_user_property_iter_t *iter,
+                                              const esp_mqtt5_event_property_t *property)
+{
+    iter->next = property ? property->properties : NULL;
+    iter->end = iter->next ? iter->next + property->properties_len : NULL;
+}
+
+bool esp_mqtt5_client_user_property_next(esp_mqtt5_user_property_iter_t *iter, esp_mqtt5_user_property_view_t *item)
+{
+    if (!iter || !item || !iter->next) {
+        return false;
+    }
+
+    return mqtt5_msg_next_user_property(&iter->next, iter->end, item);
+}
+
+esp_err_t esp_mqtt5_client_copy_user_property(const esp_mqtt5_event_property_t *property,
+                                              mqtt5_user_property_handle_t *user_property)
+{
+    if (!property || !user_property) {
+        ESP_LOGE(TAG, "Input value is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_mqtt5_user_property_iter_t iter;
+    esp_mqtt5_user_property_view_t item;
+    *user_property = NULL;
+    esp_mqtt5_client_user_property_iter_init(&iter, property);
+
+    while (esp_mqtt5_client_user_property_next(&iter, &item)) {
+        if (mqtt5_msg_set_user_property(user_property, item.key, item.key_len, item.value, item.value_len) != ESP_OK) {
+            esp_mqtt5_client_delete_user_property(*user_property);
+            *user_property = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return ESP_OK;
+}
+
 uint8_t esp_mqtt5_client_get_user_property_count(mqtt5_user_property_handle_t user_property)
 {
     uint8_t count = 0;
@@ -15,6 +15,11 @@
 #include "mqtt_msg.h"
 #include "mqtt_outbox.h"
 #include "mqtt_utils.h"
+#if MQTT_TASK_WAKEUP
+#include <sys/select.h>
+#include <unistd.h>
+#include "esp_vfs_eventfd.h"
+#endif
 
 _Static_assert(sizeof(uint64_t) == sizeof(outbox_tick_t), "mqtt-client tick type size different from outbox tick type");
 #ifdef ESP_EVENT_ANY_ID
@@ -34,6 +39,7 @@ ESP_EVENT_DEFINE_BASE(MQTT_EVENTS);
 const static int STOPPED_BIT = (1 << 0);
 const static int RECONNECT_BIT = (1 << 1);
 const static int DISCONNECT_BIT = (1 << 2);
+const static int WAKEUP_BIT = (1 << 3);     // wakes up the task waiting for reconnection, set on stop
 
 static esp_err_t esp_mqtt_dispatch_event(esp_mqtt_client_handle_t client);
 static esp_err_t esp_mqtt_dispatch_event_with_msgid(esp_mqtt_client_handle_t client);
@@ -454,6 +460,169 @@ static esp_err_t esp_mqtt_client_create_transport(esp_mqtt_client_handle_t clien
     return ret;
 }
 
+/* Drops the client references of the receive buffers, the held ones are freed once released */
+static void mqtt_in_buffers_destroy(mqtt_state_t *state)
+{
+    for (int i = 0; i < state->in_buffer_count; i++) {
+        esp_mqtt_event_release_data(state->in_buffers[i]);
+    }
+
+    free(state->in_buffers);
+    state->in_buffers = NULL;
+    state->in_buffer_count = 0;
+    state->in_buffer = NULL;
+}
+
+static esp_err_t mqtt_in_buffers_create(mqtt_state_t *state, int size, int spares)
+{
+    state->in_buffers = calloc(1 + spares, sizeof(struct esp_mqtt_in_buffer *));
+    ESP_MEM_CHECK(TAG, state->in_buffers, return ESP_ERR_NO_MEM);
+
+    for (int i = 0; i <= spares; i++) {
+        // the reference count is atomic, so it mustn't get allocated in PSRAM
+        struct esp_mqtt_in_buffer *buffer = heap_caps_calloc(1, sizeof(struct esp_mqtt_in_buffer),
+                                                             MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        ESP_MEM_CHECK(TAG, buffer, goto failed);
+        atomic_init(&buffer->refs, 1);
+        state->in_buffers[state->in_buffer_count++] = buffer;
+        buffer->data = heap_caps_malloc(size, MQTT_BUFFER_MEMORY);
+        ESP_MEM_CHECK(TAG, buffer->data, goto failed);
+    }
+
+    state->in_buffer = state->in_buffers[0]->data;
+    return ESP_OK;
+failed:
+    mqtt_in_buffers_destroy(state);
+    return ESP_ERR_NO_MEM;
+}
+
+/*
+ * Called before writing to in_buffer. If an event handler holds it, the received bytes which weren't parsed yet
+ * are moved to the start of a spare buffer, which becomes in_buffer
+ */
+static void mqtt_in_buffer_unshare(mqtt_state_t *state)
+{
+    if (state->in_buffer_count < 2 || atomic_load(&state->in_buffers[0]->refs) == 1) {
+        return;
+    }
+
+    // esp_mqtt_event_hold_data() and the queued DATA events made sure a spare was left
+    for (int i = 1; i < state->in_buffer_count; i++) {
+        struct esp_mqtt_in_buffer *spare = state->in_buffers[i];
+
+        if (atomic_load(&spare->refs) == 1) {
+            memcpy(spare->data, state->in_buffer + state->in_buffer_head, state->in_buffer_tail - state->in_buffer_head);
+            state->in_buffers[i] = state->in_buffers[0];
+            state->in_buffers[0] = spare;
+            state->in_buffer = spare->data;
+            state->in_buffer_tail -= state->in_buffer_head;
+            state->in_buffer_head = 0;
+            return;
+        }
+    }
+}
+
+static bool mqtt_in_buffer_spare_left(const mqtt_state_t *state)
+{
+    for (int i = 1; i < state->in_buffer_count; i++) {
+        if (atomic_load(&state->in_buffers[i]->refs) == 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Returns the receive buffer which contains ptr, NULL if ptr isn't in any of them */
+static struct esp_mqtt_in_buffer *mqtt_in_buffer_of(const mqtt_state_t *state, const void *ptr)
+{
+    for (int i = 0; ptr != NULL && i < state->in_buffer_count; i++) {
+        const uint8_t *data = state->in_buffers[i]->data;
+
+        if ((const uint8_t *)ptr >= data && (const uint8_t *)ptr < data + state->in_buffer_length) {
+            return state->in_buffers[i];
+        }
+    }
+
+    return NULL;
+}
+
+esp_mqtt_event_data_handle_t esp_mqtt_event_hold_data(const esp_mqtt_event_t *event)
+{
+    if (event == NULL || event->client == NULL) {
+        return NULL;
+    }
+
+    mqtt_state_t *state = &event->client->mqtt_state;
+    // a message without payload has no data, only its topic is in the buffer
+    struct esp_mqtt_in_buffer *buffer = mqtt_in_buffer_of(state, event->data ? event->data : event->topic);
+
+    if (buffer == NULL) {
+        ESP_LOGD(TAG, "The event data isn't in a receive buffer");
+        return NULL;
+    }
+
+    // the next receive needs a spare buffer to take its place
+    if (buffer == state->in_buffers[0] && !mqtt_in_buffer_spare_left(state)) {
+        ESP_LOGD(TAG, "No spare receive buffer left to hold the event data");
+        return NULL;
+    }
+
+    atomic_fetch_add(&buffer->refs, 1);
+    return buffer;
+}
+
+void esp_mqtt_event_release_data(esp_mqtt_event_data_handle_t data)
+{
+    if (data && atomic_fetch_sub(&data->refs, 1) == 1) {
+        free(data->data);
+        free(data);
+    }
+}
+
+#if defined(MQTT_SUPPORTED_FEATURE_EVENT_LOOP) && MQTT_EVENT_QUEUE_SIZE > 1
+/*
+ * A queued DATA event may only be handled after the next receive, so the buffer its data points to is held from
+ * the post until its handlers return. Like the event loop, the posted buffers are only used with the client locked
+ */
+static void mqtt_posted_data_push(esp_mqtt_client_handle_t client, struct esp_mqtt_in_buffer *buffer)
+{
+    int tail = (client->posted_data_head + client->posted_data_count) % MQTT_EVENT_QUEUE_SIZE;
+    client->posted_data[tail] = buffer;
+    client->posted_data_count++;
+}
+
+static void mqtt_release_handled_data(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_event_release_data(client->handled_data);
+    client->handled_data = NULL;
+}
+
+/* Registered before the handlers of the user, it takes over the buffer of the DATA event they are about to handle */
+static void mqtt_data_event_handled(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_client_handle_t client = handler_args;
+    // the handlers of the previous DATA event have returned
+    mqtt_release_handled_data(client);
+
+    if (client->posted_data_count > 0) {
+        client->handled_data = client->posted_data[client->posted_data_head];
+        client->posted_data_head = (client->posted_data_head + 1) % MQTT_EVENT_QUEUE_SIZE;
+        client->posted_data_count--;
+    }
+}
+
+static void mqtt_posted_data_destroy(esp_mqtt_client_handle_t client)
+{
+    mqtt_release_handled_data(client);
+
+    for (; client->posted_data_count > 0; client->posted_data_count--) {
+        esp_mqtt_event_release_data(client->posted_data[client->posted_data_head]);
+        client->posted_data_head = (client->posted_data_head + 1) % MQTT_EVENT_QUEUE_SIZE;
+    }
+}
+#endif
+
 esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config)
 {
     if (!client) {
@@ -487,16 +656,39 @@ esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_cl
         goto _mqtt_set_config_failed;
     }
 
-    free(client->mqtt_state.in_buffer);
-    client->mqtt_state.in_buffer = (uint8_t *)heap_caps_malloc(buffer_size, MQTT_BUFFER_MEMORY);
-    ESP_MEM_CHECK(TAG, client->mqtt_state.in_buffer, goto _mqtt_set_config_failed);
+    // the buffers held by event handlers are kept until released
+    mqtt_in_buffers_destroy(&client->mqtt_state);
+
+    if (mqtt_in_buffers_create(&client->mqtt_state, buffer_size,
+                               config->buffer.in_pool_size > 0 ? config->buffer.in_pool_size : 0) != ESP_OK) {
+        goto _mqtt_set_config_failed;
+    }
+
     client->mqtt_state.in_buffer_length = buffer_size;
+    client->mqtt_state.in_buffer_head = 0;
+    client->mqtt_state.in_buffer_tail = 0;
     client->config->message_retransmit_timeout = config->session.message_retransmit_timeout;
 
     if (config->session.message_retransmit_timeout <= 0) {
         client->config->message_retransmit_timeout = MQTT_DEFAULT_RETRANSMIT_TIMEOUT_MS;
     }
 
+    client->config->adaptive_retransmit_timeout = config->session.adaptive_retransmit_timeout;
+    client->config->message_retransmit_timeout_max = config->session.message_retransmit_timeout_max;
+
+    if (config->session.message_retransmit_timeout_max <= 0) {
+        client->config->message_retransmit_timeout_max = MQTT_DEFAULT_RETRANSMIT_TIMEOUT_MAX_MS;
+    }
+
+    if (client->config->adaptive_retransmit_timeout) {
+        mqtt_rtt_init(&client->rtt, client->config->message_retransmit_timeout, MQTT_RETRANSMIT_TIMEOUT_MIN_MS,
+                      client->config->message_retransmit_timeout_max);
+    } else {
+        // the fixed timeout is not adapted, nor backed off
+        mqtt_rtt_init(&client->rtt, client->config->message_retransmit_timeout,
+                      client->config->message_retransmit_timeout, client->config->message_retransmit_timeout);
+    }
+
     client->config->task_prio = config->task.priority;
 
     if (client->config->task_prio <= 0) {
@@ -582,6 +774,8 @@ esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_cl
         client->mqtt_state.connection.information.keepalive = MQTT_KEEPALIVE_TICK;
     }
 
+    client->config->keepalive_jitter_ms = config->session.keepalive_jitter_ms;
+
     if (config->session.disable_keepalive) {
         // internal `keepalive` value (in connect_info) is in line with 3.1.2.10 Keep Alive from mqtt spec:
         //      * keepalive=0: Keep alive mechanism disabled (server not to disconnect the client on its inactivity)
@@ -727,6 +921,15 @@ esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_cl
     }
 
     client->config->outbox_limit = config->outbox.limit;
+    client->config->event_callback = config->event_callback.handler;
+    client->config->event_callback_args = config->event_callback.handler_args;
+#if MQTT_OUTBOX_ARENA
+
+    if (outbox_set_arena(client->outbox, MQTT_OUTBOX_ARENA_SIZE(client->config->outbox_limit)) != ESP_OK) {
+        ESP_LOGW(TAG, "Outbox arena not updated, messages are stored on the heap");
+    }
+
+#endif
     esp_err_t config_has_conflict = esp_mqtt_check_cfg_conflict(client->config, config);
     MQTT_API_UNLOCK(client);
     return config_has_conflict;
@@ -742,7 +945,7 @@ void esp_mqtt_destroy_config(esp_mqtt_client_handle_t client)
         return;
     }
 
-    free(client->mqtt_state.in_buffer);
+    mqtt_in_buffers_destroy(&client->mqtt_state);
     mqtt_msg_buffer_destroy(&client->mqtt_state.connection);
     free(client->config->host);
     free(client->config->uri);
@@ -771,6 +974,11 @@ void esp_mqtt_destroy_config(esp_mqtt_client_handle_t client)
         esp_event_loop_delete(client->config->event_loop_handle);
     }
 
+#if MQTT_EVENT_QUEUE_SIZE > 1
+    // the DATA events left in the queue are never handled
+    mqtt_posted_data_destroy(client);
+#endif
+
 #endif
     esp_transport_destroy(client->config->transport);
     memset(client->config, 0, sizeof(mqtt_config_storage_t));
@@ -784,13 +992,29 @@ static inline bool has_timed_out(uint64_t last_tick, uint64_t timeout)
     return (int64_t)(next - platform_tick_get_ms()) <= 0;
 }
 
-static esp_err_t process_keepalive(esp_mqtt_client_handle_t client)
+static void mqtt_draw_keepalive_jitter(esp_mqtt_client_handle_t client)
+{
+    int jitter_ms = client->config->keepalive_jitter_ms;
+    const int max_jitter_ms = client->mqtt_state.connection.information.keepalive * 1000 / 4;
+
+    if (jitter_ms > max_jitter_ms) {
+        jitter_ms = max_jitter_ms;
+    }
+
+    client->keepalive_jitter_ms = jitter_ms > 0 ? platform_random(jitter_ms + 1) : 0;
+}
+
+/*
+ * Sends a PINGREQ once no packet was sent for half the keepalive interval, less the jitter, or none was received
+ * for the whole interval, and aborts the connection if its PINGRESP doesn't come within half the interval
+ */
+esp_err_t esp_mqtt_process_keepalive(esp_mqtt_client_handle_t client)
 {
     if (client->mqtt_state.connection.information.keepalive > 0) {
         const uint64_t keepalive_ms = client->mqtt_state.connection.information.keepalive * 1000;
 
         if (client->wait_for_ping_resp == true) {
-            if (has_timed_out(client->keepalive_tick, keepalive_ms)) {
+            if (has_timed_out(client->ping_tick, keepalive_ms / 2)) {
                 ESP_LOGE(TAG, "No PING_RESP, disconnected");
                 esp_mqtt_abort_connection(client);
                 client->wait_for_ping_resp = false;
@@ -800,14 +1024,25 @@ static esp_err_t process_keepalive(esp_mqtt_client_handle_t client)
             return ESP_OK;
         }
 
-        if (has_timed_out(client->keepalive_tick, keepalive_ms / 2)) {
+        /* It is the responsibility of the Client to ensure that the interval between Control Packets
+         * being sent does not exceed the Keep Alive value. In the absence of sending any other Control
+         * Packets, the Client MUST send a PINGREQ Packet [MQTT-3.1.2-23].
+         * A client which only publishes QoS 0 messages receives nothing, so it is only asked for a
+         * PINGRESP, as a proof that the connection is alive, once nothing was received for a whole interval.
+         */
+        const uint64_t idle_ms = keepalive_ms / 2 - client->keepalive_jitter_ms;
+
+        if (has_timed_out(client->last_outbound_tick, idle_ms) ||
+                has_timed_out(client->last_inbound_tick, keepalive_ms)) {
             if (esp_mqtt_client_ping(client) == ESP_FAIL) {
                 ESP_LOGE(TAG, "Can't send ping, disconnected");
                 esp_mqtt_abort_connection(client);
                 return ESP_FAIL;
             }
 
+            client->ping_tick = platform_tick_get_ms();
             client->wait_for_ping_resp = true;
+            mqtt_draw_keepalive_jitter(client);
             return ESP_OK;
         }
     }
@@ -815,19 +1050,16 @@ static esp_err_t process_keepalive(esp_mqtt_client_handle_t client)
     return ESP_OK;
 }
 
-static inline esp_err_t esp_mqtt_write(esp_mqtt_client_handle_t client)
+static esp_err_t esp_mqtt_write_data(esp_mqtt_client_handle_t client, const uint8_t *data, size_t length)
 {
-    int wlen = 0, widx = 0, len = client->mqtt_state.connection.outbound_message.length;
+    int wlen = 0, widx = 0, len = length;
 
     while (len > 0) {
-        wlen = esp_transport_write(client->transport,
-                                   (char *)client->mqtt_state.connection.outbound_message.data + widx,
-                                   len,
+        wlen = esp_transport_write(client->transport, (const char *)data + widx, len,
                                    client->config->network_timeout_ms);
 
         if (wlen < 0) {
             ESP_LOGE(TAG, "Writing failed: errno=%d", errno);
-            esp_mqtt_client_dispatch_transport_error(client);
             return ESP_FAIL;
         }
 
@@ -843,6 +1075,50 @@ static inline esp_err_t esp_mqtt_write(esp_mqtt_client_handle_t client)
     return ESP_OK;
 }
 
+/*
+ * Writes the segments of one message without reporting errors, so it may be called without the API lock.
+ * The messages written by different tasks are serialized by the write lock
+ */
+static esp_err_t mqtt_write_message(esp_mqtt_client_handle_t client, const mqtt_iovec_t *iov, int iovcnt)
+{
+    esp_err_t err = ESP_OK;
+    MQTT_WRITE_LOCK(client);
+
+    for (int i = 0; i < iovcnt && err == ESP_OK; i++) {
+        err = esp_mqtt_write_data(client, iov[i].data, iov[i].length);
+    }
+
+    if (err == ESP_OK) {
+        client->last_outbound_tick = platform_tick_get_ms();
+    }
+
+    MQTT_WRITE_UNLOCK(client);
+    return err;
+}
+
+/*
+ * Gather write, each segment is written from where it lives (encode buffer, outbox item or user memory)
+ * so that large payloads are never copied in chunks to the encode buffer
+ */
+static esp_err_t esp_mqtt_writev(esp_mqtt_client_handle_t client, const mqtt_iovec_t *iov, int iovcnt)
+{
+    esp_err_t err = mqtt_write_message(client, iov, iovcnt);
+
+    if (err == ESP_FAIL) {
+        esp_mqtt_client_dispatch_transport_error(client);
+    }
+
+    return err;
+}
+
+static inline esp_err_t esp_mqtt_write(esp_mqtt_client_handle_t client)
+{
+    mqtt_iovec_t iov = {
+        client->mqtt_state.connection.outbound_message.data, client->mqtt_state.connection.outbound_message.length
+    };
+    return esp_mqtt_writev(client, &iov, 1);
+}
+
 #ifdef MQTT_PROTOCOL_5
 static void mqtt_requeue_transmitted_messages(esp_mqtt_client_handle_t client)
 {
@@ -922,7 +1198,10 @@ static esp_err_t esp_mqtt_connect(esp_mqtt_client_handle_t client, int timeout_m
         return ESP_FAIL;
     }
 
+    // drop anything left from the previous connection
     client->mqtt_state.in_buffer_read_len = 0;
+    client->mqtt_state.in_buffer_head = 0;
+    client->mqtt_state.in_buffer_tail = 0;
     client->mqtt_state.message_length = 0;
     /* wait configured network timeout for broker connection response */
     uint64_t connack_recv_started = platform_tick_get_ms();
@@ -997,7 +1276,10 @@ static esp_err_t esp_mqtt_connect(esp_mqtt_client_handle_t client, int timeout_m
 static void esp_mqtt_abort_connection(esp_mqtt_client_handle_t client)
 {
     MQTT_API_LOCK(client);
+    // not while the MQTT task writes a queued message
+    MQTT_WRITE_LOCK(client);
     esp_transport_close(client->transport);
+    MQTT_WRITE_UNLOCK(client);
     client->wait_timeout_ms = client->config->reconnect_timeout_ms;
     client->reconnect_tick = platform_tick_get_ms();
     client->state = MQTT_STATE_WAIT_RECONNECT;
@@ -1008,12 +1290,57 @@ static void esp_mqtt_abort_connection(esp_mqtt_client_handle_t client)
     MQTT_API_UNLOCK(client);
 }
 
+#if MQTT_TASK_WAKEUP
+static int mqtt_wakeup_fd_create(void)
+{
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_err_t err = esp_vfs_eventfd_register(&config);
+
+    // already registered by the application or another client
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "Failed to register eventfd, queued messages are sent after the poll timeout: %s",
+                 esp_err_to_name(err));
+        return -1;
+    }
+
+    int fd = eventfd(0, 0);
+
+    if (fd < 0) {
+        ESP_LOGW(TAG, "Failed to create eventfd, queued messages are sent after the poll timeout: errno=%d", errno);
+    }
+
+    return fd;
+}
+#endif
+
+/*
+ * Wakes up the task waiting for incoming data to handle new work (enqueued messages, disconnect or stop requests)
+ */
+static void esp_mqtt_task_wakeup(esp_mqtt_client_handle_t client)
+{
+#if MQTT_TASK_WAKEUP
+    uint64_t count = 1;
+
+    if (client->wakeup_fd >= 0 && write(client->wakeup_fd, &count, sizeof(count)) != sizeof(count)) {
+        ESP_LOGD(TAG, "Failed to wake up the client task: errno=%d", errno);
+    }
+
+#endif
+}
+
 static bool create_client_data(esp_mqtt_client_handle_t client)
 {
+#if MQTT_TASK_WAKEUP
+    client->wakeup_fd = mqtt_wakeup_fd_create();
+#endif
     client->event.error_handle = calloc(1, sizeof(esp_mqtt_error_codes_t));
     ESP_MEM_CHECK(TAG, client->event.error_handle, return false)
     client->api_lock = xSemaphoreCreateRecursiveMutex();
     ESP_MEM_CHECK(TAG, client->api_lock, return false);
+#if MQTT_PUBLISH_FROM_TASK
+    client->write_lock = xSemaphoreCreateMutex();
+    ESP_MEM_CHECK(TAG, client->write_lock, return false);
+#endif
     client->outbox = outbox_init();
     ESP_MEM_CHECK(TAG, client->outbox, return false);
     client->status_bits = xEventGroupCreate();
@@ -1049,9 +1376,12 @@ esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *co
     esp_event_loop_create(&no_task_loop, &client->config->event_loop_handle);
 #if MQTT_EVENT_QUEUE_SIZE > 1
     atomic_init(&client->queued_events, 0);
+    esp_event_handler_register_with(client->config->event_loop_handle, MQTT_EVENTS, MQTT_EVENT_DATA,
+                                    mqtt_data_event_handled, client);
 #endif
 #endif
-    client->keepalive_tick = platform_tick_get_ms();
+    client->last_outbound_tick = platform_tick_get_ms();
+    client->last_inbound_tick = platform_tick_get_ms();
     client->reconnect_tick = platform_tick_get_ms();
     client->refresh_connection_tick = platform_tick_get_ms();
     client->wait_for_ping_resp = false;
@@ -1068,6 +1398,60 @@ _mqtt_init_failed:
     return NULL;
 }
 
+static void mqtt_complete_publish(esp_mqtt_client_handle_t client, int msg_id, esp_mqtt_publish_status_t status)
+{
+    esp_mqtt_publish_complete_cb_t complete_cb;
+    void *complete_ctx;
+
+    if (client->publish_completions == NULL ||
+            !mqtt_publish_completions_take(client->publish_completions, msg_id, &complete_cb, &complete_ctx)) {
+        return;
+    }
+
+    int reason_code = 0;
+#ifdef MQTT_PROTOCOL_5
+
+    if (status == MQTT_PUBLISH_COMPLETED &&
+            client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+        // parsed from the PUBACK or PUBCOMP
+        reason_code = client->event.reason_code;
+    }
+
+#endif
+    complete_cb(complete_ctx, msg_id, status, reason_code);
+}
+
+#if MQTT_PUBLISH_FROM_TASK
+/*
+ * Counts a QoS 0 publish message which left the outbox, completing its asynchronous publish if it was one
+ */
+static void mqtt_remove_queued_qos0(esp_mqtt_client_handle_t client, esp_mqtt_publish_status_t status)
+{
+    esp_mqtt_publish_complete_cb_t complete_cb;
+    void *complete_ctx;
+
+    client->removed_qos0 ++;
+
+    if (client->publish_completions &&
+            mqtt_publish_completions_take_queued(client->publish_completions, client->removed_qos0, &complete_cb,
+                                                 &complete_ctx)) {
+        complete_cb(complete_ctx, 0, status, 0);
+    }
+}
+#endif
+
+static void mqtt_drop_publish_completions(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_publish_complete_cb_t complete_cb;
+    void *complete_ctx;
+    uint16_t msg_id;
+
+    while (client->publish_completions &&
+            mqtt_publish_completions_take_any(client->publish_completions, &msg_id, &complete_cb, &complete_ctx)) {
+        complete_cb(complete_ctx, msg_id, MQTT_PUBLISH_DROPPED, 0);
+    }
+}
+
 esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
 {
     if (client == NULL) {
@@ -1085,10 +1469,15 @@ esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
         esp_transport_list_destroy(client->transport_list);
     }
 
+    mqtt_drop_publish_completions(client);
+    mqtt_publish_completions_destroy(client->publish_completions);
+
     if (client->outbox) {
         outbox_destroy(client->outbox);
     }
 
+    mqtt_topic_router_destroy(client->topic_router);
+
     if (client->status_bits) {
         vEventGroupDelete(client->status_bits);
     }
@@ -1097,6 +1486,21 @@ esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
         vSemaphoreDelete(client->api_lock);
     }
 
+#if MQTT_PUBLISH_FROM_TASK
+
+    if (client->write_lock) {
+        vSemaphoreDelete(client->write_lock);
+    }
+
+#endif
+
+#if MQTT_TASK_WAKEUP
+
+    if (client->wakeup_fd >= 0) {
+        close(client->wakeup_fd);
+    }
+
+#endif
     free(client->event.error_handle);
     free(client);
     return ESP_OK;
@@ -1269,24 +1673,85 @@ static esp_err_t esp_mqtt_dispatch_event(esp_mqtt_client_handle_t client)
     client->event.client = client;
     client->event.protocol_ver = client->mqtt_state.connection.information.protocol_ver;
     esp_err_t ret = ESP_FAIL;
+
+    if (client->config->event_callback) {
+        // the event isn't copied to the event loop queue, the callback gets it right away
+        client->config->event_callback(client->config->event_callback_args, &client->event);
+        ret = ESP_OK;
+    } else {
 #ifdef MQTT_SUPPORTED_FEATURE_EVENT_LOOP
-    esp_event_post_to(client->config->event_loop_handle, MQTT_EVENTS, client->event.event_id, &client->event,
-                      sizeof(client->event), portMAX_DELAY);
-    ret = esp_event_loop_run(client->config->event_loop_handle, 0);
+#if MQTT_EVENT_QUEUE_SIZE > 1
+        struct esp_mqtt_in_buffer *posted = NULL;
+
+        if (client->event.event_id == MQTT_EVENT_DATA) {
+            const char *data = client->event.data ? client->event.data : client->event.topic;
+            posted = mqtt_in_buffer_of(&client->mqtt_state, data);
+
+            if (posted) {
+                atomic_fetch_add(&posted->refs, 1);
+            }
+        }
+
+        if (esp_event_post_to(client->config->event_loop_handle, MQTT_EVENTS, client->event.event_id, &client->event,
+                              sizeof(client->event), portMAX_DELAY) != ESP_OK) {
+            esp_mqtt_event_release_data(posted);
+        } else if (client->event.event_id == MQTT_EVENT_DATA) {
+            mqtt_posted_data_push(client, posted);
+        }
+
+        ret = esp_event_loop_run(client->config->event_loop_handle, 0);
+
+        // without a spare buffer left, the next receive would overwrite the data of the queued events
+        while (ret == ESP_OK && client->posted_data_count > 0 &&
+                atomic_load(&client->mqtt_state.in_buffers[0]->refs) > 1 &&
+                !mqtt_in_buffer_spare_left(&client->mqtt_state)) {
+            ret = esp_event_loop_run(client->config->event_loop_handle, 0);
+        }
+
+        mqtt_release_handled_data(client);
 #else
-    return ESP_FAIL;
+        esp_event_post_to(client->config->event_loop_handle, MQTT_EVENTS, client->event.event_id, &client->event,
+                          sizeof(client->event), portMAX_DELAY);
+        ret = esp_event_loop_run(client->config->event_loop_handle, 0);
 #endif
+#else
+        return ESP_FAIL;
+#endif
+    }
 
     if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
 #ifdef MQTT_PROTOCOL_5
         esp_mqtt5_client_delete_user_property(client->event.property->user_property);
         client->event.property->user_property = NULL;
+        client->event.property->properties = NULL;
+        client->event.property->properties_len = 0;
+        client->mqtt5_config->publish_property_pending = false;
 #endif
     }
 
     return ret;
 }
 
+/* Calls the topic handlers matching the topic of a received message, before the event is posted */
+static void esp_mqtt_route_event(esp_mqtt_client_handle_t client, const char *topic, size_t topic_len)
+{
+    if (client->topic_router) {
+        client->event.client = client;
+        client->event.protocol_ver = client->mqtt_state.connection.information.protocol_ver;
+#if MQTT5_SUBSCRIBE_ID_ROUTING
+
+        // the broker already matched the topic of a message sent for a subscription with an identifier
+        if (client->event.protocol_ver == MQTT_PROTOCOL_V_5 &&
+                esp_mqtt5_client_route_subscription(client->mqtt5_config->subscriptions,
+                                                    client->mqtt5_config->publish_subscribe_id, topic, topic_len, &client->event)) {
+            return;
+        }
+
+#endif
+        mqtt_topic_router_dispatch(client->topic_router, topic, topic_len, &client->event);
+    }
+}
+
 static esp_err_t deliver_publish(esp_mqtt_client_handle_t client)
 {
     uint8_t *msg_buf = client->mqtt_state.in_buffer;
@@ -1354,30 +1819,41 @@ static esp_err_t deliver_publish(esp_mqtt_client_handle_t client)
         client->event.current_data_offset = msg_data_offset;
         client->event.topic = msg_topic;
         client->event.topic_len = msg_topic_len;
+        esp_mqtt_route_event(client, saved_msg_topic ? saved_msg_topic : msg_topic,
+                             saved_msg_topic ? saved_msg_topic_len : msg_topic_len);
         esp_mqtt_dispatch_event(client);
         send_event = false;
 
         if (msg_read_len < msg_total_len) {
             send_event = true;
+            bool keep_topic = client->topic_router != NULL;
 #ifdef CONFIG_MQTT_TOPIC_PRESENT_ALL_DATA_EVENTS
+            keep_topic = true;
+#endif
 
-            if (!saved_msg_topic) {
+            // the topic handlers are called for all the events of the message
+            if (!saved_msg_topic && keep_topic) {
                 saved_msg_topic = strndup(msg_topic, msg_topic_len);
                 ESP_MEM_CHECK(TAG, saved_msg_topic, return ESP_ERR_NO_MEM);
                 saved_msg_topic_len = msg_topic_len;
             }
 
-#endif
             size_t buf_len = client->mqtt_state.in_buffer_length;
+            mqtt_in_buffer_unshare(&client->mqtt_state);
             msg_data = (char *)client->mqtt_state.in_buffer;
+            msg_topic = NULL;
+            msg_topic_len = 0;
+#ifdef CONFIG_MQTT_TOPIC_PRESENT_ALL_DATA_EVENTS
             msg_topic = saved_msg_topic;
             msg_topic_len = saved_msg_topic_len;
+#endif
             msg_data_offset += msg_data_len;
             int ret = esp_transport_read(client->transport, (char *)client->mqtt_state.in_buffer,
                                          msg_total_len - msg_read_len > buf_len ? buf_len : msg_total_len - msg_read_len,
                                          client->config->network_timeout_ms);
 
             if (ret <= 0) {
+                free(saved_msg_topic);
                 return esp_mqtt_handle_transport_read_error(ret, client, false) == 0 ? ESP_OK : ESP_FAIL;
             }
 
@@ -1398,7 +1874,7 @@ static esp_err_t deliver_suback(esp_mqtt_client_handle_t client)
 
     if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
 #ifdef MQTT_PROTOCOL_5
-        msg_data = mqtt5_get_suback_data(msg_buf, &msg_data_len, &client->event.property->user_property);
+        msg_data = mqtt5_get_suback_data(msg_buf, &msg_data_len, MQTT5_EVENT_USER_PROPERTY(client));
 #else
         // SUBACK Using MQTT5 received but MQTT5 is disabled, This is unlikely to happen.
         return ESP_FAIL;
@@ -1439,6 +1915,8 @@ static esp_err_t deliver_suback(esp_mqtt_client_handle_t client)
 // Return false when message is not found, making the received counterpart invalid.
 static bool remove_initiator_message(esp_mqtt_client_handle_t client, int msg_type, int msg_id)
 {
+    MQTT_ASSERT_OUTBOX_OWNER(client);
+
     if (outbox_delete(client->outbox, msg_id, msg_type) == ESP_OK) {
         ESP_LOGD(TAG, "Removed pending_id=%d", msg_id);
         return true;
@@ -1448,7 +1926,41 @@ static bool remove_initiator_message(esp_mqtt_client_handle_t client, int msg_ty
     return false;
 }
 
-static outbox_item_handle_t mqtt_enqueue(esp_mqtt_client_handle_t client, uint8_t *remaining_data, int remaining_len)
+/* Records a write of a message, which is retransmitted unless acknowledged within its backed off timeout */
+static void mqtt_record_transmit(esp_mqtt_client_handle_t client, int msg_id, int retransmits)
+{
+    uint64_t tick = platform_tick_get_ms();
+    outbox_set_transmitted(client->outbox, msg_id, tick, retransmits,
+                           tick + mqtt_rtt_get_timeout(&client->rtt, retransmits));
+}
+
+/*
+ * Marks a message as transmitted for the first time, the tick is set after transmit to avoid retransmitting
+ * too early due slow network speed / big messages
+ */
+static void mqtt_set_transmitted(esp_mqtt_client_handle_t client, int msg_id)
+{
+    outbox_set_tick(client->outbox, msg_id, platform_tick_get_ms());
+    mqtt_record_transmit(client, msg_id, 0);
+    outbox_set_pending(client->outbox, msg_id, TRANSMITTED);
+}
+
+// Measures the round trip time to the acknowledgement of a message, unless the message was retransmitted
+// as the acknowledgement can't be matched to one of its transmissions then (Karn's algorithm)
+static void mqtt_measure_round_trip(esp_mqtt_client_handle_t client, int msg_id)
+{
+    outbox_item_handle_t item = outbox_get(client->outbox, msg_id);
+    outbox_tick_t transmit_tick;
+
+    if (item && outbox_item_get_pending(item) != QUEUED && outbox_item_get_retransmits(item, &transmit_tick) == 0) {
+        mqtt_rtt_add_sample(&client->rtt, platform_tick_get_ms() - transmit_tick);
+        ESP_LOGD(TAG, "Round trip of msg_id=%d, retransmit timeout %d ms", msg_id,
+                 (int)mqtt_rtt_get_timeout(&client->rtt, 0));
+    }
+}
+
+static outbox_item_handle_t mqtt_enqueue(esp_mqtt_client_handle_t client, uint8_t *remaining_data, int remaining_len,
+                                         outbox_free_cb_t remaining_free, void *remaining_free_ctx)
 {
     ESP_LOGD(TAG, "mqtt_enqueue id: %d, type=%d successful",
              client->mqtt_state.pending_msg_id, client->mqtt_state.pending_msg_type);
@@ -1460,160 +1972,171 @@ static outbox_item_handle_t mqtt_enqueue(esp_mqtt_client_handle_t client, uint8_
     msg.msg_qos = client->mqtt_state.pending_publish_qos;
     msg.remaining_data = remaining_data;
     msg.remaining_len = remaining_len;
+    msg.remaining_free = remaining_free;
+    msg.remaining_free_ctx = remaining_free_ctx;
     //Copy to queue buffer
     return outbox_enqueue(client->outbox, &msg, platform_tick_get_ms());
 }
 
 /*
- * Returns:
- *     -2 in case of failure or EOF (clean connection closure)
- *     -1 timeout while in-the-middle of the message
- *      0 if no message has been received
- *      1 if a message has been received and placed to client->mqtt_state:
- *           message length:  client->mqtt_state.message_length
- *           message content: client->mqtt_state.in_buffer
+ * Looks for a complete message at the start of the received bytes and moves it to the beginning of in_buffer,
+ * the bytes which follow it are kept for the next call.
  *
+ * Returns:
+ *     -2 in case of a malformed message or a message which doesn't fit the buffer
+ *      0 if more bytes are needed
+ *      1 if a message is available in client->mqtt_state (see mqtt_message_receive())
  */
-static int mqtt_message_receive(esp_mqtt_client_handle_t client, int read_poll_timeout_ms)
+static int mqtt_message_parse(esp_mqtt_client_handle_t client)
 {
-    int read_len, total_len, fixed_header_len;
-    uint8_t *buf = client->mqtt_state.in_buffer + client->mqtt_state.in_buffer_read_len;
-    esp_transport_handle_t t = client->transport;
-    client->mqtt_state.message_length = 0;
+    mqtt_state_t *state = &client->mqtt_state;
+    uint8_t *msg = state->in_buffer + state->in_buffer_head;
+    size_t available = state->in_buffer_tail - state->in_buffer_head;
+    size_t len_bytes = 1;
+    int fixed_header_len;
 
-    if (client->mqtt_state.in_buffer_read_len == 0) {
-        /*
-         * Read first byte of the mqtt packet fixed header, it contains packet
-         * type and flags.
-         */
-        read_len = esp_transport_read(t, (char *)buf, 1, read_poll_timeout_ms);
+    state->message_length = 0;
+    state->in_buffer_read_len = available;
 
-        if (read_len <= 0) {
-            return esp_mqtt_handle_transport_read_error(read_len, client, false);
-        }
+    if (available == 0) {
+        return 0;
+    }
 
-        ESP_LOGD(TAG, "%s: first byte: 0x%x", __func__, *buf);
+    /*
+     * Verify the flags and act according to MQTT protocol: close connection
+     * if the flags are set incorrectly.
+     */
+    if (!mqtt_has_valid_msg_hdr(msg, available)) {
+        ESP_LOGE(TAG, "%s: received a message with an invalid header=0x%x", __func__, *msg);
+        return -2;
+    }
+
+    // "remaining length" follows the first byte and spans up to 4 bytes
+    while (len_bytes < available && len_bytes < 5 && (msg[len_bytes] & 0x80)) {
+        len_bytes++;
+    }
+
+    if (len_bytes == 5) {
+        ESP_LOGE(TAG, "%s: received a message with an invalid remaining length", __func__);
+        return -2;
+    }
+
+    if (len_bytes == available) {
+        return 0;
+    }
+
+    size_t total_len = mqtt_get_total_length(msg, available, &fixed_header_len);
+    size_t msg_len = total_len;
+
+    if ((size_t)state->in_buffer_length < total_len) {
+        if (mqtt_get_type(msg) != MQTT_MSG_TYPE_PUBLISH) {
+            ESP_LOGE(TAG, "%s: message is too big, insufficient buffer size", __func__);
+            return -2;
+        }
 
         /*
-         * Verify the flags and act according to MQTT protocol: close connection
-         * if the flags are set incorrectly.
+         * In case larger publish messages, we only need to read full topic, data can be split to multiple data event.
+         * The message is read up to the buffer size, the rest of its data is read separately by deliver_publish()
          */
-        if (!mqtt_has_valid_msg_hdr(buf, read_len)) {
-            ESP_LOGE(TAG, "%s: received a message with an invalid header=0x%x", __func__, *buf);
-            goto err;
+        if (available < (size_t)fixed_header_len + 2) {
+            return 0;
         }
 
-        buf++;
-        client->mqtt_state.in_buffer_read_len++;
-    }
+        size_t topic_len = msg[fixed_header_len] << 8 | msg[fixed_header_len + 1];
 
-    if ((client->mqtt_state.in_buffer_read_len == 1) ||
-            ((client->mqtt_state.in_buffer_read_len < 6) && (*(buf - 1) & 0x80))) {
-        do {
-            /*
-             * Read the "remaining length" part of mqtt packet fixed header.  It
-             * starts at second byte and spans up to 4 bytes, but we accept here
-             * only up to 2 bytes of remaining length, i.e. messages with
-             * maximal remaining length value = 16383 (maximal total message
-             * size of 16386 bytes).
-             */
-            read_len = esp_transport_read(t, (char *)buf, 1, read_poll_timeout_ms);
+        if ((size_t)state->in_buffer_length < fixed_header_len + 2 + topic_len + (mqtt_get_qos(msg) > 0 ? 2 : 0)) {
+            ESP_LOGE(TAG, "%s: message is too big, insufficient buffer size", __func__);
+            return -2;
+        }
 
-            if (read_len <= 0) {
-                return esp_mqtt_handle_transport_read_error(read_len, client, true);
-            }
+        msg_len = state->in_buffer_length;
+    }
 
-            ESP_LOGD(TAG, "%s: read \"remaining length\" byte: 0x%x", __func__, *buf);
-            buf++;
-            client->mqtt_state.in_buffer_read_len++;
-        } while ((client->mqtt_state.in_buffer_read_len < 6) && (*(buf - 1) & 0x80));
-    }
-
-    total_len = mqtt_get_total_length(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_read_len,
-                                      &fixed_header_len);
-    ESP_LOGD(TAG, "%s: total message length: %d (already read: %"NEWLIB_NANO_COMPAT_FORMAT")", __func__, total_len,
-             NEWLIB_NANO_COMPAT_CAST(client->mqtt_state.in_buffer_read_len));
-    client->mqtt_state.message_length = total_len;
-
-    if (client->mqtt_state.in_buffer_length < total_len) {
-        if (mqtt_get_type(client->mqtt_state.in_buffer) == MQTT_MSG_TYPE_PUBLISH) {
-            /*
-             * In case larger publish messages, we only need to read full topic, data can be split to multiple data event.
-             * Evaluate and correct total_len to read only publish message header, so data can be read separately
-             */
-            if (client->mqtt_state.in_buffer_read_len < fixed_header_len + 2) {
-                /* read next 2 bytes - topic length to get minimum portion of publish packet */
-                read_len = esp_transport_read(t, (char *)buf, client->mqtt_state.in_buffer_read_len - fixed_header_len + 2,
-                                              read_poll_timeout_ms);
-                ESP_LOGD(TAG, "%s: read_len=%d", __func__, read_len);
-
-                if (read_len <= 0) {
-                    return esp_mqtt_handle_transport_read_error(read_len, client, true);
-                }
+    if (available < msg_len) {
+        return 0;
+    }
 
-                client->mqtt_state.in_buffer_read_len += read_len;
-                buf += read_len;
+    // message handlers expect the message at the beginning of the buffer
+    mqtt_in_buffer_unshare(state);
 
-                if (client->mqtt_state.in_buffer_read_len < fixed_header_len + 2) {
-                    ESP_LOGD(TAG,
-                             "%s: transport_read(): message reading left in progress :: total message length: %d (already read: %"NEWLIB_NANO_COMPAT_FORMAT")",
-                             __func__, total_len, NEWLIB_NANO_COMPAT_CAST(client->mqtt_state.in_buffer_read_len));
-                    return 0;
-                }
-            }
+    if (state->in_buffer_head > 0) {
+        memmove(state->in_buffer, state->in_buffer + state->in_buffer_head, msg_len);
+    }
 
-            int topic_len = client->mqtt_state.in_buffer[fixed_header_len] << 8;
-            topic_len |= client->mqtt_state.in_buffer[fixed_header_len + 1];
-            total_len = fixed_header_len + topic_len + (mqtt_get_qos(client->mqtt_state.in_buffer) > 0 ? 2 : 0);
-            ESP_LOGD(TAG, "%s: total len modified to %d as message longer than input buffer", __func__, total_len);
+    state->in_buffer_head += msg_len;
 
-            if (client->mqtt_state.in_buffer_length < total_len) {
-                ESP_LOGE(TAG, "%s: message is too big, insufficient buffer size", __func__);
-                goto err;
-            } else {
-                total_len = client->mqtt_state.in_buffer_length;
-            }
+    if (state->in_buffer_head == state->in_buffer_tail) {
+        state->in_buffer_head = 0;
+        state->in_buffer_tail = 0;
+    }
 
-            /* free to continue with reading */
-        } else {
-            ESP_LOGE(TAG, "%s: message is too big, insufficient buffer size", __func__);
-            goto err;
+    state->in_buffer_read_len = msg_len;
+    state->message_length = total_len;
+    return 1;
+}
+
+/*
+ * Reads as much as is available from the transport into in_buffer, several messages are buffered at once
+ * and returned one by one.
+ *
+ * Returns:
+ *     -2 in case of failure or EOF (clean connection closure)
+ *     -1 timeout while in-the-middle of the message
+ *      0 if no message has been received
+ *      1 if a message has been received and placed to client->mqtt_state:
+ *           message length:  client->mqtt_state.message_length
+ *           message content: client->mqtt_state.in_buffer
+ *
+ */
+static int mqtt_message_receive(esp_mqtt_client_handle_t client, int read_poll_timeout_ms)
+{
+    mqtt_state_t *state = &client->mqtt_state;
+    int ret = mqtt_message_parse(client);
+
+    if (ret == 0) {
+        mqtt_in_buffer_unshare(state);
+
+        // make room for the rest of a partially received message
+        if (state->in_buffer_head > 0) {
+            memmove(state->in_buffer, state->in_buffer + state->in_buffer_head,
+                    state->in_buffer_tail - state->in_buffer_head);
+            state->in_buffer_tail -= state->in_buffer_head;
+            state->in_buffer_head = 0;
         }
-    }
 
-    if (client->mqtt_state.in_buffer_read_len < total_len) {
-        /* read the rest of the mqtt message */
-        read_len = esp_transport_read(t, (char *)buf, total_len - client->mqtt_state.in_buffer_read_len, read_poll_timeout_ms);
-        ESP_LOGD(TAG, "%s: read_len=%d", __func__, read_len);
+        int read_len = esp_transport_read(client->transport, (char *)state->in_buffer + state->in_buffer_tail,
+                                          state->in_buffer_length - state->in_buffer_tail, read_poll_timeout_ms);
+        ESP_LOGV(TAG, "%s: read_len=%d", __func__, read_len);
 
         if (read_len <= 0) {
-            return esp_mqtt_handle_transport_read_error(read_len, client, true);
+            return esp_mqtt_handle_transport_read_error(read_len, client, state->in_buffer_tail > 0);
         }
 
-        client->mqtt_state.in_buffer_read_len += read_len;
+        state->in_buffer_tail += read_len;
+        state->in_buffer_read_tick = platform_tick_get_ms();
+        ret = mqtt_message_parse(client);
+    }
+
+    if (ret < 0) {
+        esp_mqtt_client_dispatch_transport_error(client);
+        return -2;
+    }
 
-        if (client->mqtt_state.in_buffer_read_len < total_len) {
-            ESP_LOGD(TAG,
-                     "%s: transport_read(): message reading left in progress :: total message length: %d (already read: %"NEWLIB_NANO_COMPAT_FORMAT")",
-                     __func__, total_len, NEWLIB_NANO_COMPAT_CAST(client->mqtt_state.in_buffer_read_len));
-            return 0;
-        }
+    if (ret == 0) {
+        ESP_LOGD(TAG, "%s: message reading left in progress (already read: %"NEWLIB_NANO_COMPAT_FORMAT")", __func__,
+                 NEWLIB_NANO_COMPAT_CAST(state->in_buffer_read_len));
+        return 0;
     }
 
-    ESP_LOGV(TAG, "%s: transport_read():%"NEWLIB_NANO_COMPAT_FORMAT" %"NEWLIB_NANO_COMPAT_FORMAT, __func__,
-             NEWLIB_NANO_COMPAT_CAST(client->mqtt_state.in_buffer_read_len),
-             NEWLIB_NANO_COMPAT_CAST(client->mqtt_state.message_length));
+    ESP_LOGV(TAG, "%s: message received, length %"NEWLIB_NANO_COMPAT_FORMAT" (in buffer %"NEWLIB_NANO_COMPAT_FORMAT")",
+             __func__, NEWLIB_NANO_COMPAT_CAST(state->message_length), NEWLIB_NANO_COMPAT_CAST(state->in_buffer_read_len));
     return 1;
-err:
-    esp_mqtt_client_dispatch_transport_error(client);
-    return -2;
 }
 
-static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
+static esp_err_t mqtt_process_message(esp_mqtt_client_handle_t client);
+
+esp_err_t esp_mqtt_process_receive(esp_mqtt_client_handle_t client)
 {
-    uint8_t msg_type = 0, msg_qos = 0;
-    uint16_t msg_id = 0;
-    size_t previous_in_buffer_read_len = client->mqtt_state.in_buffer_read_len;
     /* non-blocking receive in order not to block other tasks */
     int recv = mqtt_message_receive(client, 0);
 
@@ -1622,8 +2145,8 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
     }
 
     if (recv == -1) {    // Mid-message timeout
-        if (previous_in_buffer_read_len == client->mqtt_state.in_buffer_read_len) {
-            // Report error only if didn't receive anything since previous iteration
+        if (has_timed_out(client->mqtt_state.in_buffer_read_tick, client->config->network_timeout_ms)) {
+            // Report error only if the rest of the message didn't come within the network timeout
             ESP_LOGE(TAG, "%s: Network timeout while reading MQTT message", __func__);
             return ESP_FAIL;
         }
@@ -1636,6 +2159,27 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
         return ESP_FAIL;
     }
 
+    client->last_inbound_tick = platform_tick_get_ms();
+
+    // process all complete messages which came with the same read
+    do {
+        if (mqtt_process_message(client) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    } while (client->state == MQTT_STATE_CONNECTED && (recv = mqtt_message_parse(client)) == 1);
+
+    if (recv < 0) {
+        esp_mqtt_client_dispatch_transport_error(client);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t mqtt_process_message(esp_mqtt_client_handle_t client)
+{
+    uint8_t msg_type = 0, msg_qos = 0;
+    uint16_t msg_id = 0;
     int read_len = client->mqtt_state.message_length;
     // If the message was valid, get the type, quality of service and id of the message
     msg_type = mqtt_get_type(client->mqtt_state.in_buffer);
@@ -1728,6 +2272,8 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
         break;
 
     case MQTT_MSG_TYPE_PUBACK:
+        mqtt_measure_round_trip(client, msg_id);
+
         if (remove_initiator_message(client, MQTT_MSG_TYPE_PUBLISH, msg_id)) {
 #ifdef MQTT_PROTOCOL_5
 
@@ -1740,6 +2286,7 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
 #ifdef MQTT_PROTOCOL_5
             esp_mqtt5_parse_puback(client);
 #endif
+            mqtt_complete_publish(client, msg_id, MQTT_PUBLISH_COMPLETED);
             client->event.event_id = MQTT_EVENT_PUBLISHED;
             esp_mqtt_dispatch_event_with_msgid(client);
         }
@@ -1764,8 +2311,11 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
             return ESP_FAIL;
         }
 
+        mqtt_measure_round_trip(client, msg_id);
         outbox_set_pending(client->outbox, msg_id, ACKNOWLEDGED);
         esp_mqtt_write(client);
+        // the PUBREL is retransmitted from now on
+        mqtt_record_transmit(client, msg_id, 0);
         break;
 
     case MQTT_MSG_TYPE_PUBREL:
@@ -1791,6 +2341,7 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
 
     case MQTT_MSG_TYPE_PUBCOMP:
         ESP_LOGD(TAG, "received MQTT_MSG_TYPE_PUBCOMP");
+        mqtt_measure_round_trip(client, msg_id);
 
         if (remove_initiator_message(client, MQTT_MSG_TYPE_PUBLISH, msg_id)) {
 #ifdef MQTT_PROTOCOL_5
@@ -1804,6 +2355,7 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
 #ifdef MQTT_PROTOCOL_5
             esp_mqtt5_parse_pubcomp(client);
 #endif
+            mqtt_complete_publish(client, msg_id, MQTT_PUBLISH_COMPLETED);
             client->event.event_id = MQTT_EVENT_PUBLISHED;
             esp_mqtt_dispatch_event_with_msgid(client);
         }
@@ -1812,13 +2364,12 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
 
     case MQTT_MSG_TYPE_PINGRESP:
         ESP_LOGD(TAG, "MQTT_MSG_TYPE_PINGRESP");
+
+        if (client->wait_for_ping_resp) {
+            mqtt_rtt_add_sample(&client->rtt, platform_tick_get_ms() - client->ping_tick);
+        }
+
         client->wait_for_ping_resp = false;
-        /* It is the responsibility of the Client to ensure that the interval between Control Packets
-         * being sent does not exceed the Keep Alive value. In the absence of sending any other Control
-         * Packets, the Client MUST send a PINGREQ Packet [MQTT-3.1.2-23].
-         * [MQTT-3.1.2-23]
-         */
-        client->keepalive_tick = platform_tick_get_ms();
         break;
 
     case MQTT_MSG_TYPE_DISCONNECT:
@@ -1845,7 +2396,8 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
     return ESP_OK;
 }
 
-static esp_err_t mqtt_resend_queued(esp_mqtt_client_handle_t client, outbox_item_handle_t item)
+/* Decodes a queued item to mqtt_state and iov, returns the number of segments */
+static int mqtt_queued_message(esp_mqtt_client_handle_t client, outbox_item_handle_t item, mqtt_iovec_t iov[2])
 {
     // decode queued data
     client->mqtt_state.connection.outbound_message.data = outbox_item_get_data(item,
@@ -1860,8 +2412,20 @@ static esp_err_t mqtt_resend_queued(esp_mqtt_client_handle_t client, outbox_item
                  client->mqtt_state.pending_msg_id);
     }
 
+    // payload of zero-copy publishes is referenced by the item and follows the header
+    iov[0].data = client->mqtt_state.connection.outbound_message.data;
+    iov[0].length = client->mqtt_state.connection.outbound_message.length;
+    iov[1].data = outbox_item_get_remaining_data(item, &iov[1].length);
+    return iov[1].data ? 2 : 1;
+}
+
+static esp_err_t mqtt_resend_queued(esp_mqtt_client_handle_t client, outbox_item_handle_t item)
+{
+    mqtt_iovec_t iov[2];
+    int iovcnt = mqtt_queued_message(client, item, iov);
+
     // try to resend the data
-    if (esp_mqtt_write(client) != ESP_OK) {
+    if (esp_mqtt_writev(client, iov, iovcnt) != ESP_OK) {
         ESP_LOGE(TAG, "Error to resend data ");
         esp_mqtt_abort_connection(client);
         return ESP_FAIL;
@@ -1917,26 +2481,247 @@ static esp_err_t mqtt_resend_pubrel(esp_mqtt_client_handle_t client, outbox_item
     return ESP_OK;
 }
 
+static outbox_item_handle_t mqtt_next_queued(esp_mqtt_client_handle_t client)
+{
+    outbox_item_handle_t item = outbox_dequeue(client->outbox, QUEUED, NULL);
+#ifdef MQTT_PROTOCOL_5
+
+    if (item && client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5 &&
+            esp_mqtt5_client_check_inflight_maximum(client) != ESP_OK) {
+        size_t len;
+        uint16_t msg_id;
+        int msg_type = 0;
+        int msg_qos = 0;
+
+        if (outbox_item_get_data(item, &len, &msg_id, &msg_type, &msg_qos) != NULL &&
+                msg_type == MQTT_MSG_TYPE_PUBLISH && msg_qos > 0) {
+            // Receive Maximum applies only to QoS 1 and QoS 2.
+            item = mqtt_get_queued_qos0(client->outbox);
+        }
+    }
+
+#endif
+    return item;
+}
+
+/*
+ * Sends queued outbox items back to back until nothing more can go out now (the queue is empty or the
+ * MQTT5 Receive Maximum is reached), the transport would block, or the per iteration budget is used up
+ */
+mqtt_drain_result_t esp_mqtt_drain_queued(esp_mqtt_client_handle_t client)
+{
+    uint64_t start = platform_tick_get_ms();
+    size_t sent_bytes = 0;
+    outbox_item_handle_t item;
+
+    while ((item = mqtt_next_queued(client)) != NULL) {
+        if (sent_bytes > 0) {
+            if (sent_bytes >= MQTT_SEND_BUDGET_BYTES || has_timed_out(start, MQTT_SEND_BUDGET_MS)) {
+                return MQTT_DRAIN_BUDGET_EXHAUSTED;
+            }
+
+            // the first item may wait for the network timeout as before, the following ones only if there is room
+            if (esp_transport_poll_write(client->transport, 0) <= 0) {
+                return MQTT_DRAIN_WOULD_BLOCK;
+            }
+        }
+
+        mqtt_iovec_t iov[2];
+        int iovcnt = mqtt_queued_message(client, item, iov);
+        int msg_type = client->mqtt_state.pending_msg_type;
+        int msg_qos = client->mqtt_state.pending_publish_qos;
+        uint16_t msg_id = client->mqtt_state.pending_msg_id;
+#if MQTT_PUBLISH_FROM_TASK
+        // only this task deletes items (MQTT_ASSERT_OUTBOX_OWNER), other tasks may publish while it is written
+        MQTT_API_UNLOCK(client);
+        esp_err_t err = mqtt_write_message(client, iov, iovcnt);
+        MQTT_API_LOCK(client);
+
+        if (err == ESP_FAIL) {
+            esp_mqtt_client_dispatch_transport_error(client);
+        }
+
+#else
+        esp_err_t err = esp_mqtt_writev(client, iov, iovcnt);
+#endif
+
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error to resend data ");
+            esp_mqtt_abort_connection(client);
+            return MQTT_DRAIN_FAILED;
+        }
+
+        sent_bytes += iov[0].length + (iovcnt > 1 ? iov[1].length : 0);
+
+        if (msg_type == MQTT_MSG_TYPE_PUBLISH && msg_qos == 0) {
+            // delete all qos0 publish messages once we process them
+            MQTT_ASSERT_OUTBOX_OWNER(client);
+
+            if (outbox_delete_item(client->outbox, item) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to remove queued qos0 message from the outbox");
+                return MQTT_DRAIN_IDLE;
+            }
+
+#if MQTT_PUBLISH_FROM_TASK
+            mqtt_remove_queued_qos0(client, MQTT_PUBLISH_COMPLETED);
+#endif
+        } else {
+            mqtt_set_transmitted(client, msg_id);
+#ifdef MQTT_PROTOCOL_5
+
+            if (msg_type == MQTT_MSG_TYPE_PUBLISH &&
+                    client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+                esp_mqtt5_increment_packet_counter(client);
+            }
+
+#endif
+        }
+
+#if MQTT_PUBLISH_FROM_TASK
+
+        // the connection may have been aborted by another task meanwhile
+        if (client->state != MQTT_STATE_CONNECTED) {
+            return MQTT_DRAIN_FAILED;
+        }
+
+#endif
+    }
+
+    return MQTT_DRAIN_IDLE;
+}
+
+/*
+ * Resends the messages whose retransmit timeout has passed, the earliest due first, back to back until none is
+ * overdue, the transport would block, or the burst budget is used up. With MQTT5, a burst also resends no more
+ * PUBLISH packets than the broker's Receive Maximum
+ */
+mqtt_drain_result_t esp_mqtt_retransmit_overdue(esp_mqtt_client_handle_t client)
+{
+    uint64_t start = platform_tick_get_ms();
+    size_t sent_bytes = 0;
+#ifdef MQTT_PROTOCOL_5
+    int publish_quota = -1;
+
+    if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+        publish_quota = client->mqtt5_config->server_resp_property_info.receive_maximum;
+    }
+
+#endif
+    outbox_item_handle_t item;
+    outbox_tick_t due;
+
+    while ((item = outbox_get_next_retransmit(client->outbox, &due)) != NULL && due <= (outbox_tick_t)start) {
+        if (sent_bytes > 0) {
+            if (sent_bytes >= MQTT_RETRANSMIT_BURST_BYTES || has_timed_out(start, MQTT_SEND_BUDGET_MS)) {
+                return MQTT_DRAIN_BUDGET_EXHAUSTED;
+            }
+
+            if (esp_transport_poll_write(client->transport, 0) <= 0) {
+                return MQTT_DRAIN_WOULD_BLOCK;
+            }
+        }
+
+        int retransmits = outbox_item_get_retransmits(item, NULL);
+        size_t remaining_len = 0;
+
+        if (outbox_item_get_pending(item) == ACKNOWLEDGED) {
+            if (mqtt_resend_pubrel(client, item) != ESP_OK) {
+                return MQTT_DRAIN_FAILED;
+            }
+        } else {
+#ifdef MQTT_PROTOCOL_5
+            size_t len;
+            uint16_t msg_id;
+            int msg_type = 0;
+            int msg_qos;
+
+            if (outbox_item_get_data(item, &len, &msg_id, &msg_type, &msg_qos) != NULL &&
+                    msg_type == MQTT_MSG_TYPE_PUBLISH) {
+                if (publish_quota == 0) {
+                    return MQTT_DRAIN_BUDGET_EXHAUSTED;
+                }
+
+                if (publish_quota > 0) {
+                    publish_quota--;
+                }
+            }
+
+#endif
+
+            if (mqtt_resend_queued(client, item) != ESP_OK) {
+                return MQTT_DRAIN_FAILED;
+            }
+
+            outbox_item_get_remaining_data(item, &remaining_len);
+        }
+
+        sent_bytes += client->mqtt_state.connection.outbound_message.length + remaining_len;
+        mqtt_record_transmit(client, client->mqtt_state.pending_msg_id, retransmits + 1);
+    }
+
+    return MQTT_DRAIN_IDLE;
+}
+
+/* Shortens the poll timeout so that the task doesn't wait for incoming data past a due retransmission */
+static int mqtt_retransmit_poll_timeout(esp_mqtt_client_handle_t client, int timeout_ms)
+{
+    outbox_tick_t due;
+
+    if (outbox_get_next_retransmit(client->outbox, &due) != NULL) {
+        int64_t wait = due - (int64_t)platform_tick_get_ms();
+
+        if (wait < timeout_ms) {
+            timeout_ms = wait > 0 ? (int)wait : 0;
+        }
+    }
+
+    return timeout_ms;
+}
+
 static void mqtt_delete_expired_messages(esp_mqtt_client_handle_t client)
 {
+    MQTT_ASSERT_OUTBOX_OWNER(client);
     // Delete message after OUTBOX_EXPIRED_TIMEOUT_MS milliseconds
-#if MQTT_REPORT_DELETED_MESSAGES
-    // also report the deleted items as MQTT_EVENT_DELETED events if enabled
+#if !MQTT_REPORT_DELETED_MESSAGES
+#if MQTT_PUBLISH_FROM_TASK
+    // the QoS 0 messages leaving the outbox have to be counted
+    bool no_queued_qos0 = client->queued_qos0 == client->removed_qos0;
+#else
+    bool no_queued_qos0 = true;
+#endif
+
+    if (no_queued_qos0 &&
+            (client->publish_completions == NULL || mqtt_publish_completions_count(client->publish_completions) == 0)) {
+        outbox_delete_expired(client->outbox, platform_tick_get_ms(), OUTBOX_EXPIRED_TIMEOUT_MS);
+        return;
+    }
+
+#endif
+    // delete the items one by one to complete the asynchronous publishes among them
     int msg_id = 0;
 
     while ((msg_id = outbox_delete_single_expired(client->outbox, platform_tick_get_ms(),
                                                   OUTBOX_EXPIRED_TIMEOUT_MS)) >= 0) {
+#if MQTT_PUBLISH_FROM_TASK
+
+        // only QoS 0 publish messages are queued without message id
+        if (msg_id == 0) {
+            mqtt_remove_queued_qos0(client, MQTT_PUBLISH_EXPIRED);
+        }
+
+#endif
+        mqtt_complete_publish(client, msg_id, MQTT_PUBLISH_EXPIRED);
+#if MQTT_REPORT_DELETED_MESSAGES
+        // also report the deleted items as MQTT_EVENT_DELETED events if enabled
         client->event.event_id = MQTT_EVENT_DELETED;
         client->event.msg_id = msg_id;
 
         if (esp_mqtt_dispatch_event(client) != ESP_OK) {
             ESP_LOGE(TAG, "Failed to post event on deleting message id=%d", msg_id);
         }
-    }
 
-#else
-    outbox_delete_expired(client->outbox, platform_tick_get_ms(), OUTBOX_EXPIRED_TIMEOUT_MS);
 #endif
+    }
 }
 
 /**
@@ -1952,6 +2737,56 @@ static inline int max_poll_timeout(esp_mqtt_client_handle_t client, int max_time
 #endif
 }
 
+/*
+ * Polls the transport for incoming data, returning early with 0 when the task is woken up for new work
+ */
+static int mqtt_poll_read(esp_mqtt_client_handle_t client, int timeout_ms)
+{
+#if MQTT_TASK_WAKEUP
+    int sock = esp_transport_get_socket(client->transport);
+
+    if (client->wakeup_fd >= 0 && sock >= 0 && timeout_ms > 0) {
+        // data may be already buffered by the transport (e.g. decrypted TLS records)
+        int ret = esp_transport_poll_read(client->transport, 0);
+
+        if (ret != 0) {
+            return ret;
+        }
+
+        fd_set readset;
+        fd_set errset;
+        FD_ZERO(&readset);
+        FD_ZERO(&errset);
+        FD_SET(sock, &readset);
+        FD_SET(sock, &errset);
+        FD_SET(client->wakeup_fd, &readset);
+        struct timeval timeout = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000,
+        };
+        ret = select((sock > client->wakeup_fd ? sock : client->wakeup_fd) + 1, &readset, NULL, &errset, &timeout);
+
+        if (ret < 0) {
+            return ret;
+        }
+
+        uint64_t count;
+
+        if (FD_ISSET(client->wakeup_fd, &readset) && read(client->wakeup_fd, &count, sizeof(count)) < 0) {
+            ESP_LOGD(TAG, "Failed to clear the task wakeup: errno=%d", errno);
+        }
+
+        if (FD_ISSET(sock, &errset)) {
+            return -1;
+        }
+
+        return FD_ISSET(sock, &readset) ? 1 : 0;
+    }
+
+#endif
+    return esp_transport_poll_read(client->transport, timeout_ms);
+}
+
 static inline void run_event_loop(esp_mqtt_client_handle_t client)
 {
 #if MQTT_EVENT_QUEUE_SIZE > 1
@@ -1962,6 +2797,9 @@ static inline void run_event_loop(esp_mqtt_client_handle_t client)
     {
 #endif
         esp_err_t ret = esp_event_loop_run(client->config->event_loop_handle, 0);
+#if MQTT_EVENT_QUEUE_SIZE > 1
+        mqtt_release_handled_data(client);
+#endif
 
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Error in running event_loop %d", ret);
@@ -1972,13 +2810,13 @@ static inline void run_event_loop(esp_mqtt_client_handle_t client)
 static void esp_mqtt_task(void *pv)
 {
     esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t) pv;
-    uint64_t last_retransmit = 0;
-    outbox_tick_t msg_tick = 0;
     client->run = true;
     client->state = MQTT_STATE_INIT;
-    xEventGroupClearBits(client->status_bits, STOPPED_BIT);
+    xEventGroupClearBits(client->status_bits, STOPPED_BIT | WAKEUP_BIT);
 
     while (client->run) {
+        mqtt_drain_result_t drain = MQTT_DRAIN_IDLE;
+        int poll_timeout = MQTT_POLL_READ_TIMEOUT_MS;
         MQTT_API_LOCK(client);
         run_event_loop(client);
         // delete long pending messages
@@ -2053,7 +2891,9 @@ static void esp_mqtt_task(void *pv)
             client->state = MQTT_STATE_CONNECTED;
             esp_mqtt_dispatch_event_with_msgid(client);
             client->refresh_connection_tick = platform_tick_get_ms();
-            client->keepalive_tick = platform_tick_get_ms();
+            client->last_outbound_tick = platform_tick_get_ms();
+            client->last_inbound_tick = platform_tick_get_ms();
+            mqtt_draw_keepalive_jitter(client);
             break;
 
         case MQTT_STATE_CONNECTED:
@@ -2066,74 +2906,30 @@ static void esp_mqtt_task(void *pv)
             }
 
             // receive and process data
-            if (mqtt_process_receive(client) == ESP_FAIL) {
+            if (esp_mqtt_process_receive(client) == ESP_FAIL) {
                 esp_mqtt_abort_connection(client);
                 break;
             }
 
-            if (last_retransmit == 0) {
-                // connected for first time, set last_retransmit to now, avoid retransmit
-                last_retransmit = platform_tick_get_ms();
-            }
-
-            // resend all non-transmitted messages first
-            outbox_item_handle_t item = outbox_dequeue(client->outbox, QUEUED, NULL);
-#ifdef MQTT_PROTOCOL_5
+            // send all non-transmitted messages first
+            drain = esp_mqtt_drain_queued(client);
 
-            if (item && client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5 &&
-                    esp_mqtt5_client_check_inflight_maximum(client) != ESP_OK) {
-                size_t len;
-                uint16_t msg_id;
-                int msg_type = 0;
-                int msg_qos = 0;
-
-                if (outbox_item_get_data(item, &len, &msg_id, &msg_type, &msg_qos) != NULL &&
-                        msg_type == MQTT_MSG_TYPE_PUBLISH && msg_qos > 0) {
-                    // Receive Maximum applies only to QoS 1 and QoS 2.
-                    item = mqtt_get_queued_qos0(client->outbox);
-                }
+            if (drain == MQTT_DRAIN_FAILED) {
+                break;
             }
 
-#endif
-
-            if (item) {
-                if (mqtt_resend_queued(client, item) == ESP_OK) {
-                    if (client->mqtt_state.pending_msg_type == MQTT_MSG_TYPE_PUBLISH && client->mqtt_state.pending_publish_qos == 0) {
-                        // delete all qos0 publish messages once we process them
-                        if (outbox_delete_item(client->outbox, item) != ESP_OK) {
-                            ESP_LOGE(TAG, "Failed to remove queued qos0 message from the outbox");
-                        }
-                    } else {
-                        outbox_set_tick(client->outbox, client->mqtt_state.pending_msg_id, platform_tick_get_ms());
-                        outbox_set_pending(client->outbox, client->mqtt_state.pending_msg_id, TRANSMITTED);
-#ifdef MQTT_PROTOCOL_5
-
-                        if (client->mqtt_state.pending_msg_type == MQTT_MSG_TYPE_PUBLISH &&
-                                client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
-                            esp_mqtt5_increment_packet_counter(client);
-                        }
-
-#endif
-                    }
-                }
-
-                // resend other "transmitted" messages after 1s
-            } else if (has_timed_out(last_retransmit, client->config->message_retransmit_timeout)) {
-                last_retransmit = platform_tick_get_ms();
-                item = outbox_dequeue(client->outbox, TRANSMITTED, &msg_tick);
-
-                if (item && (last_retransmit - msg_tick > client->config->message_retransmit_timeout))  {
-                    mqtt_resend_queued(client, item);
-                }
-
-                item = outbox_dequeue(client->outbox, ACKNOWLEDGED, &msg_tick);
+            // resend other "transmitted" messages after their retransmit timeout
+            if (drain == MQTT_DRAIN_IDLE) {
+                drain = esp_mqtt_retransmit_overdue(client);
 
-                if (item && (last_retransmit - msg_tick > client->config->message_retransmit_timeout))  {
-                    mqtt_resend_pubrel(client, item);
+                if (drain == MQTT_DRAIN_FAILED) {
+                    break;
                 }
             }
 
-            if (process_keepalive(client) != ESP_OK) {
+            poll_timeout = mqtt_retransmit_poll_timeout(client, poll_timeout);
+
+            if (esp_mqtt_process_keepalive(client) != ESP_OK) {
                 break;
             }
 
@@ -2162,7 +2958,7 @@ static void esp_mqtt_task(void *pv)
             }
 
             MQTT_API_UNLOCK(client);
-            xEventGroupWaitBits(client->status_bits, RECONNECT_BIT, false, true,
+            xEventGroupWaitBits(client->status_bits, RECONNECT_BIT | WAKEUP_BIT, false, false,
                                 max_poll_timeout(client, client->wait_timeout_ms / 2 / portTICK_PERIOD_MS));
             // continue the while loop instead of break, as the mutex is unlocked
             continue;
@@ -2175,7 +2971,15 @@ static void esp_mqtt_task(void *pv)
         MQTT_API_UNLOCK(client);
 
         if (MQTT_STATE_CONNECTED == client->state) {
-            if (esp_transport_poll_read(client->transport, max_poll_timeout(client, MQTT_POLL_READ_TIMEOUT_MS)) < 0) {
+            // don't wait for incoming data while queued messages could still be sent, or right after connecting
+            // as messages which came together with CONNACK are already buffered
+            if (state == MQTT_STATE_INIT || drain == MQTT_DRAIN_BUDGET_EXHAUSTED) {
+                poll_timeout = 0;
+            } else if (drain == MQTT_DRAIN_WOULD_BLOCK) {
+                poll_timeout = MQTT_SEND_BUDGET_MS;
+            }
+
+            if (mqtt_poll_read(client, max_poll_timeout(client, poll_timeout)) < 0) {
                 ESP_LOGE(TAG, "Poll read error: %d, aborting connection", errno);
                 esp_mqtt_abort_connection(client);
             }
@@ -2183,7 +2987,15 @@ static void esp_mqtt_task(void *pv)
     }
 
     esp_transport_close(client->transport);
+    MQTT_ASSERT_OUTBOX_OWNER(client);
+    // other tasks may still enqueue messages, the outbox is only modified with the client locked
+    MQTT_API_LOCK(client);
     outbox_delete_all_items(client->outbox);
+#if MQTT_PUBLISH_FROM_TASK
+    client->removed_qos0 = client->queued_qos0;
+#endif
+    mqtt_drop_publish_completions(client);
+    MQTT_API_UNLOCK(client);
     client->state = MQTT_STATE_DISCONNECTED;
     xEventGroupSetBits(client->status_bits, STOPPED_BIT);
 #if MQTT_TASK_STACK_ON_EXTERNAL_MEMORY
@@ -2245,6 +3057,7 @@ esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
 
     ESP_LOGI(TAG, "Client asked to disconnect");
     xEventGroupSetBits(client->status_bits, DISCONNECT_BIT);
+    esp_mqtt_task_wakeup(client);
     return ESP_OK;
 }
 
@@ -2324,6 +3137,8 @@ esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
         client->run = false;
         client->state = MQTT_STATE_DISCONNECTED;
         MQTT_API_UNLOCK(client);
+        xEventGroupSetBits(client->status_bits, WAKEUP_BIT);
+        esp_mqtt_task_wakeup(client);
         xEventGroupWaitBits(client->status_bits, STOPPED_BIT, false, true, portMAX_DELAY);
         return ESP_OK;
     } else {
@@ -2388,14 +3203,27 @@ int esp_mqtt_client_subscribe_multiple(esp_mqtt_client_handle_t client,
             return -1;
         }
 
+        const esp_mqtt5_subscribe_property_config_t *property = client->mqtt5_config->subscribe_property_info;
+#if MQTT5_SUBSCRIBE_ID_ROUTING
+        esp_mqtt5_subscribe_property_config_t id_property;
+        property = esp_mqtt5_client_apply_subscribe_id(client, topic_list, size, &id_property);
+#endif
         mqtt5_msg_subscribe(&client->mqtt_state.connection,
                             topic_list, size,
-                            &client->mqtt_state.pending_msg_id, client->mqtt5_config->subscribe_property_info);
+                            &client->mqtt_state.pending_msg_id, property);
 
         if (client->mqtt_state.connection.outbound_message.length) {
             client->mqtt5_config->subscribe_property_info = NULL;
         }
 
+#if MQTT5_SUBSCRIBE_ID_ROUTING
+
+        if (client->mqtt_state.connection.outbound_message.length == 0 && property == &id_property) {
+            esp_mqtt5_client_remove_subscription(client->mqtt5_config->subscriptions, id_property.subscribe_id);
+        }
+
+#endif
+
 #endif
     } else {
         mqtt_msg_subscribe(&client->mqtt_state.connection,
@@ -2412,12 +3240,12 @@ int esp_mqtt_client_subscribe_multiple(esp_mqtt_client_handle_t client,
     client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.connection.outbound_message.data);
 
     //move pending msg to outbox (if have)
-    if (!mqtt_enqueue(client, NULL, 0)) {
+    if (!mqtt_enqueue(client, NULL, 0, NULL, NULL)) {
         MQTT_API_UNLOCK(client);
         return -1;
     }
 
-    outbox_set_pending(client->outbox, client->mqtt_state.pending_msg_id, TRANSMITTED);// handle error
+    mqtt_set_transmitted(client, client->mqtt_state.pending_msg_id);
 
     if (esp_mqtt_write(client) != ESP_OK) {
         ESP_LOGE(TAG, "Error to send subscribe message, first topic: %s, qos: %d", topic_list[0].filter, topic_list[0].qos);
@@ -2460,6 +3288,9 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
 
         if (client->mqtt_state.connection.outbound_message.length) {
             client->mqtt5_config->unsubscribe_property_info = NULL;
+#if MQTT5_SUBSCRIBE_ID_ROUTING
+            esp_mqtt5_client_remove_subscribed_filter(client->mqtt5_config->subscriptions, topic);
+#endif
         }
 
 #endif
@@ -2478,12 +3309,12 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
     ESP_LOGD(TAG, "unsubscribe, topic\"%s\", id: %d", topic, client->mqtt_state.pending_msg_id);
     client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.connection.outbound_message.data);
 
-    if (!mqtt_enqueue(client, NULL, 0)) {
+    if (!mqtt_enqueue(client, NULL, 0, NULL, NULL)) {
         MQTT_API_UNLOCK(client);
         return -1;
     }
 
-    outbox_set_pending(client->outbox, client->mqtt_state.pending_msg_id, TRANSMITTED); //handle error
+    mqtt_set_transmitted(client, client->mqtt_state.pending_msg_id);
 
     if (esp_mqtt_write(client) != ESP_OK) {
         ESP_LOGE(TAG, "Error to unsubscribe topic=%s", topic);
@@ -2497,21 +3328,44 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
     return pending_msg_id;
 }
 
-static int make_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
-                        int len, int qos, int retain)
-{
+/*
+ * write_now tells that a QoS 0 message is written right away and never sent again, so it can use
+ * a topic alias assigned by the client, which is only valid on the current connection
+ */
+static int make_publish(esp_mqtt_client_handle_t client, esp_mqtt_publish_template_handle_t tmpl, const char *topic,
+                        const char *data, int len, int qos, int retain, bool write_now)
+{
     uint16_t pending_msg_id = 0;
 
-    if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+    if (tmpl) {
+        mqtt_msg_publish_template(&client->mqtt_state.connection, tmpl->header, tmpl->header_len, tmpl->id_offset,
+                                  data, len, qos, retain, &pending_msg_id);
+    } else if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
 #ifdef MQTT_PROTOCOL_5
+        const esp_mqtt5_publish_property_config_t *property = client->mqtt5_config->publish_property_info;
+#if MQTT5_AUTO_TOPIC_ALIAS
+        esp_mqtt5_publish_property_config_t alias_property;
+
+        if (write_now && qos == 0) {
+            property = esp_mqtt5_client_apply_topic_alias(client, &topic, &alias_property);
+        }
+
+#endif
         mqtt5_msg_publish(&client->mqtt_state.connection,
                           topic, data, len,
                           qos, retain,
-                          &pending_msg_id, client->mqtt5_config->publish_property_info,
+                          &pending_msg_id, property,
                           client->mqtt5_config->server_resp_property_info.response_info);
 
         if (client->mqtt_state.connection.outbound_message.length) {
             client->mqtt5_config->publish_property_info = NULL;
+#if MQTT5_AUTO_TOPIC_ALIAS
+
+            if (property == &alias_property) {
+                esp_mqtt5_client_establish_outbound_topic_alias(client->mqtt5_config->topic_alias, alias_property.topic_alias);
+            }
+
+#endif
         }
 
 #endif
@@ -2529,15 +3383,32 @@ static int make_publish(esp_mqtt_client_handle_t client, const char *topic, cons
 
     return pending_msg_id;
 }
-static inline int mqtt_client_enqueue_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
-                                              int len, int qos, int retain, bool store)
+/*
+ * Encodes a publish message and stores it in the outbox if it is QoS>0 or store is set. write_now is only set
+ * by the callers which write the message right away, see make_publish()
+ */
+static inline int mqtt_client_enqueue_publish(esp_mqtt_client_handle_t client, esp_mqtt_publish_template_handle_t tmpl,
+                                              const char *topic, const char *data, int len, int qos, int retain,
+                                              bool store, bool write_now)
 {
-    int pending_msg_id = make_publish(client, topic, data, len, qos, retain);
+    if (data == NULL && len > 0) {
+        ESP_LOGE(TAG, "Publish message cannot be created");
+        return -1;
+    }
+
+    int pending_msg_id = make_publish(client, tmpl, topic, data, len, qos, retain, write_now);
 
     if (pending_msg_id < 0) {
         return -1;
     }
 
+    // A payload which doesn't fit the buffer is not encoded, it follows the outbound message on the wire
+    size_t unencoded_len = mqtt_get_total_length(client->mqtt_state.connection.outbound_message.data,
+                                                 client->mqtt_state.connection.outbound_message.length, NULL) -
+                           client->mqtt_state.connection.outbound_message.length;
+    client->mqtt_state.connection.outbound_message.fragmented_msg_data_offset = 0;
+    client->mqtt_state.connection.outbound_message.fragmented_msg_total_length = 0;
+
     /* We have to set as pending all the qos>0 messages */
     //TODO: client->mqtt_state.outbound_message = publish_msg;
     if (qos > 0 || store) {
@@ -2545,34 +3416,25 @@ static inline int mqtt_client_enqueue_publish(esp_mqtt_client_handle_t client, c
         client->mqtt_state.pending_msg_id = pending_msg_id;
         client->mqtt_state.pending_publish_qos = qos;
 
-        // by default store as QUEUED (not transmitted yet) only for messages which would fit outbound buffer
-        if (client->mqtt_state.connection.outbound_message.fragmented_msg_total_length == 0) {
-            if (!mqtt_enqueue(client, NULL, 0)) {
-                return -1;
-            }
-        } else {
-            int first_fragment = client->mqtt_state.connection.outbound_message.length -
-                                 client->mqtt_state.connection.outbound_message.fragmented_msg_data_offset;
+        if (!mqtt_enqueue(client, unencoded_len ? (uint8_t *)data + len - unencoded_len : NULL, unencoded_len, NULL, NULL)) {
+            return -1;
+        }
 
-            if (!mqtt_enqueue(client, ((uint8_t *)data) + first_fragment, len - first_fragment)) {
-                return -1;
-            }
+#if MQTT_PUBLISH_FROM_TASK
 
-            client->mqtt_state.connection.outbound_message.fragmented_msg_total_length = 0;
+        if (qos == 0) {
+            client->queued_qos0 ++;
         }
+
+#endif
     }
 
     return pending_msg_id;
 }
 
-int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
-                            int retain)
+static int mqtt_client_publish(esp_mqtt_client_handle_t client, esp_mqtt_publish_template_handle_t tmpl,
+                               const char *topic, const char *data, int len, int qos, int retain)
 {
-    if (!client) {
-        ESP_LOGE(TAG, "Client was not initialized");
-        return -1;
-    }
-
 #if MQTT_SKIP_PUBLISH_IF_DISCONNECTED
 
     if (client->state != MQTT_STATE_CONNECTED) {
@@ -2610,13 +3472,43 @@ int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
         }
     }
 
-    int pending_msg_id = mqtt_client_enqueue_publish(client, topic, data, len, qos, retain, false);
+#if MQTT_PUBLISH_FROM_TASK
+
+    if (qos == 0 && client->state != MQTT_STATE_CONNECTED) {
+        ESP_LOGW(TAG, "Publish: Losing qos0 data when client not connected");
+        MQTT_API_UNLOCK(client);
+        return -1;
+    }
+
+    // only the encoding and the outbox admission are done under the lock, the MQTT task writes the message
+    int queued_msg_id = mqtt_client_enqueue_publish(client, tmpl, topic, data, len, qos, retain, true, false);
+    MQTT_API_UNLOCK(client);
+
+    if (queued_msg_id >= 0) {
+        esp_mqtt_task_wakeup(client);
+    }
+
+    return queued_msg_id;
+#else
+    int pending_msg_id = mqtt_client_enqueue_publish(client, tmpl, topic, data, len, qos, retain, false, true);
 
     if (pending_msg_id < 0) {
         MQTT_API_UNLOCK(client);
         return -1;
     }
 
+    /* A payload which doesn't fit the buffer is not encoded, it is written straight from the user's memory */
+    mqtt_message_t *outbound = &client->mqtt_state.connection.outbound_message;
+    size_t unencoded_len = mqtt_get_total_length(outbound->data, outbound->length, NULL) - outbound->length;
+    mqtt_iovec_t iov[2] = {
+        { outbound->data, outbound->length },
+    };
+    int iovcnt = 1;
+
+    if (unencoded_len) {
+        iov[iovcnt++] = (mqtt_iovec_t) { (const uint8_t *)data + len - unencoded_len, unencoded_len };
+    }
+
     int ret = 0;
 
     /* Skip sending if not connected (rely on resending) */
@@ -2643,37 +3535,10 @@ int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
     }
 
 #endif
-    /* Provide support for sending fragmented message if it doesn't fit buffer */
-    int remaining_len = len;
-    const char *current_data = data;
-    bool sending = true;
-
-    while (sending)  {
-        if (esp_mqtt_write(client) != ESP_OK) {
-            esp_mqtt_abort_connection(client);
-            ret = -1;
-            goto cannot_publish;
-        }
-
-        int data_sent = client->mqtt_state.connection.outbound_message.length -
-                        client->mqtt_state.connection.outbound_message.fragmented_msg_data_offset;
-        client->mqtt_state.connection.outbound_message.fragmented_msg_data_offset = 0;
-        client->mqtt_state.connection.outbound_message.fragmented_msg_total_length = 0;
-        remaining_len -= data_sent;
-        current_data +=  data_sent;
-
-        if (remaining_len > 0) {
-            mqtt_connection_t *connection = &client->mqtt_state.connection;
-            ESP_LOGD(TAG, "Sending fragmented message, remains to send %d bytes of %d", remaining_len, len);
-            int write_len = remaining_len > connection->buffer_length ? connection->buffer_length : remaining_len;
-            memcpy(connection->buffer, current_data, write_len);
-            connection->outbound_message.data = connection->buffer;
-            connection->outbound_message.length = write_len;
-            sending = true;
-        } else {
-            // Message was sent correctly
-            sending = false;
-        }
+    if (esp_mqtt_writev(client, iov, iovcnt) != ESP_OK) {
+        esp_mqtt_abort_connection(client);
+        ret = -1;
+        goto cannot_publish;
     }
 
     if (qos > 0) {
@@ -2684,23 +3549,150 @@ int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
         }
 
 #endif
-        //Tick is set after transmit to avoid retransmitting too early due slow network speed / big messages
-        outbox_set_tick(client->outbox, pending_msg_id, platform_tick_get_ms());
-        outbox_set_pending(client->outbox, pending_msg_id, TRANSMITTED);
+        mqtt_set_transmitted(client, pending_msg_id);
     }
 
     MQTT_API_UNLOCK(client);
     return pending_msg_id;
 cannot_publish:
-    // clear out possible fragmented publish if failed or skipped
-    client->mqtt_state.connection.outbound_message.fragmented_msg_total_length = 0;
-
     if (qos == 0) {
         ESP_LOGW(TAG, "Publish: Losing qos0 data when client not connected");
     }
 
     MQTT_API_UNLOCK(client);
     return ret;
+#endif
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain)
+{
+    if (!client) {
+        ESP_LOGE(TAG, "Client was not initialized");
+        return -1;
+    }
+
+    return mqtt_client_publish(client, NULL, topic, data, len, qos, retain);
+}
+
+int esp_mqtt_client_publish_async(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                                  int qos, int retain, esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx)
+{
+    if (!client) {
+        ESP_LOGE(TAG, "Client was not initialized");
+        return -1;
+    }
+
+    if (!complete_cb) {
+        ESP_LOGE(TAG, "Asynchronous publish requires a completion callback");
+        return -1;
+    }
+
+    // keep the client locked until the completion is added, before the message could be acknowledged
+    MQTT_API_LOCK(client);
+
+    if (client->publish_completions == NULL) {
+        client->publish_completions = mqtt_publish_completions_create();
+
+        if (client->publish_completions == NULL) {
+            MQTT_API_UNLOCK(client);
+            return -1;
+        }
+    }
+
+#if MQTT_PUBLISH_FROM_TASK
+    // a QoS 0 message is only queued, it completes once the MQTT task writes it
+    bool queued = qos == 0;
+    esp_err_t err = queued ? mqtt_publish_completions_reserve_queued(client->publish_completions) :
+                    mqtt_publish_completions_reserve(client->publish_completions);
+#else
+    bool queued = false;
+    esp_err_t err = mqtt_publish_completions_reserve(client->publish_completions);
+#endif
+
+    if (err != ESP_OK) {
+        MQTT_API_UNLOCK(client);
+        return -1;
+    }
+
+    int msg_id = mqtt_client_publish(client, NULL, topic, data, len, qos, retain);
+
+    if (msg_id > 0) {
+        mqtt_publish_completions_add(client->publish_completions, msg_id, complete_cb, complete_ctx);
+    }
+
+#if MQTT_PUBLISH_FROM_TASK
+
+    if (msg_id == 0 && queued) {
+        // the message was just counted as queued
+        mqtt_publish_completions_add_queued(client->publish_completions, client->queued_qos0, complete_cb,
+                                            complete_ctx);
+    }
+
+#endif
+    MQTT_API_UNLOCK(client);
+
+    if (msg_id == 0 && !queued) {
+        complete_cb(complete_ctx, msg_id, MQTT_PUBLISH_COMPLETED, 0);
+    }
+
+    return msg_id;
+}
+
+esp_mqtt_publish_template_handle_t esp_mqtt_client_create_publish_template(esp_mqtt_client_handle_t client,
+                                                                           const char *topic, int qos, int retain)
+{
+    if (!client) {
+        ESP_LOGE(TAG, "Client was not initialized");
+        return NULL;
+    }
+
+    MQTT_API_LOCK(client);
+    // Encode a publish message without payload, its variable header is the template
+    esp_mqtt_publish_template_handle_t tmpl = NULL;
+    mqtt_message_t *outbound = &client->mqtt_state.connection.outbound_message;
+
+    if (make_publish(client, NULL, topic, NULL, 0, qos, retain, false) >= 0) {
+        int fixed_header_len = 0;
+        mqtt_get_total_length(outbound->data, outbound->length, &fixed_header_len);
+        size_t header_len = outbound->length - fixed_header_len;
+        tmpl = calloc(1, sizeof(struct esp_mqtt_publish_template) + header_len);
+        ESP_MEM_CHECK(TAG, tmpl, {
+            MQTT_API_UNLOCK(client);
+            return NULL;
+        });
+        tmpl->protocol_ver = client->mqtt_state.connection.information.protocol_ver;
+        tmpl->qos = qos;
+        tmpl->retain = retain;
+        tmpl->header_len = header_len;
+        memcpy(tmpl->header, outbound->data + fixed_header_len, header_len);
+        // the message id follows the topic
+        tmpl->id_offset = 2 + (tmpl->header[0] << 8 | tmpl->header[1]);
+    }
+
+    MQTT_API_UNLOCK(client);
+    return tmpl;
+}
+
+int esp_mqtt_client_publish_with_template(esp_mqtt_client_handle_t client, esp_mqtt_publish_template_handle_t tmpl,
+                                          const char *data, int len)
+{
+    if (!client) {
+        ESP_LOGE(TAG, "Client was not initialized");
+        return -1;
+    }
+
+    if (!tmpl || tmpl->protocol_ver != client->mqtt_state.connection.information.protocol_ver) {
+        ESP_LOGE(TAG, "Invalid publish template");
+        return -1;
+    }
+
+    return mqtt_client_publish(client, tmpl, NULL, data, len, tmpl->qos, tmpl->retain);
+}
+
+void esp_mqtt_client_destroy_publish_template(esp_mqtt_publish_template_handle_t tmpl)
+{
+    free(tmpl);
 }
 
 int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
@@ -2738,9 +3730,14 @@ int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic,
     }
 
 #endif
-    int ret = mqtt_client_enqueue_publish(client, topic, data, len, qos, retain, store);
+    int ret = mqtt_client_enqueue_publish(client, NULL, topic, data, len, qos, retain, store, false);
     MQTT_API_UNLOCK(client);
 
+    // qos0 messages are in the outbox only if stored
+    if (ret > 0 || (ret == 0 && store)) {
+        esp_mqtt_task_wakeup(client);
+    }
+
     if (ret == 0 && store == false) {
         // messages with qos=0 are not enqueued if not overridden by store_in_outobx -> indicate as error
         return -1;
@@ -2749,6 +3746,323 @@ int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic,
     return ret;
 }
 
+int esp_mqtt_client_publish_owned(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                                  int qos, int retain, esp_mqtt_payload_free_cb_t free_cb, void *free_ctx)
+{
+    if (!client) {
+        ESP_LOGE(TAG, "Client was not initialized");
+        return -1;
+    }
+
+    if (data == NULL || free_cb == NULL) {
+        ESP_LOGE(TAG, "Owned publish requires payload and free callback");
+        return -1;
+    }
+
+#if MQTT_SKIP_PUBLISH_IF_DISCONNECTED
+
+    if (client->state != MQTT_STATE_CONNECTED) {
+        ESP_LOGI(TAG, "Publishing skipped: client is not connected");
+        return -1;
+    }
+
+#endif
+    MQTT_API_LOCK(client);
+#ifdef MQTT_PROTOCOL_5
+
+    if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+        if (esp_mqtt5_client_publish_check(client, qos, retain) != ESP_OK) {
+            ESP_LOGI(TAG, "MQTT5 publish check fail");
+            MQTT_API_UNLOCK(client);
+            return -1;
+        }
+    }
+
+#endif
+
+    if (len <= 0) {
+        len = strlen(data);
+    }
+
+    if (client->config->outbox_limit > 0 && qos > 0) {
+        if (len + outbox_get_size(client->outbox) > client->config->outbox_limit) {
+            MQTT_API_UNLOCK(client);
+            return -2;
+        }
+    }
+
+    // Encode only the header, the payload is written from the caller's buffer
+    int pending_msg_id = make_publish(client, NULL, topic, NULL, len, qos, retain, true);
+    client->mqtt_state.connection.outbound_message.fragmented_msg_data_offset = 0;
+    client->mqtt_state.connection.outbound_message.fragmented_msg_total_length = 0;
+
+    if (pending_msg_id < 0) {
+        MQTT_API_UNLOCK(client);
+        return -1;
+    }
+
+    if (qos == 0) {
+        if (client->state != MQTT_STATE_CONNECTED) {
+            ESP_LOGW(TAG, "Publish: Losing qos0 data when client not connected");
+            MQTT_API_UNLOCK(client);
+            return -1;
+        }
+
+        mqtt_iovec_t iov[2] = {
+            { client->mqtt_state.connection.outbound_message.data, client->mqtt_state.connection.outbound_message.length },
+            { (const uint8_t *)data, len },
+        };
+
+        if (esp_mqtt_writev(client, iov, 2) != ESP_OK) {
+            esp_mqtt_abort_connection(client);
+            MQTT_API_UNLOCK(client);
+            return -1;
+        }
+
+        MQTT_API_UNLOCK(client);
+        free_cb((void *)data, free_ctx);
+        return 0;
+    }
+
+    client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.connection.outbound_message.data);
+    client->mqtt_state.pending_msg_id = pending_msg_id;
+    client->mqtt_state.pending_publish_qos = qos;
+    outbox_item_handle_t item = mqtt_enqueue(client, (uint8_t *)data, len, free_cb, free_ctx);
+
+    if (!item) {
+        MQTT_API_UNLOCK(client);
+        return -1;
+    }
+
+    // From now on the outbox owns the payload, failures below are recovered by resending
+    if (client->state != MQTT_STATE_CONNECTED) {
+        ESP_LOGD(TAG, "Publish: client is not connected");
+        MQTT_API_UNLOCK(client);
+        return pending_msg_id;
+    }
+
+#ifdef MQTT_PROTOCOL_5
+
+    if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+        if (esp_mqtt5_client_check_inflight_maximum(client) != ESP_OK) {
+            ESP_LOGW(TAG, "Unable to publish now: maximum inflight messages reached");
+            MQTT_API_UNLOCK(client);
+            return pending_msg_id;
+        }
+    }
+
+#endif
+
+    // The item is written rather than the caller's buffer, as a custom outbox may have released it already
+    if (mqtt_resend_queued(client, item) != ESP_OK) {
+        MQTT_API_UNLOCK(client);
+        return pending_msg_id;
+    }
+
+#ifdef MQTT_PROTOCOL_5
+
+    if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+        esp_mqtt5_increment_packet_counter(client);
+    }
+
+#endif
+    mqtt_set_transmitted(client, pending_msg_id);
+    MQTT_API_UNLOCK(client);
+    return pending_msg_id;
+}
+
+/*
+ * Writes the publish packets packed at the start of the output buffer followed by an optional payload
+ * which was not encoded. QoS0 messages of a failed write are lost and reported as failed, QoS>0 ones are
+ * resent from the outbox.
+ *
+ * The packed QoS>0 messages are the first `inflight` ones of the range, the later ones were held back by the
+ * broker's Receive Maximum. They count as in flight and transmitted only once written.
+ */
+static void mqtt_flush_batch(esp_mqtt_client_handle_t client, size_t packed, const uint8_t *payload,
+                             size_t payload_len, const esp_mqtt_publish_t *msgs, int *msg_ids, size_t from, size_t to,
+                             size_t inflight)
+{
+    mqtt_iovec_t iov[2] = {
+        { client->mqtt_state.connection.buffer, packed },
+        { payload, payload_len },
+    };
+
+    if (packed == 0) {
+        return;
+    }
+
+    if (esp_mqtt_writev(client, iov, payload_len ? 2 : 1) != ESP_OK) {
+        esp_mqtt_abort_connection(client);
+
+        for (size_t i = from; i < to; i++) {
+            if (msgs[i].qos == 0 && msg_ids[i] == 0) {
+                msg_ids[i] = -1;
+            }
+        }
+
+        return;
+    }
+
+    for (size_t i = from; i < to && inflight > 0; i++) {
+        if (msgs[i].qos > 0 && msg_ids[i] > 0) {
+#ifdef MQTT_PROTOCOL_5
+
+            if (client->mqtt_state.connection.information.protocol_ver == MQTT_PROTOCOL_V_5) {
+                esp_mqtt5_increment_packet_counter(client);
+            }
+
+#endif
+            mqtt_set_transmitted(client, msg_ids[i]);
+            inflight--;
+        }
+    }
+}
+
+int esp_mqtt_client_publish_batch(esp_mqtt_client_handle_t client, const esp_mqtt_publish_t *msgs, size_t n,
+                                  int *msg_ids)
+{
+    if (!client) {
+        ESP_LOGE(TAG, "Client was not initialized");
+        return -1;
+    }
+
+    if (n > 0 && (msgs == NULL || msg_ids == NULL)) {
+        ESP_LOGE(TAG, "Invalid batch arguments");
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        msg_ids[i] = -1;
+    }
+
+#if MQTT_SKIP_PUBLISH_IF_DISCONNECTED
+
+    if (client->state != MQTT_STATE_CONNECTED) {
+        ESP_LOGI(TAG, "Publishing skipped: client is not connected");
+        return 0;
+    }
+
+#endif
+    MQTT_API_LOCK(client);
+    mqtt_connection_t *connection = &client->mqtt_state.connection;
+    uint8_t *buffer = connection->buffer;
+    size_t buffer_length = connection->buffer_length;
+    size_t packed = 0;      // bytes of encoded packets waiting at the start of the buffer
+    size_t flush_from = 0;  // first message of the packed ones
+    size_t inflight = 0;    // QoS>0 messages of the packed ones
+    int accepted = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const esp_mqtt_publish_t *msg = &msgs[i];
+        int len = msg->len;
+#ifdef MQTT_PROTOCOL_5
+
+        if (connection->information.protocol_ver == MQTT_PROTOCOL_V_5) {
+            if (esp_mqtt5_client_publish_check(client, msg->qos, msg->retain) != ESP_OK) {
+                ESP_LOGI(TAG, "MQTT5 publish check fail");
+                continue;
+            }
+        }
+
+#endif
+
+        if (len <= 0 && msg->data != NULL) {
+            len = strlen(msg->data);
+        }
+
+        if (client->config->outbox_limit > 0 && msg->qos > 0) {
+            if (len + outbox_get_size(client->outbox) > client->config->outbox_limit) {
+                msg_ids[i] = -2;
+                continue;
+            }
+        }
+
+        if (msg->qos == 0 && client->state != MQTT_STATE_CONNECTED) {
+            ESP_LOGW(TAG, "Publish: Losing qos0 data when client not connected");
+            continue;
+        }
+
+        // Room needed after the packed packets: fixed header, topic, message id and MQTT5 property length at most,
+        // followed by the payload unless it doesn't fit even an empty buffer
+        size_t needed = (msg->topic ? strlen(msg->topic) : 0) + 13;
+
+        if (needed + len <= buffer_length) {
+            needed += len;
+        }
+
+        bool has_properties = false;
+#ifdef MQTT_PROTOCOL_5
+        has_properties = client->mqtt5_config && client->mqtt5_config->publish_property_info;
+#endif
+
+        if (packed > 0 && (packed + needed > buffer_length || has_properties)) {
+            mqtt_flush_batch(client, packed, NULL, 0, msgs, msg_ids, flush_from, i, inflight);
+            packed = 0;
+            flush_from = i;
+            inflight = 0;
+        }
+
+        // Encode right after the packed packets
+        connection->buffer = buffer + packed;
+        connection->buffer_length = buffer_length - packed;
+        int msg_id = mqtt_client_enqueue_publish(client, NULL, msg->topic, msg->data, len, msg->qos, msg->retain, false,
+                                                 true);
+        connection->buffer = buffer;
+        connection->buffer_length = buffer_length;
+
+        if (msg_id < 0) {
+            continue;
+        }
+
+        msg_ids[i] = msg_id;
+
+        if (client->state != MQTT_STATE_CONNECTED) {
+            continue;
+        }
+
+#ifdef MQTT_PROTOCOL_5
+
+        // The packed messages are counted in flight only once written
+        if (connection->information.protocol_ver == MQTT_PROTOCOL_V_5 && msg->qos > 0 &&
+                client->send_publish_packet_count + inflight >=
+                client->mqtt5_config->server_resp_property_info.receive_maximum) {
+            ESP_LOGW(TAG, "Unable to publish now: maximum inflight messages reached");
+            continue;
+        }
+
+#endif
+        mqtt_message_t *outbound = &connection->outbound_message;
+        size_t unencoded_len = mqtt_get_total_length(outbound->data, outbound->length, NULL) - outbound->length;
+        memmove(buffer + packed, outbound->data, outbound->length);
+        packed += outbound->length;
+
+        if (msg->qos > 0) {
+            inflight++;
+        }
+
+        if (unencoded_len) {
+            // Payload doesn't fit the buffer, it is written right after the packed packets
+            mqtt_flush_batch(client, packed, (const uint8_t *)msg->data + len - unencoded_len, unencoded_len,
+                             msgs, msg_ids, flush_from, i + 1, inflight);
+            packed = 0;
+            flush_from = i + 1;
+            inflight = 0;
+        }
+    }
+
+    mqtt_flush_batch(client, packed, NULL, 0, msgs, msg_ids, flush_from, n, inflight);
+    MQTT_API_UNLOCK(client);
+
+    for (size_t i = 0; i < n; i++) {
+        if (msg_ids[i] >= 0) {
+            accepted++;
+        }
+    }
+
+    return accepted;
+}
+
 esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
                                          esp_event_handler_t event_handler, void *event_handler_arg)
 {
@@ -2782,6 +4096,45 @@ esp_err_t esp_mqtt_client_unregister_event(esp_mqtt_client_handle_t client, esp_
 #endif
 }
 
+esp_err_t esp_mqtt_client_register_topic_handler(esp_mqtt_client_handle_t client, const char *topic_filter,
+                                                 esp_mqtt_topic_handler_t handler, void *handler_args)
+{
+    if (client == NULL) {
+        ESP_LOGD(TAG, "Unable to register topic handler - client handle is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    MQTT_API_LOCK(client);
+
+    if (client->topic_router == NULL) {
+        client->topic_router = mqtt_topic_router_create();
+
+        if (client->topic_router == NULL) {
+            MQTT_API_UNLOCK(client);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    esp_err_t ret = mqtt_topic_router_add(client->topic_router, topic_filter, handler, handler_args);
+    MQTT_API_UNLOCK(client);
+    return ret;
+}
+
+esp_err_t esp_mqtt_client_unregister_topic_handler(esp_mqtt_client_handle_t client, const char *topic_filter,
+                                                   esp_mqtt_topic_handler_t handler, void *handler_args)
+{
+    if (client == NULL) {
+        ESP_LOGD(TAG, "Unable to unregister topic handler - client handle is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    MQTT_API_LOCK(client);
+    esp_err_t ret = client->topic_router ?
+                    mqtt_topic_router_remove(client->topic_router, topic_filter, handler, handler_args) : ESP_ERR_NOT_FOUND;
+    MQTT_API_UNLOCK(client);
+    return ret;
+}
+
 static void esp_mqtt_client_dispatch_transport_error(esp_mqtt_client_handle_t client)
 {
     client->event.event_id = MQTT_EVENT_ERROR;
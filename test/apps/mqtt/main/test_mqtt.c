@@ -102,6 +102,7 @@ TEST(mqtt, broker_tests)
     RUN_MQTT_BROKER_TEST(mqtt_subscribe_publish);
     RUN_MQTT_BROKER_TEST(mqtt_lwt_clean_disconnect);
     RUN_MQTT_BROKER_TEST(mqtt_subscribe_payload);
+    RUN_MQTT_BROKER_TEST(mqtt_publish_from_tasks);
     connect_test_fixture_teardown();
 }
 #endif // SOC_EMAC_SUPPORTED
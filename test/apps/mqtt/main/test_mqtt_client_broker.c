@@ -1,10 +1,12 @@
 /*
- * SPDX-FileCopyrightText: 2021-2025 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2021-2026 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "mqtt_client.h"
 #include "esp_log.h"
 #include "esp_mac.h"
@@ -226,3 +228,121 @@ bool mqtt_subscribe_payload(void)
     free(topic);
     return true;
 }
+
+#define PUBLISH_TASKS 4
+#define PUBLISH_TASK_MESSAGES 32
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    const char *topic;
+    int task;
+    SemaphoreHandle_t done;
+} publish_task_args_t;
+
+typedef struct {
+    bool received[PUBLISH_TASKS][PUBLISH_TASK_MESSAGES];
+    int distinct;
+} publish_tasks_received_t;
+
+static void mqtt_data_handler_publish_tasks(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    if (event_id == MQTT_EVENT_DATA) {
+        esp_mqtt_event_handle_t event = event_data;
+        publish_tasks_received_t *received = handler_args;
+        char payload[16] = {0};
+        int task, msg;
+
+        if (strncmp(event->data, "qos0", event->data_len) == 0) {
+            // QoS 0 messages are only published to keep the client busy
+            return;
+        }
+
+        if (event->data_len < (int)sizeof(payload)) {
+            memcpy(payload, event->data, event->data_len);
+        }
+
+        if (sscanf(payload, "%d-%d", &task, &msg) != 2 ||
+                task < 0 || task >= PUBLISH_TASKS || msg < 0 || msg >= PUBLISH_TASK_MESSAGES) {
+            ESP_LOGE("mqtt-publish-tasks", "Unexpected DATA=%.*s", event->data_len, event->data);
+            return;
+        }
+
+        // QoS 1 messages could be received twice
+        if (!received->received[task][msg]) {
+            received->received[task][msg] = true;
+
+            if (++received->distinct == PUBLISH_TASKS * PUBLISH_TASK_MESSAGES) {
+                xEventGroupSetBits(s_event_group, DATA_BIT);
+            }
+        }
+    }
+}
+
+static void publish_task(void *pvParameters)
+{
+    publish_task_args_t *args = pvParameters;
+    char payload[16];
+
+    for (int i = 0; i < PUBLISH_TASK_MESSAGES; i++) {
+        snprintf(payload, sizeof(payload), "%d-%d", args->task, i);
+
+        // a QoS 0 message in between, so that the MQTT task writes both kinds while this task publishes
+        if (esp_mqtt_client_publish(args->client, args->topic, payload, 0, 1, 0) < 0 ||
+                esp_mqtt_client_publish(args->client, args->topic, "qos0", 0, 0, 0) < 0) {
+            ESP_LOGE("mqtt-publish-tasks", "Task %d failed to publish message %d", args->task, i);
+            break;
+        }
+    }
+
+    xSemaphoreGive(args->done);
+    vTaskDelete(NULL);
+}
+
+bool mqtt_publish_from_tasks(void)
+{
+    const esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = CONFIG_MQTT_TEST_BROKER_URI,
+        .network.disable_auto_reconnect = true,
+    };
+    char *topic = append_mac("publish_tasks");
+    TEST_ASSERT_TRUE(NULL != topic);
+    s_event_group = xEventGroupCreate();
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(PUBLISH_TASKS, 0);
+    TEST_ASSERT_TRUE(NULL != done);
+    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+    TEST_ASSERT_TRUE(NULL != client);
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    TEST_ASSERT_TRUE(ESP_OK == esp_mqtt_client_start(client));
+    WAIT_FOR_EVENT(CONNECT_BIT);
+    int qos_payload = -1;
+    esp_mqtt_client_register_event(client, MQTT_EVENT_SUBSCRIBED, mqtt_data_handler_subscribe, &qos_payload);
+    TEST_ASSERT_TRUE(esp_mqtt_client_subscribe(client, topic, 1) != -1);
+    WAIT_FOR_EVENT(DATA_BIT);
+    TEST_ASSERT_TRUE(qos_payload == 1);
+    esp_mqtt_client_unregister_event(client, MQTT_EVENT_SUBSCRIBED, mqtt_data_handler_subscribe);
+    static publish_tasks_received_t received;
+    memset(&received, 0, sizeof(received));
+    esp_mqtt_client_register_event(client, MQTT_EVENT_DATA, mqtt_data_handler_publish_tasks, &received);
+    // the tasks publish while the MQTT task writes their earlier messages, with CONFIG_MQTT_PUBLISH_FROM_TASK
+    // also without holding the client locked
+    publish_task_args_t args[PUBLISH_TASKS];
+
+    for (int i = 0; i < PUBLISH_TASKS; i++) {
+        args[i] = (publish_task_args_t) {
+            .client = client, .topic = topic, .task = i, .done = done
+        };
+        TEST_ASSERT_TRUE(xTaskCreate(publish_task, "publish_task", 4096, &args[i], 5, NULL) == pdPASS);
+    }
+
+    for (int i = 0; i < PUBLISH_TASKS; i++) {
+        TEST_ASSERT_TRUE(xSemaphoreTake(done, pdMS_TO_TICKS(COMMON_OPERATION_TIMEOUT)) == pdTRUE);
+    }
+
+    WAIT_FOR_EVENT(DATA_BIT);
+    TEST_ASSERT_TRUE(received.distinct == PUBLISH_TASKS * PUBLISH_TASK_MESSAGES);
+    esp_mqtt_client_destroy(client);
+    vSemaphoreDelete(done);
+    vEventGroupDelete(s_event_group);
+    free(topic);
+    return true;
+}
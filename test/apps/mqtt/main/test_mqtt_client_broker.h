@@ -47,3 +47,9 @@ bool mqtt_lwt_clean_disconnect(void);
  * and verifies the qos in SUBACK message from the broker.
  */
 bool mqtt_subscribe_payload(void);
+
+/**
+ * @brief Several tasks publish on a subscribed topic at the same time
+ * and the client verifies that all their QoS 1 messages are received.
+ */
+bool mqtt_publish_from_tasks(void);
@@ -1,4 +1,4 @@
-# SPDX-FileCopyrightText: 2023-2025 Espressif Systems (Shanghai) CO LTD
+# SPDX-FileCopyrightText: 2023-2026 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: Unlicense OR CC0-1.0
 import pytest
 from pytest_embedded import Dut
@@ -6,6 +6,7 @@ from pytest_embedded_idf.utils import idf_parametrize
 
 
 @pytest.mark.eth_ip101
+@pytest.mark.parametrize("config", ["default", "publish_from_task"], indirect=True)
 @idf_parametrize("target", ["esp32"], indirect=["target"])
 def test_mqtt_client(dut: Dut) -> None:
     dut.expect_unity_test_output()
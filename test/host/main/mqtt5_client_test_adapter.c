@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <stdint.h>
+#include <string.h>
 
 #include "mqtt_client_priv.h"
 
@@ -25,3 +26,123 @@ int test_mqtt5_increment_packet_counter_with_dup(void)
     esp_mqtt5_increment_packet_counter(&client);
     return client.send_publish_packet_count;
 }
+
+int test_mqtt5_encode_publish(uint8_t *buffer, size_t buffer_size, const char *topic, const char *data, int data_len,
+                              int qos, const esp_mqtt5_publish_property_config_t *property, const char *resp_info,
+                              uint8_t **packet)
+{
+    mqtt_connection_t connection = {.buffer = buffer, .buffer_length = buffer_size};
+    uint16_t msg_id = 0;
+    mqtt_message_t *msg = mqtt5_msg_publish(&connection, topic, data, data_len, qos, 0, &msg_id, property, resp_info);
+    *packet = msg->data;
+    return msg->length;
+}
+
+int test_mqtt5_encode_publish_from_template(uint8_t *buffer, size_t buffer_size, const char *topic, const char *data,
+                                            int data_len, int qos, const esp_mqtt5_publish_property_config_t *property,
+                                            uint8_t **packet)
+{
+    // variable header encoded without payload, as esp_mqtt_client_create_publish_template() does
+    uint8_t header[1024];
+    mqtt_connection_t connection = {.buffer = header, .buffer_length = sizeof(header)};
+    uint16_t msg_id = 0;
+    mqtt_message_t *msg = mqtt5_msg_publish(&connection, topic, NULL, 0, qos, 0, &msg_id, property, NULL);
+    int fixed_header_len = 0;
+    mqtt_get_total_length(msg->data, msg->length, &fixed_header_len);
+
+    mqtt_connection_t template_connection = {.buffer = buffer, .buffer_length = buffer_size};
+    msg = mqtt_msg_publish_template(&template_connection, msg->data + fixed_header_len, msg->length - fixed_header_len,
+                                    2 + strlen(topic), data, data_len, qos, 0, &msg_id);
+    *packet = msg->data;
+    return msg->length;
+}
+
+int test_mqtt5_encode_subscribe(uint8_t *buffer, size_t buffer_size, const char *filter,
+                                const esp_mqtt5_subscribe_property_config_t *property, uint8_t **packet)
+{
+    mqtt_connection_t connection = {.buffer = buffer, .buffer_length = buffer_size};
+    esp_mqtt_topic_t topic = {.filter = filter, .qos = 1};
+    uint16_t msg_id = 0;
+    mqtt_message_t *msg = mqtt5_msg_subscribe(&connection, &topic, 1, &msg_id, property);
+    *packet = msg->data;
+    return msg->length;
+}
+
+mqtt5_user_property_handle_t test_mqtt5_decode_publish(uint8_t *packet, size_t length, const char **response_topic,
+                                                       int *response_topic_len, const char **payload, size_t *payload_len)
+{
+    esp_mqtt5_publish_resp_property_t property = {0};
+    mqtt5_user_property_handle_t user_property = NULL;
+    char *topic = NULL;
+    size_t topic_len = 0;
+    uint16_t property_len = 0;
+    *payload = mqtt5_get_publish_property_payload(packet, length, &topic, &topic_len, &property, &property_len,
+                                                  payload_len, &user_property);
+    *response_topic = property.response_topic;
+    *response_topic_len = property.response_topic_len;
+    return user_property;
+}
+
+size_t test_mqtt5_decode_publish_in_place(uint8_t *packet, size_t length, esp_mqtt5_event_property_t *event_property)
+{
+    esp_mqtt5_publish_resp_property_t property = {0};
+    char *topic = NULL;
+    size_t topic_len = 0, payload_len = 0;
+    uint16_t property_len = 0;
+
+    if (!mqtt5_get_publish_property_payload(packet, length, &topic, &topic_len, &property, &property_len, &payload_len,
+                                            NULL)) {
+        return 0;
+    }
+
+    event_property->properties = mqtt5_get_properties(packet, length, &event_property->properties_len);
+    return payload_len;
+}
+
+const char *test_mqtt5_locate_publish_payload(uint8_t *packet, size_t length, uint16_t *topic_alias,
+                                              uint8_t **properties, size_t *properties_len, size_t *payload_len)
+{
+    char *topic = NULL;
+    size_t topic_len = 0;
+    uint16_t property_len = 0;
+    esp_mqtt5_publish_resp_property_t property = {0};
+    char *payload = mqtt5_get_publish_payload(packet, length, &topic, &topic_len, &property, &property_len,
+                                              payload_len);
+    *topic_alias = property.topic_alias;
+    *properties = payload ? (uint8_t *)payload - property_len : NULL;
+    *properties_len = property_len;
+    return payload;
+}
+
+int test_mqtt5_parse_publish_property(uint8_t *properties, size_t properties_len, const char **response_topic,
+                                      int *response_topic_len, const char **content_type, int *content_type_len)
+{
+    esp_mqtt5_publish_resp_property_t property = {0};
+
+    if (mqtt5_msg_parse_publish_property(properties, properties_len, &property, NULL) != ESP_OK) {
+        return -1;
+    }
+
+    *response_topic = property.response_topic;
+    *response_topic_len = property.response_topic_len;
+    *content_type = property.content_type;
+    *content_type_len = property.content_type_len;
+    return property.topic_alias;
+}
+
+size_t test_mqtt5_topic_alias_arena_size(mqtt5_topic_alias_handle_t topic_alias_handle)
+{
+    return topic_alias_handle->arena_size;
+}
+
+void test_mqtt5_client_set_receive_maximum(esp_mqtt_client_handle_t client, uint16_t receive_maximum)
+{
+    client->mqtt5_config->server_resp_property_info.receive_maximum = receive_maximum;
+}
+
+void test_mqtt5_client_set_outbound_topic_alias_maximum(esp_mqtt_client_handle_t client, uint16_t topic_alias_maximum)
+{
+    // as on CONNACK from a broker which accepts topic_alias_maximum aliases
+    esp_mqtt5_client_delete_outbound_topic_alias(client->mqtt5_config->topic_alias);
+    client->mqtt5_config->topic_alias = esp_mqtt5_client_create_outbound_topic_alias(topic_alias_maximum);
+}
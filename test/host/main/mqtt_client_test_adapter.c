@@ -0,0 +1,43 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "mqtt_client_priv.h"
+
+void test_mqtt_client_set_connected(esp_mqtt_client_handle_t client, esp_transport_handle_t transport)
+{
+    client->transport = transport;
+    client->state = MQTT_STATE_CONNECTED;
+}
+
+void test_mqtt_client_set_disconnected(esp_mqtt_client_handle_t client)
+{
+    client->transport = NULL;
+    client->state = MQTT_STATE_INIT;
+}
+
+int test_mqtt_client_drain_queued(esp_mqtt_client_handle_t client)
+{
+    return esp_mqtt_drain_queued(client);
+}
+
+int test_mqtt_client_process_receive(esp_mqtt_client_handle_t client)
+{
+    return esp_mqtt_process_receive(client);
+}
+
+int test_mqtt_client_retransmit_overdue(esp_mqtt_client_handle_t client)
+{
+    return esp_mqtt_retransmit_overdue(client);
+}
+
+int test_mqtt_client_process_keepalive(esp_mqtt_client_handle_t client)
+{
+    return esp_mqtt_process_keepalive(client);
+}
+
+int test_mqtt_client_get_keepalive_jitter(esp_mqtt_client_handle_t client)
+{
+    return client->keepalive_jitter_ms;
+}
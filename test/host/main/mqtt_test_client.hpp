@@ -0,0 +1,94 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Client fixture for host tests: a client marked connected without running
+ * the MQTT task, over a mocked transport.
+ */
+
+#pragma once
+
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <type_traits>
+
+#include "mqtt_client.h"
+extern "C" {
+#include "Mockesp_transport.h"
+#include "Mockesp_transport_ssl.h"
+#include "Mockesp_transport_tcp.h"
+#include "Mockesp_transport_ws.h"
+#include "Mockevent_groups.h"
+#include "Mockqueue.h"
+#include "Mockesp_timer.h"
+#include "Mockesp_event.h"
+
+    void test_mqtt_client_set_connected(esp_mqtt_client_handle_t client, esp_transport_handle_t transport);
+    void test_mqtt_client_set_disconnected(esp_mqtt_client_handle_t client);
+}
+
+namespace test::mqtt
+{
+
+struct client_deleter {
+    void operator()(esp_mqtt_client_handle_t client) const
+    {
+        test_mqtt_client_set_disconnected(client);
+        esp_mqtt_client_destroy(client);
+    }
+};
+
+using unique_client = std::unique_ptr<std::remove_pointer_t<esp_mqtt_client_handle_t>, client_deleter>;
+
+/*
+ * The clock reads 0 and the other mocked calls succeed. Tests stub the transport reads and writes, and the event
+ * posts they check, once the client is created. The broker URI defaults to mqtt://1.1.1.1
+ */
+struct connected_client {
+    int mtx = 0;
+    int transport_list = 0;
+    int transport = 0;
+    int event_group = 0;
+    unique_client client;
+
+    explicit connected_client(esp_mqtt_client_config_t config)
+    {
+        esp_timer_get_time_IgnoreAndReturn(0);
+        xQueueTakeMutexRecursive_IgnoreAndReturn(true);
+        xQueueGiveMutexRecursive_IgnoreAndReturn(true);
+        xQueueCreateMutex_IgnoreAndReturn(reinterpret_cast<QueueHandle_t>(&mtx));
+        xEventGroupCreate_IgnoreAndReturn(reinterpret_cast<EventGroupHandle_t>(&event_group));
+        esp_transport_list_init_IgnoreAndReturn(reinterpret_cast<esp_transport_list_handle_t>(&transport_list));
+        esp_transport_tcp_init_IgnoreAndReturn(reinterpret_cast<esp_transport_handle_t>(&transport));
+        esp_transport_ssl_init_IgnoreAndReturn(reinterpret_cast<esp_transport_handle_t>(&transport));
+        esp_transport_ws_init_IgnoreAndReturn(reinterpret_cast<esp_transport_handle_t>(&transport));
+        esp_transport_ws_set_subprotocol_IgnoreAndReturn(ESP_OK);
+        esp_transport_list_add_IgnoreAndReturn(ESP_OK);
+        esp_transport_set_default_port_IgnoreAndReturn(ESP_OK);
+        esp_event_loop_create_IgnoreAndReturn(ESP_OK);
+        esp_event_loop_run_IgnoreAndReturn(ESP_OK);
+        esp_event_post_to_IgnoreAndReturn(ESP_OK);
+        esp_transport_list_destroy_IgnoreAndReturn(ESP_OK);
+        esp_transport_destroy_IgnoreAndReturn(ESP_OK);
+        esp_transport_close_IgnoreAndReturn(ESP_OK);
+        esp_transport_poll_write_IgnoreAndReturn(1);
+        vEventGroupDelete_Ignore();
+        vQueueDelete_Ignore();
+
+        if (config.broker.address.uri == nullptr) {
+            config.broker.address.uri = "mqtt://1.1.1.1";
+        }
+
+        client.reset(esp_mqtt_client_init(&config));
+        REQUIRE(client != nullptr);
+        set_connected();
+    }
+
+    void set_connected()
+    {
+        test_mqtt_client_set_connected(client.get(), reinterpret_cast<esp_transport_handle_t>(&transport));
+    }
+};
+
+}
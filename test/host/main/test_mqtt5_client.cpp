@@ -4,13 +4,88 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>
 #include <cstdint>
+#include <string>
+#include <vector>
 
 #include "esp_err.h"
+#include "mqtt_client.h"
 
 extern "C" {
     esp_err_t test_mqtt5_check_inflight_maximum(uint16_t send_count, uint16_t receive_maximum);
     int test_mqtt5_increment_packet_counter_with_dup(void);
+
+    typedef struct mqtt5_topic_alias_table *mqtt5_topic_alias_handle_t;
+    mqtt5_topic_alias_handle_t esp_mqtt5_client_create_topic_alias(uint16_t topic_alias_maximum);
+    esp_err_t esp_mqtt5_client_update_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
+                                                  const char *topic, size_t topic_len);
+    char *esp_mqtt5_client_get_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle, uint16_t topic_alias,
+                                           size_t *topic_length);
+    void esp_mqtt5_client_reset_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle);
+    void esp_mqtt5_client_delete_topic_alias(mqtt5_topic_alias_handle_t topic_alias_handle);
+    size_t test_mqtt5_topic_alias_arena_size(mqtt5_topic_alias_handle_t topic_alias_handle);
+
+    typedef struct mqtt5_outbound_topic_alias_table *mqtt5_outbound_topic_alias_handle_t;
+    mqtt5_outbound_topic_alias_handle_t esp_mqtt5_client_create_outbound_topic_alias(uint16_t topic_alias_maximum);
+    uint16_t esp_mqtt5_client_assign_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                          const char *topic, size_t topic_len, bool *established);
+    void esp_mqtt5_client_establish_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                         uint16_t topic_alias);
+    void esp_mqtt5_client_forget_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle,
+                                                      uint16_t topic_alias);
+    void esp_mqtt5_client_reset_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle);
+    void esp_mqtt5_client_delete_outbound_topic_alias(mqtt5_outbound_topic_alias_handle_t topic_alias_handle);
+
+    typedef struct mqtt_topic_router *mqtt_topic_router_handle_t;
+    mqtt_topic_router_handle_t mqtt_topic_router_create(void);
+    void mqtt_topic_router_destroy(mqtt_topic_router_handle_t router);
+    esp_err_t mqtt_topic_router_add(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                    esp_mqtt_topic_handler_t handler, void *handler_args);
+    esp_err_t mqtt_topic_router_remove(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                       esp_mqtt_topic_handler_t handler, void *handler_args);
+    typedef struct mqtt5_subscription_table *mqtt5_subscription_handle_t;
+    mqtt5_subscription_handle_t esp_mqtt5_client_create_subscriptions(mqtt_topic_router_handle_t router);
+    uint16_t esp_mqtt5_client_add_subscription(mqtt5_subscription_handle_t subscription_handle,
+                                               const esp_mqtt_topic_t *topic_list, int size);
+    void esp_mqtt5_client_remove_subscription(mqtt5_subscription_handle_t subscription_handle, uint16_t subscribe_id);
+    void esp_mqtt5_client_remove_subscribed_filter(mqtt5_subscription_handle_t subscription_handle, const char *filter);
+    void esp_mqtt5_client_reset_subscriptions(mqtt5_subscription_handle_t subscription_handle);
+    void esp_mqtt5_client_delete_subscriptions(mqtt5_subscription_handle_t subscription_handle);
+    bool esp_mqtt5_client_route_subscription(mqtt5_subscription_handle_t subscription_handle, uint16_t subscribe_id,
+                                             const char *topic, size_t topic_len, esp_mqtt_event_handle_t event);
+}
+
+namespace {
+
+std::string topic_of(mqtt5_topic_alias_handle_t table, uint16_t alias)
+{
+    size_t len = 0;
+    char *topic = esp_mqtt5_client_get_topic_alias(table, alias, &len);
+    return topic ? std::string(topic, len) : std::string();
+}
+
+uint16_t assign(mqtt5_outbound_topic_alias_handle_t table, const std::string &topic, bool &established)
+{
+    return esp_mqtt5_client_assign_outbound_topic_alias(table, topic.data(), topic.size(), &established);
+}
+
+std::vector<std::string> routed;    // filters of the handlers called
+
+void record_route(void *filter, esp_mqtt_event_handle_t)
+{
+    routed.emplace_back(static_cast<const char *>(filter));
+}
+
+bool route(mqtt5_subscription_handle_t table, uint16_t subscribe_id, const std::string &topic)
+{
+    esp_mqtt_event_t event{};
+    routed.clear();
+    bool ret = esp_mqtt5_client_route_subscription(table, subscribe_id, topic.data(), topic.size(), &event);
+    std::sort(routed.begin(), routed.end());
+    return ret;
+}
+
 }
 
 TEST_CASE("MQTT5 inflight quota uses an exact upper bound")
@@ -23,3 +98,180 @@ TEST_CASE("MQTT5 first send on a connection counts even when PUBLISH has DUP set
 {
     REQUIRE(test_mqtt5_increment_packet_counter_with_dup() == 1);
 }
+
+TEST_CASE("MQTT5 inbound topic aliases are indexed by alias")
+{
+    mqtt5_topic_alias_handle_t table = esp_mqtt5_client_create_topic_alias(4);
+    REQUIRE(table != nullptr);
+    std::string sensor = "/sensor/temperature", longer = "/sensor/temperature/outdoor", shorter = "/s";
+
+    REQUIRE(topic_of(table, 1).empty());
+    REQUIRE(esp_mqtt5_client_update_topic_alias(table, 1, sensor.data(), sensor.size()) == ESP_OK);
+    REQUIRE(esp_mqtt5_client_update_topic_alias(table, 4, shorter.data(), shorter.size()) == ESP_OK);
+    REQUIRE(topic_of(table, 1) == sensor);
+    REQUIRE(topic_of(table, 4) == shorter);
+
+    SECTION("Aliases can be remapped to shorter and longer topics") {
+        REQUIRE(esp_mqtt5_client_update_topic_alias(table, 1, shorter.data(), shorter.size()) == ESP_OK);
+        REQUIRE(topic_of(table, 1) == shorter);
+        REQUIRE(esp_mqtt5_client_update_topic_alias(table, 1, longer.data(), longer.size()) == ESP_OK);
+        REQUIRE(topic_of(table, 1) == longer);
+        REQUIRE(topic_of(table, 4) == shorter);
+    }
+    SECTION("Aliases out of range are rejected") {
+        REQUIRE(esp_mqtt5_client_update_topic_alias(table, 0, sensor.data(), sensor.size()) == ESP_FAIL);
+        REQUIRE(esp_mqtt5_client_update_topic_alias(table, 5, sensor.data(), sensor.size()) == ESP_FAIL);
+        REQUIRE(topic_of(table, 0).empty());
+        REQUIRE(topic_of(table, 5).empty());
+    }
+    SECTION("Reset forgets all aliases") {
+        esp_mqtt5_client_reset_topic_alias(table);
+        REQUIRE(topic_of(table, 1).empty());
+        REQUIRE(topic_of(table, 4).empty());
+    }
+
+    esp_mqtt5_client_delete_topic_alias(table);
+}
+
+TEST_CASE("MQTT5 topic alias updates reuse the table memory")
+{
+    mqtt5_topic_alias_handle_t table = esp_mqtt5_client_create_topic_alias(16);
+    REQUIRE(table != nullptr);
+    size_t arena_size = 0;
+
+    for (int i = 0; i < 10000; i++) {
+        uint16_t alias = i % 16 + 1;
+        std::string topic = "/device/" + std::to_string(i % 97) + "/state" + std::string(i % 13, 'x');
+        REQUIRE(esp_mqtt5_client_update_topic_alias(table, alias, topic.data(), topic.size()) == ESP_OK);
+        REQUIRE(topic_of(table, alias) == topic);
+
+        if (i == 1000) {
+            arena_size = test_mqtt5_topic_alias_arena_size(table);
+        }
+    }
+
+    // once sized for the topics in use, remapping aliases does not grow the table
+    REQUIRE(test_mqtt5_topic_alias_arena_size(table) == arena_size);
+
+    SECTION("Topics longer than the arena grow it") {
+        std::string topic(arena_size, 't');
+        REQUIRE(esp_mqtt5_client_update_topic_alias(table, 3, topic.data(), topic.size()) == ESP_OK);
+        REQUIRE(topic_of(table, 3) == topic);
+        REQUIRE(test_mqtt5_topic_alias_arena_size(table) > arena_size);
+    }
+
+    esp_mqtt5_client_delete_topic_alias(table);
+}
+
+TEST_CASE("MQTT5 outbound topic aliases are assigned to the least recently used slot")
+{
+    mqtt5_outbound_topic_alias_handle_t table = esp_mqtt5_client_create_outbound_topic_alias(2);
+    REQUIRE(table != nullptr);
+    bool established = true;
+
+    uint16_t temperature = assign(table, "/home/kitchen/temperature", established);
+    REQUIRE(temperature != 0);
+    REQUIRE_FALSE(established);
+    esp_mqtt5_client_establish_outbound_topic_alias(table, temperature);
+    REQUIRE(assign(table, "/home/kitchen/temperature", established) == temperature);
+    REQUIRE(established);
+
+    uint16_t humidity = assign(table, "/home/kitchen/humidity", established);
+    REQUIRE(humidity != 0);
+    REQUIRE(humidity != temperature);
+    esp_mqtt5_client_establish_outbound_topic_alias(table, humidity);
+
+    SECTION("Short topics are sent without an alias") {
+        REQUIRE(assign(table, "/a", established) == 0);
+    }
+    SECTION("A new topic takes the alias used least recently") {
+        REQUIRE(assign(table, "/home/kitchen/temperature", established) == temperature);
+        REQUIRE(assign(table, "/home/kitchen/pressure", established) == humidity);
+        REQUIRE_FALSE(established);
+        REQUIRE(assign(table, "/home/kitchen/temperature", established) == temperature);
+        REQUIRE(established);
+    }
+    SECTION("A new connection sends the topics again") {
+        esp_mqtt5_client_reset_outbound_topic_alias(table);
+        REQUIRE(assign(table, "/home/kitchen/temperature", established) == temperature);
+        REQUIRE_FALSE(established);
+    }
+    SECTION("An alias set by the user is not reused for its topic") {
+        esp_mqtt5_client_forget_outbound_topic_alias(table, humidity);
+        REQUIRE(assign(table, "/home/kitchen/humidity", established) == humidity);
+        REQUIRE_FALSE(established);
+    }
+
+    esp_mqtt5_client_delete_outbound_topic_alias(table);
+}
+
+TEST_CASE("MQTT5 messages are routed by the subscription identifier assigned by the client")
+{
+    mqtt_topic_router_handle_t router = mqtt_topic_router_create();
+    mqtt5_subscription_handle_t table = esp_mqtt5_client_create_subscriptions(router);
+    REQUIRE(table != nullptr);
+
+    for (const char *filter : {
+                "home/+/temperature", "home/kitchen/#", "$share/group/office/#"
+            }) {
+        REQUIRE(mqtt_topic_router_add(router, filter, record_route, const_cast<char *>(filter)) == ESP_OK);
+    }
+
+    esp_mqtt_topic_t temperature[] = {{.filter = "home/+/temperature", .qos = 1}};
+    esp_mqtt_topic_t several[] = {{.filter = "home/kitchen/#", .qos = 1}, {.filter = "$share/group/office/#", .qos = 0}};
+    uint16_t temperature_id = esp_mqtt5_client_add_subscription(table, temperature, 1);
+    uint16_t several_id = esp_mqtt5_client_add_subscription(table, several, 2);
+    REQUIRE(temperature_id != 0);
+    REQUIRE(several_id != 0);
+    REQUIRE(several_id != temperature_id);
+
+    // the broker matched the only filter of the subscription, the topic isn't compared
+    REQUIRE(route(table, temperature_id, "home/kitchen/temperature"));
+    REQUIRE(routed == std::vector<std::string> {"home/+/temperature"});
+    REQUIRE(route(table, several_id, "office/desk"));
+    REQUIRE(routed == std::vector<std::string> {"$share/group/office/#"});
+    REQUIRE_FALSE(route(table, several_id + 1, "home/kitchen/temperature"));
+    REQUIRE_FALSE(route(table, 0, "home/kitchen/temperature"));
+
+    SECTION("Messages are matched by topic when some handlers are not subscribed") {
+        REQUIRE(mqtt_topic_router_add(router, "garden/#", record_route, const_cast<char *>("garden/#")) == ESP_OK);
+        REQUIRE_FALSE(route(table, temperature_id, "home/kitchen/temperature"));
+        esp_mqtt_topic_t garden[] = {{.filter = "garden/#", .qos = 0}};
+        REQUIRE(esp_mqtt5_client_add_subscription(table, garden, 1) != 0);
+        REQUIRE(route(table, temperature_id, "home/kitchen/temperature"));
+    }
+    SECTION("Unsubscribed filters are no longer routed") {
+        esp_mqtt5_client_remove_subscribed_filter(table, "home/kitchen/#");
+        // its handler now needs the topic to be matched
+        REQUIRE_FALSE(route(table, several_id, "office/desk"));
+        REQUIRE(mqtt_topic_router_remove(router, "home/kitchen/#", record_route,
+                                         const_cast<char *>("home/kitchen/#")) == ESP_OK);
+        REQUIRE(route(table, several_id, "office/desk"));
+        REQUIRE(routed == std::vector<std::string> {"$share/group/office/#"});
+        esp_mqtt5_client_remove_subscribed_filter(table, "$share/group/office/#");
+        REQUIRE_FALSE(route(table, several_id, "office/desk"));
+    }
+    SECTION("A new subscription to a filter takes it from the previous one") {
+        uint16_t again = esp_mqtt5_client_add_subscription(table, temperature, 1);
+        REQUIRE(again != 0);
+        REQUIRE(again != temperature_id);
+        REQUIRE_FALSE(route(table, temperature_id, "home/kitchen/temperature"));
+        REQUIRE(route(table, again, "home/kitchen/temperature"));
+        REQUIRE(routed == std::vector<std::string> {"home/+/temperature"});
+    }
+    SECTION("Freed identifiers are reused last") {
+        esp_mqtt5_client_remove_subscription(table, temperature_id);
+        esp_mqtt_topic_t office[] = {{.filter = "office/#", .qos = 0}};
+        uint16_t office_id = esp_mqtt5_client_add_subscription(table, office, 1);
+        REQUIRE(office_id != temperature_id);
+        REQUIRE_FALSE(route(table, temperature_id, "home/kitchen/temperature"));
+    }
+    SECTION("Subscriptions are dropped with the session") {
+        esp_mqtt5_client_reset_subscriptions(table);
+        REQUIRE_FALSE(route(table, temperature_id, "home/kitchen/temperature"));
+        REQUIRE_FALSE(route(table, several_id, "office/desk"));
+    }
+
+    esp_mqtt5_client_delete_subscriptions(table);
+    mqtt_topic_router_destroy(router);
+}
@@ -0,0 +1,357 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * MQTT5 message encoder tests, the encoded packets are decoded back by the
+ * receive side parser.
+ */
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "mqtt_client.h"
+
+extern "C" {
+    int test_mqtt5_encode_publish(uint8_t *buffer, size_t buffer_size, const char *topic, const char *data, int data_len,
+                                  int qos, const esp_mqtt5_publish_property_config_t *property, const char *resp_info,
+                                  uint8_t **packet);
+    int test_mqtt5_encode_publish_from_template(uint8_t *buffer, size_t buffer_size, const char *topic, const char *data,
+                                                int data_len, int qos, const esp_mqtt5_publish_property_config_t *property,
+                                                uint8_t **packet);
+    int test_mqtt5_encode_subscribe(uint8_t *buffer, size_t buffer_size, const char *filter,
+                                    const esp_mqtt5_subscribe_property_config_t *property, uint8_t **packet);
+    mqtt5_user_property_handle_t test_mqtt5_decode_publish(uint8_t *packet, size_t length, const char **response_topic,
+                                                           int *response_topic_len, const char **payload, size_t *payload_len);
+    size_t test_mqtt5_decode_publish_in_place(uint8_t *packet, size_t length, esp_mqtt5_event_property_t *property);
+    const char *test_mqtt5_locate_publish_payload(uint8_t *packet, size_t length, uint16_t *topic_alias,
+                                                  uint8_t **properties, size_t *properties_len, size_t *payload_len);
+    int test_mqtt5_parse_publish_property(uint8_t *properties, size_t properties_len, const char **response_topic,
+                                          int *response_topic_len, const char **content_type, int *content_type_len);
+}
+
+namespace {
+
+struct user_properties {
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    mqtt5_user_property_handle_t handle = nullptr;
+
+    explicit user_properties(size_t count, size_t value_len = 8)
+    {
+        for (size_t i = 0; i < count; i++) {
+            keys.push_back("key-" + std::to_string(i));
+            values.push_back(std::string(value_len, static_cast<char>('a' + i % 26)));
+            esp_mqtt5_user_property_item_t item = {keys.back().c_str(), values.back().c_str()};
+            REQUIRE(esp_mqtt5_client_set_user_property(&handle, &item, 1) == ESP_OK);
+        }
+    }
+
+    ~user_properties()
+    {
+        esp_mqtt5_client_delete_user_property(handle);
+    }
+
+    void require_equal(const esp_mqtt5_event_property_t &property) const
+    {
+        esp_mqtt5_user_property_iter_t iter;
+        esp_mqtt5_user_property_view_t item;
+        size_t count = 0;
+        esp_mqtt5_client_user_property_iter_init(&iter, &property);
+
+        while (esp_mqtt5_client_user_property_next(&iter, &item)) {
+            REQUIRE(count < keys.size());
+            CHECK(keys[count] == std::string(item.key, item.key_len));
+            CHECK(values[count] == std::string(item.value, item.value_len));
+            count++;
+        }
+
+        REQUIRE(count == keys.size());
+    }
+
+    void require_equal(mqtt5_user_property_handle_t decoded) const
+    {
+        uint8_t count = esp_mqtt5_client_get_user_property_count(decoded);
+        REQUIRE(count == keys.size());
+        std::vector<esp_mqtt5_user_property_item_t> items(count);
+        REQUIRE(esp_mqtt5_client_get_user_property(decoded, items.data(), &count) == ESP_OK);
+
+        for (size_t i = 0; i < count; i++) {
+            CHECK(keys[i] == items[i].key);
+            CHECK(values[i] == items[i].value);
+            free(const_cast<char *>(items[i].key));
+            free(const_cast<char *>(items[i].value));
+        }
+    }
+};
+
+}
+
+TEST_CASE("MQTT5 publish properties of any length are encoded once", "[mqtt5_msg]")
+{
+    std::vector<uint8_t> buffer(64 * 1024);
+    std::string payload = "payload";
+
+    // property lengths encoded in one, two and three bytes
+    for (size_t count : {0, 3, 20, 200}) {
+        for (size_t value_len : {8, 100}) {
+            CAPTURE(count, value_len);
+            user_properties props(count, value_len);
+            esp_mqtt5_publish_property_config_t property = {};
+            property.response_topic = "reply";
+            property.content_type = "text/plain";
+            property.user_property = props.handle;
+            uint8_t *packet = nullptr;
+            int len = test_mqtt5_encode_publish(buffer.data(), buffer.size(), "/topic", payload.c_str(), payload.size(), 1,
+                                                &property, "info", &packet);
+            REQUIRE(len > 0);
+
+            const char *response_topic = nullptr;
+            int response_topic_len = 0;
+            const char *data = nullptr;
+            size_t data_len = 0;
+            mqtt5_user_property_handle_t decoded = test_mqtt5_decode_publish(packet, len, &response_topic,
+                                                   &response_topic_len, &data, &data_len);
+            REQUIRE(data != nullptr);
+            REQUIRE(std::string(data, data_len) == payload);
+            REQUIRE(std::string(response_topic, response_topic_len) == "reply/info");
+
+            if (count > 0) {
+                props.require_equal(decoded);
+            }
+
+            esp_mqtt5_client_delete_user_property(decoded);
+        }
+    }
+}
+
+TEST_CASE("MQTT5 publish fails when properties don't fit the buffer", "[mqtt5_msg]")
+{
+    std::vector<uint8_t> buffer(256);
+    user_properties props(20);
+    esp_mqtt5_publish_property_config_t property = {};
+    property.user_property = props.handle;
+    uint8_t *packet = nullptr;
+    REQUIRE(test_mqtt5_encode_publish(buffer.data(), buffer.size(), "/topic", "x", 1, 0, &property, nullptr,
+                                      &packet) == 0);
+}
+
+TEST_CASE("MQTT5 publish from a template keeps its properties", "[mqtt5_msg]")
+{
+    std::vector<uint8_t> buffer(1024);
+    user_properties props(5, 20);
+    esp_mqtt5_publish_property_config_t property = {};
+    property.response_topic = "reply";
+    property.user_property = props.handle;
+    std::string payload = "payload";
+    uint8_t *packet = nullptr;
+    int len = test_mqtt5_encode_publish_from_template(buffer.data(), buffer.size(), "/topic", payload.c_str(),
+              payload.size(), 1, &property, &packet);
+    REQUIRE(len > 0);
+
+    const char *response_topic = nullptr;
+    int response_topic_len = 0;
+    const char *data = nullptr;
+    size_t data_len = 0;
+    mqtt5_user_property_handle_t decoded = test_mqtt5_decode_publish(packet, len, &response_topic, &response_topic_len,
+                                           &data, &data_len);
+    REQUIRE(std::string(data, data_len) == payload);
+    REQUIRE(std::string(response_topic, response_topic_len) == "reply");
+    props.require_equal(decoded);
+    esp_mqtt5_client_delete_user_property(decoded);
+}
+
+TEST_CASE("MQTT5 user properties are read in place", "[mqtt5_msg]")
+{
+    std::vector<uint8_t> buffer(16 * 1024);
+    std::string payload = "payload";
+
+    for (size_t count : {0, 1, 20}) {
+        CAPTURE(count);
+        user_properties props(count, 30);
+        esp_mqtt5_publish_property_config_t property = {};
+        property.payload_format_indicator = true;
+        property.message_expiry_interval = 100;
+        property.response_topic = "reply";
+        property.correlation_data = "1234";
+        property.correlation_data_len = 4;
+        property.content_type = "text/plain";
+        property.user_property = props.handle;
+        uint8_t *packet = nullptr;
+        int len = test_mqtt5_encode_publish(buffer.data(), buffer.size(), "/topic", payload.c_str(), payload.size(), 1,
+                                            &property, nullptr, &packet);
+        REQUIRE(len > 0);
+
+        esp_mqtt5_event_property_t event_property = {};
+        REQUIRE(test_mqtt5_decode_publish_in_place(packet, len, &event_property) == payload.size());
+        REQUIRE(event_property.user_property == nullptr);
+        props.require_equal(event_property);
+
+        mqtt5_user_property_handle_t copy = nullptr;
+        REQUIRE(esp_mqtt5_client_copy_user_property(&event_property, &copy) == ESP_OK);
+        REQUIRE((copy == nullptr) == (count == 0));
+
+        if (count > 0) {
+            props.require_equal(copy);
+        }
+
+        esp_mqtt5_client_delete_user_property(copy);
+    }
+
+    SECTION("an event without properties has no user properties") {
+        esp_mqtt5_event_property_t event_property = {};
+        esp_mqtt5_user_property_iter_t iter;
+        esp_mqtt5_user_property_view_t item;
+        esp_mqtt5_client_user_property_iter_init(&iter, &event_property);
+        REQUIRE_FALSE(esp_mqtt5_client_user_property_next(&iter, &item));
+        mqtt5_user_property_handle_t copy = nullptr;
+        REQUIRE(esp_mqtt5_client_copy_user_property(&event_property, &copy) == ESP_OK);
+        REQUIRE(copy == nullptr);
+    }
+    SECTION("a truncated property ends the iteration") {
+        user_properties props(2, 30);
+        esp_mqtt5_publish_property_config_t property = {};
+        property.user_property = props.handle;
+        uint8_t *packet = nullptr;
+        int len = test_mqtt5_encode_publish(buffer.data(), buffer.size(), "/topic", "", 0, 0, &property, nullptr, &packet);
+        REQUIRE(len > 0);
+        esp_mqtt5_event_property_t event_property = {};
+        test_mqtt5_decode_publish_in_place(packet, len, &event_property);
+        REQUIRE(event_property.properties != nullptr);
+        event_property.properties_len -= 1;
+        esp_mqtt5_user_property_iter_t iter;
+        esp_mqtt5_user_property_view_t item;
+        esp_mqtt5_client_user_property_iter_init(&iter, &event_property);
+        REQUIRE(esp_mqtt5_client_user_property_next(&iter, &item));
+        REQUIRE_FALSE(esp_mqtt5_client_user_property_next(&iter, &item));
+    }
+}
+
+TEST_CASE("MQTT5 publish properties are parsed after the payload is located", "[mqtt5_msg]")
+{
+    std::vector<uint8_t> buffer(1024);
+    user_properties props(4, 20);
+    esp_mqtt5_publish_property_config_t property = {};
+    property.topic_alias = 5;
+    property.response_topic = "reply";
+    property.correlation_data = "1234";
+    property.correlation_data_len = 4;
+    property.content_type = "text/plain";
+    property.user_property = props.handle;
+    std::string payload = "payload";
+    uint8_t *packet = nullptr;
+    int len = test_mqtt5_encode_publish(buffer.data(), buffer.size(), "/topic", payload.c_str(), payload.size(), 1,
+                                        &property, nullptr, &packet);
+    REQUIRE(len > 0);
+
+    uint16_t topic_alias = 0;
+    uint8_t *properties = nullptr;
+    size_t properties_len = 0;
+    size_t payload_len = 0;
+    const char *data = test_mqtt5_locate_publish_payload(packet, len, &topic_alias, &properties, &properties_len,
+                       &payload_len);
+    REQUIRE(data != nullptr);
+    REQUIRE(std::string(data, payload_len) == payload);
+    REQUIRE(topic_alias == 5);
+
+    const char *response_topic = nullptr;
+    const char *content_type = nullptr;
+    int response_topic_len = 0;
+    int content_type_len = 0;
+    REQUIRE(test_mqtt5_parse_publish_property(properties, properties_len, &response_topic, &response_topic_len,
+                                              &content_type, &content_type_len) == 5);
+    REQUIRE(std::string(response_topic, response_topic_len) == "reply");
+    REQUIRE(std::string(content_type, content_type_len) == "text/plain");
+
+    SECTION("malformed properties are rejected without parsing them") {
+        // the content type length runs past the properties
+        uint8_t *content_type_len_byte = reinterpret_cast<uint8_t *>(const_cast<char *>(content_type)) - 1;
+        *content_type_len_byte = 0xff;
+        REQUIRE(test_mqtt5_parse_publish_property(properties, properties_len, &response_topic, &response_topic_len,
+                                                  &content_type, &content_type_len) == -1);
+        REQUIRE(test_mqtt5_locate_publish_payload(packet, len, &topic_alias, &properties, &properties_len,
+                                                  &payload_len) == nullptr);
+    }
+}
+
+TEST_CASE("MQTT5 shared subscription is encoded with its share name", "[mqtt5_msg]")
+{
+    std::vector<uint8_t> buffer(1024);
+    user_properties props(10, 20);
+    esp_mqtt5_subscribe_property_config_t property = {};
+    property.subscribe_id = 1000;
+    property.is_share_subscribe = true;
+    property.share_name = "group";
+    property.user_property = props.handle;
+    uint8_t *packet = nullptr;
+    int len = test_mqtt5_encode_subscribe(buffer.data(), buffer.size(), "/filter", &property, &packet);
+    REQUIRE(len > 0);
+
+    std::string topic = "$share/group//filter";
+    std::vector<uint8_t> tail = {0, static_cast<uint8_t>(topic.size())};
+    tail.insert(tail.end(), topic.begin(), topic.end());
+    tail.push_back(1);
+    REQUIRE(std::vector<uint8_t>(packet + len - tail.size(), packet + len) == tail);
+}
+
+TEST_CASE("MQTT5 encoder throughput", "[mqtt5_msg][benchmark]")
+{
+    std::vector<uint8_t> buffer(16 * 1024);
+    uint8_t *packet = nullptr;
+
+    for (size_t count : {0, 4, 16}) {
+        user_properties props(count, 16);
+        esp_mqtt5_publish_property_config_t property = {};
+        property.content_type = "application/json";
+        property.user_property = props.handle;
+        BENCHMARK("QoS1 publish with " + std::to_string(count) + " user properties") {
+            return test_mqtt5_encode_publish(buffer.data(), buffer.size(), "/sensors/room/temperature", "21.5", 4, 1,
+                                             &property, nullptr, &packet);
+        };
+    }
+}
+
+TEST_CASE("MQTT5 decoder throughput", "[mqtt5_msg][benchmark]")
+{
+    std::vector<uint8_t> buffer(16 * 1024);
+    user_properties props(8, 16);
+    esp_mqtt5_publish_property_config_t property = {};
+    property.user_property = props.handle;
+    uint8_t *packet = nullptr;
+    int len = test_mqtt5_encode_publish(buffer.data(), buffer.size(), "/sensors/room/temperature", "21.5", 4, 1,
+                                        &property, nullptr, &packet);
+    const char *response_topic = nullptr;
+    int response_topic_len = 0;
+    const char *payload = nullptr;
+    size_t payload_len = 0;
+
+    BENCHMARK("publish with 8 user properties, copied") {
+        mqtt5_user_property_handle_t decoded = test_mqtt5_decode_publish(packet, len, &response_topic, &response_topic_len,
+                                               &payload, &payload_len);
+        esp_mqtt5_client_delete_user_property(decoded);
+        return payload_len;
+    };
+    BENCHMARK("publish with 8 user properties, payload located only") {
+        uint16_t topic_alias = 0;
+        uint8_t *properties = nullptr;
+        size_t properties_len = 0;
+        test_mqtt5_locate_publish_payload(packet, len, &topic_alias, &properties, &properties_len, &payload_len);
+        return payload_len;
+    };
+    BENCHMARK("publish with 8 user properties, read in place") {
+        esp_mqtt5_event_property_t event_property = {};
+        esp_mqtt5_user_property_iter_t iter;
+        esp_mqtt5_user_property_view_t item;
+        size_t total = test_mqtt5_decode_publish_in_place(packet, len, &event_property);
+        esp_mqtt5_client_user_property_iter_init(&iter, &event_property);
+
+        while (esp_mqtt5_client_user_property_next(&iter, &item)) {
+            total += item.value_len;
+        }
+
+        return total;
+    };
+}
@@ -0,0 +1,240 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Keepalive tests on a client which is marked connected without running
+ * the MQTT task, the clock is set by the tests through esp_timer_get_time().
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mqtt_test_client.hpp"
+extern "C" {
+    int test_mqtt_client_process_receive(esp_mqtt_client_handle_t client);
+    int test_mqtt_client_process_keepalive(esp_mqtt_client_handle_t client);
+    int test_mqtt_client_get_keepalive_jitter(esp_mqtt_client_handle_t client);
+}
+
+namespace {
+
+struct link_stats {
+    std::vector<uint8_t> inbound;   // bytes the broker sent, served by the next reads
+    size_t pings = 0;               // PINGREQs written by the client
+    size_t disconnects = 0;         // MQTT_EVENT_DISCONNECTED events
+};
+
+link_stats wire;
+
+int serve_read(esp_transport_handle_t, char *buffer, int len, int, int)
+{
+    if (wire.inbound.empty()) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+
+    size_t n = std::min(static_cast<size_t>(len), wire.inbound.size());
+    memcpy(buffer, wire.inbound.data(), n);
+    wire.inbound.erase(wire.inbound.begin(), wire.inbound.begin() + n);
+    return static_cast<int>(n);
+}
+
+int count_pings(esp_transport_handle_t, const char *buffer, int len, int, int)
+{
+    if (static_cast<uint8_t>(buffer[0]) == 0xc0) {
+        wire.pings++;
+    }
+
+    return len;
+}
+
+esp_err_t count_disconnects(esp_event_loop_handle_t, esp_event_base_t, int32_t id, const void *, size_t, TickType_t,
+                            int)
+{
+    if (id == MQTT_EVENT_DISCONNECTED) {
+        wire.disconnects++;
+    }
+
+    return ESP_OK;
+}
+
+void set_time_ms(int64_t ms)
+{
+    esp_timer_get_time_IgnoreAndReturn(ms * 1000);
+}
+
+struct connected_client : test::mqtt::connected_client {
+    explicit connected_client(int keepalive, int keepalive_jitter_ms = 0)
+        : test::mqtt::connected_client(config(keepalive, keepalive_jitter_ms))
+    {
+        esp_transport_read_Stub(serve_read);
+        esp_transport_write_Stub(count_pings);
+        esp_event_post_to_Stub(count_disconnects);
+        wire = {};
+    }
+
+    static esp_mqtt_client_config_t config(int keepalive, int keepalive_jitter_ms)
+    {
+        esp_mqtt_client_config_t config{};
+        config.session.keepalive = keepalive;
+        config.session.keepalive_jitter_ms = keepalive_jitter_ms;
+        return config;
+    }
+
+    void send()
+    {
+        REQUIRE(esp_mqtt_client_publish(client.get(), "/topic", "data", 0, 0, 0) == 0);
+    }
+
+    void receive()
+    {
+        // QoS 0 PUBLISH of "data" to "/t"
+        wire.inbound.insert(wire.inbound.end(), {0x30, 8, 0, 2, '/', 't', 'd', 'a', 't', 'a'});
+        REQUIRE(test_mqtt_client_process_receive(client.get()) == ESP_OK);
+    }
+
+    void receive_pingresp()
+    {
+        wire.inbound.insert(wire.inbound.end(), {0xd0, 0});
+        REQUIRE(test_mqtt_client_process_receive(client.get()) == ESP_OK);
+    }
+
+    [[nodiscard]] int keepalive() const
+    {
+        return test_mqtt_client_process_keepalive(client.get());
+    }
+};
+
+}
+
+TEST_CASE("No ping is sent while packets flow both ways", "[keepalive]")
+{
+    connected_client c(10);
+
+    for (int64_t t = 1000; t <= 60000; t += 1000) {
+        set_time_ms(t);
+        c.send();
+        c.receive();
+        REQUIRE(c.keepalive() == ESP_OK);
+    }
+
+    REQUIRE(wire.pings == 0);
+}
+
+TEST_CASE("A ping is sent once nothing was sent for half the keepalive", "[keepalive]")
+{
+    connected_client c(10);
+
+    for (int64_t t = 1000; t < 5000; t += 1000) {
+        set_time_ms(t);
+        c.receive();
+        REQUIRE(c.keepalive() == ESP_OK);
+    }
+
+    REQUIRE(wire.pings == 0);
+    set_time_ms(5000);
+    c.receive();
+    REQUIRE(c.keepalive() == ESP_OK);
+    REQUIRE(wire.pings == 1);
+
+    // only one ping until its response
+    set_time_ms(6000);
+    REQUIRE(c.keepalive() == ESP_OK);
+    REQUIRE(wire.pings == 1);
+    c.receive_pingresp();
+    REQUIRE(c.keepalive() == ESP_OK);
+    REQUIRE(wire.pings == 1);
+}
+
+TEST_CASE("A client which only publishes pings once nothing was received for the keepalive", "[keepalive]")
+{
+    connected_client c(10);
+
+    for (int64_t t = 1000; t < 10000; t += 1000) {
+        set_time_ms(t);
+        c.send();
+        REQUIRE(c.keepalive() == ESP_OK);
+    }
+
+    REQUIRE(wire.pings == 0);
+    set_time_ms(10000);
+    c.send();
+    REQUIRE(c.keepalive() == ESP_OK);
+    REQUIRE(wire.pings == 1);
+
+    // the response proves the connection alive for another interval
+    c.receive_pingresp();
+
+    for (int64_t t = 11000; t < 20000; t += 1000) {
+        set_time_ms(t);
+        c.send();
+        REQUIRE(c.keepalive() == ESP_OK);
+    }
+
+    REQUIRE(wire.pings == 1);
+}
+
+TEST_CASE("The ping response is awaited for half the keepalive from the ping", "[keepalive]")
+{
+    connected_client c(10);
+
+    // the MQTT task only gets to the ping after 7 s, its response is due 5 s later
+    set_time_ms(7000);
+    REQUIRE(c.keepalive() == ESP_OK);
+    REQUIRE(wire.pings == 1);
+
+    SECTION("a late response disconnects") {
+        set_time_ms(11999);
+        REQUIRE(c.keepalive() == ESP_OK);
+        REQUIRE(wire.disconnects == 0);
+        set_time_ms(12000);
+        REQUIRE(c.keepalive() == ESP_FAIL);
+        REQUIRE(wire.disconnects == 1);
+    }
+    SECTION("a response in time keeps the connection") {
+        set_time_ms(11999);
+        c.receive_pingresp();
+        set_time_ms(12000);
+        REQUIRE(c.keepalive() == ESP_OK);
+        REQUIRE(wire.disconnects == 0);
+    }
+}
+
+TEST_CASE("Ping jitter stays within a quarter of the keepalive", "[keepalive]")
+{
+    const int keepalive = 120;
+    const int max_jitter_ms = keepalive * 1000 / 4;
+    int jitter_ms = 0;
+    int expected_max_ms = 0;
+
+    SECTION("larger jitter is limited") {
+        jitter_ms = 1000000;
+        expected_max_ms = max_jitter_ms;
+    }
+    SECTION("negative jitter is none") {
+        jitter_ms = -1000;
+        expected_max_ms = 0;
+    }
+
+    connected_client c(keepalive, jitter_ms);
+    int64_t t = 0;
+    int largest = 0;
+
+    for (int i = 0; i < 100; i++) {
+        t += keepalive * 1000 / 2;
+        set_time_ms(t);
+        REQUIRE(c.keepalive() == ESP_OK);
+        REQUIRE(wire.pings == static_cast<size_t>(i + 1));
+        c.receive_pingresp();
+
+        int drawn = test_mqtt_client_get_keepalive_jitter(c.client.get());
+        REQUIRE(drawn >= 0);
+        REQUIRE(drawn <= expected_max_ms);
+        largest = std::max(largest, drawn);
+    }
+
+    // uniformly drawn, 100 draws in the lower half are as good as impossible
+    REQUIRE(largest >= expected_max_ms / 2);
+}
@@ -0,0 +1,514 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Publish path tests on a client which is marked connected without running
+ * the MQTT task, every transport write is recorded by a stub.
+ */
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mqtt_test_client.hpp"
+#include "sdkconfig.h"
+extern "C" {
+    // returns zero once nothing more can be sent right now
+    int test_mqtt_client_drain_queued(esp_mqtt_client_handle_t client);
+    // returns zero once no message is overdue
+    int test_mqtt_client_retransmit_overdue(esp_mqtt_client_handle_t client);
+    void test_mqtt5_client_set_receive_maximum(esp_mqtt_client_handle_t client, uint16_t receive_maximum);
+    void test_mqtt5_client_set_outbound_topic_alias_maximum(esp_mqtt_client_handle_t client, uint16_t topic_alias_maximum);
+}
+
+namespace {
+
+struct write_stats {
+    const char *payload = nullptr;
+    size_t payload_len = 0;
+    size_t writes = 0;
+    size_t bytes = 0;
+    size_t from_payload = 0;    // bytes handed to the transport straight from the user's memory
+    bool keep_stream = false;
+    std::vector<uint8_t> stream;
+
+    void reset(const char *data, size_t len, bool keep = false)
+    {
+        *this = {data, len};
+        keep_stream = keep;
+    }
+
+    // payload bytes which were copied to the client buffer before being written
+    [[nodiscard]] size_t payload_copied() const
+    {
+        size_t header = bytes - payload_len;
+        return bytes - from_payload - header;
+    }
+};
+
+write_stats stats;
+
+int record_write(esp_transport_handle_t, const char *buffer, int len, int, int)
+{
+    stats.writes++;
+    stats.bytes += len;
+
+    if (stats.keep_stream) {
+        stats.stream.insert(stats.stream.end(), buffer, buffer + len);
+    }
+
+    if (buffer >= stats.payload && buffer < stats.payload + stats.payload_len) {
+        stats.from_payload += len;
+    }
+
+    return len;
+}
+
+// The transport doesn't take any data before the write times out
+int time_out_write(esp_transport_handle_t, const char *, int, int, int)
+{
+    return 0;
+}
+
+struct connected_client : test::mqtt::connected_client {
+    explicit connected_client(uint64_t outbox_limit = 0, esp_mqtt_protocol_ver_t protocol_ver = MQTT_PROTOCOL_UNDEFINED)
+        : test::mqtt::connected_client(config(outbox_limit, protocol_ver))
+    {
+        esp_transport_write_Stub(record_write);
+    }
+
+    static esp_mqtt_client_config_t config(uint64_t outbox_limit, esp_mqtt_protocol_ver_t protocol_ver)
+    {
+        esp_mqtt_client_config_t config{};
+        config.buffer.size = 1024;
+        config.outbox.limit = outbox_limit;
+        config.session.protocol_ver = protocol_ver;
+        return config;
+    }
+};
+
+// Splits the written stream into packets, calling on_packet with the offsets of each packet and of its variable header
+template<typename F>
+void split_packets(const std::vector<uint8_t> &stream, F on_packet)
+{
+    size_t pos = 0;
+
+    while (pos < stream.size()) {
+        size_t remaining = 0;
+        size_t i = 1;
+
+        for (int shift = 0; ; shift += 7, i++) {
+            remaining |= static_cast<size_t>(stream.at(pos + i) & 0x7f) << shift;
+
+            if ((stream.at(pos + i) & 0x80) == 0) {
+                break;
+            }
+        }
+
+        on_packet(pos, pos + i + 1);
+        pos += i + 1 + remaining;
+    }
+
+    REQUIRE(pos == stream.size());
+}
+
+std::vector<int> packet_types(const std::vector<uint8_t> &stream)
+{
+    std::vector<int> types;
+    split_packets(stream, [&](size_t packet, size_t) {
+        types.push_back(stream[packet] >> 4);
+    });
+    return types;
+}
+
+// Topics written in the publish packets of the stream, empty when only a topic alias is sent
+std::vector<std::string> publish_topics(const std::vector<uint8_t> &stream)
+{
+    std::vector<std::string> topics;
+    split_packets(stream, [&](size_t, size_t variable_header) {
+        size_t topic_len = stream.at(variable_header) << 8 | stream.at(variable_header + 1);
+        auto topic = stream.begin() + variable_header + 2;
+        topics.emplace_back(topic, topic + topic_len);
+    });
+    return topics;
+}
+
+}
+
+TEST_CASE("Publish writes payloads larger than the buffer without copying", "[publish]")
+{
+    connected_client c;
+
+    for (int qos : {0, 1}) {
+        for (size_t len : {64, 1024, 16 * 1024, 64 * 1024}) {
+            std::vector<char> payload(len, 'x');
+            stats.reset(payload.data(), len);
+            REQUIRE(esp_mqtt_client_publish(c.client.get(), "/topic", payload.data(), len, qos, 0) >= 0);
+            CAPTURE(qos, len, stats.writes);
+            REQUIRE(stats.bytes > len);
+
+            if (len < 1024) {
+                // small payloads are encoded together with the header and written at once
+                REQUIRE(stats.payload_copied() == len);
+                REQUIRE(stats.writes == 1);
+            } else {
+                REQUIRE(stats.payload_copied() == 0);
+                REQUIRE(stats.writes == 2);
+            }
+        }
+    }
+}
+
+TEST_CASE("Owned publish writes the caller's payload and releases it once", "[publish]")
+{
+    // declared before the client, which releases outbox payloads on destroy
+    int released = 0;
+    connected_client c;
+    std::vector<char> payload(4096, 'y');
+    auto release = [](void *, void *ctx) {
+        ++*static_cast<int *>(ctx);
+    };
+
+    SECTION("QoS0 is written from the caller's buffer and released before returning") {
+        stats.reset(payload.data(), payload.size());
+        REQUIRE(esp_mqtt_client_publish_owned(c.client.get(), "/topic", payload.data(), payload.size(), 0, 0,
+                                              release, &released) == 0);
+        REQUIRE(stats.writes == 2);
+        REQUIRE(stats.payload_copied() == 0);
+        REQUIRE(released == 1);
+    }
+    SECTION("QoS1 is referenced by the outbox and released when the client is destroyed") {
+        test_mqtt_client_set_disconnected(c.client.get());
+        stats.reset(payload.data(), payload.size());
+        REQUIRE(esp_mqtt_client_publish_owned(c.client.get(), "/topic", payload.data(), payload.size(), 1, 0,
+                                              release, &released) > 0);
+        REQUIRE(stats.writes == 0);
+        REQUIRE(released == 0);
+        c.client.reset();
+        REQUIRE(released == 1);
+    }
+    SECTION("rejected publish leaves the payload with the caller") {
+        REQUIRE(esp_mqtt_client_publish_owned(c.client.get(), "", payload.data(), payload.size(), 0, 0,
+                                              release, &released) == -1);
+        REQUIRE(released == 0);
+    }
+}
+
+#if CONFIG_MQTT5_AUTO_TOPIC_ALIAS
+TEST_CASE("MQTT5 topic aliases are only assigned by messages which are written", "[publish][topic_alias]")
+{
+    connected_client c(0, MQTT_PROTOCOL_V_5);
+    test_mqtt5_client_set_outbound_topic_alias_maximum(c.client.get(), 4);
+    stats.reset(nullptr, 0, true);
+
+    // a QoS0 message which isn't stored is dropped, so the broker never learns an alias from it
+    REQUIRE(esp_mqtt_client_enqueue(c.client.get(), "/topic", "dropped", 0, 0, 0, false) == -1);
+    REQUIRE(stats.writes == 0);
+
+    REQUIRE(esp_mqtt_client_publish(c.client.get(), "/topic", "first", 0, 0, 0) == 0);
+    REQUIRE(esp_mqtt_client_publish(c.client.get(), "/topic", "second", 0, 0, 0) == 0);
+    REQUIRE(publish_topics(stats.stream) == std::vector<std::string> {"/topic", ""});
+}
+#endif
+
+TEST_CASE("Batch publish packs messages into few transport writes", "[publish]")
+{
+    std::vector<std::string> payloads;
+    std::vector<esp_mqtt_publish_t> msgs;
+
+    for (int i = 0; i < 100; i++) {
+        payloads.push_back("sensor-" + std::to_string(i));
+    }
+
+    for (auto &payload : payloads) {
+        msgs.push_back({"/gw/sensor", payload.c_str(), 0, 0, 0});
+    }
+
+    std::vector<int> ids(msgs.size(), 123);
+
+    SECTION("QoS0 messages are flushed when the buffer is full") {
+        connected_client c;
+        stats.reset(nullptr, 0, true);
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), msgs.data(), msgs.size(), ids.data()) == 100);
+        REQUIRE(std::ranges::all_of(ids, [](int id) {
+            return id == 0;
+        }));
+        // 100 packets of 25-26 bytes fit in 3 buffers of 1 KiB
+        REQUIRE(stats.writes == 3);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(100, 3));
+    }
+    SECTION("large payloads are written after the packed messages") {
+        connected_client c;
+        std::string large(4000, 'L');
+        msgs[50] = {"/gw/camera", large.c_str(), static_cast<int>(large.size()), 1, 0};
+        stats.reset(nullptr, 0, true);
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), msgs.data(), msgs.size(), ids.data()) == 100);
+        REQUIRE(ids[50] > 0);
+        REQUIRE(packet_types(stats.stream).size() == 100);
+        REQUIRE(stats.writes <= 5);
+    }
+    SECTION("messages which don't fit the outbox are reported one by one") {
+        connected_client c(100);
+        std::string large(80, 'L');
+        msgs[0] = {"/a", large.c_str(), static_cast<int>(large.size()), 1, 0};
+        msgs[1] = {"/b", large.c_str(), static_cast<int>(large.size()), 1, 0};
+        msgs[2] = {"/c", "small", 0, 2, 0};
+        test_mqtt_client_set_disconnected(c.client.get());
+        stats.reset(nullptr, 0);
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), msgs.data(), 4, ids.data()) == 2);
+        REQUIRE(ids[0] > 0);
+        REQUIRE(ids[1] == -2);
+        REQUIRE(ids[2] > 0);
+        REQUIRE(ids[3] == -1);  // QoS0 while disconnected
+        REQUIRE(stats.writes == 0);
+    }
+    SECTION("QoS>0 messages of a failed write are sent again from the outbox") {
+        connected_client c;
+        for (auto &msg : msgs) {
+            msg.qos = 1;
+        }
+        esp_transport_close_IgnoreAndReturn(ESP_OK);
+        esp_event_post_to_IgnoreAndReturn(ESP_OK);
+        esp_event_loop_run_IgnoreAndReturn(ESP_OK);
+        esp_transport_write_Stub(time_out_write);
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), msgs.data(), 10, ids.data()) == 10);
+
+        // nothing was written, so the messages are still queued rather than waiting for acknowledgements
+        esp_transport_write_Stub(record_write);
+        c.set_connected();
+        stats.reset(nullptr, 0, true);
+        REQUIRE(test_mqtt_client_drain_queued(c.client.get()) == 0);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(10, 3));
+    }
+    SECTION("with MQTT5, QoS>0 messages in flight are bounded by the broker's Receive Maximum") {
+        connected_client c(0, MQTT_PROTOCOL_V_5);
+        test_mqtt5_client_set_receive_maximum(c.client.get(), 3);
+        for (auto &msg : msgs) {
+            msg.qos = 1;
+        }
+        stats.reset(nullptr, 0, true);
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), msgs.data(), 5, ids.data()) == 5);
+        REQUIRE(packet_types(stats.stream).size() == 3);
+
+        // the written ones are counted in flight, the held back ones stay queued
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), msgs.data() + 5, 1, ids.data()) == 1);
+        REQUIRE(packet_types(stats.stream).size() == 3);
+    }
+    SECTION("empty batch and invalid arguments") {
+        connected_client c;
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), nullptr, 0, nullptr) == 0);
+        REQUIRE(esp_mqtt_client_publish_batch(c.client.get(), msgs.data(), msgs.size(), nullptr) == -1);
+        REQUIRE(esp_mqtt_client_publish_batch(nullptr, msgs.data(), msgs.size(), ids.data()) == -1);
+    }
+}
+
+TEST_CASE("Queued messages are drained in few task iterations", "[publish]")
+{
+    connected_client c;
+    std::string payload(32, 'q');
+
+    for (int i = 0; i < 500; i++) {
+        REQUIRE(esp_mqtt_client_enqueue(c.client.get(), "/topic", payload.c_str(), 0, 0, 0, true) == 0);
+    }
+
+    stats.reset(nullptr, 0, true);
+
+    SECTION("until the byte budget is used up") {
+        int iterations = 0;
+
+        while (test_mqtt_client_drain_queued(c.client.get()) != 0) {
+            iterations++;
+        }
+
+        // 500 packets of 42 bytes, 16 KiB per iteration
+        REQUIRE(iterations == 1);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(500, 3));
+        REQUIRE(test_mqtt_client_drain_queued(c.client.get()) == 0);
+        REQUIRE(stats.writes == 500);
+    }
+    SECTION("until the transport would block") {
+        esp_transport_poll_write_IgnoreAndReturn(0);
+        REQUIRE(test_mqtt_client_drain_queued(c.client.get()) != 0);
+        REQUIRE(stats.writes == 1);
+        esp_transport_poll_write_IgnoreAndReturn(1);
+        REQUIRE(test_mqtt_client_drain_queued(c.client.get()) != 0);
+        REQUIRE(test_mqtt_client_drain_queued(c.client.get()) == 0);
+        REQUIRE(stats.writes == 500);
+    }
+}
+
+TEST_CASE("Overdue messages are retransmitted in bursts", "[publish]")
+{
+    constexpr int64_t overdue_us = 10 * 1000 * 1000;
+    std::string payload(32, 'r');
+    auto publish = [&payload](esp_mqtt_client_handle_t client, int count) {
+        for (int i = 0; i < count; i++) {
+            REQUIRE(esp_mqtt_client_publish(client, "/topic", payload.c_str(), payload.size(), 1, 0) > 0);
+        }
+    };
+
+    SECTION("every overdue message is resent in one iteration") {
+        connected_client c;
+        publish(c.client.get(), 20);
+        stats.reset(nullptr, 0, true);
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) == 0);
+        REQUIRE(stats.writes == 0);
+
+        esp_timer_get_time_IgnoreAndReturn(overdue_us);
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) == 0);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(20, 3));
+        REQUIRE((stats.stream[0] & 0x08) != 0);
+
+        // resent messages are due again only after their backed off timeout
+        stats.reset(nullptr, 0, true);
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) == 0);
+        REQUIRE(stats.writes == 0);
+    }
+    SECTION("until the byte budget is used up") {
+        connected_client c;
+        publish(c.client.get(), 500);
+        esp_timer_get_time_IgnoreAndReturn(overdue_us);
+        stats.reset(nullptr, 0, true);
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) != 0);
+
+        // the burst stops with the packet which reaches the budget
+        size_t burst = packet_types(stats.stream).size();
+        REQUIRE(stats.bytes >= CONFIG_MQTT_RETRANSMIT_BURST_BYTES);
+        REQUIRE(stats.bytes - stats.bytes / burst < CONFIG_MQTT_RETRANSMIT_BURST_BYTES);
+
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) == 0);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(500, 3));
+    }
+    SECTION("until the transport would block") {
+        connected_client c;
+        publish(c.client.get(), 20);
+        esp_timer_get_time_IgnoreAndReturn(overdue_us);
+        stats.reset(nullptr, 0, true);
+        esp_transport_poll_write_IgnoreAndReturn(0);
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) != 0);
+        REQUIRE(packet_types(stats.stream).size() == 1);
+        esp_transport_poll_write_IgnoreAndReturn(1);
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) == 0);
+        REQUIRE(packet_types(stats.stream).size() == 20);
+    }
+    SECTION("with MQTT5, up to the broker's Receive Maximum") {
+        connected_client c(0, MQTT_PROTOCOL_V_5);
+        publish(c.client.get(), 10);
+        test_mqtt5_client_set_receive_maximum(c.client.get(), 4);
+        esp_timer_get_time_IgnoreAndReturn(overdue_us);
+        stats.reset(nullptr, 0, true);
+
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) != 0);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(4, 3));
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) != 0);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(8, 3));
+        REQUIRE(test_mqtt_client_retransmit_overdue(c.client.get()) == 0);
+        REQUIRE(packet_types(stats.stream) == std::vector<int>(10, 3));
+    }
+}
+
+TEST_CASE("Publish template encodes the same messages as publish", "[publish]")
+{
+    connected_client c;
+    std::string topic = "/building/floor/room/sensor/temperature";
+    std::string payload = "21.5";
+
+    for (int qos : {0, 1}) {
+        CAPTURE(qos);
+        esp_mqtt_publish_template_handle_t tmpl = esp_mqtt_client_create_publish_template(c.client.get(), topic.c_str(),
+                                                                                         qos, 1);
+        REQUIRE(tmpl != nullptr);
+
+        stats.reset(nullptr, 0, true);
+        int id = esp_mqtt_client_publish(c.client.get(), topic.c_str(), payload.c_str(), 0, qos, 1);
+        std::vector<uint8_t> expected = stats.stream;
+        stats.reset(nullptr, 0, true);
+        int template_id = esp_mqtt_client_publish_with_template(c.client.get(), tmpl, payload.c_str(), 0);
+        REQUIRE(template_id >= 0);
+        REQUIRE(stats.writes == 1);
+
+        if (qos > 0) {
+            REQUIRE(template_id > 0);
+            // message ids differ, they follow the fixed header and the topic
+            size_t id_pos = 2 + 2 + topic.size();
+            REQUIRE(stats.stream.at(id_pos) == (template_id >> 8));
+            REQUIRE(stats.stream.at(id_pos + 1) == (template_id & 0xff));
+            stats.stream[id_pos] = id >> 8;
+            stats.stream[id_pos + 1] = id & 0xff;
+        }
+
+        REQUIRE(stats.stream == expected);
+        esp_mqtt_client_destroy_publish_template(tmpl);
+    }
+}
+
+TEST_CASE("Publish template writes large payloads from user memory", "[publish]")
+{
+    connected_client c;
+    esp_mqtt_publish_template_handle_t tmpl = esp_mqtt_client_create_publish_template(c.client.get(), "/camera", 1, 0);
+    REQUIRE(tmpl != nullptr);
+    std::vector<char> payload(16 * 1024, 'x');
+    stats.reset(payload.data(), payload.size());
+    REQUIRE(esp_mqtt_client_publish_with_template(c.client.get(), tmpl, payload.data(), payload.size()) > 0);
+    REQUIRE(stats.writes == 2);
+    REQUIRE(stats.payload_copied() == 0);
+
+    REQUIRE(esp_mqtt_client_publish_with_template(c.client.get(), nullptr, payload.data(), 1) == -1);
+    REQUIRE(esp_mqtt_client_create_publish_template(c.client.get(), "", 0, 0) == nullptr);
+    esp_mqtt_client_destroy_publish_template(tmpl);
+}
+
+TEST_CASE("Publish throughput", "[publish][benchmark]")
+{
+    connected_client c;
+    std::vector<char> payload(64 * 1024, 'z');
+    stats.reset(payload.data(), payload.size());
+
+    BENCHMARK("QoS0 publish, 64 KiB payload, 1 KiB buffer") {
+        return esp_mqtt_client_publish(c.client.get(), "/topic", payload.data(), payload.size(), 0, 0);
+    };
+    BENCHMARK("QoS0 publish, 512 B payload, 1 KiB buffer") {
+        return esp_mqtt_client_publish(c.client.get(), "/topic", payload.data(), 512, 0, 0);
+    };
+
+    const char *topic = "/building/floor/room/sensor/temperature";
+    esp_mqtt_publish_template_handle_t tmpl = esp_mqtt_client_create_publish_template(c.client.get(), topic, 0, 0);
+    BENCHMARK("QoS0 publish, 16 B payload, 40 B topic") {
+        return esp_mqtt_client_publish(c.client.get(), topic, payload.data(), 16, 0, 0);
+    };
+    BENCHMARK("QoS0 publish, 16 B payload, 40 B topic, through a template") {
+        return esp_mqtt_client_publish_with_template(c.client.get(), tmpl, payload.data(), 16);
+    };
+    esp_mqtt_client_destroy_publish_template(tmpl);
+
+    std::vector<esp_mqtt_publish_t> msgs(100, {"/gw/sensor", payload.data(), 16, 0, 0});
+    std::vector<int> ids(msgs.size());
+    BENCHMARK("100 QoS0 publishes of 16 B, one by one") {
+        for (auto &msg : msgs) {
+            esp_mqtt_client_publish(c.client.get(), msg.topic, msg.data, msg.len, msg.qos, msg.retain);
+        }
+        return stats.writes;
+    };
+    BENCHMARK("100 QoS0 publishes of 16 B, batched") {
+        return esp_mqtt_client_publish_batch(c.client.get(), msgs.data(), msgs.size(), ids.data());
+    };
+
+    BENCHMARK_ADVANCED("drain of 500 queued QoS0 messages of 16 B")(Catch::Benchmark::Chronometer meter) {
+        for (int i = 0; i < 500 * meter.runs(); i++) {
+            esp_mqtt_client_enqueue(c.client.get(), "/gw/sensor", payload.data(), 16, 0, 0, true);
+        }
+
+        // a drain may run ahead into the messages of the next run, the total over all runs is exact
+        size_t base = stats.writes;
+        meter.measure([&](int run) {
+            while (stats.writes < base + 500 * static_cast<size_t>(run + 1)) {
+                test_mqtt_client_drain_queued(c.client.get());
+            }
+
+            return stats.writes;
+        });
+    };
+}
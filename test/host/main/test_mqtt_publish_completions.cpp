@@ -0,0 +1,222 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "mqtt_client.h"
+
+extern "C" {
+    typedef struct mqtt_publish_completions *mqtt_publish_completions_handle_t;
+    mqtt_publish_completions_handle_t mqtt_publish_completions_create(void);
+    void mqtt_publish_completions_destroy(mqtt_publish_completions_handle_t completions);
+    esp_err_t mqtt_publish_completions_reserve(mqtt_publish_completions_handle_t completions);
+    void mqtt_publish_completions_add(mqtt_publish_completions_handle_t completions, uint16_t msg_id,
+                                      esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx);
+    bool mqtt_publish_completions_take(mqtt_publish_completions_handle_t completions, uint16_t msg_id,
+                                       esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx);
+    bool mqtt_publish_completions_take_any(mqtt_publish_completions_handle_t completions, uint16_t *msg_id,
+                                           esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx);
+    size_t mqtt_publish_completions_count(mqtt_publish_completions_handle_t completions);
+    esp_err_t mqtt_publish_completions_reserve_queued(mqtt_publish_completions_handle_t completions);
+    void mqtt_publish_completions_add_queued(mqtt_publish_completions_handle_t completions, uint32_t position,
+                                             esp_mqtt_publish_complete_cb_t complete_cb, void *complete_ctx);
+    bool mqtt_publish_completions_take_queued(mqtt_publish_completions_handle_t completions, uint32_t removed,
+                                              esp_mqtt_publish_complete_cb_t *complete_cb, void **complete_ctx);
+}
+
+namespace {
+
+void complete(void *, int, esp_mqtt_publish_status_t, int)
+{
+}
+
+struct completions {
+    mqtt_publish_completions_handle_t handle = mqtt_publish_completions_create();
+
+    completions()
+    {
+        REQUIRE(handle != nullptr);
+    }
+
+    ~completions()
+    {
+        mqtt_publish_completions_destroy(handle);
+    }
+
+    void add(uint16_t msg_id, uintptr_t ctx)
+    {
+        REQUIRE(mqtt_publish_completions_reserve(handle) == ESP_OK);
+        mqtt_publish_completions_add(handle, msg_id, complete, reinterpret_cast<void *>(ctx));
+    }
+
+    void add_queued(uint32_t position, uintptr_t ctx)
+    {
+        REQUIRE(mqtt_publish_completions_reserve_queued(handle) == ESP_OK);
+        mqtt_publish_completions_add_queued(handle, position, complete, reinterpret_cast<void *>(ctx));
+    }
+
+    // context of the oldest queued completion once removed messages left the outbox, 0 if there was none
+    uintptr_t take_queued(uint32_t removed)
+    {
+        esp_mqtt_publish_complete_cb_t complete_cb = nullptr;
+        void *ctx = nullptr;
+
+        if (!mqtt_publish_completions_take_queued(handle, removed, &complete_cb, &ctx)) {
+            return 0;
+        }
+
+        REQUIRE(complete_cb == complete);
+        return reinterpret_cast<uintptr_t>(ctx);
+    }
+
+    // context of the taken completion, 0 if there was none
+    uintptr_t take(uint16_t msg_id)
+    {
+        esp_mqtt_publish_complete_cb_t complete_cb = nullptr;
+        void *ctx = nullptr;
+
+        if (!mqtt_publish_completions_take(handle, msg_id, &complete_cb, &ctx)) {
+            return 0;
+        }
+
+        REQUIRE(complete_cb == complete);
+        return reinterpret_cast<uintptr_t>(ctx);
+    }
+};
+
+}
+
+TEST_CASE("Publish completions are taken by message id", "[publish_completions]")
+{
+    completions c;
+    c.add(1, 101);
+    c.add(17, 117);     // same bucket as 1 in the initial table
+    c.add(2, 102);
+    REQUIRE(mqtt_publish_completions_count(c.handle) == 3);
+
+    REQUIRE(c.take(3) == 0);
+    REQUIRE(c.take(1) == 101);
+    REQUIRE(c.take(1) == 0);
+    REQUIRE(c.take(17) == 117);
+    REQUIRE(c.take(2) == 102);
+    REQUIRE(mqtt_publish_completions_count(c.handle) == 0);
+
+    SECTION("A reused message id is completed once per publish") {
+        c.add(5, 1);
+        c.add(5, 2);
+        std::vector<uintptr_t> taken = {c.take(5), c.take(5), c.take(5)};
+        std::sort(taken.begin(), taken.end());
+        REQUIRE(taken == std::vector<uintptr_t> {0, 1, 2});
+    }
+}
+
+TEST_CASE("Publish completions stay reachable as the table grows and shrinks", "[publish_completions]")
+{
+    completions c;
+    std::vector<uint16_t> ids;
+    std::mt19937 rng(42);
+
+    for (uint16_t i = 0; i < 3000; i++) {
+        ids.push_back(static_cast<uint16_t>(rng() % 65535 + 1));
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    std::shuffle(ids.begin(), ids.end(), rng);
+
+    for (uint16_t id : ids) {
+        c.add(id, id);
+    }
+
+    REQUIRE(mqtt_publish_completions_count(c.handle) == ids.size());
+
+    // take every other one, the rest must still be found after the probe sequences are shifted back
+    for (size_t i = 0; i < ids.size(); i += 2) {
+        REQUIRE(c.take(ids[i]) == ids[i]);
+    }
+
+    for (size_t i = 1; i < ids.size(); i += 2) {
+        REQUIRE(c.take(ids[i]) == ids[i]);
+    }
+
+    REQUIRE(mqtt_publish_completions_count(c.handle) == 0);
+
+    SECTION("All the completions can be taken without their ids") {
+        for (uint16_t id = 1; id <= 100; id++) {
+            c.add(id, id);
+        }
+
+        esp_mqtt_publish_complete_cb_t complete_cb;
+        void *ctx;
+        uint16_t msg_id;
+        size_t taken = 0;
+
+        while (mqtt_publish_completions_take_any(c.handle, &msg_id, &complete_cb, &ctx)) {
+            REQUIRE(reinterpret_cast<uintptr_t>(ctx) == msg_id);
+            taken++;
+        }
+
+        REQUIRE(taken == 100);
+        REQUIRE(mqtt_publish_completions_count(c.handle) == 0);
+    }
+}
+
+TEST_CASE("Queued QoS 0 completions are taken in order once their message left the outbox", "[publish_completions]")
+{
+    completions c;
+
+    // QoS 0 messages 2, 3 and 6 were published asynchronously, the others synchronously
+    c.add_queued(2, 102);
+    c.add_queued(3, 103);
+    c.add_queued(6, 106);
+    c.add(1, 1);
+    REQUIRE(mqtt_publish_completions_count(c.handle) == 4);
+
+    REQUIRE(c.take_queued(1) == 0);
+    REQUIRE(c.take_queued(2) == 102);
+    REQUIRE(c.take_queued(2) == 0);
+    REQUIRE(c.take_queued(3) == 103);
+    REQUIRE(c.take_queued(5) == 0);
+    REQUIRE(c.take_queued(6) == 106);
+    REQUIRE(mqtt_publish_completions_count(c.handle) == 1);
+
+    SECTION("the ring grows while it wraps around") {
+        uint32_t position = UINT32_MAX - 20;   // the counts wrap around too
+
+        for (int round = 0; round < 10; round++) {
+            uint32_t removed = position;
+
+            for (int i = 0; i < 3 + round; i++) {
+                position++;
+                c.add_queued(position, position);
+            }
+
+            while (removed != position) {
+                removed++;
+                REQUIRE(c.take_queued(removed) == removed);
+            }
+        }
+
+        REQUIRE(mqtt_publish_completions_count(c.handle) == 1);
+    }
+    SECTION("all of them can be dropped") {
+        c.add_queued(7, 107);
+        esp_mqtt_publish_complete_cb_t complete_cb;
+        void *ctx;
+        uint16_t msg_id;
+        std::vector<uintptr_t> taken;
+
+        while (mqtt_publish_completions_take_any(c.handle, &msg_id, &complete_cb, &ctx)) {
+            REQUIRE(msg_id == (reinterpret_cast<uintptr_t>(ctx) == 107 ? 0 : 1));
+            taken.push_back(reinterpret_cast<uintptr_t>(ctx));
+        }
+
+        REQUIRE(taken == std::vector<uintptr_t> {107, 1});
+    }
+}
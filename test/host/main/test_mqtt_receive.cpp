@@ -0,0 +1,595 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Receive path tests on a client which is marked connected without running
+ * the MQTT task, the transport reads are served from a byte stream.
+ */
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "mqtt_test_client.hpp"
+extern "C" {
+    int test_mqtt_client_process_receive(esp_mqtt_client_handle_t client);
+}
+
+namespace {
+
+struct inbound_stream {
+    std::vector<uint8_t> bytes;
+    size_t pos = 0;
+    size_t chunk = SIZE_MAX;    // most bytes returned by one read
+    size_t reads = 0;
+    size_t acks = 0;            // PUBACKs written by the client
+    std::string data;           // payload of the received publish messages
+    size_t data_events = 0;
+};
+
+inbound_stream in;
+
+int serve_read(esp_transport_handle_t, char *buffer, int len, int, int)
+{
+    if (in.pos == in.bytes.size()) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+
+    in.reads++;
+    size_t n = std::min({static_cast<size_t>(len), in.chunk, in.bytes.size() - in.pos});
+    memcpy(buffer, in.bytes.data() + in.pos, n);
+    in.pos += n;
+    return static_cast<int>(n);
+}
+
+int count_acks(esp_transport_handle_t, const char *buffer, int len, int, int)
+{
+    if ((static_cast<uint8_t>(buffer[0]) >> 4) == 4) {
+        in.acks++;
+    }
+
+    return len;
+}
+
+esp_err_t record_event(esp_event_loop_handle_t, esp_event_base_t, int32_t id, const void *data, size_t, TickType_t,
+                       int)
+{
+    auto *event = static_cast<const esp_mqtt_event_t *>(data);
+
+    if (id == MQTT_EVENT_DATA) {
+        in.data_events++;
+        in.data.append(event->data, event->data_len);
+    }
+
+    return ESP_OK;
+}
+
+void record_callback(void *args, const esp_mqtt_event_t *event)
+{
+    auto *events = static_cast<size_t *>(args);
+    (*events)++;
+
+    if (event->event_id == MQTT_EVENT_DATA) {
+        in.data.append(event->data, event->data_len);
+    }
+}
+
+struct held_event {
+    esp_mqtt_event_t event;
+    esp_mqtt_event_data_handle_t data;
+    esp_mqtt5_event_property_t property;    // event.property is shared by the events, so it's copied
+};
+
+std::vector<held_event> held;
+bool release_previous;      // keeps at most one buffer held
+
+void hold_callback(void *, const esp_mqtt_event_t *event)
+{
+    if (event->event_id != MQTT_EVENT_DATA) {
+        return;
+    }
+
+    if (release_previous && !held.empty()) {
+        esp_mqtt_event_release_data(held.back().data);
+        held.back().data = nullptr;
+    }
+
+    held.push_back({*event, esp_mqtt_event_hold_data(event), {}});
+
+    if (event->property) {
+        REQUIRE(esp_mqtt5_client_parse_publish_property(event->client, event->property) == ESP_OK);
+        held.back().property = *event->property;
+    }
+}
+
+std::string held_data(const held_event &h)
+{
+    return std::string(h.event.data, h.event.data_len);
+}
+
+/*
+ * Event loop of the host tests, posting works like esp_event_post_to(): the event is copied to the heap and
+ * queued, the run calls the handler and frees the copy. The handler lookup and the locking are left out
+ */
+void *queued_event;
+
+esp_err_t queue_event(esp_event_loop_handle_t, esp_event_base_t, int32_t, const void *data, size_t size, TickType_t,
+                      int)
+{
+    queued_event = malloc(size);
+    memcpy(queued_event, data, size);
+    return ESP_OK;
+}
+
+esp_err_t run_queue(esp_event_loop_handle_t, TickType_t, int)
+{
+    if (queued_event) {
+        record_callback(&in.data_events, static_cast<esp_mqtt_event_t *>(queued_event));
+        free(queued_event);
+        queued_event = nullptr;
+    }
+
+    return ESP_OK;
+}
+
+#if CONFIG_MQTT_EVENT_QUEUE_SIZE > 1
+/*
+ * Event loop with a queue, each run handles the oldest event. The handler the client registers when it creates the
+ * loop is called before hold_callback(), like the handlers registered after it
+ */
+struct queued_loop {
+    esp_event_handler_t client_handler = nullptr;
+    void *client_handler_args = nullptr;
+    esp_event_base_t base = nullptr;
+    std::deque<std::pair<int32_t, std::vector<uint8_t>>> events;
+} loop;
+
+esp_err_t register_client_handler(esp_event_loop_handle_t, esp_event_base_t, int32_t id, esp_event_handler_t handler,
+                                  void *args, int)
+{
+    REQUIRE(id == MQTT_EVENT_DATA);
+    loop.client_handler = handler;
+    loop.client_handler_args = args;
+    return ESP_OK;
+}
+
+esp_err_t post_queued(esp_event_loop_handle_t, esp_event_base_t base, int32_t id, const void *data, size_t size,
+                      TickType_t, int)
+{
+    auto *bytes = static_cast<const uint8_t *>(data);
+    loop.base = base;
+    loop.events.emplace_back(id, std::vector<uint8_t>(bytes, bytes + size));
+    return ESP_OK;
+}
+
+esp_err_t run_queued(esp_event_loop_handle_t, TickType_t, int)
+{
+    if (loop.events.empty()) {
+        return ESP_OK;
+    }
+
+    auto [id, copy] = std::move(loop.events.front());
+    loop.events.pop_front();
+
+    if (id == MQTT_EVENT_DATA) {
+        auto *event = reinterpret_cast<esp_mqtt_event_t *>(copy.data());
+        loop.client_handler(loop.client_handler_args, loop.base, id, event);
+        hold_callback(nullptr, event);
+    }
+
+    return ESP_OK;
+}
+#endif
+
+void append_variable_length(std::vector<uint8_t> &out, size_t length)
+{
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        out.push_back(length > 0 ? byte | 0x80 : byte);
+    } while (length > 0);
+}
+
+// properties are only set for MQTT5, which encodes their length even if there are none
+void append_publish(std::vector<uint8_t> &out, const std::string &topic, const std::string &payload, uint16_t msg_id,
+                    const std::vector<uint8_t> *properties = nullptr)
+{
+    std::vector<uint8_t> property_length;
+
+    if (properties) {
+        append_variable_length(property_length, properties->size());
+    }
+
+    out.push_back(0x32);   // PUBLISH, QoS1
+    append_variable_length(out, 2 + topic.size() + 2 + (properties ? property_length.size() + properties->size() : 0) +
+                           payload.size());
+    out.push_back(topic.size() >> 8);
+    out.push_back(topic.size() & 0xff);
+    out.insert(out.end(), topic.begin(), topic.end());
+    out.push_back(msg_id >> 8);
+    out.push_back(msg_id & 0xff);
+
+    if (properties) {
+        out.insert(out.end(), property_length.begin(), property_length.end());
+        out.insert(out.end(), properties->begin(), properties->end());
+    }
+
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+struct connected_client : test::mqtt::connected_client {
+    explicit connected_client(int buffer_size = 1024, esp_mqtt_event_callback_t event_callback = nullptr,
+                              void *event_callback_args = nullptr, int in_pool_size = 0,
+                              esp_mqtt_protocol_ver_t protocol_ver = MQTT_PROTOCOL_UNDEFINED)
+        : test::mqtt::connected_client(config(buffer_size, event_callback, event_callback_args, in_pool_size,
+                                              protocol_ver))
+    {
+        esp_transport_read_Stub(serve_read);
+        esp_transport_write_Stub(count_acks);
+        esp_event_post_to_Stub(record_event);
+        in = {};
+    }
+
+    static esp_mqtt_client_config_t config(int buffer_size, esp_mqtt_event_callback_t event_callback,
+                                           void *event_callback_args, int in_pool_size,
+                                           esp_mqtt_protocol_ver_t protocol_ver)
+    {
+        esp_mqtt_client_config_t config{};
+        config.buffer.size = buffer_size;
+        config.buffer.in_pool_size = in_pool_size;
+        config.session.protocol_ver = protocol_ver;
+        config.event_callback.handler = event_callback;
+        config.event_callback.handler_args = event_callback_args;
+        return config;
+    }
+};
+
+}
+
+TEST_CASE("Messages received in one read are all processed", "[receive]")
+{
+    connected_client c;
+    std::string expected;
+
+    for (uint16_t id = 1; id <= 20; id++) {
+        std::string payload = "payload-" + std::to_string(id);
+        append_publish(in.bytes, "/topic", payload, id);
+        expected += payload;
+    }
+
+    SECTION("A single read delivers all messages") {
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+        REQUIRE(in.reads == 1);
+        REQUIRE(in.acks == 20);
+        REQUIRE(in.data_events == 20);
+        REQUIRE(in.data == expected);
+    }
+    SECTION("Messages split across reads are reassembled") {
+        in.chunk = 7;
+
+        for (int i = 0; i < 1000 && in.pos < in.bytes.size(); i++) {
+            REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+        }
+
+        REQUIRE(in.pos == in.bytes.size());
+        REQUIRE(in.acks == 20);
+        REQUIRE(in.data == expected);
+    }
+}
+
+TEST_CASE("Publish larger than the buffer is delivered in parts", "[receive]")
+{
+    connected_client c(256);
+    std::string large(1000, 'L');
+    append_publish(in.bytes, "/large", large, 1);
+    append_publish(in.bytes, "/small", "after", 2);
+
+    for (int i = 0; i < 10 && in.pos < in.bytes.size(); i++) {
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    }
+
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(in.data == large + "after");
+    REQUIRE(in.data_events > 2);
+    REQUIRE(in.acks == 2);
+}
+
+TEST_CASE("Malformed remaining length aborts the receive", "[receive]")
+{
+    connected_client c;
+    in.bytes = {0x30, 0xff, 0xff, 0xff, 0xff, 0x01};
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_FAIL);
+}
+
+TEST_CASE("Topic handlers receive the messages matching their filter", "[receive]")
+{
+    connected_client c(256);
+    struct routed {
+        std::string data;
+        size_t events = 0;
+    } sensors, all;
+    auto record = [](void *args, esp_mqtt_event_handle_t event) {
+        auto *r = static_cast<routed *>(args);
+        r->events++;
+        r->data.append(event->data, event->data_len);
+    };
+    REQUIRE(esp_mqtt_client_register_topic_handler(c.client.get(), "/sensor/+", record, &sensors) == ESP_OK);
+    REQUIRE(esp_mqtt_client_register_topic_handler(c.client.get(), "#", record, &all) == ESP_OK);
+    REQUIRE(esp_mqtt_client_register_topic_handler(c.client.get(), "/sensor/#/x", record, &all) == ESP_ERR_INVALID_ARG);
+    std::string large(1000, 'L');
+    append_publish(in.bytes, "/sensor/temperature", large, 1);
+    append_publish(in.bytes, "/status", "online", 2);
+
+    for (int i = 0; i < 10 && in.pos < in.bytes.size(); i++) {
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    }
+
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    // every part of the large message is routed, not only the one carrying the topic
+    REQUIRE(sensors.data == large);
+    REQUIRE(sensors.events > 1);
+    REQUIRE(all.data == large + "online");
+    REQUIRE(in.data == large + "online");
+
+    REQUIRE(esp_mqtt_client_unregister_topic_handler(c.client.get(), "/sensor/+", record, &sensors) == ESP_OK);
+    REQUIRE(esp_mqtt_client_unregister_topic_handler(c.client.get(), "/sensor/+", record, &sensors) == ESP_ERR_NOT_FOUND);
+    append_publish(in.bytes, "/sensor/humidity", "40", 3);
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(sensors.data == large);
+    REQUIRE(all.data == large + "online" + "40");
+}
+
+TEST_CASE("Events are delivered to the event callback instead of the event loop", "[receive]")
+{
+    size_t callback_events = 0;
+    connected_client c(1024, record_callback, &callback_events);
+    append_publish(in.bytes, "/topic", "direct", 1);
+
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(in.data == "direct");
+    REQUIRE(callback_events == 1);
+    REQUIRE(in.data_events == 0);
+}
+
+TEST_CASE("Event handlers hold the received data until released", "[receive]")
+{
+    held.clear();
+    release_previous = false;
+
+    SECTION("Held data isn't overwritten by the next messages") {
+        connected_client c(1024, hold_callback, nullptr, 2);
+
+        for (uint16_t id = 1; id <= 20; id++) {
+            append_publish(in.bytes, "/topic/" + std::to_string(id), "payload-" + std::to_string(id), id);
+        }
+
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+        REQUIRE(in.reads == 1);
+        REQUIRE(held.size() == 20);
+        // one hold per spare buffer
+        REQUIRE(held[0].data != nullptr);
+        REQUIRE(held[1].data != nullptr);
+        REQUIRE(held[2].data == nullptr);
+        c.client.reset();
+        REQUIRE(held_data(held[0]) == "payload-1");
+        REQUIRE(std::string(held[0].event.topic, held[0].event.topic_len) == "/topic/1");
+        REQUIRE(held_data(held[1]) == "payload-2");
+        esp_mqtt_event_release_data(held[0].data);
+        esp_mqtt_event_release_data(held[1].data);
+        esp_mqtt_event_release_data(nullptr);
+    }
+    SECTION("Released buffers are held again") {
+        connected_client c(64, hold_callback, nullptr, 1);
+        release_previous = true;
+        in.chunk = 23;
+
+        for (uint16_t id = 1; id <= 20; id++) {
+            append_publish(in.bytes, "/t", "payload-" + std::to_string(id), id);
+        }
+
+        for (int i = 0; i < 1000 && in.pos < in.bytes.size(); i++) {
+            REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+            REQUIRE((held.empty() || held_data(held.back()) == "payload-" + std::to_string(held.size())));
+        }
+
+        REQUIRE(held.size() == 20);
+        REQUIRE(std::all_of(held.begin(), held.end() - 1, [](const held_event & h) {
+            return h.data == nullptr;
+        }));
+        REQUIRE(held.back().data != nullptr);
+        esp_mqtt_event_release_data(held.back().data);
+    }
+    SECTION("Parts of a large message are read to a spare buffer") {
+        connected_client c(256, hold_callback, nullptr, 1);
+        std::string large;
+
+        for (int i = 0; large.size() < 1000; i++) {
+            large += std::to_string(i) + ",";
+        }
+
+        append_publish(in.bytes, "/large", large, 1);
+
+        for (int i = 0; i < 10 && in.pos < in.bytes.size(); i++) {
+            REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+        }
+
+        REQUIRE(held.size() > 2);
+        REQUIRE(held[0].data != nullptr);
+        REQUIRE(held[1].data == nullptr);
+        REQUIRE(large.compare(0, held[0].event.data_len, held_data(held[0])) == 0);
+        esp_mqtt_event_release_data(held[0].data);
+    }
+    SECTION("MQTT5 properties copied by the handler are held with the buffer") {
+        connected_client c(1024, hold_callback, nullptr, 1, MQTT_PROTOCOL_V_5);
+        // response topic, then a user property
+        std::vector<uint8_t> properties = {0x08, 0, 6, 'r', 'e', 's', 'p', '-', '1', 0x26, 0, 1, 'k', 0, 1, 'v'};
+        append_publish(in.bytes, "/topic", "payload-1", 1, &properties);
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+
+        properties = {0x08, 0, 6, 'r', 'e', 's', 'p', '-', '2'};
+        append_publish(in.bytes, "/topic", "payload-2", 2, &properties);
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+
+        REQUIRE(held.size() == 2);
+        REQUIRE(held[0].data != nullptr);
+        REQUIRE(held[1].data == nullptr);
+        // the properties of the event were cleared once handled, the copy still points into the held buffer
+        REQUIRE(held[0].event.property->properties == nullptr);
+        const esp_mqtt5_event_property_t &property = held[0].property;
+        REQUIRE(std::string(property.response_topic, property.response_topic_len) == "resp-1");
+        REQUIRE(property.properties_len == 16);
+        REQUIRE(std::equal(property.properties, property.properties + 9, "\x08\x00\x06resp-1"));
+        REQUIRE(held_data(held[0]) == "payload-1");
+        REQUIRE(std::string(held[0].event.topic, held[0].event.topic_len) == "/topic");
+        REQUIRE(std::string(held[1].property.response_topic, held[1].property.response_topic_len) == "resp-2");
+        esp_mqtt_event_release_data(held[0].data);
+    }
+    SECTION("Without spare buffers nothing is held") {
+        connected_client c(1024, hold_callback);
+        append_publish(in.bytes, "/topic", "payload", 1);
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+        REQUIRE(held.size() == 1);
+        REQUIRE(held[0].data == nullptr);
+    }
+}
+
+#if CONFIG_MQTT_EVENT_QUEUE_SIZE > 1
+TEST_CASE("Queued data events keep their receive buffer until handled", "[receive][event_queue]")
+{
+    held.clear();
+    release_previous = false;
+    loop = {};
+    esp_event_handler_register_with_Stub(register_client_handler);
+    connected_client c(64, nullptr, nullptr, 1);
+    esp_event_post_to_Stub(post_queued);
+    esp_event_loop_run_Stub(run_queued);
+    REQUIRE(loop.client_handler != nullptr);
+    // a custom event queued ahead, the data events are handled one receive late
+    loop.events.emplace_back(MQTT_USER_EVENT, std::vector<uint8_t>());
+
+    append_publish(in.bytes, "/t", "payload-1", 1);
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(held.empty());
+
+    // the second message is received into the spare buffer
+    append_publish(in.bytes, "/t", "payload-2", 2);
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(held.size() == 2);
+    REQUIRE(held[0].data != nullptr);
+    REQUIRE(held_data(held[0]) == "payload-1");
+    // the buffers are taken, so the second event was handled before the next receive and couldn't be held
+    REQUIRE(held[1].data == nullptr);
+    REQUIRE(held_data(held[1]) == "payload-2");
+    REQUIRE(loop.events.empty());
+
+    append_publish(in.bytes, "/t", "payload-3", 3);
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(held.size() == 3);
+    REQUIRE(held_data(held[2]) == "payload-3");
+    REQUIRE(held_data(held[0]) == "payload-1");
+    esp_mqtt_event_release_data(held[0].data);
+
+    // the buffer of a data event left in the queue is released with the client
+    loop.events.emplace_back(MQTT_USER_EVENT, std::vector<uint8_t>());
+    append_publish(in.bytes, "/t", "payload-4", 4);
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(loop.events.size() == 1);
+    c.client.reset();
+    REQUIRE(held.size() == 3);
+    loop = {};
+}
+#endif
+
+TEST_CASE("Asynchronous publishes complete on their acknowledgement", "[receive]")
+{
+    struct completion {
+        int msg_id;
+        esp_mqtt_publish_status_t status;
+        bool operator==(const completion &other) const
+        {
+            return msg_id == other.msg_id && status == other.status;
+        }
+    };
+    std::vector<completion> completed;
+    auto record = [](void *ctx, int msg_id, esp_mqtt_publish_status_t status, int reason_code) {
+        REQUIRE(reason_code == 0);
+        static_cast<std::vector<completion> *>(ctx)->push_back({msg_id, status});
+    };
+    auto append_ack = [](uint8_t type, int msg_id) {
+        in.bytes.insert(in.bytes.end(), {static_cast<uint8_t>(type << 4), 2, static_cast<uint8_t>(msg_id >> 8),
+                                          static_cast<uint8_t>(msg_id & 0xff)
+                                         });
+    };
+    connected_client c;
+
+    REQUIRE(esp_mqtt_client_publish_async(c.client.get(), "/topic", "qos0", 0, 0, 0, nullptr, nullptr) == -1);
+    REQUIRE(esp_mqtt_client_publish_async(c.client.get(), "/topic", "qos0", 0, 0, 0, record, &completed) == 0);
+    REQUIRE(completed == std::vector<completion> {{0, MQTT_PUBLISH_COMPLETED}});
+    int qos1 = esp_mqtt_client_publish_async(c.client.get(), "/topic", "qos1", 0, 1, 0, record, &completed);
+    int qos2 = esp_mqtt_client_publish_async(c.client.get(), "/topic", "qos2", 0, 2, 0, record, &completed);
+    REQUIRE(qos1 > 0);
+    REQUIRE(qos2 > 0);
+    REQUIRE(completed.size() == 1);
+
+    append_ack(4, qos1);    // PUBACK
+    REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+    REQUIRE(completed.size() == 2);
+    REQUIRE(completed.back() == completion{qos1, MQTT_PUBLISH_COMPLETED});
+
+    SECTION("QoS 2 completes on PUBCOMP") {
+        append_ack(7, qos2);
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+        REQUIRE(completed.size() == 3);
+        REQUIRE(completed.back() == completion{qos2, MQTT_PUBLISH_COMPLETED});
+        // acknowledged again, completed only once
+        append_ack(7, qos2);
+        REQUIRE(test_mqtt_client_process_receive(c.client.get()) == ESP_OK);
+        REQUIRE(completed.size() == 3);
+    }
+    SECTION("Messages pending when the client is destroyed are dropped") {
+        c.client.reset();
+        REQUIRE(completed.size() == 3);
+        REQUIRE(completed.back() == completion{qos2, MQTT_PUBLISH_DROPPED});
+    }
+}
+
+TEST_CASE("Event callback dispatch cost", "[receive][benchmark]")
+{
+    size_t callback_events = 0;
+    connected_client posted;
+    connected_client direct(1024, record_callback, &callback_events);
+    esp_event_post_to_Stub(queue_event);
+    esp_event_loop_run_Stub(run_queue);
+
+    for (uint16_t id = 1; id <= 100; id++) {
+        append_publish(in.bytes, "/sensors/temperature", "21.5", id);
+    }
+
+    auto receive_all = [](esp_mqtt_client_handle_t client) {
+        in.pos = 0;
+
+        while (in.pos < in.bytes.size()) {
+            test_mqtt_client_process_receive(client);
+        }
+
+        return in.pos;
+    };
+
+    receive_all(posted.client.get());
+    REQUIRE(in.data_events == 100);
+    receive_all(direct.client.get());
+    REQUIRE(callback_events == 100);
+
+    BENCHMARK("100 publishes of 4 B, posted to the event loop") {
+        return receive_all(posted.client.get());
+    };
+    BENCHMARK("100 publishes of 4 B, event callback") {
+        return receive_all(direct.client.get());
+    };
+}
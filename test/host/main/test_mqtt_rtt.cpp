@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+extern "C" {
+    typedef struct mqtt_rtt {
+        uint32_t srtt8;
+        uint32_t rttvar4;
+        uint32_t timeout;
+        uint32_t min_timeout;
+        uint32_t max_timeout;
+    } mqtt_rtt_t;
+    void mqtt_rtt_init(mqtt_rtt_t *rtt, uint32_t initial_timeout, uint32_t min_timeout, uint32_t max_timeout);
+    void mqtt_rtt_add_sample(mqtt_rtt_t *rtt, uint32_t sample);
+    uint32_t mqtt_rtt_get_timeout(const mqtt_rtt_t *rtt, int retransmits);
+}
+
+TEST_CASE("Retransmit timeout follows the measured round trip times", "[rtt]")
+{
+    mqtt_rtt_t rtt;
+    mqtt_rtt_init(&rtt, 1000, 1, 60000);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) == 1000);
+
+    // SRTT = R, RTTVAR = R/2, then RTTVAR = 3/4 * 50 + 1/4 * |100 - 300| and SRTT = 7/8 * 100 + 1/8 * 300
+    mqtt_rtt_add_sample(&rtt, 100);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) == 100 + 4 * 50);
+    mqtt_rtt_add_sample(&rtt, 300);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) == 125 + 350);
+
+    SECTION("A slow link settles just above its round trip time") {
+        mqtt_rtt_init(&rtt, 1000, 200, 60000);
+
+        for (int i = 0; i < 100; i++) {
+            mqtt_rtt_add_sample(&rtt, 3000);
+            REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) > 3000);
+        }
+
+        REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) < 3100);
+    }
+
+    SECTION("A fast link is bounded by the minimal timeout") {
+        mqtt_rtt_init(&rtt, 1000, 200, 60000);
+        mqtt_rtt_add_sample(&rtt, 5);
+        REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) == 200);
+        mqtt_rtt_add_sample(&rtt, 0);
+        REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) == 200);
+    }
+
+    SECTION("A round trip longer than the maximal timeout is capped") {
+        mqtt_rtt_init(&rtt, 1000, 200, 60000);
+        mqtt_rtt_add_sample(&rtt, UINT32_MAX);
+        REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) == 60000);
+    }
+}
+
+TEST_CASE("Retransmit timeout backs off exponentially up to the maximum", "[rtt]")
+{
+    mqtt_rtt_t rtt;
+    mqtt_rtt_init(&rtt, 1000, 200, 60000);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 1) == 2000);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 2) == 4000);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 5) == 32000);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 6) == 60000);
+    REQUIRE(mqtt_rtt_get_timeout(&rtt, 1000) == 60000);
+
+    SECTION("A fixed timeout is neither adapted nor backed off") {
+        mqtt_rtt_init(&rtt, 1000, 1000, 1000);
+        mqtt_rtt_add_sample(&rtt, 5);
+        REQUIRE(mqtt_rtt_get_timeout(&rtt, 0) == 1000);
+        REQUIRE(mqtt_rtt_get_timeout(&rtt, 3) == 1000);
+    }
+}
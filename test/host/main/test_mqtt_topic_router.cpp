@@ -0,0 +1,257 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mqtt_client.h"
+
+extern "C" {
+    typedef struct mqtt_topic_router *mqtt_topic_router_handle_t;
+    typedef struct mqtt_topic_node *mqtt_topic_filter_handle_t;
+    mqtt_topic_router_handle_t mqtt_topic_router_create(void);
+    void mqtt_topic_router_destroy(mqtt_topic_router_handle_t router);
+    esp_err_t mqtt_topic_router_add(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                    esp_mqtt_topic_handler_t handler, void *handler_args);
+    esp_err_t mqtt_topic_router_remove(mqtt_topic_router_handle_t router, const char *topic_filter,
+                                       esp_mqtt_topic_handler_t handler, void *handler_args);
+    size_t mqtt_topic_router_dispatch(mqtt_topic_router_handle_t router, const char *topic, size_t topic_len,
+                                      esp_mqtt_event_handle_t event);
+    mqtt_topic_filter_handle_t mqtt_topic_router_hold(mqtt_topic_router_handle_t router, const char *topic_filter);
+    void mqtt_topic_router_release(mqtt_topic_router_handle_t router, mqtt_topic_filter_handle_t filter);
+    bool mqtt_topic_router_all_held(mqtt_topic_router_handle_t router);
+    size_t mqtt_topic_router_dispatch_filter(mqtt_topic_router_handle_t router, mqtt_topic_filter_handle_t filter,
+                                             esp_mqtt_event_handle_t event);
+    bool mqtt_topic_filter_matches(const char *topic_filter, const char *topic, size_t topic_len);
+}
+
+namespace {
+
+std::vector<std::string> called;    // filters of the handlers called by the last dispatch
+
+struct router {
+    mqtt_topic_router_handle_t handle = mqtt_topic_router_create();
+
+    router()
+    {
+        REQUIRE(handle != nullptr);
+    }
+
+    ~router()
+    {
+        mqtt_topic_router_destroy(handle);
+    }
+
+    static void record(void *filter, esp_mqtt_event_handle_t)
+    {
+        called.emplace_back(static_cast<const char *>(filter));
+    }
+
+    esp_err_t add(const char *filter)
+    {
+        return mqtt_topic_router_add(handle, filter, record, const_cast<char *>(filter));
+    }
+
+    esp_err_t remove(const char *filter)
+    {
+        return mqtt_topic_router_remove(handle, filter, record, const_cast<char *>(filter));
+    }
+
+    std::vector<std::string> dispatch(mqtt_topic_filter_handle_t filter)
+    {
+        esp_mqtt_event_t event{};
+        called.clear();
+        size_t count = mqtt_topic_router_dispatch_filter(handle, filter, &event);
+        REQUIRE(count == called.size());
+        std::sort(called.begin(), called.end());
+        return called;
+    }
+
+    std::vector<std::string> dispatch(const std::string &topic)
+    {
+        esp_mqtt_event_t event{};
+        called.clear();
+        size_t count = mqtt_topic_router_dispatch(handle, topic.data(), topic.size(), &event);
+        REQUIRE(count == called.size());
+        std::sort(called.begin(), called.end());
+        return called;
+    }
+};
+
+using filters = std::vector<std::string>;
+
+}
+
+TEST_CASE("Topic router matches filters with wildcards", "[topic_router]")
+{
+    router r;
+
+    for (const char *filter : {
+                "sport/tennis/player1", "sport/tennis/+", "sport/+/player1", "sport/#", "#", "+/+", "+", "/+",
+                "sport/tennis/player1/#", "$SYS/#", "$SYS/monitor/+", "$share/group/sport/tennis/player1"
+            }) {
+        REQUIRE(r.add(filter) == ESP_OK);
+    }
+
+    REQUIRE(r.dispatch("sport/tennis/player1") == filters{
+        "#", "$share/group/sport/tennis/player1", "sport/#", "sport/+/player1", "sport/tennis/+",
+        "sport/tennis/player1", "sport/tennis/player1/#"
+    });
+    REQUIRE(r.dispatch("sport/tennis/player2") == filters{"#", "sport/#", "sport/tennis/+"});
+    REQUIRE(r.dispatch("sport") == filters{"#", "+", "sport/#"});
+    REQUIRE(r.dispatch("sport/") == filters{"#", "+/+", "sport/#"});
+    REQUIRE(r.dispatch("/finance") == filters{"#", "+/+", "/+"});
+    REQUIRE(r.dispatch("$SYS/monitor/clients") == filters{"$SYS/#", "$SYS/monitor/+"});
+    REQUIRE(r.dispatch("$SYS") == filters{"$SYS/#"});
+}
+
+TEST_CASE("Topic router rejects malformed filters", "[topic_router]")
+{
+    router r;
+
+    for (const char *filter : {
+                "", "sport/#/ranking", "sport/tennis#", "sport+", "+tennis/x", "$share/group", "$share//sport",
+                "$share/gr+oup/sport", "$share/group/"
+            }) {
+        CAPTURE(filter);
+        REQUIRE(r.add(filter) == ESP_ERR_INVALID_ARG);
+    }
+
+    REQUIRE(r.dispatch("sport/tennis").empty());
+}
+
+TEST_CASE("Topic router removes handlers", "[topic_router]")
+{
+    router r;
+    REQUIRE(r.add("a/b/c") == ESP_OK);
+    REQUIRE(r.add("a/+/c") == ESP_OK);
+    REQUIRE(r.add("a/#") == ESP_OK);
+
+    SECTION("Removed filters no longer match") {
+        REQUIRE(r.remove("a/b/c") == ESP_OK);
+        REQUIRE(r.remove("a/b/c") == ESP_ERR_NOT_FOUND);
+        REQUIRE(r.remove("a/b") == ESP_ERR_NOT_FOUND);
+        REQUIRE(r.dispatch("a/b/c") == filters{"a/#", "a/+/c"});
+        REQUIRE(r.remove("a/+/c") == ESP_OK);
+        REQUIRE(r.remove("a/#") == ESP_OK);
+        REQUIRE(r.dispatch("a/b/c").empty());
+        REQUIRE(r.add("a/b/c") == ESP_OK);
+        REQUIRE(r.dispatch("a/b/c") == filters{"a/b/c"});
+    }
+    SECTION("Handlers may remove themselves while called") {
+        static mqtt_topic_router_handle_t handle;
+        static int calls;
+        handle = r.handle;
+        calls = 0;
+        esp_mqtt_topic_handler_t once = [](void *args, esp_mqtt_event_handle_t) {
+            calls++;
+            called.emplace_back("once");
+            REQUIRE(mqtt_topic_router_remove(handle, "a/b/+", reinterpret_cast<esp_mqtt_topic_handler_t>(args), args) ==
+                    ESP_OK);
+        };
+        REQUIRE(mqtt_topic_router_add(r.handle, "a/b/+", once, reinterpret_cast<void *>(once)) == ESP_OK);
+        REQUIRE(r.dispatch("a/b/c") == filters{"a/#", "a/+/c", "a/b/c", "once"});
+        REQUIRE(calls == 1);
+        REQUIRE(r.dispatch("a/b/c") == filters{"a/#", "a/+/c", "a/b/c"});
+        REQUIRE(calls == 1);
+    }
+}
+
+TEST_CASE("Topic router calls the handlers of held filters", "[topic_router]")
+{
+    router r;
+    REQUIRE(r.add("a/+") == ESP_OK);
+    REQUIRE(r.add("$share/group/a/+") == ESP_OK);
+    REQUIRE(mqtt_topic_router_hold(r.handle, "a/#/b") == nullptr);
+
+    mqtt_topic_filter_handle_t filter = mqtt_topic_router_hold(r.handle, "a/+");
+    REQUIRE(filter != nullptr);
+    REQUIRE(mqtt_topic_router_all_held(r.handle));
+    REQUIRE(r.dispatch(filter) == filters{"$share/group/a/+", "a/+"});
+
+    // a filter is kept while held, without handlers
+    mqtt_topic_filter_handle_t held = mqtt_topic_router_hold(r.handle, "b/c");
+    REQUIRE(r.add("b/c") == ESP_OK);
+    REQUIRE(r.remove("b/c") == ESP_OK);
+    REQUIRE(r.dispatch(held).empty());
+    REQUIRE(r.add("b/c") == ESP_OK);
+    REQUIRE(r.dispatch(held) == filters{"b/c"});
+    mqtt_topic_router_release(r.handle, held);
+    REQUIRE_FALSE(mqtt_topic_router_all_held(r.handle));
+    REQUIRE(r.remove("b/c") == ESP_OK);
+    REQUIRE(mqtt_topic_router_all_held(r.handle));
+
+    REQUIRE(r.add("d") == ESP_OK);
+    REQUIRE_FALSE(mqtt_topic_router_all_held(r.handle));
+    mqtt_topic_router_release(r.handle, filter);
+    REQUIRE(r.dispatch("a/x") == filters{"$share/group/a/+", "a/+"});
+}
+
+TEST_CASE("Topic filters match topics", "[topic_router]")
+{
+    auto matches = [](const char *filter, const std::string & topic) {
+        return mqtt_topic_filter_matches(filter, topic.data(), topic.size());
+    };
+
+    REQUIRE(matches("sport/tennis/player1", "sport/tennis/player1"));
+    REQUIRE(matches("sport/tennis/+", "sport/tennis/player1"));
+    REQUIRE(matches("sport/#", "sport"));
+    REQUIRE(matches("sport/#", "sport/tennis/player1"));
+    REQUIRE(matches("+/+", "/finance"));
+    REQUIRE(matches("#", "sport"));
+    REQUIRE(matches("$share/group/sport/+", "sport/tennis"));
+    REQUIRE(matches("$SYS/#", "$SYS/monitor"));
+    REQUIRE_FALSE(matches("sport/tennis/+", "sport/tennis"));
+    REQUIRE_FALSE(matches("sport/+", "sport/tennis/player1"));
+    REQUIRE_FALSE(matches("sport/tennis", "sport/tennis/player1"));
+    REQUIRE_FALSE(matches("sport/tennis", "sport/tenni"));
+    REQUIRE_FALSE(matches("#", "$SYS/monitor"));
+    REQUIRE_FALSE(matches("+/monitor", "$SYS/monitor"));
+    REQUIRE_FALSE(matches("sport/#/x", "sport/tennis/x"));
+}
+
+TEST_CASE("Topic router dispatch cost doesn't grow with the filters", "[topic_router][benchmark]")
+{
+    router r;
+    std::vector<std::string> topics;
+
+    // 10k filters of devices with a few wildcard filters, like a gateway forwarding for many devices
+    for (int i = 0; i < 10000; i++) {
+        topics.push_back("site/" + std::to_string(i % 10) + "/device/" + std::to_string(i) + "/telemetry");
+    }
+
+    for (const auto &topic : topics) {
+        REQUIRE(mqtt_topic_router_add(r.handle, topic.c_str(), router::record, const_cast<char *>(topic.c_str())) == ESP_OK);
+    }
+
+    REQUIRE(r.add("site/+/device/+/status") == ESP_OK);
+    REQUIRE(r.add("site/3/#") == ESP_OK);
+    REQUIRE(r.dispatch(topics[4242]) == filters{topics[4242]});
+    REQUIRE(r.dispatch(topics[1233]) == filters{"site/3/#", topics[1233]});
+
+    esp_mqtt_event_t event{};
+    size_t next = 0;
+    BENCHMARK("trie, 10k filters") {
+        const std::string &topic = topics[next = (next + 7919) % topics.size()];
+        called.clear();
+        return mqtt_topic_router_dispatch(r.handle, topic.data(), topic.size(), &event);
+    };
+    BENCHMARK("strncmp chain, 10k filters") {
+        const std::string &topic = topics[next = (next + 7919) % topics.size()];
+        size_t matched = 0;
+
+        for (const auto &filter : topics) {
+            if (filter.size() == topic.size() && strncmp(filter.data(), topic.data(), topic.size()) == 0) {
+                matched++;
+            }
+        }
+
+        return matched;
+    };
+}
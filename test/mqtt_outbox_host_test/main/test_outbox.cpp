@@ -12,8 +12,10 @@
 #include <rapidcheck.h>
 #include <rapidcheck/catch.h>
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <numeric>
 #include <string>
@@ -52,6 +54,35 @@ static outbox_message_t make_msg(int msg_id, int qos, int msg_type,
     return message;
 }
 
+// Time per item of an ACK storm which looks up and deletes every item by msg_id, newest first
+static double ack_storm_ns_per_item(int item_count)
+{
+    double best = std::numeric_limits<double>::max();
+
+    // the fastest of a few runs is the least disturbed by the host
+    for (int run = 0; run < 5; ++run) {
+        OutboxGuard outbox;
+        for (int id = 1; id <= item_count; ++id) {
+            auto message = make_msg(id, 1, 3, "x", 1);
+            outbox_enqueue(outbox.handle, &message, 0);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        int found = 0;
+        for (int id = item_count; id >= 1; --id) {
+            found += outbox_get(outbox.handle, id) != nullptr;
+            outbox_delete(outbox.handle, id, 3);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        REQUIRE(found == item_count);
+        REQUIRE(outbox_get_size(outbox.handle) == 0);
+        best = std::min(best, elapsed.count() / item_count);
+    }
+
+    return best;
+}
+
 TEST_CASE("Outbox lifecycle")
 {
     SECTION("init returns a non-null handle") {
@@ -265,6 +296,19 @@ TEST_CASE("Outbox delete by item handle")
         REQUIRE(outbox_get(outbox.handle, 77) == nullptr);
         REQUIRE(outbox_get_size(outbox.handle) == 0);
     }
+    SECTION("item of another outbox returns ESP_FAIL and is kept") {
+        OutboxGuard other;
+        auto message = make_msg(77, 1, 3, "item", 4);
+        auto kept = make_msg(78, 1, 3, "kept", 4);
+        outbox_item_handle_t item = outbox_enqueue(other.handle, &message, 0);
+        REQUIRE(item != nullptr);
+        REQUIRE(outbox_enqueue(outbox.handle, &kept, 0) != nullptr);
+        REQUIRE(outbox_delete_item(outbox.handle, item) == ESP_FAIL);
+        REQUIRE(outbox_get(other.handle, 77) == item);
+        REQUIRE(outbox_get(outbox.handle, 78) != nullptr);
+        REQUIRE(outbox_get_size(other.handle) == 4);
+        REQUIRE(outbox_get_size(outbox.handle) == 4);
+    }
 }
 
 TEST_CASE("Outbox expiry")
@@ -294,6 +338,22 @@ TEST_CASE("Outbox expiry")
                         + (outbox_get(outbox.handle, 20) != nullptr ? 1 : 0);
         REQUIRE(remaining == 1);
     }
+    SECTION("delete_single_expired follows tick order, including updated ticks") {
+        auto message1 = make_msg(1, 1, 3, "a", 1);
+        auto message2 = make_msg(2, 1, 3, "b", 1);
+        auto message3 = make_msg(3, 1, 3, "c", 1);
+        outbox_enqueue(outbox.handle, &message1, 30);
+        outbox_enqueue(outbox.handle, &message2, 10);
+        outbox_enqueue(outbox.handle, &message3, 20);
+        // Retransmission refreshes the tick of msg 2, so msg 3 now expires first
+        REQUIRE(outbox_set_tick(outbox.handle, 2, 40) == ESP_OK);
+        REQUIRE(outbox_delete_single_expired(outbox.handle, 125, 100) == 3);
+        REQUIRE(outbox_delete_single_expired(outbox.handle, 125, 100) == -1);
+        REQUIRE(outbox_delete_single_expired(outbox.handle, 1000, 100) == 1);
+        REQUIRE(outbox_delete_single_expired(outbox.handle, 1000, 100) == 2);
+        REQUIRE(outbox_delete_single_expired(outbox.handle, 1000, 100) == -1);
+        REQUIRE(outbox_get_size(outbox.handle) == 0);
+    }
     SECTION("delete_expired returns 0 when no items are expired") {
         auto message = make_msg(1, 1, 3, "fresh", 5);
         outbox_enqueue(outbox.handle, &message, 1000);
@@ -302,6 +362,366 @@ TEST_CASE("Outbox expiry")
     }
 }
 
+TEST_CASE("Outbox per-state queues")
+{
+    OutboxGuard outbox;
+    uint16_t id; int type, qos; size_t len;
+    auto dequeue_id = [&](pending_state_t state) {
+        outbox_item_handle_t item = outbox_dequeue(outbox.handle, state, nullptr);
+        REQUIRE(item != nullptr);
+        outbox_item_get_data(item, &len, &id, &type, &qos);
+        return static_cast<int>(id);
+    };
+    for (int i = 1; i <= 6; ++i) {
+        auto message = make_msg(i, 1, 3, "x", 1);
+        outbox_enqueue(outbox.handle, &message, 0);
+    }
+
+    SECTION("requeued items are dequeued before never sent ones, in enqueue order") {
+        for (int i = 1; i <= 4; ++i) {
+            REQUIRE(outbox_set_pending(outbox.handle, i, TRANSMITTED) == ESP_OK);
+        }
+        // Requeue the way the client does after reconnect: oldest TRANSMITTED first
+        while (outbox_dequeue(outbox.handle, TRANSMITTED, nullptr) != nullptr) {
+            REQUIRE(outbox_set_pending(outbox.handle, dequeue_id(TRANSMITTED), QUEUED) == ESP_OK);
+        }
+        for (int i = 1; i <= 6; ++i) {
+            REQUIRE(dequeue_id(QUEUED) == i);
+            outbox_delete(outbox.handle, i, 3);
+        }
+    }
+    SECTION("out of order transitions keep each state sorted by enqueue order") {
+        for (int i : {5, 2, 6, 1}) {
+            REQUIRE(outbox_set_pending(outbox.handle, i, ACKNOWLEDGED) == ESP_OK);
+        }
+        for (int i : {1, 2, 5, 6}) {
+            REQUIRE(dequeue_id(ACKNOWLEDGED) == i);
+            REQUIRE(outbox_set_pending(outbox.handle, i, CONFIRMED) == ESP_OK);
+        }
+        REQUIRE(dequeue_id(QUEUED) == 3);
+        REQUIRE(outbox_dequeue(outbox.handle, ACKNOWLEDGED, nullptr) == nullptr);
+    }
+    SECTION("setting the current state again keeps the position") {
+        REQUIRE(outbox_set_pending(outbox.handle, 1, QUEUED) == ESP_OK);
+        REQUIRE(dequeue_id(QUEUED) == 1);
+    }
+    SECTION("deleted items leave their state queue") {
+        REQUIRE(outbox_set_pending(outbox.handle, 3, TRANSMITTED) == ESP_OK);
+        REQUIRE(outbox_delete(outbox.handle, 3, 3) == ESP_OK);
+        REQUIRE(outbox_dequeue(outbox.handle, TRANSMITTED, nullptr) == nullptr);
+    }
+}
+
+TEST_CASE("Outbox retransmit order")
+{
+    OutboxGuard outbox;
+    auto next_id = [&](outbox_tick_t expected_due) {
+        outbox_tick_t due = 0;
+        outbox_item_handle_t item = outbox_get_next_retransmit(outbox.handle, &due);
+        REQUIRE(item != nullptr);
+        REQUIRE(due == expected_due);
+        uint16_t id; int type, qos; size_t len;
+        outbox_item_get_data(item, &len, &id, &type, &qos);
+        return static_cast<int>(id);
+    };
+    auto transmit = [&](int msg_id, outbox_tick_t due) {
+        REQUIRE(outbox_set_transmitted(outbox.handle, msg_id, 0, 0, due) == ESP_OK);
+        REQUIRE(outbox_set_pending(outbox.handle, msg_id, TRANSMITTED) == ESP_OK);
+    };
+    for (int i = 1; i <= 6; ++i) {
+        auto message = make_msg(i, 1, 3, "x", 1);
+        outbox_enqueue(outbox.handle, &message, 0);
+    }
+
+    SECTION("nothing is due while no item waits for an acknowledgement") {
+        outbox_tick_t due = 1234;
+        REQUIRE(outbox_get_next_retransmit(outbox.handle, &due) == nullptr);
+        REQUIRE(due == 1234);
+    }
+    SECTION("items waiting for an acknowledgement are due earliest first") {
+        transmit(3, 300);
+        transmit(1, 100);
+        transmit(5, 200);
+        REQUIRE(next_id(100) == 1);
+        // Retransmission of msg 1 pushes it behind the others
+        REQUIRE(outbox_set_transmitted(outbox.handle, 1, 100, 1, 400) == ESP_OK);
+        outbox_tick_t transmit_tick = 0;
+        REQUIRE(outbox_item_get_retransmits(outbox_get(outbox.handle, 1), &transmit_tick) == 1);
+        REQUIRE(transmit_tick == 100);
+        REQUIRE(next_id(200) == 5);
+        REQUIRE(outbox_delete(outbox.handle, 5, 3) == ESP_OK);
+        REQUIRE(next_id(300) == 3);
+        REQUIRE(outbox_delete(outbox.handle, 3, 3) == ESP_OK);
+        REQUIRE(next_id(400) == 1);
+    }
+    SECTION("state moves keep the order, TRANSMITTED -> ACKNOWLEDGED -> QUEUED") {
+        transmit(1, 40);
+        transmit(2, 10);
+        transmit(3, 30);
+        transmit(4, 20);
+        // A PUBREC keeps the item due, for its PUBREL
+        REQUIRE(outbox_set_pending(outbox.handle, 2, ACKNOWLEDGED) == ESP_OK);
+        REQUIRE(next_id(10) == 2);
+        // Requeued items are written again before they are due
+        REQUIRE(outbox_set_pending(outbox.handle, 2, QUEUED) == ESP_OK);
+        REQUIRE(next_id(20) == 4);
+        REQUIRE(outbox_set_pending(outbox.handle, 4, CONFIRMED) == ESP_OK);
+        REQUIRE(next_id(30) == 3);
+        REQUIRE(outbox_delete_item(outbox.handle, outbox_get(outbox.handle, 3)) == ESP_OK);
+        REQUIRE(next_id(40) == 1);
+        REQUIRE(outbox_set_pending(outbox.handle, 1, QUEUED) == ESP_OK);
+        outbox_tick_t due;
+        REQUIRE(outbox_get_next_retransmit(outbox.handle, &due) == nullptr);
+        transmit(2, 50);
+        REQUIRE(next_id(50) == 2);
+    }
+}
+
+TEST_CASE("Outbox msg_id index with 10k items")
+{
+    constexpr int item_count = 10000;
+    OutboxGuard outbox;
+    std::vector<int> msg_ids(item_count);
+    std::iota(msg_ids.begin(), msg_ids.end(), 1);
+
+    for (int id : msg_ids) {
+        std::string payload = "p" + std::to_string(id);
+        auto message = make_msg(id, 1, 3, payload.c_str(), static_cast<int>(payload.size()));
+        REQUIRE(outbox_enqueue(outbox.handle, &message, id) != nullptr);
+    }
+
+    SECTION("every item is found by msg_id and can change state") {
+        for (int id : msg_ids) {
+            outbox_item_handle_t item = outbox_get(outbox.handle, id);
+            REQUIRE(item != nullptr);
+            uint16_t found_id; int type, qos; size_t len;
+            auto *data = outbox_item_get_data(item, &len, &found_id, &type, &qos);
+            REQUIRE(found_id == id);
+            REQUIRE(std::string(reinterpret_cast<char *>(data), len) == "p" + std::to_string(id));
+            REQUIRE(outbox_set_pending(outbox.handle, id, TRANSMITTED) == ESP_OK);
+            REQUIRE(outbox_set_tick(outbox.handle, id, 0) == ESP_OK);
+        }
+        REQUIRE(outbox_dequeue(outbox.handle, QUEUED, nullptr) == nullptr);
+    }
+    SECTION("requeue of every TRANSMITTED item preserves enqueue order") {
+        for (int id : msg_ids) {
+            REQUIRE(outbox_set_pending(outbox.handle, id, TRANSMITTED) == ESP_OK);
+        }
+        outbox_item_handle_t item;
+        while ((item = outbox_dequeue(outbox.handle, TRANSMITTED, nullptr)) != nullptr) {
+            uint16_t id; int type, qos; size_t len;
+            outbox_item_get_data(item, &len, &id, &type, &qos);
+            REQUIRE(outbox_set_pending(outbox.handle, id, QUEUED) == ESP_OK);
+        }
+        for (int id : msg_ids) {
+            item = outbox_dequeue(outbox.handle, QUEUED, nullptr);
+            REQUIRE(item == outbox_get(outbox.handle, id));
+            REQUIRE(outbox_delete_item(outbox.handle, item) == ESP_OK);
+        }
+    }
+    SECTION("ACK storm in reverse order empties the outbox") {
+        std::reverse(msg_ids.begin(), msg_ids.end());
+        for (int id : msg_ids) {
+            REQUIRE(outbox_delete(outbox.handle, id, 3) == ESP_OK);
+            REQUIRE(outbox_get(outbox.handle, id) == nullptr);
+        }
+        REQUIRE(outbox_get_size(outbox.handle) == 0);
+        REQUIRE(outbox_dequeue(outbox.handle, QUEUED, nullptr) == nullptr);
+    }
+    SECTION("QoS 0 items sharing msg_id zero keep FIFO order") {
+        auto qos0_first = make_msg(0, 0, 3, "first", 5);
+        auto qos0_second = make_msg(0, 0, 3, "second", 6);
+        outbox_enqueue(outbox.handle, &qos0_first, 0);
+        outbox_enqueue(outbox.handle, &qos0_second, 0);
+        for (int id = item_count + 1; id <= 2 * item_count; ++id) {
+            auto message = make_msg(id, 1, 3, "x", 1);
+            REQUIRE(outbox_enqueue(outbox.handle, &message, 0) != nullptr);
+        }
+        uint16_t id; int type, qos; size_t len;
+        outbox_item_handle_t item = outbox_get(outbox.handle, 0);
+        auto *data = outbox_item_get_data(item, &len, &id, &type, &qos);
+        REQUIRE(std::string(reinterpret_cast<char *>(data), len) == "first");
+        REQUIRE(outbox_delete(outbox.handle, 0, 3) == ESP_OK);
+        item = outbox_get(outbox.handle, 0);
+        data = outbox_item_get_data(item, &len, &id, &type, &qos);
+        REQUIRE(std::string(reinterpret_cast<char *>(data), len) == "second");
+    }
+    SECTION("single expiry removes due items oldest first") {
+        for (int id : msg_ids) {
+            REQUIRE(outbox_delete_single_expired(outbox.handle, item_count + 101, 100) == id);
+        }
+        REQUIRE(outbox_delete_single_expired(outbox.handle, item_count + 101, 100) == -1);
+        REQUIRE(outbox_get_size(outbox.handle) == 0);
+    }
+    SECTION("expiry leaves the index consistent") {
+        REQUIRE(outbox_delete_expired(outbox.handle, item_count / 2 + 100, 100) == item_count / 2 - 1);
+        for (int id : msg_ids) {
+            REQUIRE((outbox_get(outbox.handle, id) != nullptr) == (id >= item_count / 2));
+        }
+    }
+    SECTION("ACK storm costs the same per item at 1k and 10k items") {
+        // A scan of the outbox per msg_id would make each item 10 times more expensive with 10 times more items
+        double small = ack_storm_ns_per_item(item_count / 10);
+        double large = ack_storm_ns_per_item(item_count);
+        INFO("1k items: " << small << " ns per item, 10k items: " << large << " ns per item");
+        REQUIRE(large < 4 * small);
+    }
+}
+
+TEST_CASE("Outbox arena")
+{
+    OutboxGuard outbox;
+    outbox_arena_info_t info;
+    REQUIRE(outbox_set_arena(outbox.handle, 1024) == ESP_OK);
+    auto payload_of = [](int id) {
+        return std::string(40 + id % 50, static_cast<char>('a' + id % 26));
+    };
+    auto enqueue = [&](int id) {
+        std::string payload = payload_of(id);
+        auto message = make_msg(id, 1, 3, payload.c_str(), static_cast<int>(payload.size()));
+        REQUIRE(outbox_enqueue(outbox.handle, &message, 0) != nullptr);
+    };
+    auto check = [&](int id) {
+        uint16_t found_id; int type, qos; size_t len;
+        auto *data = outbox_item_get_data(outbox_get(outbox.handle, id), &len, &found_id, &type, &qos);
+        REQUIRE(data != nullptr);
+        REQUIRE(std::string(reinterpret_cast<char *>(data), len) == payload_of(id));
+    };
+
+    SECTION("arena can only be replaced while the outbox is empty") {
+        enqueue(1);
+        REQUIRE(outbox_set_arena(outbox.handle, 2048) == ESP_ERR_INVALID_STATE);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.capacity == 1024);
+        REQUIRE(outbox_delete(outbox.handle, 1, 3) == ESP_OK);
+        REQUIRE(outbox_set_arena(outbox.handle, 2048) == ESP_OK);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.capacity == 2048);
+    }
+    SECTION("items are placed in the arena and reclaimed in FIFO order") {
+        enqueue(1);
+        enqueue(2);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.used > 0);
+        REQUIRE(info.used == info.pinned);
+        REQUIRE(info.fallback_items == 0);
+        REQUIRE(outbox_delete(outbox.handle, 1, 3) == ESP_OK);
+        REQUIRE(outbox_delete(outbox.handle, 2, 3) == ESP_OK);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.used == 0);
+        REQUIRE(info.pinned == 0);
+    }
+    SECTION("out of order delete stays pinned until older items are gone") {
+        enqueue(1);
+        enqueue(2);
+        enqueue(3);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        const size_t pinned = info.pinned;
+        REQUIRE(outbox_delete(outbox.handle, 2, 3) == ESP_OK);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.used < info.pinned);
+        REQUIRE(info.pinned == pinned);
+        check(1);
+        check(3);
+        REQUIRE(outbox_delete(outbox.handle, 1, 3) == ESP_OK);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.used == info.pinned);
+    }
+    SECTION("items which don't fit fall back to the heap") {
+        int id = 1;
+        do {
+            enqueue(id++);
+            REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        } while (info.fallback_items == 0);
+        for (int i = 1; i < id; ++i) {
+            check(i);
+        }
+        outbox_delete_all_items(outbox.handle);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.fallback_items == 0);
+        REQUIRE(info.pinned == 0);
+    }
+    SECTION("steady traffic wraps around the arena") {
+        constexpr int in_flight = 3;
+        for (int id = 1; id <= 1000; ++id) {
+            enqueue(id);
+            if (id > in_flight) {
+                check(id - in_flight);
+                REQUIRE(outbox_delete(outbox.handle, id - in_flight, 3) == ESP_OK);
+            }
+        }
+        for (int id = 1001 - in_flight; id <= 1000; ++id) {
+            check(id);
+        }
+        outbox_delete_all_items(outbox.handle);
+        REQUIRE(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        REQUIRE(info.used == 0);
+        REQUIRE(info.pinned == 0);
+        REQUIRE(info.fallback_items == 0);
+    }
+}
+
+TEST_CASE("Outbox referenced payload")
+{
+    // declared before the outbox, which releases its payloads on destroy
+    std::vector<int> released;
+    OutboxGuard outbox;
+    auto release = [](void *data, void *ctx) {
+        static_cast<std::vector<int> *>(ctx)->push_back(*static_cast<int *>(data));
+    };
+    int payloads[3] = {1, 2, 3};
+    auto enqueue = [&](int id, outbox_tick_t tick) {
+        auto message = make_msg(id, 1, 3, "hdr", 3);
+        message.remaining_data = reinterpret_cast<uint8_t *>(&payloads[id - 1]);
+        message.remaining_len = sizeof(int);
+        message.remaining_free = release;
+        message.remaining_free_ctx = &released;
+        auto *item = outbox_enqueue(outbox.handle, &message, tick);
+        REQUIRE(item != nullptr);
+        return item;
+    };
+
+    SECTION("only the header is copied, the payload is referenced") {
+        auto *item = enqueue(1, 0);
+        uint16_t id; int type, qos; size_t len, remaining_len;
+        REQUIRE(outbox_item_get_data(item, &len, &id, &type, &qos) != nullptr);
+        REQUIRE(len == 3);
+        REQUIRE(outbox_item_get_remaining_data(item, &remaining_len) == reinterpret_cast<uint8_t *>(&payloads[0]));
+        REQUIRE(remaining_len == sizeof(int));
+        REQUIRE(outbox_get_size(outbox.handle) == 3 + sizeof(int));
+        REQUIRE(released.empty());
+    }
+    SECTION("copied items have no remaining data") {
+        auto message = make_msg(4, 1, 3, "data", 4);
+        size_t remaining_len = 1;
+        REQUIRE(outbox_item_get_remaining_data(outbox_enqueue(outbox.handle, &message, 0), &remaining_len) == nullptr);
+        REQUIRE(remaining_len == 0);
+    }
+    SECTION("payload is released exactly once on every delete path") {
+        enqueue(1, 0);
+        enqueue(2, 100);
+        enqueue(3, 100);
+        REQUIRE(outbox_delete(outbox.handle, 2, 3) == ESP_OK);
+        REQUIRE(released == std::vector<int> {2});
+        REQUIRE(outbox_delete_single_expired(outbox.handle, 50, 10) == 1);
+        REQUIRE(released == std::vector<int> {2, 1});
+        outbox_delete_all_items(outbox.handle);
+        REQUIRE(released == std::vector<int> {2, 1, 3});
+        REQUIRE(outbox_get_size(outbox.handle) == 0);
+    }
+    SECTION("destroy releases remaining payloads") {
+        outbox_handle_t other = outbox_init();
+        auto message = make_msg(1, 1, 3, "hdr", 3);
+        message.remaining_data = reinterpret_cast<uint8_t *>(&payloads[0]);
+        message.remaining_len = sizeof(int);
+        message.remaining_free = release;
+        message.remaining_free_ctx = &released;
+        REQUIRE(outbox_enqueue(other, &message, 0) != nullptr);
+        outbox_destroy(other);
+        REQUIRE(released == std::vector<int> {1});
+    }
+}
+
 // ---------------------------------------------------------------------------
 // Property-based tests
 // ---------------------------------------------------------------------------
@@ -342,6 +762,165 @@ TEST_CASE("Outbox size invariant (RapidCheck)")
     });
 }
 
+TEST_CASE("Outbox expiry property (RapidCheck)")
+{
+    rc::prop("delete_expired removes exactly the items older than timeout",
+    []() {
+        OutboxGuard outbox;
+        int count = *rc::gen::inRange(1, 32);
+        std::vector<outbox_tick_t> ticks;
+
+        for (int i = 0; i < count; ++i) {
+            outbox_tick_t tick = *rc::gen::inRange(0, 1000);
+            auto message = make_msg(i + 1, 1, 3, "x", 1);
+            const bool enqueued = outbox_enqueue(outbox.handle, &message, tick) != nullptr;
+            RC_ASSERT(enqueued);
+            ticks.push_back(tick);
+        }
+
+        // Refresh some ticks, as retransmission does
+        for (int i = 0; i < count; ++i) {
+            if (*rc::gen::arbitrary<bool>()) {
+                ticks[i] = *rc::gen::inRange(0, 1000);
+                outbox_set_tick(outbox.handle, i + 1, ticks[i]);
+            }
+        }
+
+        outbox_tick_t current_tick = *rc::gen::inRange(0, 1200);
+        outbox_tick_t timeout = *rc::gen::inRange(0, 200);
+        int expected = static_cast<int>(std::count_if(ticks.begin(), ticks.end(), [&](outbox_tick_t tick) {
+            return current_tick - tick > timeout;
+        }));
+        RC_ASSERT(outbox_delete_expired(outbox.handle, current_tick, timeout) == expected);
+
+        for (int i = 0; i < count; ++i) {
+            const bool present = outbox_get(outbox.handle, i + 1) != nullptr;
+            RC_ASSERT(present == !(current_tick - ticks[i] > timeout));
+        }
+    });
+}
+
+TEST_CASE("Outbox retransmit order property (RapidCheck)")
+{
+    rc::prop("outbox_get_next_retransmit returns the earliest due item waiting for an acknowledgement",
+    []() {
+        OutboxGuard outbox;
+        int count = *rc::gen::inRange(1, 32);
+        std::vector<pending_state_t> states(count, QUEUED);
+        std::vector<outbox_tick_t> dues(count, 0);
+        std::vector<bool> alive(count, true);
+
+        for (int i = 0; i < count; ++i) {
+            auto message = make_msg(i + 1, 1, 3, "x", 1);
+            const bool enqueued = outbox_enqueue(outbox.handle, &message, 0) != nullptr;
+            RC_ASSERT(enqueued);
+        }
+
+        auto earliest_due = [&]() {
+            outbox_tick_t earliest = -1;
+            for (int i = 0; i < count; ++i) {
+                if (alive[i] && (states[i] == TRANSMITTED || states[i] == ACKNOWLEDGED) &&
+                        (earliest == -1 || dues[i] < earliest)) {
+                    earliest = dues[i];
+                }
+            }
+            return earliest;
+        };
+        auto check_next = [&]() {
+            outbox_tick_t due = -1;
+            outbox_item_handle_t item = outbox_get_next_retransmit(outbox.handle, &due);
+            outbox_tick_t expected = earliest_due();
+            RC_ASSERT((item == nullptr) == (expected == -1));
+            if (item != nullptr) {
+                uint16_t id; int type, qos; size_t len;
+                outbox_item_get_data(item, &len, &id, &type, &qos);
+                RC_ASSERT(due == expected);
+                RC_ASSERT(dues[id - 1] == expected);
+            }
+            return item;
+        };
+
+        // Transmissions, acknowledgements, requeues and deletes in any order, as the client and the broker drive them
+        int operations = *rc::gen::inRange(1, 100);
+        for (int op = 0; op < operations; ++op) {
+            int i = *rc::gen::inRange(0, count);
+            if (!alive[i]) {
+                continue;
+            }
+            switch (*rc::gen::inRange(0, 4)) {
+            case 0:
+                dues[i] = *rc::gen::inRange(0, 1000);
+                outbox_set_transmitted(outbox.handle, i + 1, 0, 0, dues[i]);
+                break;
+            case 1:
+                states[i] = static_cast<pending_state_t>(*rc::gen::inRange(0, 4));
+                outbox_set_pending(outbox.handle, i + 1, states[i]);
+                break;
+            case 2:
+                if (*rc::gen::inRange(0, 4) == 0) {
+                    alive[i] = false;
+                    outbox_delete(outbox.handle, i + 1, 3);
+                }
+                break;
+            default:
+                // The expiry order is kept apart and must not disturb the retransmit order
+                outbox_set_tick(outbox.handle, i + 1, *rc::gen::inRange(0, 1000));
+                break;
+            }
+            check_next();
+        }
+
+        // Acknowledging the due items one by one visits them in due order
+        outbox_item_handle_t item;
+        while ((item = check_next()) != nullptr) {
+            uint16_t id; int type, qos; size_t len;
+            outbox_item_get_data(item, &len, &id, &type, &qos);
+            states[id - 1] = CONFIRMED;
+            outbox_set_pending(outbox.handle, id, CONFIRMED);
+        }
+    });
+}
+
+TEST_CASE("Outbox arena property (RapidCheck)")
+{
+    rc::prop("arena keeps item data intact under arbitrary delete order",
+    []() {
+        OutboxGuard outbox;
+        RC_ASSERT(outbox_set_arena(outbox.handle, 2048) == ESP_OK);
+        std::vector<std::pair<int, std::string>> live;
+        int operations = *rc::gen::inRange(1, 200);
+
+        for (int i = 0; i < operations; ++i) {
+            if (live.empty() || *rc::gen::arbitrary<bool>()) {
+                std::string payload(*rc::gen::inRange(1, 300), static_cast<char>('a' + i % 26));
+                auto message = make_msg(i + 1, 1, 3, payload.c_str(), static_cast<int>(payload.size()));
+                const bool enqueued = outbox_enqueue(outbox.handle, &message, 0) != nullptr;
+                RC_ASSERT(enqueued);
+                live.emplace_back(i + 1, payload);
+            } else {
+                size_t victim = *rc::gen::inRange<size_t>(0, live.size());
+                RC_ASSERT(outbox_delete(outbox.handle, live[victim].first, 3) == ESP_OK);
+                live.erase(live.begin() + static_cast<std::ptrdiff_t>(victim));
+            }
+        }
+
+        for (auto &[id, payload] : live) {
+            uint16_t found_id; int type, qos; size_t len;
+            auto *data = outbox_item_get_data(outbox_get(outbox.handle, id), &len, &found_id, &type, &qos);
+            RC_ASSERT(std::string(reinterpret_cast<char *>(data), len) == payload);
+        }
+
+        outbox_arena_info_t info;
+        RC_ASSERT(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        RC_ASSERT(info.used <= info.pinned);
+        RC_ASSERT(info.pinned <= info.capacity);
+        outbox_delete_all_items(outbox.handle);
+        RC_ASSERT(outbox_get_arena_info(outbox.handle, &info) == ESP_OK);
+        RC_ASSERT(info.pinned == 0);
+        RC_ASSERT(info.fallback_items == 0);
+    });
+}
+
 TEST_CASE("Outbox FIFO ordering property (RapidCheck)")
 {
     rc::prop("dequeue(QUEUED) returns items in exact enqueue order",